@@ -0,0 +1,181 @@
+/* Benchmarks how ConcurrentHashTable scales with the number of threads
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_concurrent_hash_table [max_threads] [read_percent] [num_keys]
+//
+// For 1, 2, 4, ... up to `max_threads` (default 64) threads, reports the total
+// throughput of a mixed workload of lookups, inserts and removals over
+// `num_keys` (default 100000) keys, of which `read_percent` percent (default
+// 90) are lookups. The same workload is run against a ConcurrentHashTable and,
+// as a baseline, a HashTable guarded by a pthread_rwlock_t.
+
+#define _XOPEN_SOURCE 700
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "concurrent_hash_table.h"
+#include "hash_table.h"
+
+#define OPS_PER_THREAD 200000
+
+typedef struct {
+  uint64_t seed;
+  size_t read_percent;
+  size_t num_keys;
+} WorkerArgs;
+
+static pthread_barrier_t start_barrier;
+
+static ConcurrentHashTable *cht;
+static HashTable *locked_ht;
+static pthread_rwlock_t ht_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static void *cht_worker(void *arg) {
+  WorkerArgs *args = arg;
+  uint64_t rng = args->seed;
+  pthread_barrier_wait(&start_barrier);
+  for (int i = 0; i < OPS_PER_THREAD; i++) {
+    uint64_t r = bench_rand(&rng);
+    uint64_t key = (r >> 8) % args->num_keys;
+    if (r % 100 < args->read_percent) {
+      HTValue value;
+      BENCH_KEEP(ConcurrentHashTable_find(cht, (unsigned char *)&key,
+            sizeof(key), &value));
+    } else if (r & 0x80) {
+      ConcurrentHashTable_insert(cht, (unsigned char *)&key, sizeof(key),
+          (HTValue)key, NULL);
+    } else {
+      ConcurrentHashTable_remove(cht, (unsigned char *)&key, sizeof(key),
+          NULL);
+    }
+  }
+  return NULL;
+}
+
+static void *locked_worker(void *arg) {
+  WorkerArgs *args = arg;
+  uint64_t rng = args->seed;
+  pthread_barrier_wait(&start_barrier);
+  for (int i = 0; i < OPS_PER_THREAD; i++) {
+    uint64_t r = bench_rand(&rng);
+    uint64_t key = (r >> 8) % args->num_keys;
+    if (r % 100 < args->read_percent) {
+      pthread_rwlock_rdlock(&ht_lock);
+      HTValue *value =
+        HashTable_find(locked_ht, (unsigned char *)&key, sizeof(key));
+      BENCH_KEEP(value != NULL ? *value : NULL);
+      pthread_rwlock_unlock(&ht_lock);
+    } else {
+      pthread_rwlock_wrlock(&ht_lock);
+      if (r & 0x80) {
+        HashTable_insert(locked_ht, (unsigned char *)&key, sizeof(key),
+            (HTValue)key, NULL);
+      } else {
+        HashTable_remove(locked_ht, (unsigned char *)&key, sizeof(key), NULL);
+      }
+      pthread_rwlock_unlock(&ht_lock);
+    }
+  }
+  return NULL;
+}
+
+// Runs `worker` on `num_threads` threads at once.
+//
+// Returns the total throughput, in millions of operations per second, or a
+// negative number if the threads couldn't be started.
+static double run(void *(*worker)(void *), size_t num_threads,
+    size_t read_percent, size_t num_keys) {
+  pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+  WorkerArgs *args = malloc(num_threads * sizeof(WorkerArgs));
+  if (threads == NULL || args == NULL) {
+    free(threads);
+    free(args);
+    return -1;
+  }
+
+  pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+  for (size_t i = 0; i < num_threads; i++) {
+    args[i].seed = 0x5eed + i;
+    args[i].read_percent = read_percent;
+    args[i].num_keys = num_keys;
+    if (pthread_create(&threads[i], NULL, worker, &args[i]) != 0) {
+      fprintf(stderr, "Couldn't start thread %zu\n", i);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  pthread_barrier_wait(&start_barrier);
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < num_threads; i++) pthread_join(threads[i], NULL);
+  uint64_t elapsed = bench_now_ns() - start;
+  pthread_barrier_destroy(&start_barrier);
+
+  free(threads);
+  free(args);
+  return (double)num_threads * OPS_PER_THREAD / ((double)elapsed / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_threads = bench_size_arg(argc, argv, 1, 64);
+  size_t read_percent = bench_size_arg(argc, argv, 2, 90);
+  size_t num_keys = bench_size_arg(argc, argv, 3, 100000);
+  if (read_percent > 100 || num_keys == 0) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%zu keys, %zu%% lookups\n", num_keys, read_percent);
+  printf("%8s %16s %16s\n", "threads", "concurrent", "rwlock");
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    cht = ConcurrentHashTable_allocate(HT_HASH_WYHASH);
+    HTOptions opts;
+    HTOptions_init(&opts);
+    opts.hash_fn = HT_HASH_WYHASH;
+    locked_ht = HashTable_allocate_with_options(&opts);
+    if (cht == NULL || locked_ht == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+    // Start with about as many keys as the workload settles at
+    for (uint64_t key = 0; key < num_keys; key += 2) {
+      ConcurrentHashTable_insert(cht, (unsigned char *)&key, sizeof(key),
+          (HTValue)key, NULL);
+      HashTable_insert(locked_ht, (unsigned char *)&key, sizeof(key),
+          (HTValue)key, NULL);
+    }
+
+    double cht_mops = run(&cht_worker, threads, read_percent, num_keys);
+    double locked_mops = run(&locked_worker, threads, read_percent, num_keys);
+    if (cht_mops < 0 || locked_mops < 0) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+    printf("%8zu %16.2f %16.2f\n", threads, cht_mops, locked_mops);
+
+    ConcurrentHashTable_free(cht, NULL);
+    HashTable_free(locked_ht, NULL);
+  }
+
+  printf("(throughput in millions of ops/s, summed over all threads)\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+/* Benchmarks Deque against LinkedList as a FIFO queue
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_deque [num_ops]
+//
+// Uses a Deque and a LinkedList as FIFO queues of pending messages, appending
+// at the tail and popping at the head, `num_ops` (default 10000000) times
+// each. Two patterns are timed at several queue depths:
+// - steady: the queue holds `depth` messages, and each new one is appended
+//   as the oldest is popped.
+// - burst:  `depth` messages are appended, then all of them are popped.
+// Reports nanoseconds per append + pop pair.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "deque.h"
+#include "linked_list.h"
+
+#define NUM_DEPTHS (sizeof(depths) / sizeof(depths[0]))
+
+static const size_t depths[] = {1, 16, 256, 4096, 65536};
+
+typedef struct {
+  bool (*append)(void *queue, void *payload);
+  bool (*pop_head)(void *queue, void **payload_out);
+} QueueOps;
+
+static bool deque_append(void *queue, void *payload) {
+  return Deque_append(queue, payload);
+}
+static bool deque_pop_head(void *queue, void **payload_out) {
+  return Deque_pop_head(queue, payload_out);
+}
+static bool list_append(void *queue, void *payload) {
+  return LinkedList_append(queue, payload);
+}
+static bool list_pop_head(void *queue, void **payload_out) {
+  return LinkedList_pop_head(queue, payload_out);
+}
+
+static const QueueOps deque_ops = {deque_append, deque_pop_head};
+static const QueueOps list_ops = {list_append, list_pop_head};
+
+// Returns the time per append + pop pair, in nanoseconds, or a negative
+// number if memory ran out.
+static double time_steady(const QueueOps *ops, void *queue, size_t depth,
+    size_t num_ops) {
+  void *payload;
+  uintptr_t next = 1;
+  for (size_t i = 0; i < depth; i++) {
+    if (!ops->append(queue, (void *)next++)) return -1;
+  }
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < num_ops; i++) {
+    if (!ops->append(queue, (void *)next++)) return -1;
+    ops->pop_head(queue, &payload);
+    BENCH_KEEP(payload);
+  }
+  double ns = (double)(bench_now_ns() - start) / num_ops;
+
+  for (size_t i = 0; i < depth; i++) ops->pop_head(queue, &payload);
+  return ns;
+}
+
+static double time_burst(const QueueOps *ops, void *queue, size_t depth,
+    size_t num_ops) {
+  void *payload;
+  size_t num_bursts = num_ops / depth + 1;
+  uint64_t start = bench_now_ns();
+  for (size_t b = 0; b < num_bursts; b++) {
+    for (uintptr_t i = 1; i <= depth; i++) {
+      if (!ops->append(queue, (void *)i)) return -1;
+    }
+    for (size_t i = 0; i < depth; i++) {
+      ops->pop_head(queue, &payload);
+      BENCH_KEEP(payload);
+    }
+  }
+  return (double)(bench_now_ns() - start) / (num_bursts * depth);
+}
+
+int main(int argc, char *argv[]) {
+  size_t num_ops = bench_size_arg(argc, argv, 1, 10000000);
+  if (num_ops == 0) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  Deque *dq = Deque_allocate();
+  LinkedList *ll = LinkedList_allocate();
+  if (dq == NULL || ll == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%8s %14s %14s %14s %14s\n", "depth", "Deque steady",
+      "List steady", "Deque burst", "List burst");
+  for (size_t d = 0; d < NUM_DEPTHS; d++) {
+    double results[] = {
+      time_steady(&deque_ops, dq, depths[d], num_ops),
+      time_steady(&list_ops, ll, depths[d], num_ops),
+      time_burst(&deque_ops, dq, depths[d], num_ops),
+      time_burst(&list_ops, ll, depths[d], num_ops),
+    };
+    for (size_t i = 0; i < sizeof(results) / sizeof(results[0]); i++) {
+      if (results[i] < 0) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+      }
+    }
+    printf("%8zu %14.2f %14.2f %14.2f %14.2f\n", depths[d], results[0],
+        results[1], results[2], results[3]);
+  }
+
+  Deque_free(dq, NULL);
+  LinkedList_free(ll, NULL);
+  return EXIT_SUCCESS;
+}
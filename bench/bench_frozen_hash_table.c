@@ -0,0 +1,126 @@
+/* Benchmarks FrozenHashTable lookups against mutable HashTable lookups
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_frozen_hash_table [max_entries]
+//
+// For table sizes from 1000 up to `max_entries` (default 1M) entries, fills a
+// HashTable of each HTEngine, freezes one of them, and reports how long the
+// freeze took along with the per-lookup cost of finding random keys that are
+// present (hits) and that aren't (misses) in each table. Every table uses
+// wyhash, which is what FrozenHashTable always uses, so the comparison is
+// only between the table layouts.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "frozen_hash_table.h"
+#include "hash_table.h"
+
+#define LOOKUPS 4000000
+
+static const struct {
+  HTEngine engine;
+  const char *name;
+} engines[] = {
+  {HT_ENGINE_CHAINED, "chained"},
+  {HT_ENGINE_OPEN, "open"},
+};
+#define NUM_ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+// Looks up LOOKUPS random keys from [first_key, first_key + num_keys) in
+// either `ht` or `fht`, whichever isn't NULL.
+//
+// Returns the average time per lookup, in nanoseconds.
+static double time_lookups(HashTable *ht, FrozenHashTable *fht,
+    uint64_t first_key, uint64_t num_keys) {
+  uint64_t rng = 0x5eed;
+  uint64_t start = bench_now_ns();
+  for (int i = 0; i < LOOKUPS; i++) {
+    uint64_t key = first_key + bench_rand(&rng) % num_keys;
+    if (fht != NULL) {
+      const HTValue *value =
+        FrozenHashTable_find(fht, (unsigned char *)&key, sizeof(key));
+      BENCH_KEEP(value);
+    } else {
+      HTValue *value = HashTable_find(ht, (unsigned char *)&key, sizeof(key));
+      BENCH_KEEP(value);
+    }
+  }
+  return (double)(bench_now_ns() - start) / LOOKUPS;
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_entries = bench_size_arg(argc, argv, 1, 1000000);
+  if (max_entries < 1000) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%10s %10s %8s %8s %8s %8s %8s %8s\n", "entries", "freeze ms",
+      "hit:chn", "hit:open", "hit:frz", "miss:chn", "miss:opn", "miss:frz");
+  for (size_t num_entries = 1000; num_entries <= max_entries;
+      num_entries *= 10) {
+    HashTable *tables[NUM_ENGINES];
+    for (size_t e = 0; e < NUM_ENGINES; e++) {
+      HTOptions opts;
+      HTOptions_init(&opts);
+      opts.engine = engines[e].engine;
+      opts.hash_fn = HT_HASH_WYHASH;
+      tables[e] = HashTable_allocate_with_options(&opts);
+      if (tables[e] == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+      }
+      for (uint64_t key = 0; key < num_entries; key++) {
+        HashTable_insert(tables[e], (unsigned char *)&key, sizeof(key),
+            (HTValue)key, NULL);
+      }
+    }
+
+    uint64_t start = bench_now_ns();
+    FrozenHashTable *fht = HashTable_freeze(tables[0]);
+    double freeze_ms = (double)(bench_now_ns() - start) / 1e6;
+    if (fht == NULL) {
+      fprintf(stderr, "Couldn't freeze the table\n");
+      return EXIT_FAILURE;
+    }
+
+    double hits[NUM_ENGINES + 1];
+    double misses[NUM_ENGINES + 1];
+    for (size_t e = 0; e < NUM_ENGINES; e++) {
+      hits[e] = time_lookups(tables[e], NULL, 0, num_entries);
+      misses[e] = time_lookups(tables[e], NULL, num_entries, num_entries);
+    }
+    hits[NUM_ENGINES] = time_lookups(NULL, fht, 0, num_entries);
+    misses[NUM_ENGINES] = time_lookups(NULL, fht, num_entries, num_entries);
+
+    printf("%10zu %10.1f", num_entries, freeze_ms);
+    for (size_t e = 0; e <= NUM_ENGINES; e++) printf(" %8.1f", hits[e]);
+    for (size_t e = 0; e <= NUM_ENGINES; e++) printf(" %8.1f", misses[e]);
+    printf("\n");
+
+    FrozenHashTable_free(fht, NULL);
+    for (size_t e = 0; e < NUM_ENGINES; e++) HashTable_free(tables[e], NULL);
+  }
+
+  printf("(lookup times in ns/lookup)\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+/* Benchmarks the hash functions HashTable can be configured to use
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_hash_functions [bytes_per_run]
+//
+// For key lengths from 4 bytes up to 4KiB, reports how long each HTHashFn
+// takes per key and its throughput. Each (function, key length) pair hashes
+// about `bytes_per_run` bytes in total (default 256MiB).
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "hash_table.h"
+
+#define MAX_KEY_LEN 4096
+
+static const struct {
+  HTHashFn hash_fn;
+  const char *name;
+} hash_fns[] = {
+  {HT_HASH_SIPHASH, "siphash"},
+  {HT_HASH_WYHASH, "wyhash"},
+  {HT_HASH_FNV1A, "fnv1a"},
+};
+
+static const size_t key_lens[] = {4, 8, 16, 32, 64, 128, 256, 1024, 4096};
+
+int main(int argc, char *argv[]) {
+  size_t bytes_per_run = bench_size_arg(argc, argv, 1, (size_t)256 << 20);
+
+  // Hashing keys at different offsets into the buffer keeps each iteration
+  // from being hashed from the exact same address.
+  unsigned char *buf = malloc(2 * MAX_KEY_LEN);
+  if (buf == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+  uint64_t rng = 0x5eed;
+  for (size_t i = 0; i < 2 * MAX_KEY_LEN; i++) buf[i] = bench_rand(&rng);
+
+  printf("%8s %8s %12s %12s\n", "key len", "hash", "ns/key", "GiB/s");
+  for (size_t l = 0; l < sizeof(key_lens) / sizeof(key_lens[0]); l++) {
+    size_t len = key_lens[l];
+    size_t iters = bytes_per_run / len;
+    for (size_t f = 0; f < sizeof(hash_fns) / sizeof(hash_fns[0]); f++) {
+      uint64_t acc = 0;
+      uint64_t start = bench_now_ns();
+      for (size_t i = 0; i < iters; i++) {
+        // Feed each hash into the next key's offset so the calls can't be
+        // overlapped, similar to a lookup that depends on the previous one.
+        size_t offset = acc & (MAX_KEY_LEN - 1);
+        acc += HashTable_hash_key(hash_fns[f].hash_fn, buf + offset, len);
+      }
+      uint64_t elapsed = bench_now_ns() - start;
+      BENCH_KEEP(acc);
+
+      double ns_per_key = (double)elapsed / iters;
+      double gib_per_s =
+        ((double)iters * len / (1 << 30)) / ((double)elapsed / 1e9);
+      printf("%8zu %8s %12.1f %12.2f\n", len, hash_fns[f].name, ns_per_key,
+          gib_per_s);
+    }
+  }
+
+  free(buf);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+/* Benchmarks ways of filling a HashTable with many entries at once
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_hash_table_bulk_load [num_entries]
+//
+// Loads `num_entries` (default 500000) entries with 24-byte string keys, like
+// the lines of a token file, into a fresh table. Reports the time per entry
+// for each storage engine when inserting them one by one into a table that
+// starts out empty, when reserving room for all of them first, and when
+// building the table with HashTable_allocate_from.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "hash_table.h"
+
+#define KEY_LEN 24
+
+static const struct {
+  HTEngine engine;
+  bool use_slab;
+  const char *name;
+} configs[] = {
+  {HT_ENGINE_CHAINED, false, "chained"},
+  {HT_ENGINE_CHAINED, true, "slab"},
+  {HT_ENGINE_OPEN, false, "open"},
+};
+#define NUM_CONFIGS (sizeof(configs) / sizeof(configs[0]))
+
+// Fills in each of `num_entries` keys with random hex digits.
+static void make_keys(unsigned char *buf, unsigned char **keys,
+    size_t num_entries) {
+  uint64_t rng = 0x5eed;
+  for (size_t i = 0; i < num_entries; i++) {
+    keys[i] = &buf[i * KEY_LEN];
+    for (size_t j = 0; j < KEY_LEN; j++) {
+      keys[i][j] = "0123456789abcdef"[bench_rand(&rng) & 0xF];
+    }
+  }
+}
+
+// Fills a table one insert at a time, optionally reserving room first.
+//
+// Returns the time taken per entry, in nanoseconds, or a negative number if
+// memory ran out.
+static double time_inserts(const HTOptions *opts, unsigned char **keys,
+    const size_t *key_lens, const HTValue *values, size_t num_entries,
+    bool reserve) {
+  uint64_t start = bench_now_ns();
+  HashTable *ht = HashTable_allocate_with_options(opts);
+  if (ht == NULL) return -1;
+  if (reserve && !HashTable_reserve(ht, num_entries)) {
+    HashTable_free(ht, NULL);
+    return -1;
+  }
+  for (size_t i = 0; i < num_entries; i++) {
+    HashTable_insert(ht, keys[i], key_lens[i], values[i], NULL);
+  }
+  double ns = (double)(bench_now_ns() - start) / num_entries;
+  HashTable_free(ht, NULL);
+  return ns;
+}
+
+// Same as time_inserts, but with HashTable_allocate_from.
+static double time_allocate_from(const HTOptions *opts, unsigned char **keys,
+    const size_t *key_lens, const HTValue *values, size_t num_entries) {
+  uint64_t start = bench_now_ns();
+  HashTable *ht = HashTable_allocate_from(opts, keys, key_lens, values,
+      num_entries);
+  if (ht == NULL) return -1;
+  double ns = (double)(bench_now_ns() - start) / num_entries;
+  HashTable_free(ht, NULL);
+  return ns;
+}
+
+int main(int argc, char *argv[]) {
+  size_t num_entries = bench_size_arg(argc, argv, 1, 500000);
+  if (num_entries == 0) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  unsigned char *buf = malloc(num_entries * KEY_LEN);
+  unsigned char **keys = malloc(num_entries * sizeof(unsigned char *));
+  size_t *key_lens = malloc(num_entries * sizeof(size_t));
+  HTValue *values = malloc(num_entries * sizeof(HTValue));
+  if (buf == NULL || keys == NULL || key_lens == NULL || values == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+  make_keys(buf, keys, num_entries);
+  for (size_t i = 0; i < num_entries; i++) {
+    key_lens[i] = KEY_LEN;
+    values[i] = (HTValue)(uintptr_t)i;
+  }
+
+  printf("%zu entries\n", num_entries);
+  printf("%8s %10s %10s %10s\n", "engine", "insert", "reserve", "bulk");
+  for (size_t c = 0; c < NUM_CONFIGS; c++) {
+    HTOptions opts;
+    HTOptions_init(&opts);
+    opts.engine = configs[c].engine;
+    opts.use_slab = configs[c].use_slab;
+
+    // Warm up malloc first, so that the first measurement doesn't pay for
+    // faulting in memory that the others get to reuse
+    time_inserts(&opts, keys, key_lens, values, num_entries, false);
+    double insert_ns = time_inserts(&opts, keys, key_lens, values,
+        num_entries, false);
+    double reserve_ns = time_inserts(&opts, keys, key_lens, values,
+        num_entries, true);
+    double bulk_ns = time_allocate_from(&opts, keys, key_lens, values,
+        num_entries);
+    if (insert_ns < 0 || reserve_ns < 0 || bulk_ns < 0) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+    printf("%8s %10.1f %10.1f %10.1f\n", configs[c].name, insert_ns,
+        reserve_ns, bulk_ns);
+  }
+
+  printf("(all times in ns/entry, including allocating the table)\n");
+  free(buf);
+  free(keys);
+  free(key_lens);
+  free(values);
+  return EXIT_SUCCESS;
+}
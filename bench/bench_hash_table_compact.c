@@ -0,0 +1,139 @@
+/* Benchmarks how much memory HashTable_compact gets back after mass removals
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_hash_table_compact [num_entries] [keep_percent]
+//
+// Simulates a rate limiting table after a burst of traffic: fills a table
+// with `num_entries` (default 2M) entries, then removes all but
+// `keep_percent` percent (default 1) of them, and finally compacts it. Reports
+// the process's resident set size after each step, and how long compacting
+// took, for each storage engine. Each engine is run in a child process of
+// its own, so that memory left over from one doesn't skew the next.
+//
+// On glibc, memory freed by the table may stay in malloc's free lists rather
+// than being returned to the system, so the RSS after calling malloc_trim is
+// reported as well.
+
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "bench_util.h"
+#include "hash_table.h"
+
+static const struct {
+  HTEngine engine;
+  bool use_slab;
+  const char *name;
+} configs[] = {
+  {HT_ENGINE_CHAINED, false, "chained"},
+  {HT_ENGINE_CHAINED, true, "slab"},
+  {HT_ENGINE_OPEN, false, "open"},
+};
+#define NUM_CONFIGS (sizeof(configs) / sizeof(configs[0]))
+
+static double rss_mib() {
+  return bench_rss_bytes() / (1024.0 * 1024.0);
+}
+
+// Runs the benchmark for configs[c] and prints its row.
+//
+// Returns false if memory ran out.
+static bool run(size_t c, size_t num_entries, size_t keep_percent) {
+  double start_mib = rss_mib();
+  HTOptions opts;
+  HTOptions_init(&opts);
+  opts.engine = configs[c].engine;
+  opts.use_slab = configs[c].use_slab;
+  HashTable *ht = HashTable_allocate_with_options(&opts);
+  if (ht == NULL) return false;
+
+  for (uint64_t i = 0; i < num_entries; i++) {
+    // Scattered like client addresses would be
+    uint64_t key = i * 0x9E3779B97F4A7C15ULL;
+    HashTable_insert(ht, (unsigned char *)&key, sizeof(key), NULL, NULL);
+  }
+  if ((size_t)HashTable_num_elements(ht) != num_entries) return false;
+  double full_mib = rss_mib();
+
+  for (uint64_t i = 0; i < num_entries; i++) {
+    if (i % 100 < keep_percent) continue;
+    uint64_t key = i * 0x9E3779B97F4A7C15ULL;
+    HashTable_remove(ht, (unsigned char *)&key, sizeof(key), NULL);
+  }
+  double removed_mib = rss_mib();
+
+  uint64_t start = bench_now_ns();
+  if (!HashTable_compact(ht)) return false;
+  double compact_ms = (double)(bench_now_ns() - start) / 1e6;
+  double compacted_mib = rss_mib();
+  double trimmed_mib = compacted_mib;
+#ifdef __GLIBC__
+  malloc_trim(0);
+  trimmed_mib = rss_mib();
+#endif
+
+  printf("%8s %10.1f %10.1f %10.1f %10.1f %10.1f\n", configs[c].name,
+      full_mib - start_mib, removed_mib - start_mib,
+      compacted_mib - start_mib, trimmed_mib - start_mib, compact_ms);
+  HashTable_free(ht, NULL);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  size_t num_entries = bench_size_arg(argc, argv, 1, 2000000);
+  size_t keep_percent = bench_size_arg(argc, argv, 2, 1);
+  if (num_entries == 0 || keep_percent > 100) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%zu entries, keeping %zu%%\n", num_entries, keep_percent);
+  printf("%8s %10s %10s %10s %10s %10s\n", "engine", "full", "removed",
+      "compacted", "trimmed", "compact ms");
+  fflush(stdout);
+  for (size_t c = 0; c < NUM_CONFIGS; c++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      fprintf(stderr, "Couldn't fork\n");
+      return EXIT_FAILURE;
+    }
+    if (pid == 0) {
+      bool ok = run(c, num_entries, keep_percent);
+      if (!ok) fprintf(stderr, "Out of memory\n");
+      fflush(stdout);
+      _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != EXIT_SUCCESS) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("(memory in MiB of RSS over what the process started with)\n");
+  return EXIT_SUCCESS;
+}
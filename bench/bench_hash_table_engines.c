@@ -0,0 +1,129 @@
+/* Benchmarks the HashTable storage engines against each other
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_hash_table_engines [max_entries]
+//
+// For tables of 1000, 10000, ... up to `max_entries` (default 1M) entries,
+// reports the per-operation cost of inserts, successful lookups, failed
+// lookups and removals for each HTEngine. Also reports the per-entry cost of
+// iterating over the full table, and over the table once 15 out of every 16
+// entries have been removed.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "hash_table.h"
+
+#define LOOKUPS 1000000
+// Only every SPARSE_STRIDE-th key is left in the table for the sparse
+// iteration
+#define SPARSE_STRIDE 16
+
+// Iterates over every entry in `ht`.
+//
+// Returns the time taken per entry, in nanoseconds.
+static double time_iteration(HashTable *ht) {
+  int num_elems = HashTable_num_elements(ht);
+  uint64_t start = bench_now_ns();
+  HTIterator *hti = HTIterator_allocate(ht);
+  for (; HTIterator_is_valid(hti); HTIterator_next(hti)) {
+    HTValue value;
+    HTIterator_get(hti, NULL, NULL, &value);
+    BENCH_KEEP(value);
+  }
+  HTIterator_free(hti);
+  return (double)(bench_now_ns() - start) / num_elems;
+}
+
+static const struct {
+  HTEngine engine;
+  const char *name;
+} engines[] = {
+  {HT_ENGINE_CHAINED, "chained"},
+  {HT_ENGINE_OPEN, "open"},
+};
+
+int main(int argc, char *argv[]) {
+  size_t max_entries = bench_size_arg(argc, argv, 1, 1000000);
+
+  printf("%10s %8s %10s %10s %10s %10s %10s %10s\n", "entries", "engine",
+      "insert", "find hit", "find miss", "iterate", "sparse it", "remove");
+  for (size_t n = 1000; n <= max_entries; n *= 10) {
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+      HTOptions opts;
+      HTOptions_init(&opts);
+      opts.engine = engines[e].engine;
+      HashTable *ht = HashTable_allocate_with_options(&opts);
+      if (ht == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+      }
+
+      uint64_t start = bench_now_ns();
+      for (uint64_t key = 0; key < n; key++) {
+        HashTable_insert(ht, (unsigned char *)&key, sizeof(key), (HTValue)key,
+            NULL);
+      }
+      double insert_ns = (double)(bench_now_ns() - start) / n;
+
+      uint64_t rng = 0x5eed;
+      start = bench_now_ns();
+      for (int i = 0; i < LOOKUPS; i++) {
+        uint64_t key = bench_rand(&rng) % n;
+        HTValue *value = HashTable_find(ht, (unsigned char *)&key, sizeof(key));
+        BENCH_KEEP(value);
+      }
+      double hit_ns = (double)(bench_now_ns() - start) / LOOKUPS;
+
+      start = bench_now_ns();
+      for (int i = 0; i < LOOKUPS; i++) {
+        uint64_t key = n + bench_rand(&rng) % n;
+        HTValue *value = HashTable_find(ht, (unsigned char *)&key, sizeof(key));
+        BENCH_KEEP(value);
+      }
+      double miss_ns = (double)(bench_now_ns() - start) / LOOKUPS;
+
+      double iterate_ns = time_iteration(ht);
+
+      start = bench_now_ns();
+      for (uint64_t key = 0; key < n; key++) {
+        if (key % SPARSE_STRIDE == 0) continue;
+        HashTable_remove(ht, (unsigned char *)&key, sizeof(key), NULL);
+      }
+      uint64_t remove_time = bench_now_ns() - start;
+      double sparse_ns = time_iteration(ht);
+      start = bench_now_ns();
+      for (uint64_t key = 0; key < n; key += SPARSE_STRIDE) {
+        HashTable_remove(ht, (unsigned char *)&key, sizeof(key), NULL);
+      }
+      remove_time += bench_now_ns() - start;
+      double remove_ns = (double)remove_time / n;
+
+      printf("%10zu %8s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", n,
+          engines[e].name, insert_ns, hit_ns, miss_ns, iterate_ns, sparse_ns,
+          remove_ns);
+      HashTable_free(ht, NULL);
+    }
+  }
+
+  printf("(all times in ns/op)\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+/* Benchmarks batched HashTable lookups against one-at-a-time lookups
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_hash_table_find_many [num_entries]
+//
+// Fills a table with `num_entries` (default 1M) entries, then reports the
+// per-key cost of looking up random keys (three quarters of which are
+// present) with HashTable_find one at a time, and with HashTable_find_many in
+// batches of various sizes, for each HTEngine. Batching only pays off once the
+// table is too large to fit in cache.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "hash_table.h"
+
+#define LOOKUPS 4000000
+#define MAX_BATCH 64
+
+static const struct {
+  HTEngine engine;
+  const char *name;
+} engines[] = {
+  {HT_ENGINE_CHAINED, "chained"},
+  {HT_ENGINE_OPEN, "open"},
+};
+
+static const size_t batch_sizes[] = {3, 8, 16, MAX_BATCH};
+#define NUM_BATCH_SIZES (sizeof(batch_sizes) / sizeof(batch_sizes[0]))
+
+int main(int argc, char *argv[]) {
+  size_t num_entries = bench_size_arg(argc, argv, 1, 1000000);
+  if (num_entries == 0) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  uint64_t key_bufs[MAX_BATCH];
+  unsigned char *keys[MAX_BATCH];
+  size_t key_lens[MAX_BATCH];
+  HTValue *values[MAX_BATCH];
+  for (size_t i = 0; i < MAX_BATCH; i++) {
+    keys[i] = (unsigned char *)&key_bufs[i];
+    key_lens[i] = sizeof(uint64_t);
+  }
+
+  printf("%zu entries\n", num_entries);
+  printf("%8s %12s", "engine", "find");
+  for (size_t b = 0; b < NUM_BATCH_SIZES; b++) {
+    char header[32];
+    snprintf(header, sizeof(header), "batch of %zu", batch_sizes[b]);
+    printf(" %12s", header);
+  }
+  printf("\n");
+
+  for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+    HTOptions opts;
+    HTOptions_init(&opts);
+    opts.engine = engines[e].engine;
+    HashTable *ht = HashTable_allocate_with_options(&opts);
+    if (ht == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+    for (uint64_t key = 0; key < num_entries; key++) {
+      HashTable_insert(ht, (unsigned char *)&key, sizeof(key), (HTValue)key,
+          NULL);
+    }
+
+    uint64_t rng = 0x5eed;
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < LOOKUPS; i++) {
+      uint64_t key = bench_rand(&rng) % (num_entries + num_entries / 3);
+      HTValue *value = HashTable_find(ht, (unsigned char *)&key, sizeof(key));
+      BENCH_KEEP(value);
+    }
+    printf("%8s %12.1f", engines[e].name,
+        (double)(bench_now_ns() - start) / LOOKUPS);
+
+    for (size_t b = 0; b < NUM_BATCH_SIZES; b++) {
+      size_t batch = batch_sizes[b];
+      rng = 0x5eed;
+      start = bench_now_ns();
+      for (int i = 0; i + batch <= LOOKUPS; i += batch) {
+        for (size_t j = 0; j < batch; j++) {
+          key_bufs[j] = bench_rand(&rng) % (num_entries + num_entries / 3);
+        }
+        size_t found = HashTable_find_many(ht, keys, key_lens, batch, values);
+        BENCH_KEEP(found);
+      }
+      printf(" %12.1f", (double)(bench_now_ns() - start) / LOOKUPS);
+    }
+    printf("\n");
+
+    HashTable_free(ht, NULL);
+  }
+
+  printf("(all times in ns/key)\n");
+  return EXIT_SUCCESS;
+}
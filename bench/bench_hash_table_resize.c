@@ -0,0 +1,74 @@
+/* Benchmarks HashTable lookup latency as the table grows
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_hash_table_resize [max_entries]
+//
+// Builds tables of 10, 100, ... up to `max_entries` (default 10M) entries and
+// reports the average latency of a successful lookup at each size, along with
+// the worst single insert seen while building the table. With incremental
+// resizing, both should stay roughly flat as the table grows.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "hash_table.h"
+
+#define LOOKUPS 1000000
+
+int main(int argc, char *argv[]) {
+  size_t max_entries = bench_size_arg(argc, argv, 1, 10000000);
+
+  printf("%12s %16s %16s %16s\n", "entries", "insert ns/op", "max insert ns",
+      "lookup ns/op");
+  for (size_t n = 10; n <= max_entries; n *= 10) {
+    HashTable *ht = HashTable_allocate();
+    if (ht == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+
+    uint64_t worst_insert = 0;
+    uint64_t build_start = bench_now_ns();
+    for (uint64_t key = 0; key < n; key++) {
+      uint64_t start = bench_now_ns();
+      HashTable_insert(ht, (unsigned char *)&key, sizeof(key), (HTValue)key,
+          NULL);
+      uint64_t elapsed = bench_now_ns() - start;
+      if (elapsed > worst_insert) worst_insert = elapsed;
+    }
+    uint64_t build_ns = bench_now_ns() - build_start;
+
+    uint64_t rng = 0x5eed;
+    uint64_t lookup_start = bench_now_ns();
+    for (int i = 0; i < LOOKUPS; i++) {
+      uint64_t key = bench_rand(&rng) % n;
+      HTValue *value = HashTable_find(ht, (unsigned char *)&key, sizeof(key));
+      BENCH_KEEP(value);
+    }
+    uint64_t lookup_ns = bench_now_ns() - lookup_start;
+
+    printf("%12zu %16.1f %16llu %16.1f\n", n, (double)build_ns / n,
+        (unsigned long long)worst_insert, (double)lookup_ns / LOOKUPS);
+    HashTable_free(ht, NULL);
+  }
+
+  return EXIT_SUCCESS;
+}
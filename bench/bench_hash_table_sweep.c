@@ -0,0 +1,117 @@
+/* Benchmarks removing entries from a HashTable while iterating over it
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_hash_table_sweep [num_entries]
+//
+// Fills a HashTable of each HTEngine with `num_entries` (default 1M) entries,
+// then sweeps over it with an HTIterator, removing some percentage of them.
+// Each sweep is done twice: once by removing through the iterator, and once
+// by copying the current key, advancing, and removing the key with
+// HashTable_remove, which hashes the key and searches the table for it again.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench_util.h"
+#include "hash_table.h"
+
+static const struct {
+  HTEngine engine;
+  const char *name;
+} engines[] = {
+  {HT_ENGINE_CHAINED, "chained"},
+  {HT_ENGINE_OPEN, "open"},
+};
+#define NUM_ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+static const int percentages[] = {10, 50, 90, 100};
+#define NUM_PERCENTAGES (sizeof(percentages) / sizeof(percentages[0]))
+
+static HashTable *fill(HTEngine engine, size_t num_entries) {
+  HTOptions opts;
+  HTOptions_init(&opts);
+  opts.engine = engine;
+  HashTable *ht = HashTable_allocate_with_options(&opts);
+  if (ht == NULL) return NULL;
+  for (uint64_t key = 0; key < num_entries; key++) {
+    HashTable_insert(ht, (unsigned char *)&key, sizeof(key), (HTValue)key,
+        NULL);
+  }
+  return ht;
+}
+
+// Sweeps over `ht`, removing every entry whose key is in the lowest `percent`
+// percent of each hundred keys, either through the iterator (if `direct`) or
+// with HashTable_remove.
+//
+// Returns the time the sweep took, in milliseconds.
+static double sweep(HashTable *ht, int percent, bool direct) {
+  uint64_t start = bench_now_ns();
+  HTIterator *hti = HTIterator_allocate(ht);
+  while (HTIterator_is_valid(hti)) {
+    const unsigned char *key;
+    size_t key_len;
+    HTIterator_get(hti, &key, &key_len, NULL);
+    uint64_t key_val;
+    memcpy(&key_val, key, sizeof(key_val));
+    if ((int)(key_val % 100) >= percent) {
+      HTIterator_next(hti);
+    } else if (direct) {
+      HTIterator_remove(hti, NULL, NULL, NULL);
+    } else {
+      unsigned char key_cpy[sizeof(uint64_t)];
+      memcpy(key_cpy, key, key_len);
+      HTIterator_next(hti);
+      HashTable_remove(ht, key_cpy, key_len, NULL);
+    }
+  }
+  HTIterator_free(hti);
+  return (double)(bench_now_ns() - start) / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+  size_t num_entries = bench_size_arg(argc, argv, 1, 1000000);
+  if (num_entries < 100) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%8s %8s %12s %12s %8s\n", "engine", "removed", "lookup ms",
+      "iterator ms", "speedup");
+  for (size_t e = 0; e < NUM_ENGINES; e++) {
+    for (size_t p = 0; p < NUM_PERCENTAGES; p++) {
+      double times[2];
+      for (int direct = 0; direct <= 1; direct++) {
+        HashTable *ht = fill(engines[e].engine, num_entries);
+        if (ht == NULL) {
+          fprintf(stderr, "Out of memory\n");
+          return EXIT_FAILURE;
+        }
+        times[direct] = sweep(ht, percentages[p], direct);
+        HashTable_free(ht, NULL);
+      }
+      printf("%8s %7d%% %12.1f %12.1f %7.2fx\n", engines[e].name,
+          percentages[p], times[0], times[1], times[0] / times[1]);
+    }
+  }
+  return EXIT_SUCCESS;
+}
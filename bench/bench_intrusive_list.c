@@ -0,0 +1,155 @@
+/* Benchmarks IntrusiveList against LinkedList as a queue
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_intrusive_list [queue_len]
+//
+// Keeps a queue of `queue_len` (default 10000) connection-like objects, and
+// repeatedly takes one off the front and puts it back on the end, as an event
+// loop servicing connections round robin would. Then walks the whole queue
+// reading a field of each object. Reports the time per operation for an
+// IntrusiveList, and for a LinkedList of pointers to the same objects (which
+// allocates a node per append).
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "intrusive_list.h"
+#include "linked_list.h"
+
+#define NUM_OPS 10000000
+
+typedef struct {
+  uint64_t id;
+  char buf[48];
+  ILLink link;
+} Connection;
+
+int main(int argc, char *argv[]) {
+  size_t queue_len = bench_size_arg(argc, argv, 1, 10000);
+  if (queue_len == 0) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  Connection *conns = calloc(queue_len, sizeof(Connection));
+  LinkedList *ll = LinkedList_allocate();
+  if (conns == NULL || ll == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  // Shuffle the order objects are queued in, so walking the queue isn't just
+  // walking an array
+  size_t *order = malloc(queue_len * sizeof(size_t));
+  if (order == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+  uint64_t rng = 0x11;
+  for (size_t i = 0; i < queue_len; i++) order[i] = i;
+  for (size_t i = queue_len - 1; i > 0; i--) {
+    size_t j = bench_rand(&rng) % (i + 1);
+    size_t tmp = order[i];
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+
+  // Both queues are in the shuffled order. A LinkedList's nodes are allocated
+  // in sequence, so they're appended in object order and then relinked into
+  // the shuffled order, leaving them as scattered as the objects themselves
+  // (as they'd be in a long running program).
+  IntrusiveList il;
+  IntrusiveList_init(&il);
+  LLIterator *iters = malloc(queue_len * sizeof(LLIterator));
+  if (iters == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+  for (size_t i = 0; i < queue_len; i++) {
+    conns[i].id = i;
+    LinkedList_append(ll, &conns[i]);
+    LLIterator_init(&iters[i], ll);
+    LLIterator_fast_forward(&iters[i]);
+  }
+  for (size_t i = 0; i < queue_len; i++) {
+    IntrusiveList_append(&il, &conns[order[i]].link);
+    LLIterator_move_to_head(&iters[order[queue_len - 1 - i]]);
+  }
+  if (LinkedList_num_elements(ll) != (int)queue_len) {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+  free(iters);
+  free(order);
+
+  // Round robin
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < NUM_OPS; i++) {
+    ILLink *link;
+    IntrusiveList_pop_head(&il, &link);
+    IntrusiveList_append(&il, link);
+  }
+  double il_rotate_ns = (double)(bench_now_ns() - start) / NUM_OPS;
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < NUM_OPS; i++) {
+    LLPayload payload;
+    LinkedList_pop_head(ll, &payload);
+    LinkedList_append(ll, payload);
+  }
+  double ll_rotate_ns = (double)(bench_now_ns() - start) / NUM_OPS;
+
+  // Walks
+  size_t num_walks = NUM_OPS / queue_len + 1;
+  uint64_t sum = 0;
+  start = bench_now_ns();
+  for (size_t w = 0; w < num_walks; w++) {
+    ILIterator ili;
+    ILIterator_init(&ili, &il);
+    for (; ILIterator_is_valid(&ili); ILIterator_next(&ili)) {
+      sum += IL_ENTRY(ILIterator_get(&ili), Connection, link)->id;
+    }
+  }
+  double il_walk_ns = (double)(bench_now_ns() - start) /
+    (num_walks * queue_len);
+  BENCH_KEEP(sum);
+
+  start = bench_now_ns();
+  for (size_t w = 0; w < num_walks; w++) {
+    LLIterator lli;
+    LLIterator_init(&lli, ll);
+    for (; LLIterator_is_valid(&lli); LLIterator_next(&lli)) {
+      sum += ((Connection *)*LLIterator_get(&lli))->id;
+    }
+  }
+  double ll_walk_ns = (double)(bench_now_ns() - start) /
+    (num_walks * queue_len);
+  BENCH_KEEP(sum);
+
+  printf("queue of %zu\n", queue_len);
+  printf("%14s %16s %14s\n", "", "pop+append ns", "walk ns/elem");
+  printf("%14s %16.1f %14.2f\n", "IntrusiveList", il_rotate_ns, il_walk_ns);
+  printf("%14s %16.1f %14.2f\n", "LinkedList", ll_rotate_ns, ll_walk_ns);
+
+  LinkedList_free(ll, NULL);
+  free(conns);
+  return EXIT_SUCCESS;
+}
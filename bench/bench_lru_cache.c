@@ -0,0 +1,129 @@
+/* Benchmarks LRUCache hit rates and throughput
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_lru_cache [num_keys]
+//
+// Replays a stream of requests for keys drawn from `num_keys` (default 1M)
+// distinct keys against LRUCaches of various capacities, where a request
+// that misses inserts its key, as a read-through cache would. Key popularity
+// follows a Zipf distribution, as it tends to for real workloads like web
+// requests, with a few very hot keys and a long tail of rarely used ones.
+// Reports the hit rate and the average time per request for each capacity.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "lru_cache.h"
+
+#define REQUESTS 5000000
+// The Zipf distribution's exponent; 1 is the classic "the n-th most popular
+// key is requested 1/n as often as the most popular one"
+#define ZIPF_S 0.99
+// The number of bytes each cached value is said to take up
+#define VALUE_BYTES 100
+
+// Capacities to try, in thousandths of the key space
+static const int capacities[] = {1, 10, 50, 100, 250};
+#define NUM_CAPACITIES (sizeof(capacities) / sizeof(capacities[0]))
+
+// Generates REQUESTS requests for `num_keys` distinct keys, following a Zipf
+// distribution. The keys are scattered over the range of a uint64_t, so that
+// the most popular ones aren't all small numbers.
+static uint64_t *make_requests(size_t num_keys) {
+  double *cdf = malloc(num_keys * sizeof(double));
+  uint64_t *requests = malloc(REQUESTS * sizeof(uint64_t));
+  if (cdf == NULL || requests == NULL) {
+    free(cdf);
+    free(requests);
+    return NULL;
+  }
+  double total = 0;
+  for (size_t i = 0; i < num_keys; i++) {
+    total += 1.0 / pow((double)(i + 1), ZIPF_S);
+    cdf[i] = total;
+  }
+
+  uint64_t rng = 0x5eed;
+  for (size_t r = 0; r < REQUESTS; r++) {
+    double target = (double)(bench_rand(&rng) >> 11) / (1ULL << 53) * total;
+    size_t lo = 0, hi = num_keys - 1;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (cdf[mid] < target) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    // Multiplying by an odd number is a bijection on 64-bit integers
+    requests[r] = lo * 0x9E3779B97F4A7C15ULL;
+  }
+  free(cdf);
+  return requests;
+}
+
+int main(int argc, char *argv[]) {
+  size_t num_keys = bench_size_arg(argc, argv, 1, 1000000);
+  if (num_keys < 1000) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+  uint64_t *requests = make_requests(num_keys);
+  if (requests == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%10s %10s %8s %10s\n", "capacity", "entries", "hit %", "ns/req");
+  for (size_t c = 0; c < NUM_CAPACITIES; c++) {
+    size_t entries = num_keys * capacities[c] / 1000;
+    size_t entry_bytes = VALUE_BYTES + sizeof(uint64_t);
+    LRUCache *cache = LRUCache_allocate(entries * entry_bytes, NULL);
+    if (cache == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+
+    size_t hits = 0;
+    uint64_t start = bench_now_ns();
+    for (size_t r = 0; r < REQUESTS; r++) {
+      uint64_t key = requests[r];
+      HTValue *value = LRUCache_find(cache, (unsigned char *)&key,
+          sizeof(key));
+      if (value != NULL) {
+        hits++;
+        BENCH_KEEP(*value);
+      } else {
+        LRUCache_insert(cache, (unsigned char *)&key, sizeof(key),
+            (HTValue)key, VALUE_BYTES, NULL);
+      }
+    }
+    double ns = (double)(bench_now_ns() - start) / REQUESTS;
+
+    printf("%9.1f%% %10zu %8.1f %10.1f\n", capacities[c] / 10.0, entries,
+        100.0 * hits / REQUESTS, ns);
+    LRUCache_free(cache, NULL);
+  }
+
+  free(requests);
+  return EXIT_SUCCESS;
+}
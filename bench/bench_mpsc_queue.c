@@ -0,0 +1,184 @@
+/* Benchmarks MPSCQueue against a LinkedList guarded by a mutex
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_mpsc_queue [max_producers] [batch_size]
+//
+// For 1, 2, 4, ... up to `max_producers` (default 64) producer threads, each
+// of which pushes MSGS_PER_PRODUCER messages as fast as it can, reports how
+// fast a single consumer thread receives them, popping up to `batch_size`
+// (default 64) at a time. The same workload is run against an MPSCQueue and,
+// as a baseline, a LinkedList guarded by a pthread_mutex_t (whose consumer
+// also pops a whole batch per lock acquisition).
+
+#define _XOPEN_SOURCE 700
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "linked_list.h"
+#include "mpsc_queue.h"
+
+#define MSGS_PER_PRODUCER 200000
+
+typedef struct {
+  uint64_t producer;
+  uint64_t seq;
+  MPSCLink link;
+} Message;
+
+static pthread_barrier_t start_barrier;
+
+static MPSCQueue *queue;
+static LinkedList *locked_list;
+static pthread_mutex_t list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *queue_producer(void *arg) {
+  Message *msgs = arg;
+  pthread_barrier_wait(&start_barrier);
+  for (int i = 0; i < MSGS_PER_PRODUCER; i++) {
+    MPSCQueue_push(queue, &msgs[i].link);
+  }
+  return NULL;
+}
+
+static void *locked_producer(void *arg) {
+  Message *msgs = arg;
+  pthread_barrier_wait(&start_barrier);
+  for (int i = 0; i < MSGS_PER_PRODUCER; i++) {
+    pthread_mutex_lock(&list_lock);
+    bool ok = LinkedList_append(locked_list, &msgs[i]);
+    pthread_mutex_unlock(&list_lock);
+    if (!ok) {
+      fprintf(stderr, "Out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  return NULL;
+}
+
+// Pops up to `batch_size` messages from whichever queue is being measured.
+//
+// Returns the number of messages popped.
+static size_t queue_consume(size_t batch_size, void **batch) {
+  MPSCLink **links = (MPSCLink **)batch;
+  size_t n = MPSCQueue_pop_many(queue, links, batch_size);
+  for (size_t i = 0; i < n; i++) {
+    BENCH_KEEP(MPSC_ENTRY(links[i], Message, link)->seq);
+  }
+  return n;
+}
+
+static size_t locked_consume(size_t batch_size, void **batch) {
+  size_t n = 0;
+  pthread_mutex_lock(&list_lock);
+  while (n < batch_size && LinkedList_pop_head(locked_list, &batch[n])) n++;
+  pthread_mutex_unlock(&list_lock);
+  for (size_t i = 0; i < n; i++) BENCH_KEEP(((Message *)batch[i])->seq);
+  return n;
+}
+
+// Runs `producer` on `num_producers` threads at once, consuming everything
+// they produce on the calling thread.
+//
+// Returns the throughput, in millions of messages per second, or a negative
+// number if memory ran out.
+static double run(void *(*producer)(void *),
+    size_t (*consume)(size_t, void **), size_t num_producers,
+    size_t batch_size) {
+  size_t total = num_producers * MSGS_PER_PRODUCER;
+  pthread_t *threads = malloc(num_producers * sizeof(pthread_t));
+  Message *msgs = malloc(total * sizeof(Message));
+  void **batch = malloc(batch_size * sizeof(void *));
+  if (threads == NULL || msgs == NULL || batch == NULL) {
+    free(threads);
+    free(msgs);
+    free(batch);
+    return -1;
+  }
+  for (size_t i = 0; i < total; i++) {
+    msgs[i].producer = i / MSGS_PER_PRODUCER;
+    msgs[i].seq = i % MSGS_PER_PRODUCER;
+  }
+
+  pthread_barrier_init(&start_barrier, NULL, num_producers + 1);
+  for (size_t i = 0; i < num_producers; i++) {
+    if (pthread_create(&threads[i], NULL, producer,
+          &msgs[i * MSGS_PER_PRODUCER]) != 0) {
+      fprintf(stderr, "Couldn't start thread %zu\n", i);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  pthread_barrier_wait(&start_barrier);
+  uint64_t start = bench_now_ns();
+  for (size_t received = 0; received < total;) {
+    size_t n = consume(batch_size, batch);
+    // Let producers run if they're starved for CPU time
+    if (n == 0) sched_yield();
+    received += n;
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  for (size_t i = 0; i < num_producers; i++) pthread_join(threads[i], NULL);
+  pthread_barrier_destroy(&start_barrier);
+
+  free(threads);
+  free(msgs);
+  free(batch);
+  return (double)total / ((double)elapsed / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_producers = bench_size_arg(argc, argv, 1, 64);
+  size_t batch_size = bench_size_arg(argc, argv, 2, 64);
+  if (max_producers == 0 || batch_size == 0) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  queue = MPSCQueue_allocate();
+  locked_list = LinkedList_allocate();
+  if (queue == NULL || locked_list == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("batches of up to %zu\n", batch_size);
+  printf("%10s %16s %16s\n", "producers", "mpsc", "mutex");
+  for (size_t producers = 1; producers <= max_producers; producers *= 2) {
+    double queue_mmps =
+      run(&queue_producer, &queue_consume, producers, batch_size);
+    double locked_mmps =
+      run(&locked_producer, &locked_consume, producers, batch_size);
+    if (queue_mmps < 0 || locked_mmps < 0) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+    printf("%10zu %16.2f %16.2f\n", producers, queue_mmps, locked_mmps);
+  }
+
+  printf("(throughput in millions of messages/s received by the consumer)\n");
+  MPSCQueue_free(queue);
+  LinkedList_free(locked_list, NULL);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+/* Benchmarks PersistentHashMap snapshots against cloning a HashTable
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_persistent_hash_map [num_entries] [num_changes]
+//
+// Simulates a config that's reloaded over and over while readers hold on to
+// the previous version: each new version starts out as a copy of the current
+// one, then has `num_changes` (default 16) of its `num_entries` (default
+// 100000) keys changed, and the version before the current one is freed.
+// Reports the time per new version for a PersistentHashMap (a snapshot plus
+// the changes) and for a HashTable (cloned entry by entry, then changed),
+// along with the time to build each one from scratch and to look keys up.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "hash_table.h"
+#include "persistent_hash_map.h"
+
+#define NUM_VERSIONS 50
+#define NUM_FINDS 1000000
+
+// Copies every entry of `ht` into a new table, the way callers without
+// snapshots have to.
+static HashTable *clone_table(HashTable *ht) {
+  HashTable *clone = HashTable_allocate();
+  if (clone == NULL) return NULL;
+  if (!HashTable_reserve(clone, HashTable_num_elements(ht))) {
+    HashTable_free(clone, NULL);
+    return NULL;
+  }
+  HTIterator *hti = HTIterator_allocate(ht);
+  if (hti == NULL) {
+    HashTable_free(clone, NULL);
+    return NULL;
+  }
+  for (; HTIterator_is_valid(hti); HTIterator_next(hti)) {
+    const unsigned char *key;
+    size_t key_len;
+    HTValue value;
+    HTIterator_get(hti, &key, &key_len, &value);
+    HashTable_insert(clone, (unsigned char *)key, key_len, value, NULL);
+  }
+  HTIterator_free(hti);
+  return clone;
+}
+
+static void change_keys(uint64_t *rng, size_t num_entries, size_t num_changes,
+    HashTable *ht, PersistentHashMap *map) {
+  for (size_t i = 0; i < num_changes; i++) {
+    uint64_t key = bench_rand(rng) % num_entries;
+    HTValue value = (HTValue)(uintptr_t)bench_rand(rng);
+    if (ht != NULL) {
+      HashTable_insert(ht, (unsigned char *)&key, sizeof(key), value, NULL);
+    } else {
+      PersistentHashMap_insert(map, (unsigned char *)&key, sizeof(key),
+          value);
+    }
+  }
+}
+
+// Looks up NUM_FINDS random keys in whichever of `ht` or `map` isn't NULL.
+//
+// Returns the time per lookup, in nanoseconds.
+static double time_finds(size_t num_entries, HashTable *ht,
+    PersistentHashMap *map) {
+  uint64_t rng = 0xf1d5;
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < NUM_FINDS; i++) {
+    uint64_t key = bench_rand(&rng) % num_entries;
+    const void *value = ht != NULL ?
+      (const void *)HashTable_find(ht, (unsigned char *)&key, sizeof(key)) :
+      (const void *)PersistentHashMap_find(map, (unsigned char *)&key,
+          sizeof(key));
+    BENCH_KEEP(value);
+  }
+  return (double)(bench_now_ns() - start) / NUM_FINDS;
+}
+
+int main(int argc, char *argv[]) {
+  size_t num_entries = bench_size_arg(argc, argv, 1, 100000);
+  size_t num_changes = bench_size_arg(argc, argv, 2, 16);
+  if (num_entries == 0) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  // Build both from scratch
+  uint64_t start = bench_now_ns();
+  HashTable *ht = HashTable_allocate();
+  for (uint64_t key = 0; ht != NULL && key < num_entries; key++) {
+    HashTable_insert(ht, (unsigned char *)&key, sizeof(key),
+        (HTValue)(uintptr_t)key, NULL);
+  }
+  double ht_build_ns = (double)(bench_now_ns() - start) / num_entries;
+  start = bench_now_ns();
+  PersistentHashMap *map = PersistentHashMap_allocate(HT_HASH_SIPHASH, NULL);
+  for (uint64_t key = 0; map != NULL && key < num_entries; key++) {
+    PersistentHashMap_insert(map, (unsigned char *)&key, sizeof(key),
+        (HTValue)(uintptr_t)key);
+  }
+  double map_build_ns = (double)(bench_now_ns() - start) / num_entries;
+  if (ht == NULL || map == NULL ||
+      HashTable_num_elements(ht) != (int)num_entries ||
+      PersistentHashMap_num_elements(map) != (int)num_entries) {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  // New versions, keeping the previous one alive like a reader would
+  uint64_t rng = 0x5eed;
+  HashTable *ht_prev = NULL;
+  start = bench_now_ns();
+  for (int v = 0; v < NUM_VERSIONS; v++) {
+    HashTable *next = clone_table(ht);
+    if (next == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+    change_keys(&rng, num_entries, num_changes, next, NULL);
+    HashTable_free(ht_prev, NULL);
+    ht_prev = ht;
+    ht = next;
+  }
+  double ht_version_us = (double)(bench_now_ns() - start) / NUM_VERSIONS /
+    1000;
+
+  rng = 0x5eed;
+  PersistentHashMap *map_prev = NULL;
+  start = bench_now_ns();
+  for (int v = 0; v < NUM_VERSIONS; v++) {
+    PersistentHashMap *next = PersistentHashMap_snapshot(map);
+    if (next == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+    change_keys(&rng, num_entries, num_changes, NULL, next);
+    PersistentHashMap_free(map_prev);
+    map_prev = map;
+    map = next;
+  }
+  double map_version_us = (double)(bench_now_ns() - start) / NUM_VERSIONS /
+    1000;
+
+  double ht_find_ns = time_finds(num_entries, ht, NULL);
+  double map_find_ns = time_finds(num_entries, NULL, map);
+
+  printf("%zu entries, %zu changes per version\n", num_entries, num_changes);
+  printf("%18s %14s %14s %12s\n", "", "build ns/key", "version us",
+      "find ns");
+  printf("%18s %14.1f %14.2f %12.1f\n", "HashTable clone", ht_build_ns,
+      ht_version_us, ht_find_ns);
+  printf("%18s %14.1f %14.2f %12.1f\n", "PersistentHashMap", map_build_ns,
+      map_version_us, map_find_ns);
+
+  HashTable_free(ht_prev, NULL);
+  HashTable_free(ht, NULL);
+  PersistentHashMap_free(map_prev);
+  PersistentHashMap_free(map);
+  return EXIT_SUCCESS;
+}
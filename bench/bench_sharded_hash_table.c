@@ -0,0 +1,194 @@
+/* Benchmarks ShardedHashTable counter updates as the number of threads grows
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_sharded_hash_table [max_threads] [num_keys]
+//
+// For 1, 2, 4, ... up to `max_threads` (default 64) threads, reports the total
+// throughput of threads incrementing counters for random keys out of
+// `num_keys` (default 1000) keys. The same workload is run against a
+// ShardedHashTable with a shard per thread, the same again with another
+// thread merging it as fast as it can, and, as a baseline, a HashTable
+// guarded by a pthread_mutex_t.
+
+#define _XOPEN_SOURCE 700
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench_util.h"
+#include "hash_table.h"
+#include "sharded_hash_table.h"
+
+#define OPS_PER_THREAD 500000
+
+typedef struct {
+  uint64_t seed;
+  int shard;
+  size_t num_keys;
+} WorkerArgs;
+
+static pthread_barrier_t start_barrier;
+
+static ShardedHashTable *sht;
+static HashTable *locked_ht;
+static pthread_mutex_t ht_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_bool workers_done;
+
+static void *sharded_worker(void *arg) {
+  WorkerArgs *args = arg;
+  uint64_t rng = args->seed;
+  pthread_barrier_wait(&start_barrier);
+  for (int i = 0; i < OPS_PER_THREAD; i++) {
+    uint64_t key = bench_rand(&rng) % args->num_keys;
+    ShardedHashTable_add(sht, args->shard, (unsigned char *)&key, sizeof(key),
+        1);
+  }
+  return NULL;
+}
+
+static void *locked_worker(void *arg) {
+  WorkerArgs *args = arg;
+  uint64_t rng = args->seed;
+  pthread_barrier_wait(&start_barrier);
+  for (int i = 0; i < OPS_PER_THREAD; i++) {
+    uint64_t key = bench_rand(&rng) % args->num_keys;
+    pthread_mutex_lock(&ht_lock);
+    HTValue *slot = HashTable_entry(locked_ht, (unsigned char *)&key,
+        sizeof(key), NULL);
+    if (slot != NULL) {
+      int64_t count;
+      memcpy(&count, slot, sizeof(count));
+      count++;
+      memcpy(slot, &count, sizeof(count));
+    }
+    pthread_mutex_unlock(&ht_lock);
+  }
+  return NULL;
+}
+
+static void *merger(void *arg) {
+  (void)arg;
+  while (!atomic_load(&workers_done)) ShardedHashTable_merge(sht);
+  return NULL;
+}
+
+// Runs `worker` on `num_threads` threads at once, each with its own shard,
+// plus a thread merging `sht` throughout if `merging` is set.
+//
+// Returns the total throughput, in millions of increments per second, or a
+// negative number if memory ran out.
+static double run(void *(*worker)(void *), size_t num_threads,
+    size_t num_keys, bool merging) {
+  pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+  WorkerArgs *args = malloc(num_threads * sizeof(WorkerArgs));
+  if (threads == NULL || args == NULL) {
+    free(threads);
+    free(args);
+    return -1;
+  }
+
+  atomic_store(&workers_done, false);
+  pthread_t merger_thread;
+  if (merging && pthread_create(&merger_thread, NULL, &merger, NULL) != 0) {
+    fprintf(stderr, "Couldn't start merger thread\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+  for (size_t i = 0; i < num_threads; i++) {
+    args[i].seed = 0x5eed + i;
+    args[i].shard = (int)i;
+    args[i].num_keys = num_keys;
+    if (pthread_create(&threads[i], NULL, worker, &args[i]) != 0) {
+      fprintf(stderr, "Couldn't start thread %zu\n", i);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  pthread_barrier_wait(&start_barrier);
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < num_threads; i++) pthread_join(threads[i], NULL);
+  uint64_t elapsed = bench_now_ns() - start;
+  atomic_store(&workers_done, true);
+  if (merging) pthread_join(merger_thread, NULL);
+  pthread_barrier_destroy(&start_barrier);
+
+  free(threads);
+  free(args);
+  return (double)num_threads * OPS_PER_THREAD / ((double)elapsed / 1e3);
+}
+
+// Returns the sum of every counter in `sht`, which should be the total number
+// of increments made.
+static int64_t sharded_total(size_t num_keys) {
+  int64_t total = 0;
+  for (uint64_t key = 0; key < num_keys; key++) {
+    total += ShardedHashTable_get(sht, (unsigned char *)&key, sizeof(key));
+  }
+  return total;
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_threads = bench_size_arg(argc, argv, 1, 64);
+  size_t num_keys = bench_size_arg(argc, argv, 2, 1000);
+  if (num_keys == 0) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%zu keys\n", num_keys);
+  printf("%8s %16s %16s %16s\n", "threads", "sharded", "sharded+merge",
+      "mutex");
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    double mops[3];
+    for (int merging = 0; merging <= 1; merging++) {
+      sht = ShardedHashTable_allocate((int)threads);
+      if (sht == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+      }
+      mops[merging] = run(&sharded_worker, threads, num_keys, merging);
+      if (sharded_total(num_keys) != (int64_t)threads * OPS_PER_THREAD) {
+        fprintf(stderr, "Lost counts with %zu threads\n", threads);
+        return EXIT_FAILURE;
+      }
+      ShardedHashTable_free(sht);
+    }
+
+    locked_ht = HashTable_allocate();
+    if (locked_ht == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+    mops[2] = run(&locked_worker, threads, num_keys, false);
+    HashTable_free(locked_ht, NULL);
+
+    if (mops[0] < 0 || mops[1] < 0 || mops[2] < 0) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+    printf("%8zu %16.2f %16.2f %16.2f\n", threads, mops[0], mops[1], mops[2]);
+  }
+
+  printf("(throughput in millions of increments/s, summed over all threads)\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,138 @@
+/* Benchmarks slab allocation against malloc for HashTable and LinkedList
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_slab [num_entries]
+//
+// Reports the per-operation cost of filling a chained HashTable with
+// `num_entries` (default 1M) entries, churning it by removing and reinserting
+// random keys, and freeing it, with and without HTOptions.use_slab (the best
+// of a few runs of each). Also reports the cost of LinkedList_append and
+// LinkedList_pop_head on lists whose nodes are allocated with malloc and from
+// a Slab.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "hash_table.h"
+#include "linked_list.h"
+#include "slab.h"
+
+#define LIST_OPS 1000000
+#define ROUNDS 3
+
+// Fills, churns and frees a chained HashTable with `num_entries` entries.
+//
+// times - Set to the per-entry cost of each of those phases, in ns.
+//
+// Returns false if out of memory.
+static bool time_table(size_t num_entries, bool use_slab, double times[3]) {
+  HTOptions opts;
+  HTOptions_init(&opts);
+  opts.engine = HT_ENGINE_CHAINED;
+  opts.use_slab = use_slab;
+  HashTable *ht = HashTable_allocate_with_options(&opts);
+  if (ht == NULL) return false;
+
+  uint64_t start = bench_now_ns();
+  for (uint64_t key = 0; key < num_entries; key++) {
+    HashTable_insert(ht, (unsigned char *)&key, sizeof(key), (HTValue)key,
+        NULL);
+  }
+  times[0] = (double)(bench_now_ns() - start) / num_entries;
+
+  uint64_t rng = 0x5eed;
+  start = bench_now_ns();
+  for (size_t i = 0; i < num_entries; i++) {
+    uint64_t key = bench_rand(&rng) % num_entries;
+    HashTable_remove(ht, (unsigned char *)&key, sizeof(key), NULL);
+    HashTable_insert(ht, (unsigned char *)&key, sizeof(key), (HTValue)key,
+        NULL);
+  }
+  times[1] = (double)(bench_now_ns() - start) / num_entries;
+
+  start = bench_now_ns();
+  HashTable_free(ht, NULL);
+  times[2] = (double)(bench_now_ns() - start) / num_entries;
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  size_t num_entries = bench_size_arg(argc, argv, 1, 1000000);
+  if (num_entries == 0) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  // How much the heap has already been used skews the results, so run each
+  // configuration a few times, alternating between them, and keep the best.
+  double best[2][3];
+  for (int round = 0; round < ROUNDS; round++) {
+    for (int use_slab = 0; use_slab <= 1; use_slab++) {
+      double times[3];
+      if (!time_table(num_entries, use_slab, times)) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+      }
+      for (int i = 0; i < 3; i++) {
+        if (round == 0 || times[i] < best[use_slab][i]) {
+          best[use_slab][i] = times[i];
+        }
+      }
+    }
+  }
+
+  printf("%zu entries\n", num_entries);
+  printf("%8s %12s %12s %12s\n", "alloc", "insert", "churn", "free");
+  for (int use_slab = 0; use_slab <= 1; use_slab++) {
+    printf("%8s %12.1f %12.1f %12.1f\n", use_slab ? "slab" : "malloc",
+        best[use_slab][0], best[use_slab][1], best[use_slab][2]);
+  }
+  printf("(HashTable, ns/entry; churn is a remove plus an insert)\n\n");
+
+  printf("%8s %12s %12s\n", "alloc", "append", "pop head");
+  Slab *slab = Slab_allocate(LinkedList_node_size());
+  for (int use_slab = 0; use_slab <= 1; use_slab++) {
+    LinkedList *list = LinkedList_allocate_with_slab(use_slab ? slab : NULL);
+    if (slab == NULL || list == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+
+    uint64_t start = bench_now_ns();
+    for (uintptr_t i = 0; i < LIST_OPS; i++) {
+      LinkedList_append(list, (LLPayload)i);
+    }
+    double append_ns = (double)(bench_now_ns() - start) / LIST_OPS;
+
+    start = bench_now_ns();
+    LLPayload payload;
+    while (LinkedList_pop_head(list, &payload)) BENCH_KEEP(payload);
+    double pop_ns = (double)(bench_now_ns() - start) / LIST_OPS;
+
+    printf("%8s %12.1f %12.1f\n", use_slab ? "slab" : "malloc", append_ns,
+        pop_ns);
+    LinkedList_free(list, NULL);
+  }
+  Slab_free(slab);
+  printf("(LinkedList, ns/op)\n");
+  return EXIT_SUCCESS;
+}
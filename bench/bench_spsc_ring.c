@@ -0,0 +1,191 @@
+/* Benchmarks SPSCRing against a Deque guarded by a mutex
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_spsc_ring [num_msgs] [capacity]
+//
+// Passes `num_msgs` (default 10000000) messages from a producer thread to a
+// consumer thread through a queue holding at most `capacity` (default 1024)
+// of them, moving several batch sizes' worth at a time. Three queues are
+// compared:
+// - ring:  an SPSCRing; both sides yield the CPU when they can't make
+//   progress.
+// - wait:  an SPSCRing allocated with wakeups, whose consumer sleeps in
+//   SPSCRing_wait when the ring is empty.
+// - mutex: a Deque guarded by a pthread_mutex_t, which takes the lock once
+//   per batch.
+// Reports the throughput in millions of messages per second.
+
+#define _XOPEN_SOURCE 700
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "deque.h"
+#include "spsc_ring.h"
+
+#define NUM_BATCHES (sizeof(batches) / sizeof(batches[0]))
+#define MAX_BATCH 256
+
+static const size_t batches[] = {1, 16, 256};
+
+typedef enum {
+  QUEUE_RING,
+  QUEUE_WAIT,
+  QUEUE_MUTEX,
+} QueueKind;
+
+typedef struct {
+  QueueKind kind;
+  size_t num_msgs;
+  size_t capacity;
+  size_t batch;
+  SPSCRing *ring;
+  Deque *dq;
+  pthread_mutex_t lock;
+} Run;
+
+// Moves up to `num` messages into the queue. Returns how many were moved.
+static size_t produce_batch(Run *run, void **msgs, size_t num) {
+  if (run->kind != QUEUE_MUTEX) {
+    if (num == 1) return SPSCRing_push(run->ring, msgs[0]) ? 1 : 0;
+    return SPSCRing_push_many(run->ring, msgs, num);
+  }
+
+  pthread_mutex_lock(&run->lock);
+  size_t space = run->capacity - Deque_num_elements(run->dq);
+  if (num > space) num = space;
+  for (size_t i = 0; i < num; i++) {
+    if (!Deque_append(run->dq, msgs[i])) {
+      fprintf(stderr, "Out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  pthread_mutex_unlock(&run->lock);
+  return num;
+}
+
+// Moves up to `max` messages out of the queue. Returns how many were moved.
+static size_t consume_batch(Run *run, void **msgs, size_t max) {
+  if (run->kind != QUEUE_MUTEX) {
+    if (max == 1) return SPSCRing_pop(run->ring, &msgs[0]) ? 1 : 0;
+    return SPSCRing_pop_many(run->ring, msgs, max);
+  }
+
+  size_t num = 0;
+  pthread_mutex_lock(&run->lock);
+  while (num < max && Deque_pop_head(run->dq, &msgs[num])) num++;
+  pthread_mutex_unlock(&run->lock);
+  return num;
+}
+
+static void *producer(void *arg) {
+  Run *run = arg;
+  void *msgs[MAX_BATCH];
+  uintptr_t next = 1;
+  while (next <= run->num_msgs) {
+    size_t num = run->batch;
+    if (num > run->num_msgs - next + 1) num = run->num_msgs - next + 1;
+    for (size_t i = 0; i < num; i++) msgs[i] = (void *)(next + i);
+    size_t moved = produce_batch(run, msgs, num);
+    if (moved == 0) sched_yield();
+    next += moved;
+  }
+  return NULL;
+}
+
+// Returns the throughput, in millions of messages per second, or a negative
+// number if the queue couldn't be set up.
+static double time_run(QueueKind kind, size_t num_msgs, size_t capacity,
+    size_t batch) {
+  Run run = {
+    .kind = kind,
+    .num_msgs = num_msgs,
+    .capacity = capacity,
+    .batch = batch,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+  };
+  if (kind == QUEUE_MUTEX) {
+    run.dq = Deque_allocate();
+    if (run.dq == NULL) return -1;
+  } else {
+    run.ring = SPSCRing_allocate(capacity, kind == QUEUE_WAIT);
+    if (run.ring == NULL) return -1;
+  }
+
+  uint64_t start = bench_now_ns();
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, &producer, &run) != 0) {
+    fprintf(stderr, "Couldn't start producer thread\n");
+    exit(EXIT_FAILURE);
+  }
+  void *msgs[MAX_BATCH];
+  for (size_t received = 0; received < num_msgs;) {
+    size_t num = consume_batch(&run, msgs, batch);
+    if (num == 0) {
+      if (kind == QUEUE_WAIT) {
+        SPSCRing_wait(run.ring, -1);
+      } else {
+        sched_yield();
+      }
+    }
+    for (size_t i = 0; i < num; i++) BENCH_KEEP(msgs[i]);
+    received += num;
+  }
+  pthread_join(thread, NULL);
+  uint64_t elapsed = bench_now_ns() - start;
+
+  SPSCRing_free(run.ring, NULL);
+  Deque_free(run.dq, NULL);
+  return (double)num_msgs / ((double)elapsed / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+  size_t num_msgs = bench_size_arg(argc, argv, 1, 10000000);
+  size_t capacity = bench_size_arg(argc, argv, 2, 1024);
+  if (num_msgs == 0 || capacity == 0) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%8s %12s %12s %12s\n", "batch", "ring", "wait", "mutex");
+  for (size_t b = 0; b < NUM_BATCHES; b++) {
+    size_t batch = batches[b] < capacity ? batches[b] : capacity;
+    double results[] = {
+      time_run(QUEUE_RING, num_msgs, capacity, batch),
+      time_run(QUEUE_WAIT, num_msgs, capacity, batch),
+      time_run(QUEUE_MUTEX, num_msgs, capacity, batch),
+    };
+    for (size_t i = 0; i < sizeof(results) / sizeof(results[0]); i++) {
+      if (results[i] < 0) {
+        fprintf(stderr, "Couldn't allocate a queue\n");
+        return EXIT_FAILURE;
+      }
+    }
+    printf("%8zu %12.2f %12.2f %12.2f\n", batch, results[0], results[1],
+        results[2]);
+  }
+
+  printf("(throughput in millions of messages/s)\n");
+  return EXIT_SUCCESS;
+}
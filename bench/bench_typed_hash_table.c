@@ -0,0 +1,149 @@
+/* Benchmarks a DEFINE_HASHTABLE table against HashTable with integer keys
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_typed_hash_table [max_entries]
+//
+// For tables of 1000, 10000, ... up to `max_entries` (default 1M) entries
+// keyed by uint32_t, reports the per-operation cost of inserts, successful
+// lookups, failed lookups and removals for a table generated by
+// DEFINE_HASHTABLE and for a HashTable using each HTEngine (with wyhash, the
+// fastest of its hash functions).
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "hash_table.h"
+#include "typed_hash_table.h"
+
+#define LOOKUPS 1000000
+
+DEFINE_HASHTABLE(U32Table, uint32_t, uint32_t, TypedHT_hash_u32, TYPED_HT_EQ)
+
+typedef struct {
+  double insert_ns;
+  double hit_ns;
+  double miss_ns;
+  double remove_ns;
+} Timings;
+
+static void print_row(size_t n, const char *name, const Timings *t) {
+  printf("%10zu %8s %10.1f %10.1f %10.1f %10.1f\n", n, name, t->insert_ns,
+      t->hit_ns, t->miss_ns, t->remove_ns);
+}
+
+// Returns false if memory ran out.
+static bool time_typed(uint32_t n, Timings *t) {
+  U32Table *ut = U32Table_allocate();
+  if (ut == NULL) return false;
+
+  uint64_t start = bench_now_ns();
+  for (uint32_t key = 0; key < n; key++) U32Table_insert(ut, key, key, NULL);
+  t->insert_ns = (double)(bench_now_ns() - start) / n;
+
+  uint64_t rng = 0x5eed;
+  start = bench_now_ns();
+  for (int i = 0; i < LOOKUPS; i++) {
+    uint32_t key = bench_rand(&rng) % n;
+    BENCH_KEEP(U32Table_find(ut, key));
+  }
+  t->hit_ns = (double)(bench_now_ns() - start) / LOOKUPS;
+
+  start = bench_now_ns();
+  for (int i = 0; i < LOOKUPS; i++) {
+    uint32_t key = n + bench_rand(&rng) % n;
+    BENCH_KEEP(U32Table_find(ut, key));
+  }
+  t->miss_ns = (double)(bench_now_ns() - start) / LOOKUPS;
+
+  start = bench_now_ns();
+  for (uint32_t key = 0; key < n; key++) U32Table_remove(ut, key, NULL);
+  t->remove_ns = (double)(bench_now_ns() - start) / n;
+
+  U32Table_free(ut, NULL);
+  return true;
+}
+
+// Returns false if memory ran out.
+static bool time_generic(uint32_t n, HTEngine engine, Timings *t) {
+  HTOptions opts;
+  HTOptions_init(&opts);
+  opts.engine = engine;
+  opts.hash_fn = HT_HASH_WYHASH;
+  HashTable *ht = HashTable_allocate_with_options(&opts);
+  if (ht == NULL) return false;
+
+  uint64_t start = bench_now_ns();
+  for (uint32_t key = 0; key < n; key++) {
+    HashTable_insert(ht, (unsigned char *)&key, sizeof(key),
+        (HTValue)(uintptr_t)key, NULL);
+  }
+  t->insert_ns = (double)(bench_now_ns() - start) / n;
+
+  uint64_t rng = 0x5eed;
+  start = bench_now_ns();
+  for (int i = 0; i < LOOKUPS; i++) {
+    uint32_t key = bench_rand(&rng) % n;
+    BENCH_KEEP(HashTable_find(ht, (unsigned char *)&key, sizeof(key)));
+  }
+  t->hit_ns = (double)(bench_now_ns() - start) / LOOKUPS;
+
+  start = bench_now_ns();
+  for (int i = 0; i < LOOKUPS; i++) {
+    uint32_t key = n + bench_rand(&rng) % n;
+    BENCH_KEEP(HashTable_find(ht, (unsigned char *)&key, sizeof(key)));
+  }
+  t->miss_ns = (double)(bench_now_ns() - start) / LOOKUPS;
+
+  start = bench_now_ns();
+  for (uint32_t key = 0; key < n; key++) {
+    HashTable_remove(ht, (unsigned char *)&key, sizeof(key), NULL);
+  }
+  t->remove_ns = (double)(bench_now_ns() - start) / n;
+
+  HashTable_free(ht, NULL);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_entries = bench_size_arg(argc, argv, 1, 1000000);
+  if (max_entries > UINT32_MAX / 2) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%10s %8s %10s %10s %10s %10s\n", "entries", "table", "insert",
+      "find hit", "find miss", "remove");
+  for (size_t n = 1000; n <= max_entries; n *= 10) {
+    Timings typed, chained, open;
+    if (!time_typed(n, &typed) ||
+        !time_generic(n, HT_ENGINE_CHAINED, &chained) ||
+        !time_generic(n, HT_ENGINE_OPEN, &open)) {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+    }
+    print_row(n, "typed", &typed);
+    print_row(n, "chained", &chained);
+    print_row(n, "open", &open);
+  }
+
+  printf("(all times in ns/op)\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,63 @@
+/* Definitions of helpers shared by the benchmarks
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "bench_util.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+uint64_t bench_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t bench_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1D;
+}
+
+size_t bench_size_arg(int argc, char *argv[], int idx, size_t fallback) {
+  if (idx >= argc) return fallback;
+
+  char *end;
+  unsigned long long parsed = strtoull(argv[idx], &end, 10);
+  if (end == argv[idx] || *end != '\0') return fallback;
+  return (size_t)parsed;
+}
+
+size_t bench_rss_bytes() {
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm == NULL) return 0;
+  unsigned long long total_pages, resident_pages;
+  int parsed = fscanf(statm, "%llu %llu", &total_pages, &resident_pages);
+  fclose(statm);
+  if (parsed != 2) return 0;
+  return (size_t)resident_pages * (size_t)sysconf(_SC_PAGESIZE);
+}
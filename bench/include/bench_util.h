@@ -0,0 +1,51 @@
+/* Declares helpers shared by the benchmarks
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SUPER_GLUE_BENCH_INCLUDE_BENCH_UTIL_H_
+#define SUPER_GLUE_BENCH_INCLUDE_BENCH_UTIL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Returns the current time of a monotonic clock, in nanoseconds.
+uint64_t bench_now_ns();
+
+// Returns the next number from a fast, non-cryptographic PRNG (xorshift64*).
+//
+// state - The generator's state. Must be initialized to a nonzero value.
+uint64_t bench_rand(uint64_t *state);
+
+// Parses an optional size argument given on the command line.
+//
+// argc     - The argc passed to main.
+// argv     - The argv passed to main.
+// idx      - The index of the argument to parse.
+// fallback - Returned if there is no argument at `idx` or it isn't a number.
+//
+// Returns the parsed argument, or `fallback`.
+size_t bench_size_arg(int argc, char *argv[], int idx, size_t fallback);
+
+// Returns the resident set size of the current process, in bytes, or 0 if it
+// can't be determined (it's read from /proc, so this only works on Linux).
+size_t bench_rss_bytes();
+
+// Prevents the compiler from optimizing away the computation of `value`.
+#define BENCH_KEEP(value) __asm__ volatile("" : : "r"(value) : "memory")
+
+#endif  // SUPER_GLUE_BENCH_INCLUDE_BENCH_UTIL_H_
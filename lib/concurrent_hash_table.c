@@ -0,0 +1,384 @@
+/* Provides a hash table that can be shared between threads.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "concurrent_hash_table.h"
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "epoch.h"
+#include "hash_table_internal.h"
+
+// Must be a power of two. Writers only contend with each other when their keys
+// land in the same stripe.
+#define NUM_STRIPES 64
+// Must be a power of two, and at least NUM_STRIPES. Since the stripe of a key
+// is given by the low bits of its hash, just like its bucket, this guarantees
+// every bucket belongs to exactly one stripe.
+#define DEFAULT_BUCKETS 64
+// The table grows once any stripe has more than this many elements per bucket
+// that belongs to it. Checking per stripe means writers never have to touch a
+// shared counter.
+#define MAX_STRIPE_LOAD_FACTOR 2
+
+// An entry in the table. Everything except `next` and `value` is immutable
+// once the node has been published, so readers can look at it without locks.
+typedef struct CHTNode {
+  EpochEntry retire;  // Must be first, see node_reclaim
+  _Atomic(struct CHTNode *) next;
+  Hash64 hash;
+  _Atomic(HTValue) value;
+  size_t key_len;
+  unsigned char key[];
+} CHTNode;
+
+// A bucket array. Readers load the current one once per lookup, and keep using
+// it even if the table is grown in the meantime.
+typedef struct {
+  EpochEntry retire;  // Must be first, see buckets_reclaim
+  size_t num_buckets;  // Always a power of two
+  _Atomic(CHTNode *) buckets[];
+} CHTBuckets;
+
+typedef struct {
+  alignas(64) pthread_mutex_t lock;
+  // Only modified while holding `lock`, but atomic so that
+  // ConcurrentHashTable_num_elements can read it without locking.
+  atomic_int num_elems;
+} CHTStripe;
+
+// Typedef'd to ConcurrentHashTable in concurrent_hash_table.h
+//
+// The bucket array can only be replaced while holding every stripe lock, so
+// writers holding any one of them see a stable bucket array. Readers don't
+// take any locks, and rely on epoch-based reclamation to make sure nodes and
+// bucket arrays aren't freed while they might still be looking at them.
+struct _CHT {
+  _Atomic(CHTBuckets *) buckets;
+  HashFunction hash;
+  CHTStripe stripes[NUM_STRIPES];
+};
+
+// Gets true key length (helper if user passes key_len = 0 => strlen(key))
+static inline size_t get_true_key_len(const unsigned char *key,
+    size_t key_len);
+// Allocates a bucket array with `num_buckets` empty buckets.
+static CHTBuckets *buckets_allocate(size_t num_buckets);
+// Frees a bucket array and every node in it. Must only be used once no other
+// thread can be reading it.
+static void buckets_free(CHTBuckets *buckets, HTValue_free value_free);
+// Epoch_reclaim callback for retired bucket arrays.
+static void buckets_reclaim(EpochEntry *entry);
+// Allocates a new node, copying the given key into it.
+static CHTNode *node_allocate(Hash64 hash, const unsigned char *key,
+    size_t key_len, HTValue value);
+// Epoch_reclaim callback for removed nodes.
+static void node_reclaim(EpochEntry *entry);
+// Checks if `node` holds the given key. The key itself is only compared if
+// COLLISION_RESIST is enabled.
+static inline bool node_matches(const CHTNode *node, Hash64 hash,
+    const unsigned char *key, size_t key_len);
+// Finds the node holding the given key.
+//
+// link_out - If not NULL, set to the link (either a bucket or some node's
+//            `next`) that pointed to the returned node, or to the NULL at the
+//            end of the chain if there's no such node. Only meaningful to
+//            writers, since other writers can't change it under them.
+//
+// Returns the node holding the key, or NULL if there isn't one.
+static CHTNode *find_node(CHTBuckets *buckets, Hash64 hash,
+    const unsigned char *key, size_t key_len, _Atomic(CHTNode *) **link_out);
+// Returns a copy of `old` with twice as many buckets, which holds a copy of
+// every node in `old`, or NULL if memory couldn't be allocated. Readers may
+// still be walking the chains in `old`, so its nodes can't just be relinked.
+static CHTBuckets *copy_buckets(CHTBuckets *old);
+// Doubles the number of buckets, unless the bucket array has already been
+// replaced since the caller saw `seen`. The old bucket array and its nodes are
+// retired, to be reclaimed once no reader can be using them. Does nothing if
+// memory can't be allocated for the new bucket array.
+static void grow(ConcurrentHashTable *cht, CHTBuckets *seen);
+
+static inline size_t get_true_key_len(const unsigned char *key,
+    size_t key_len) {
+  return key_len != 0 ? key_len : strlen((const char *)key);
+}
+
+static CHTBuckets *buckets_allocate(size_t num_buckets) {
+  CHTBuckets *buckets =
+    calloc(1, sizeof(CHTBuckets) + num_buckets * sizeof(_Atomic(CHTNode *)));
+  if (buckets == NULL) return NULL;
+  buckets->num_buckets = num_buckets;
+  return buckets;
+}
+
+static void buckets_free(CHTBuckets *buckets, HTValue_free value_free) {
+  for (size_t i = 0; i < buckets->num_buckets; i++) {
+    CHTNode *node =
+      atomic_load_explicit(&buckets->buckets[i], memory_order_relaxed);
+    while (node != NULL) {
+      CHTNode *next = atomic_load_explicit(&node->next, memory_order_relaxed);
+      if (value_free != NULL) {
+        value_free(atomic_load_explicit(&node->value, memory_order_relaxed));
+      }
+      free(node);
+      node = next;
+    }
+  }
+  free(buckets);
+}
+
+static void buckets_reclaim(EpochEntry *entry) {
+  // Values were carried over to the new bucket array, so they stay alive.
+  buckets_free((CHTBuckets *)entry, NULL);
+}
+
+static CHTNode *node_allocate(Hash64 hash, const unsigned char *key,
+    size_t key_len, HTValue value) {
+  CHTNode *node = malloc(sizeof(CHTNode) + key_len);
+  if (node == NULL) return NULL;
+  atomic_init(&node->next, NULL);
+  node->hash = hash;
+  atomic_init(&node->value, value);
+  node->key_len = key_len;
+  memcpy(node->key, key, key_len);
+  return node;
+}
+
+static void node_reclaim(EpochEntry *entry) {
+  free(entry);
+}
+
+static inline bool node_matches(const CHTNode *node, Hash64 hash,
+    const unsigned char *key, size_t key_len) {
+  if (node->hash != hash) return false;
+#if COLLISION_RESIST
+  return node->key_len == key_len && memcmp(node->key, key, key_len) == 0;
+#else
+  (void)key;
+  (void)key_len;
+  return true;
+#endif
+}
+
+static CHTNode *find_node(CHTBuckets *buckets, Hash64 hash,
+    const unsigned char *key, size_t key_len, _Atomic(CHTNode *) **link_out) {
+  _Atomic(CHTNode *) *link =
+    &buckets->buckets[hash & (buckets->num_buckets - 1)];
+  CHTNode *node;
+  while ((node = atomic_load_explicit(link, memory_order_acquire)) != NULL) {
+    if (node_matches(node, hash, key, key_len)) break;
+    link = &node->next;
+  }
+  if (link_out != NULL) *link_out = link;
+  return node;
+}
+
+ConcurrentHashTable *ConcurrentHashTable_allocate(HTHashFn hash_fn) {
+  HashFunction hash = HashFunction_get(hash_fn);
+  if (hash == NULL) return NULL;
+
+  ConcurrentHashTable *cht =
+    aligned_alloc(alignof(ConcurrentHashTable), sizeof(ConcurrentHashTable));
+  if (cht == NULL) return NULL;
+
+  CHTBuckets *buckets = buckets_allocate(DEFAULT_BUCKETS);
+  if (buckets == NULL) {
+    free(cht);
+    return NULL;
+  }
+  atomic_init(&cht->buckets, buckets);
+  cht->hash = hash;
+  for (int i = 0; i < NUM_STRIPES; i++) {
+    pthread_mutex_init(&cht->stripes[i].lock, NULL);
+    atomic_init(&cht->stripes[i].num_elems, 0);
+  }
+  return cht;
+}
+
+void ConcurrentHashTable_free(ConcurrentHashTable *cht,
+    HTValue_free value_free) {
+  if (cht == NULL) return;
+  buckets_free(atomic_load(&cht->buckets), value_free);
+  for (int i = 0; i < NUM_STRIPES; i++) {
+    pthread_mutex_destroy(&cht->stripes[i].lock);
+  }
+  free(cht);
+}
+
+int ConcurrentHashTable_num_elements(ConcurrentHashTable *cht) {
+  if (cht == NULL) return -1;
+  int num_elems = 0;
+  for (int i = 0; i < NUM_STRIPES; i++) {
+    num_elems += atomic_load_explicit(&cht->stripes[i].num_elems,
+        memory_order_relaxed);
+  }
+  return num_elems;
+}
+
+bool ConcurrentHashTable_insert(ConcurrentHashTable *cht, unsigned char *key,
+    size_t key_len, HTValue new_value, HTValue *old_value) {
+  if (cht == NULL || key == NULL) return false;
+
+  size_t true_key_len = get_true_key_len(key, key_len);
+  Hash64 hash = cht->hash(key, true_key_len);
+  CHTStripe *stripe = &cht->stripes[hash & (NUM_STRIPES - 1)];
+
+  pthread_mutex_lock(&stripe->lock);
+  // The bucket array can't change while we hold a stripe lock
+  CHTBuckets *buckets =
+    atomic_load_explicit(&cht->buckets, memory_order_relaxed);
+  CHTNode *node = find_node(buckets, hash, key, true_key_len, NULL);
+  if (node != NULL) {
+    HTValue prev = atomic_exchange_explicit(&node->value, new_value,
+        memory_order_acq_rel);
+    pthread_mutex_unlock(&stripe->lock);
+    if (old_value != NULL) *old_value = prev;
+    return true;
+  }
+
+  // FIXME like HashTable_insert, there's no way to report allocation failure
+  // to the caller.
+  node = node_allocate(hash, key, true_key_len, new_value);
+  if (node == NULL) {
+    pthread_mutex_unlock(&stripe->lock);
+    return false;
+  }
+
+  // New nodes go at the head of the bucket. Once `node` is published with the
+  // release store, readers are guaranteed to see it fully initialized.
+  _Atomic(CHTNode *) *head =
+    &buckets->buckets[hash & (buckets->num_buckets - 1)];
+  atomic_store_explicit(&node->next,
+      atomic_load_explicit(head, memory_order_relaxed), memory_order_relaxed);
+  atomic_store_explicit(head, node, memory_order_release);
+
+  int stripe_elems = atomic_load_explicit(&stripe->num_elems,
+      memory_order_relaxed) + 1;
+  atomic_store_explicit(&stripe->num_elems, stripe_elems,
+      memory_order_relaxed);
+  pthread_mutex_unlock(&stripe->lock);
+
+  size_t stripe_buckets = buckets->num_buckets / NUM_STRIPES;
+  if ((size_t)stripe_elems > stripe_buckets * MAX_STRIPE_LOAD_FACTOR) {
+    grow(cht, buckets);
+  }
+  return false;
+}
+
+bool ConcurrentHashTable_find(ConcurrentHashTable *cht, unsigned char *key,
+    size_t key_len, HTValue *value_out) {
+  if (cht == NULL || key == NULL) return false;
+
+  size_t true_key_len = get_true_key_len(key, key_len);
+  Hash64 hash = cht->hash(key, true_key_len);
+
+  Epoch_enter();
+  CHTBuckets *buckets =
+    atomic_load_explicit(&cht->buckets, memory_order_acquire);
+  CHTNode *node = find_node(buckets, hash, key, true_key_len, NULL);
+  if (node != NULL && value_out != NULL) {
+    *value_out = atomic_load_explicit(&node->value, memory_order_acquire);
+  }
+  Epoch_exit();
+
+  return node != NULL;
+}
+
+bool ConcurrentHashTable_remove(ConcurrentHashTable *cht, unsigned char *key,
+    size_t key_len, HTValue *old_value) {
+  if (cht == NULL || key == NULL) return false;
+
+  size_t true_key_len = get_true_key_len(key, key_len);
+  Hash64 hash = cht->hash(key, true_key_len);
+  CHTStripe *stripe = &cht->stripes[hash & (NUM_STRIPES - 1)];
+
+  pthread_mutex_lock(&stripe->lock);
+  CHTBuckets *buckets =
+    atomic_load_explicit(&cht->buckets, memory_order_relaxed);
+  _Atomic(CHTNode *) *link;
+  CHTNode *node = find_node(buckets, hash, key, true_key_len, &link);
+  if (node == NULL) {
+    pthread_mutex_unlock(&stripe->lock);
+    return false;
+  }
+
+  // Readers that already reached `node` can keep following its `next`, which
+  // stays intact until the node is reclaimed.
+  atomic_store_explicit(link,
+      atomic_load_explicit(&node->next, memory_order_relaxed),
+      memory_order_release);
+  atomic_fetch_sub_explicit(&stripe->num_elems, 1, memory_order_relaxed);
+  HTValue prev = atomic_load_explicit(&node->value, memory_order_relaxed);
+  pthread_mutex_unlock(&stripe->lock);
+
+  if (old_value != NULL) *old_value = prev;
+  Epoch_retire(&node->retire, node_reclaim);
+  return true;
+}
+
+static CHTBuckets *copy_buckets(CHTBuckets *old) {
+  CHTBuckets *new = buckets_allocate(old->num_buckets * 2);
+  if (new == NULL) return NULL;
+
+  size_t mask = new->num_buckets - 1;
+  for (size_t i = 0; i < old->num_buckets; i++) {
+    for (CHTNode *node =
+          atomic_load_explicit(&old->buckets[i], memory_order_relaxed);
+        node != NULL;
+        node = atomic_load_explicit(&node->next, memory_order_relaxed)) {
+      CHTNode *copy = node_allocate(node->hash, node->key, node->key_len,
+          atomic_load_explicit(&node->value, memory_order_relaxed));
+      if (copy == NULL) {
+        buckets_free(new, NULL);
+        return NULL;
+      }
+      _Atomic(CHTNode *) *head = &new->buckets[copy->hash & mask];
+      atomic_store_explicit(&copy->next,
+          atomic_load_explicit(head, memory_order_relaxed),
+          memory_order_relaxed);
+      atomic_store_explicit(head, copy, memory_order_relaxed);
+    }
+  }
+  return new;
+}
+
+static void grow(ConcurrentHashTable *cht, CHTBuckets *seen) {
+  // Stripes are always locked in the same order, and writers never hold more
+  // than one otherwise, so this can't deadlock.
+  for (int i = 0; i < NUM_STRIPES; i++) {
+    pthread_mutex_lock(&cht->stripes[i].lock);
+  }
+
+  CHTBuckets *old = atomic_load_explicit(&cht->buckets, memory_order_relaxed);
+  CHTBuckets *new = old == seen ? copy_buckets(old) : NULL;
+  if (new != NULL) {
+    atomic_store_explicit(&cht->buckets, new, memory_order_release);
+  }
+
+  for (int i = NUM_STRIPES - 1; i >= 0; i--) {
+    pthread_mutex_unlock(&cht->stripes[i].lock);
+  }
+  if (new != NULL) Epoch_retire(&old->retire, buckets_reclaim);
+}
@@ -0,0 +1,205 @@
+/* Implements a double-ended queue stored in fixed-size blocks.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "deque.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#define CACHE_LINE_SIZE 64
+
+typedef struct dqb {
+  struct dqb *prev, *next;
+  DequePayload slots[DEQUE_BLOCK_SLOTS];
+} DQBlock;
+
+_Static_assert(sizeof(DQBlock) % CACHE_LINE_SIZE == 0,
+    "DQBlock should be a whole number of cache lines");
+
+// Typedef'd to Deque in "deque.h"
+//
+// The elements are the slots [head_idx, tail_idx) if head == tail, and
+// otherwise [head_idx, DEQUE_BLOCK_SLOTS) of head, every slot of the blocks
+// in between, then [0, tail_idx) of tail. Blocks are unlinked as soon as
+// they're emptied, so when head != tail, both hold at least one element.
+// There's always at least one block, even when the deque is empty.
+struct _dq {
+  DQBlock *head, *tail;
+  int head_idx, tail_idx;
+  int num_elems;
+  // The last block to be emptied, kept so that a queue hovering around a
+  // block boundary doesn't allocate and free a block each time it crosses it.
+  DQBlock *spare;  // NULL if there isn't one
+};
+
+static inline DQBlock *block_alloc(Deque *dq) {
+  if (dq->spare != NULL) {
+    DQBlock *block = dq->spare;
+    dq->spare = NULL;
+    return block;
+  }
+  return aligned_alloc(CACHE_LINE_SIZE, sizeof(DQBlock));
+}
+
+// Unlinks `block`, which must be empty, and either keeps it as the spare
+// block or frees it.
+static inline void block_retire(Deque *dq, DQBlock *block) {
+  if (block->prev != NULL) block->prev->next = block->next;
+  if (block->next != NULL) block->next->prev = block->prev;
+  if (dq->spare == NULL) {
+    dq->spare = block;
+  } else {
+    free(block);
+  }
+}
+
+// Called when the last element is popped. Starts the (single) block over in
+// the middle, so that either end can grow without needing a new block.
+static inline void reset_empty(Deque *dq) {
+  dq->head_idx = DEQUE_BLOCK_SLOTS / 2;
+  dq->tail_idx = DEQUE_BLOCK_SLOTS / 2;
+}
+
+Deque *Deque_allocate() {
+  Deque *dq = malloc(sizeof(Deque));
+  if (dq == NULL) return NULL;
+
+  DQBlock *block = aligned_alloc(CACHE_LINE_SIZE, sizeof(DQBlock));
+  if (block == NULL) {
+    free(dq);
+    return NULL;
+  }
+  block->prev = NULL;
+  block->next = NULL;
+  dq->head = block;
+  dq->tail = block;
+  dq->num_elems = 0;
+  dq->spare = NULL;
+  reset_empty(dq);
+  return dq;
+}
+
+void Deque_free(Deque *dq, DequePayloadFreeFn payload_free) {
+  if (dq == NULL) return;
+
+  DQBlock *block = dq->head;
+  int idx = dq->head_idx;
+  while (block != NULL) {
+    int end = block == dq->tail ? dq->tail_idx : DEQUE_BLOCK_SLOTS;
+    if (payload_free != NULL) {
+      for (; idx < end; idx++) payload_free(block->slots[idx]);
+    }
+    DQBlock *next = block->next;
+    free(block);
+    block = next;
+    idx = 0;
+  }
+  free(dq->spare);
+  free(dq);
+}
+
+int Deque_num_elements(Deque *dq) {
+  if (dq == NULL) return -1;
+  return dq->num_elems;
+}
+
+bool Deque_prepend(Deque *dq, DequePayload payload) {
+  if (dq == NULL) return false;
+
+  if (dq->head_idx == 0) {
+    DQBlock *block = block_alloc(dq);
+    if (block == NULL) return false;
+    block->prev = NULL;
+    block->next = dq->head;
+    dq->head->prev = block;
+    dq->head = block;
+    dq->head_idx = DEQUE_BLOCK_SLOTS;
+  }
+  dq->head->slots[--dq->head_idx] = payload;
+  dq->num_elems++;
+  return true;
+}
+
+bool Deque_append(Deque *dq, DequePayload payload) {
+  if (dq == NULL) return false;
+
+  if (dq->tail_idx == DEQUE_BLOCK_SLOTS) {
+    DQBlock *block = block_alloc(dq);
+    if (block == NULL) return false;
+    block->prev = dq->tail;
+    block->next = NULL;
+    dq->tail->next = block;
+    dq->tail = block;
+    dq->tail_idx = 0;
+  }
+  dq->tail->slots[dq->tail_idx++] = payload;
+  dq->num_elems++;
+  return true;
+}
+
+bool Deque_pop_head(Deque *dq, DequePayload *payload_out) {
+  if (dq == NULL || payload_out == NULL) return false;
+  if (dq->num_elems == 0) return false;
+
+  *payload_out = dq->head->slots[dq->head_idx++];
+  dq->num_elems--;
+  if (dq->num_elems == 0) {
+    reset_empty(dq);
+  } else if (dq->head_idx == DEQUE_BLOCK_SLOTS) {
+    DQBlock *emptied = dq->head;
+    dq->head = emptied->next;
+    dq->head_idx = 0;
+    block_retire(dq, emptied);
+  }
+  return true;
+}
+
+bool Deque_pop_tail(Deque *dq, DequePayload *payload_out) {
+  if (dq == NULL || payload_out == NULL) return false;
+  if (dq->num_elems == 0) return false;
+
+  *payload_out = dq->tail->slots[--dq->tail_idx];
+  dq->num_elems--;
+  if (dq->num_elems == 0) {
+    reset_empty(dq);
+  } else if (dq->tail_idx == 0) {
+    DQBlock *emptied = dq->tail;
+    dq->tail = emptied->prev;
+    dq->tail_idx = DEQUE_BLOCK_SLOTS;
+    block_retire(dq, emptied);
+  }
+  return true;
+}
+
+bool Deque_peek_head(Deque *dq, DequePayload *payload_out) {
+  if (dq == NULL || payload_out == NULL) return false;
+  if (dq->num_elems == 0) return false;
+
+  *payload_out = dq->head->slots[dq->head_idx];
+  return true;
+}
+
+bool Deque_peek_tail(Deque *dq, DequePayload *payload_out) {
+  if (dq == NULL || payload_out == NULL) return false;
+  if (dq->num_elems == 0) return false;
+
+  *payload_out = dq->tail->slots[dq->tail_idx - 1];
+  return true;
+}
@@ -0,0 +1,240 @@
+/* Provides epoch-based memory reclamation for lock-free readers.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _XOPEN_SOURCE 700
+
+#include "epoch.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// This is the classic scheme from Keir Fraser's "Practical lock-freedom".
+// There's a global epoch, and each thread publishes the epoch it observed when
+// it entered its current critical section. The global epoch only advances once
+// every thread in a critical section has observed its current value, so once
+// it has advanced twice past the epoch an object was retired in, no thread can
+// still be in a critical section that started before the object was unlinked.
+
+// How many objects a thread retires between attempts to reclaim them.
+#define RETIRED_PER_COLLECT 64
+
+typedef struct EpochRecord {
+  // `(epoch << 1) | 1` while the thread is in a critical section, 0 otherwise.
+  // Aligned so that threads publishing their state don't false share.
+  alignas(64) _Atomic uint64_t state;
+  // Only accessed while holding records_lock
+  struct EpochRecord *next;
+
+  // Only accessed by the thread that owns the record
+  int nesting;
+  EpochEntry *limbo_head;  // Retired objects, oldest first
+  EpochEntry *limbo_tail;
+  int retired_since_collect;
+} EpochRecord;
+
+typedef enum {
+  REGISTRATION_NONE = 0,
+  REGISTRATION_OK,
+  // The thread couldn't be registered (the only way for this to happen is
+  // pthread_key_create/pthread_setspecific failing). Such threads fall back to
+  // a global counter of readers, which is slower but always works.
+  REGISTRATION_FAILED,
+} Registration;
+
+static _Atomic uint64_t global_epoch = 0;
+
+// Records for every registered thread. Scanning the list is rare (once per
+// RETIRED_PER_COLLECT retirements), so a mutex is fine here, and it lets
+// threads unlink their records when they exit.
+static pthread_mutex_t records_lock = PTHREAD_MUTEX_INITIALIZER;
+static EpochRecord *records = NULL;
+
+// Number of unregistered threads currently in a critical section. The epoch
+// can't advance while this is nonzero.
+static atomic_int unregistered_readers = 0;
+
+static pthread_key_t exit_key;
+static bool exit_key_ok = false;
+static pthread_once_t exit_key_once = PTHREAD_ONCE_INIT;
+
+static _Thread_local EpochRecord self;
+static _Thread_local Registration registration = REGISTRATION_NONE;
+
+// Creates exit_key, whose destructor unregisters exiting threads.
+static void create_exit_key(void);
+// Adds the calling thread's record to `records`, or marks the thread as
+// unregistered if it can't be.
+static void register_thread(void);
+// Destructor for exit_key. Waits for the exiting thread's retired objects to
+// be reclaimed, then removes its record from `records`.
+static void unregister_thread(void *unused);
+// Advances the global epoch if every thread in a critical section has
+// observed its current value.
+static void try_advance(void);
+// Reclaims every object in the calling thread's limbo list that was retired
+// at least two epochs ago.
+static void collect(void);
+
+static void create_exit_key(void) {
+  exit_key_ok = pthread_key_create(&exit_key, unregister_thread) == 0;
+}
+
+static void register_thread(void) {
+  pthread_once(&exit_key_once, create_exit_key);
+  if (!exit_key_ok || pthread_setspecific(exit_key, &self) != 0) {
+    registration = REGISTRATION_FAILED;
+    return;
+  }
+
+  pthread_mutex_lock(&records_lock);
+  self.next = records;
+  records = &self;
+  pthread_mutex_unlock(&records_lock);
+  registration = REGISTRATION_OK;
+}
+
+static void unregister_thread(void *unused) {
+  (void)unused;
+  // A thread that exits from inside a critical section can't be reading
+  // anything anymore.
+  self.nesting = 0;
+  atomic_store_explicit(&self.state, 0, memory_order_release);
+  Epoch_barrier();
+
+  pthread_mutex_lock(&records_lock);
+  for (EpochRecord **rec = &records; *rec != NULL; rec = &(*rec)->next) {
+    if (*rec == &self) {
+      *rec = self.next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&records_lock);
+  registration = REGISTRATION_NONE;
+}
+
+void Epoch_enter() {
+  if (registration == REGISTRATION_NONE) register_thread();
+  if (registration == REGISTRATION_FAILED) {
+    atomic_fetch_add(&unregistered_readers, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    return;
+  }
+
+  if (self.nesting++ > 0) return;
+  uint64_t epoch = atomic_load_explicit(&global_epoch, memory_order_relaxed);
+  atomic_store_explicit(&self.state, (epoch << 1) | 1, memory_order_relaxed);
+  // Publishing our state has to be ordered before any reads of shared data,
+  // which no weaker ordering guarantees.
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+void Epoch_exit() {
+  if (registration == REGISTRATION_FAILED) {
+    atomic_fetch_sub_explicit(&unregistered_readers, 1, memory_order_release);
+    return;
+  }
+  if (registration != REGISTRATION_OK || self.nesting == 0) return;
+
+  if (--self.nesting > 0) return;
+  atomic_store_explicit(&self.state, 0, memory_order_release);
+}
+
+static void try_advance(void) {
+  uint64_t epoch = atomic_load(&global_epoch);
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&unregistered_readers, memory_order_acquire) > 0) {
+    return;
+  }
+
+  bool all_caught_up = true;
+  pthread_mutex_lock(&records_lock);
+  for (EpochRecord *rec = records; rec != NULL; rec = rec->next) {
+    uint64_t state = atomic_load_explicit(&rec->state, memory_order_acquire);
+    if ((state & 1) && (state >> 1) != epoch) {
+      all_caught_up = false;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&records_lock);
+
+  // If this fails, some other thread advanced the epoch already.
+  if (all_caught_up) {
+    atomic_compare_exchange_strong(&global_epoch, &epoch, epoch + 1);
+  }
+}
+
+static void collect(void) {
+  uint64_t epoch = atomic_load_explicit(&global_epoch, memory_order_acquire);
+  while (self.limbo_head != NULL && self.limbo_head->epoch + 2 <= epoch) {
+    EpochEntry *entry = self.limbo_head;
+    self.limbo_head = entry->next;
+    entry->reclaim(entry);
+  }
+  if (self.limbo_head == NULL) self.limbo_tail = NULL;
+}
+
+void Epoch_retire(EpochEntry *entry, Epoch_reclaim reclaim) {
+  if (entry == NULL) return;
+  if (registration == REGISTRATION_NONE) register_thread();
+
+  entry->next = NULL;
+  entry->reclaim = reclaim;
+  // The caller's unlinking of the object has to be ordered before reading the
+  // epoch, otherwise it could be tagged with an epoch that's too old.
+  atomic_thread_fence(memory_order_seq_cst);
+  entry->epoch = atomic_load_explicit(&global_epoch, memory_order_relaxed);
+
+  if (registration == REGISTRATION_FAILED) {
+    // With nowhere to keep the object until later, just wait it out.
+    while (atomic_load(&global_epoch) < entry->epoch + 2) {
+      try_advance();
+      if (atomic_load(&global_epoch) < entry->epoch + 2) sched_yield();
+    }
+    reclaim(entry);
+    return;
+  }
+
+  if (self.limbo_tail == NULL) {
+    self.limbo_head = entry;
+  } else {
+    self.limbo_tail->next = entry;
+  }
+  self.limbo_tail = entry;
+
+  if (++self.retired_since_collect >= RETIRED_PER_COLLECT) {
+    self.retired_since_collect = 0;
+    try_advance();
+    collect();
+  }
+}
+
+void Epoch_barrier() {
+  if (registration != REGISTRATION_OK) return;
+  while (self.limbo_head != NULL) {
+    try_advance();
+    collect();
+    if (self.limbo_head != NULL) sched_yield();
+  }
+  self.retired_since_collect = 0;
+}
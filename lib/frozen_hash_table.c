@@ -0,0 +1,336 @@
+/* Provides an immutable hash table with perfect hashing.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "frozen_hash_table.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_table_internal.h"
+
+// How this works: keys are split into buckets by their hash, and then,
+// biggest bucket first, each bucket is given a displacement: the smallest d
+// such that the d-th of a family of hash functions sends every key in the
+// bucket to a slot that's still free. A lookup then only needs the
+// displacement of its key's bucket to know which slot to look in. Since each
+// value of d picks an unrelated slot for every key, the search for a bucket
+// behaves like repeated independent tries, so even the last few buckets,
+// which have to hit the last few free slots, are placed quickly.
+//
+// This is the "hash and displace" scheme of CHD (Belazzougui, Botelho and
+// Dietzfelbinger, "Hash, displace, and compress", 2009), without compressing
+// the displacements, which are small enough as is.
+
+// The average number of keys per bucket on the first try. Bigger buckets make
+// the table smaller, but take longer to find displacements for. Each retry
+// uses one key fewer per bucket (down to one), since what usually sinks a try
+// is a small table whose last few multi-key buckets can't find free slots.
+#define KEYS_PER_BUCKET 4
+// How many displacements are tried per slot in the table before giving up on
+// a bucket and starting over with a different seed. Placing a bucket is only
+// ever expected to take more than num_slots tries for the very last ones, so
+// this is only reached with astronomically bad luck.
+#define MAX_TRIES_PER_SLOT 64
+// How many tries, each with a different seed, are made before giving up on
+// building the table.
+#define MAX_SEEDS 8
+// Odd constant used to spread out the hash functions picked by successive
+// displacements (2^64 divided by the golden ratio).
+#define DISPLACEMENT_STEP 0x9E3779B97F4A7C15
+
+// Typedef'd to FrozenHashTable in frozen_hash_table.h
+struct _FHT {
+  HashFunction hash;
+  uint64_t seed;
+  uint32_t num_elems;  // Also the number of slots
+  uint32_t num_buckets;
+  uint32_t *displacements;  // One per bucket
+  // Entry i holds the key whose hash maps to slot i
+  HTEntry *entries;
+};
+
+// A key from the table being frozen.
+typedef struct {
+  const unsigned char *key;
+  size_t key_len;
+  HTValue value;
+  Hash64 hash;
+} FreezeKey;
+
+// The splitmix64 finalizer. It's a bijection, so keys with different hashes
+// always give different results.
+static inline uint64_t mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EB;
+  x ^= x >> 31;
+  return x;
+}
+
+// Maps a 32-bit value onto [0, range) without a division.
+static inline uint32_t fast_range(uint32_t x, uint32_t range) {
+  return (uint32_t)(((uint64_t)x * range) >> 32);
+}
+
+static inline uint32_t bucket_for(Hash64 hash, uint32_t num_buckets) {
+  return fast_range((uint32_t)hash, num_buckets);
+}
+
+static inline uint32_t slot_for(Hash64 hash, uint64_t seed,
+    uint32_t displacement, uint32_t num_slots) {
+  uint64_t mixed = mix64((hash ^ seed) + displacement * DISPLACEMENT_STEP);
+  return fast_range((uint32_t)(mixed >> 32), num_slots);
+}
+
+// Checks if any two keys have the same hash, in which case they'd always map
+// to the same slot. Sorts `hashes` as a side effect.
+static bool has_duplicate_hash(Hash64 *hashes, size_t num_hashes);
+// Tries to find a displacement for every bucket using fht->seed, filling in
+// fht->displacements and setting `slot_keys[i]` to the index of the key that
+// maps to slot i.
+//
+// Returns false if some bucket couldn't be placed, or if out of memory.
+static bool find_displacements(FrozenHashTable *fht, const FreezeKey *keys,
+    uint32_t *slot_keys);
+
+static int compare_hashes(const void *a, const void *b) {
+  Hash64 x = *(const Hash64 *)a;
+  Hash64 y = *(const Hash64 *)b;
+  return (x > y) - (x < y);
+}
+
+static bool has_duplicate_hash(Hash64 *hashes, size_t num_hashes) {
+  qsort(hashes, num_hashes, sizeof(Hash64), &compare_hashes);
+  for (size_t i = 1; i < num_hashes; i++) {
+    if (hashes[i] == hashes[i - 1]) return true;
+  }
+  return false;
+}
+
+static bool find_displacements(FrozenHashTable *fht, const FreezeKey *keys,
+    uint32_t *slot_keys) {
+  uint32_t n = fht->num_elems;
+  uint32_t num_buckets = fht->num_buckets;
+  uint64_t max_tries = (uint64_t)MAX_TRIES_PER_SLOT * n;
+  if (max_tries > UINT32_MAX) max_tries = UINT32_MAX;
+  bool ok = false;
+
+  // Group the keys by bucket with a counting sort: the keys of bucket b end
+  // up in bucket_keys[bucket_start[b]] up to bucket_keys[bucket_start[b + 1]].
+  uint32_t *bucket_start = calloc(num_buckets + 1, sizeof(uint32_t));
+  uint32_t *bucket_fill = calloc(num_buckets, sizeof(uint32_t));
+  uint32_t *bucket_keys = malloc(n * sizeof(uint32_t));
+  uint32_t *order = malloc(num_buckets * sizeof(uint32_t));
+  uint32_t *size_start = NULL;
+  // One bit per slot, set once a key has been placed there. This is what
+  // every try checks, so it's kept much smaller than slot_keys to make it
+  // more likely to stay in cache.
+  uint64_t *taken = calloc((n + 63) / 64, sizeof(uint64_t));
+  // The slots picked by the displacement currently being tried
+  uint32_t *try_slots = malloc(n * sizeof(uint32_t));
+  if (bucket_start == NULL || bucket_fill == NULL || bucket_keys == NULL ||
+      order == NULL || taken == NULL || try_slots == NULL) {
+    goto out;
+  }
+
+  uint32_t max_bucket_size = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t size = ++bucket_start[bucket_for(keys[i].hash, num_buckets) + 1];
+    if (size > max_bucket_size) max_bucket_size = size;
+  }
+  for (uint32_t b = 0; b < num_buckets; b++) {
+    bucket_start[b + 1] += bucket_start[b];
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t b = bucket_for(keys[i].hash, num_buckets);
+    bucket_keys[bucket_start[b] + bucket_fill[b]++] = i;
+  }
+
+  // Place the biggest buckets first, while most slots are still free. This
+  // is another counting sort, on bucket size, biggest first.
+  size_start = calloc(max_bucket_size + 2, sizeof(uint32_t));
+  if (size_start == NULL) goto out;
+  for (uint32_t b = 0; b < num_buckets; b++) {
+    uint32_t size = bucket_start[b + 1] - bucket_start[b];
+    size_start[max_bucket_size - size + 1]++;
+  }
+  for (uint32_t s = 0; s <= max_bucket_size; s++) {
+    size_start[s + 1] += size_start[s];
+  }
+  for (uint32_t b = 0; b < num_buckets; b++) {
+    uint32_t size = bucket_start[b + 1] - bucket_start[b];
+    order[size_start[max_bucket_size - size]++] = b;
+  }
+
+  for (uint32_t b = 0; b < num_buckets; b++) fht->displacements[b] = 0;
+  for (uint32_t o = 0; o < num_buckets; o++) {
+    uint32_t b = order[o];
+    const uint32_t *members = &bucket_keys[bucket_start[b]];
+    uint32_t size = bucket_start[b + 1] - bucket_start[b];
+    // Buckets are in order of size, so the rest are empty as well
+    if (size == 0) break;
+
+    uint32_t d;
+    for (d = 0; d < max_tries; d++) {
+      uint32_t k;
+      for (k = 0; k < size; k++) {
+        uint32_t slot = slot_for(keys[members[k]].hash, fht->seed, d, n);
+        if (taken[slot / 64] & (UINT64_C(1) << (slot % 64))) break;
+        // Buckets are small, so checking against the bucket's other keys one
+        // by one is cheap.
+        uint32_t j;
+        for (j = 0; j < k && try_slots[j] != slot; j++) continue;
+        if (j < k) break;
+        try_slots[k] = slot;
+      }
+      if (k == size) break;
+    }
+    if (d == max_tries) goto out;
+
+    for (uint32_t k = 0; k < size; k++) {
+      uint32_t slot = try_slots[k];
+      taken[slot / 64] |= UINT64_C(1) << (slot % 64);
+      slot_keys[slot] = members[k];
+    }
+    fht->displacements[b] = d;
+  }
+  ok = true;
+
+out:
+  free(bucket_start);
+  free(bucket_fill);
+  free(bucket_keys);
+  free(order);
+  free(size_start);
+  free(taken);
+  free(try_slots);
+  return ok;
+}
+
+FrozenHashTable *HashTable_freeze(HashTable *ht) {
+  int num_elems = HashTable_num_elements(ht);
+  if (num_elems < 0) return NULL;
+  uint32_t n = num_elems;
+
+  FrozenHashTable *fht = malloc(sizeof(FrozenHashTable));
+  if (fht == NULL) return NULL;
+  fht->hash = HashFunction_get(HT_HASH_WYHASH);
+  fht->seed = 0;
+  fht->num_elems = n;
+  fht->num_buckets = 0;
+  // Big enough for a bucket per key, which is the most any try uses
+  fht->displacements = malloc(n * sizeof(uint32_t));
+  fht->entries = aligned_alloc(HT_ENTRY_ALIGN, n * sizeof(HTEntry));
+  FreezeKey *keys = malloc(n * sizeof(FreezeKey));
+  Hash64 *hashes = malloc(n * sizeof(Hash64));
+  uint32_t *slot_keys = malloc(n * sizeof(uint32_t));
+  HTIterator hti;
+  HTIterator_init(&hti, ht);
+  bool ok = false;
+  if (n > 0 && (fht->displacements == NULL || fht->entries == NULL ||
+          keys == NULL || hashes == NULL || slot_keys == NULL)) {
+    goto out;
+  }
+
+  for (uint32_t i = 0; i < n; i++, HTIterator_next(&hti)) {
+    HTIterator_get(&hti, &keys[i].key, &keys[i].key_len, &keys[i].value);
+    keys[i].hash = fht->hash(keys[i].key, keys[i].key_len);
+    hashes[i] = keys[i].hash;
+  }
+  if (has_duplicate_hash(hashes, n)) goto out;
+
+  bool found = false;
+  for (uint32_t attempt = 0; attempt < MAX_SEEDS && !found; attempt++) {
+    uint32_t keys_per_bucket =
+      attempt < KEYS_PER_BUCKET ? KEYS_PER_BUCKET - attempt : 1;
+    fht->seed = mix64(attempt + 1);
+    fht->num_buckets = (n + keys_per_bucket - 1) / keys_per_bucket;
+    found = find_displacements(fht, keys, slot_keys);
+  }
+  if (!found) goto out;
+  if (fht->num_buckets < n) {
+    uint32_t *shrunk =
+      realloc(fht->displacements, fht->num_buckets * sizeof(uint32_t));
+    if (shrunk != NULL) fht->displacements = shrunk;
+  }
+
+  // Copy the keys over, allocating everything up front so that a failure
+  // leaves nothing half built.
+  uint32_t copied;
+  for (copied = 0; copied < n; copied++) {
+    const FreezeKey *key = &keys[slot_keys[copied]];
+    unsigned char *key_cpy = NULL;
+    if (!HTEntry_key_is_inline(key->key_len)) {
+      key_cpy = malloc(key->key_len);
+      if (key_cpy == NULL) break;
+    }
+    HTEntry_init(&fht->entries[copied], key->hash, key->key, key->key_len,
+        key_cpy, key->value);
+  }
+  if (copied < n) {
+    for (uint32_t i = 0; i < copied; i++) HTEntry_free_key(&fht->entries[i]);
+    goto out;
+  }
+  ok = true;
+
+out:
+  HTIterator_release(&hti);
+  free(keys);
+  free(hashes);
+  free(slot_keys);
+  if (!ok) {
+    free(fht->displacements);
+    free(fht->entries);
+    free(fht);
+    return NULL;
+  }
+  return fht;
+}
+
+void FrozenHashTable_free(FrozenHashTable *fht, HTValue_free value_free) {
+  if (fht == NULL) return;
+  for (uint32_t i = 0; i < fht->num_elems; i++) {
+    if (value_free != NULL) value_free(fht->entries[i].value);
+    HTEntry_free_key(&fht->entries[i]);
+  }
+  free(fht->displacements);
+  free(fht->entries);
+  free(fht);
+}
+
+int FrozenHashTable_num_elements(FrozenHashTable *fht) {
+  if (fht == NULL) return -1;
+  return fht->num_elems;
+}
+
+const HTValue *FrozenHashTable_find(FrozenHashTable *fht, unsigned char *key,
+    size_t key_len) {
+  if (fht == NULL || key == NULL || fht->num_elems == 0) return NULL;
+
+  size_t true_key_len = key_len != 0 ? key_len : strlen((char *)key);
+  Hash64 hash = fht->hash(key, true_key_len);
+  uint32_t d = fht->displacements[bucket_for(hash, fht->num_buckets)];
+  const HTEntry *entry =
+    &fht->entries[slot_for(hash, fht->seed, d, fht->num_elems)];
+  if (!HTEntry_matches(entry, hash, key, true_key_len)) return NULL;
+  return &entry->value;
+}
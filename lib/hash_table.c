@@ -19,108 +19,347 @@ along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "hash_table.h"
 
+#include <inttypes.h>
+#include <limits.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "hash_table_internal.h"
 #include "linked_list.h"
+#include "slab.h"
 
-// Change to `1` if there are errors with hash collisions. This will have a
-// performance penalty because instead of just checking the hashes, if two
-// hashes match the full key will be checked as well.
-#ifndef COLLISION_RESIST
-#define COLLISION_RESIST 1
+// The engine used by HashTable_allocate and by HTOptions_init. Can be
+// overridden at compile time, e.g. `-DHT_DEFAULT_ENGINE=HT_ENGINE_OPEN`.
+#ifndef HT_DEFAULT_ENGINE
+#define HT_DEFAULT_ENGINE HT_ENGINE_CHAINED
+#endif
+// The hash function used by HashTable_allocate and by HTOptions_init. Can be
+// overridden at compile time, e.g. `-DHT_DEFAULT_HASH=HT_HASH_WYHASH`.
+#ifndef HT_DEFAULT_HASH
+#define HT_DEFAULT_HASH HT_HASH_SIPHASH
 #endif
-
-typedef uint64_t Hash64;
 
 // Typedef'd to HashTable in hash_table.h
+//
+// With HT_ENGINE_CHAINED, the table resizes itself incrementally: when the
+// load factor goes out of bounds (see MAX_LOAD_FACTOR and MIN_LOAD_FACTOR_INV)
+// a new bucket array is allocated, and the old one is kept around in
+// `old_buckets` until every one of its buckets has been migrated over. Every
+// insert of a new key and every removal migrates a few buckets, so no single
+// operation ever has to pay for rehashing the whole table.
+//
+// While a resize is in progress, an entry lives in
+// `old_buckets[hash & (old_num_buckets - 1)]` if that index is at least
+// `migrate_idx` (i.e., the bucket hasn't been migrated yet), otherwise it
+// lives in `buckets[hash & (num_buckets - 1)]`.
+//
+// Buckets are allocated lazily, so a NULL bucket is an empty bucket.
+//
+// With HT_ENGINE_OPEN, entries are stored in `open` instead and none of the
+// bucket members are used.
 struct _HT {
-  LinkedList **buckets;
-  int num_buckets;
+  HTEngine engine;
+  HashFunction hash;
   int num_elems;
-};
-// Typedef'd to HTIterator in hash_table.h
-struct _HTIt {
-  LLIterator *bucket_iter;
-  HashTable *table;
-  int bucket_idx;
-};
+  // Number of entries whose keys are too long to be stored inline. Only kept
+  // up to date with HT_ENGINE_CHAINED.
+  int num_heap_keys;
 
-typedef struct {
-  Hash64 hash;
-  unsigned char *key;
-  size_t key_len;
-  HTValue value;
-} HTEntry;
+  // Where entries and bucket nodes are allocated from with
+  // HTOptions.use_slab, otherwise NULL and they're allocated with malloc.
+  Slab *entry_slab;
+  Slab *node_slab;
 
-// Computes the hash of data using the Fowler-Noll-Vo 1a Hash with a hash length
-// of 64 bits.
-//
-// data     - the data to hash.
-// data_len - the length of data in unsigned chars.
-//
-// Returns a Hash64 of the given data.
-static Hash64 FNV1a_64bit(const unsigned char *data, size_t data_len);
+  // Number of live HTIterators. The table isn't resized while this is nonzero
+  // so that iterators stay usable across calls to HashTable_find and
+  // HTIterator_remove.
+  int num_iterators;
+  // Set by HTIterator_remove, so that releasing the last iterator only tries
+  // to shrink the table if something was actually removed through one.
+  bool removed_by_iterator;
+
+  LinkedList **buckets;
+  int num_buckets;  // Always a power of two
+
+  LinkedList **old_buckets;  // NULL unless a resize is in progress
+  int old_num_buckets;
+  int migrate_idx;  // Index of the next bucket in `old_buckets` to migrate
+
+  OpenTable open;
+
+#if HT_STATS
+  // See HTStats. With HT_ENGINE_OPEN, probes and resizes are counted in
+  // `open` instead.
+  uint64_t lookups;
+  uint64_t probes;
+  uint64_t resizes;
+#endif
+};
 // Frees a HTEntry structure, used in HashTable_free to free each entry in the
-// HashTable. Sensitive to the value of `value_free`.
+// HashTable. Sensitive to the values of `value_free` and `entries_in_slab`.
 static void HTEntry_free(void *e);
-// Advances the given LLIterator until it reaches an element that matches the
-// given hash (or optionally, if COLLISION_RESIST is enabled, the given key as
-// well).
+// Allocates memory for an entry of a table using HT_ENGINE_CHAINED.
+static inline HTEntry *entry_alloc(HashTable *ht);
+// Frees memory allocated by entry_alloc. Doesn't free the entry's key.
+static inline void entry_free(HashTable *ht, HTEntry *entry);
+// Allocates an empty bucket for a table using HT_ENGINE_CHAINED.
+static inline LinkedList *bucket_alloc(HashTable *ht);
+// Advances the given LLIterator over one of `ht`'s buckets until it reaches an
+// element that matches the given hash (or optionally, if COLLISION_RESIST is
+// enabled, the given key as well).
 //
 // Returns true if a matching element was found, false otherwise. False on NULL.
 #if COLLISION_RESIST
-static bool advance_to_target(LLIterator *iter, Hash64 hash, unsigned char *key,
-    size_t key_len);
+static bool advance_to_target(HashTable *ht, LLIterator *iter, Hash64 hash,
+    unsigned char *key, size_t key_len);
 #else
-static bool advance_to_target(LLIterator *iter, Hash64 hash);
+static bool advance_to_target(HashTable *ht, LLIterator *iter, Hash64 hash);
 #endif
 // Gets true key length (helper if user passes key_len = 0 => strlen(key))
-static inline size_t get_true_key_len(unsigned char *key, size_t key_len);
+static inline size_t get_true_key_len(const unsigned char *key,
+    size_t key_len);
+// Returns a pointer to the slot holding the bucket that an entry with the given
+// hash belongs in, taking any in-progress resize into account. The bucket
+// itself may be NULL if nothing has been inserted into it yet.
+static inline LinkedList **bucket_slot_by_hash(HashTable *ht, Hash64 hash);
+// Starts resizing `ht` to have `new_num_buckets` buckets, first finishing any
+// resize that's already in progress. Does nothing if memory can't be allocated
+// for the new bucket array; the table keeps working at its current size.
+static void start_resize(HashTable *ht, int new_num_buckets);
+// Migrates a bounded number of buckets from `old_buckets` into `buckets`, and
+// finishes the resize once `old_buckets` has been emptied.
+//
+// max_buckets - The maximum number of non-empty buckets to migrate. Up to
+//               EMPTY_VISITS_PER_BUCKET times as many empty buckets may be
+//               skipped over as well.
+//
+// Returns false if migration couldn't make progress due to lack of memory.
+static bool migrate_buckets(HashTable *ht, int max_buckets);
+// Does a bounded amount of resize work, if a resize is in progress and no
+// iterators are live. Called after every insert of a new key and every
+// removal. Lookups and overwrites don't do any resize work, since migrating
+// buckets can allocate and they're guaranteed not to.
+static inline void resize_step(HashTable *ht);
+// Starts shrinking a table using HT_ENGINE_CHAINED if it has become sparse
+// and no iterators are live. Called after removals, and when the last
+// iterator on the table is freed since removals through an iterator can't
+// shrink the table themselves.
+static inline void maybe_start_shrink(HashTable *ht);
+// Returns the number of buckets a table using HT_ENGINE_CHAINED with
+// `num_elems` elements would ideally have.
+static int ideal_num_buckets(int num_elems);
+// Moves every entry of a table using HT_ENGINE_CHAINED, which must not be in
+// the middle of a resize, into `new_num_buckets` buckets whose entries and
+// nodes are carved out of newly allocated Slabs, then frees the old Slabs.
+// The old Slabs can't return the memory of removed entries on their own.
+//
+// Returns false if memory couldn't be allocated, in which case `ht` is left
+// untouched.
+static bool rebuild_slabs(HashTable *ht, int new_num_buckets);
+// Finds the entry with the given hash/key, whichever engine `ht` uses.
+// `key_len` must be the true key length.
+//
+// Returns the entry, or NULL if the key isn't in `ht`.
+static HTEntry *find_entry(HashTable *ht, Hash64 hash, unsigned char *key,
+    size_t key_len);
+// Finds the entry with the given hash/key, creating it with a NULL value if it
+// isn't in `ht` yet, whichever engine `ht` uses. `key_len` must be the true
+// key length.
+//
+// Returns the entry, or NULL if it needed to be created and memory couldn't be
+// allocated. Sets *inserted to whether the entry was created.
+static HTEntry *find_or_insert(HashTable *ht, Hash64 hash, unsigned char *key,
+    size_t key_len, bool *inserted);
+// find_or_insert for tables using HT_ENGINE_OPEN.
+static HTEntry *open_find_or_insert(HashTable *ht, Hash64 hash,
+    unsigned char *key, size_t key_len, bool *inserted);
+// HashTable_remove for tables using HT_ENGINE_OPEN. Same semantics as
+// HashTable_remove, except that `key_len` must be the true key length.
+static bool open_remove(HashTable *ht, Hash64 hash, unsigned char *key,
+    size_t key_len, HTValue *old_value);
 
-static inline size_t get_true_key_len(unsigned char *key, size_t key_len) {
+static inline size_t get_true_key_len(const unsigned char *key,
+    size_t key_len) {
   size_t true_key_len;
   if (key_len == 0) {
     true_key_len = 0;
-    for (unsigned char *c = key; *c != 0; c++) true_key_len++;
+    for (const unsigned char *c = key; *c != 0; c++) true_key_len++;
   } else {
     true_key_len = key_len;
   }
   return true_key_len;
 }
 
+// Must be a power of two
 #define DEFAULT_BUCKETS 8
+// The table grows once there are more than MAX_LOAD_FACTOR elements per bucket
+// on average, and shrinks once there are fewer than 1 / MIN_LOAD_FACTOR_INV.
+#define MAX_LOAD_FACTOR 1
+#define MIN_LOAD_FACTOR_INV 8
+// How many non-empty buckets are migrated during each insert of a new key and
+// each removal while a resize is in progress. This must be at least 2 so that
+// growing finishes before the new bucket array fills up.
+#define MIGRATE_BUCKETS_PER_STEP 2
+// Caps how many empty buckets a single migration step will skip over per
+// non-empty bucket, so that sparse tables still have a bounded step cost.
+#define EMPTY_VISITS_PER_BUCKET 8
+// HashTable_find_many looks keys up in batches of this many, so that it can
+// keep the hashes for a batch on the stack. Big enough that the prefetches for
+// a batch have plenty of time to land before the first lookup needs them.
+#define FIND_MANY_BATCH 16
+// The most buckets HashTable_reserve will give a table, so that doubling the
+// bucket count can't overflow an int.
+#define MAX_BUCKETS (1 << 30)
+void HTOptions_init(HTOptions *opts) {
+  if (opts == NULL) return;
+  opts->engine = HT_DEFAULT_ENGINE;
+  opts->hash_fn = HT_DEFAULT_HASH;
+  opts->use_slab = false;
+}
+
 HashTable *HashTable_allocate() {
+  return HashTable_allocate_with_options(NULL);
+}
+
+HashTable *HashTable_allocate_with_options(const HTOptions *opts) {
+  HTOptions defaults;
+  if (opts == NULL) {
+    HTOptions_init(&defaults);
+    opts = &defaults;
+  }
+
+  HashFunction hash = HashFunction_get(opts->hash_fn);
+  if (hash == NULL) return NULL;
+
   HashTable *ht = malloc(sizeof(HashTable));
   if (ht == NULL) return NULL;
 
+  ht->engine = opts->engine;
+  ht->hash = hash;
   ht->num_elems = 0;
-  ht->num_buckets = DEFAULT_BUCKETS;
-  ht->buckets = malloc(sizeof(LinkedList *) * DEFAULT_BUCKETS);
-  if (ht->buckets == NULL) {
-    free(ht);
-    return NULL;
+  ht->num_heap_keys = 0;
+  ht->entry_slab = NULL;
+  ht->node_slab = NULL;
+  ht->num_iterators = 0;
+  ht->removed_by_iterator = false;
+  ht->buckets = NULL;
+  ht->num_buckets = 0;
+  ht->old_buckets = NULL;
+  ht->old_num_buckets = 0;
+  ht->migrate_idx = 0;
+#if HT_STATS
+  ht->lookups = 0;
+  ht->probes = 0;
+  ht->resizes = 0;
+#endif
+
+  switch (ht->engine) {
+    case HT_ENGINE_CHAINED:
+      if (opts->use_slab) {
+        ht->entry_slab = Slab_allocate(sizeof(HTEntry));
+        ht->node_slab = Slab_allocate(LinkedList_node_size());
+      }
+      bool slabs_ok = !opts->use_slab ||
+        (ht->entry_slab != NULL && ht->node_slab != NULL);
+      ht->num_buckets = DEFAULT_BUCKETS;
+      ht->buckets = calloc(DEFAULT_BUCKETS, sizeof(LinkedList *));
+      if (ht->buckets == NULL || !slabs_ok) {
+        Slab_free(ht->entry_slab);
+        Slab_free(ht->node_slab);
+        free(ht->buckets);
+        free(ht);
+        return NULL;
+      }
+      break;
+    case HT_ENGINE_OPEN:
+      if (!OpenTable_init(&ht->open, 0)) {
+        free(ht);
+        return NULL;
+      }
+      break;
+    default:
+      free(ht);
+      return NULL;
   }
 
-  for (int i = 0; i < ht->num_buckets; i++) {
-    ht->buckets[i] = LinkedList_allocate();
+  return ht;
+}
+
+HashTable *HashTable_allocate_from(const HTOptions *opts,
+    unsigned char *const keys[], const size_t key_lens[],
+    const HTValue values[], size_t num_entries) {
+  if (keys == NULL && num_entries > 0) return NULL;
+
+  HashTable *ht = HashTable_allocate_with_options(opts);
+  if (ht == NULL) return NULL;
+  if (!HashTable_reserve(ht, num_entries)) {
+    HashTable_free(ht, NULL);
+    return NULL;
   }
 
+  for (size_t i = 0; i < num_entries; i++) {
+    if (keys[i] == NULL) {
+      HashTable_free(ht, NULL);
+      return NULL;
+    }
+    size_t key_len = get_true_key_len(keys[i],
+        key_lens != NULL ? key_lens[i] : 0);
+    bool inserted;
+    HTEntry *entry = find_or_insert(ht, ht->hash(keys[i], key_len), keys[i],
+        key_len, &inserted);
+    if (entry == NULL) {
+      HashTable_free(ht, NULL);
+      return NULL;
+    }
+    entry->value = values != NULL ? values[i] : NULL;
+  }
   return ht;
 }
 
 static _Thread_local HTValue_free value_free;
+// Set while freeing a table whose entries are about to be released along with
+// its Slab, so they don't need to be freed one by one.
+static _Thread_local bool entries_in_slab;
 void HashTable_free(HashTable *ht, HTValue_free ll_value_free) {
   if (ht == NULL) return;
   
   value_free = ll_value_free;
+  if (ht->engine == HT_ENGINE_OPEN) {
+    for (size_t i = OpenTable_next_full(&ht->open, 0);
+        i < ht->open.num_entries; i = OpenTable_next_full(&ht->open, i + 1)) {
+      HTEntry *entry = &ht->open.entries[i];
+      if (value_free != NULL) value_free(entry->value);
+      HTEntry_free_key(entry);
+    }
+    OpenTable_destroy(&ht->open);
+    free(ht);
+    return;
+  }
+
+  // Unless there are values or keys to free, a table using Slabs doesn't need
+  // to visit its entries at all.
+  entries_in_slab = ht->entry_slab != NULL;
+  LLPayloadFreeFn free_fn = HTEntry_free;
+  if (entries_in_slab && value_free == NULL && ht->num_heap_keys == 0) {
+    free_fn = NULL;
+  }
+
   for (int i = 0; i < ht->num_buckets; i++) {
-    LinkedList_free(ht->buckets[i], HTEntry_free);
+    LinkedList_free(ht->buckets[i], free_fn);
+  }
+  if (ht->old_buckets != NULL) {
+    for (int i = ht->migrate_idx; i < ht->old_num_buckets; i++) {
+      LinkedList_free(ht->old_buckets[i], free_fn);
+    }
   }
 
+  Slab_free(ht->entry_slab);
+  Slab_free(ht->node_slab);
   free(ht->buckets);
+  free(ht->old_buckets);
   free(ht);
 }
 
@@ -129,8 +368,39 @@ static void HTEntry_free(void *e) {
   if (value_free != NULL) {
     value_free(entry->value);
   }
-  free(entry->key);
-  free(entry);
+  HTEntry_free_key(entry);
+  if (!entries_in_slab) free(entry);
+}
+
+static inline HTEntry *entry_alloc(HashTable *ht) {
+  if (ht->entry_slab != NULL) return Slab_alloc_object(ht->entry_slab);
+  return malloc(sizeof(HTEntry));
+}
+
+static inline void entry_free(HashTable *ht, HTEntry *entry) {
+  if (ht->entry_slab != NULL) {
+    Slab_free_object(ht->entry_slab, entry);
+  } else {
+    free(entry);
+  }
+}
+
+static inline LinkedList *bucket_alloc(HashTable *ht) {
+  return LinkedList_allocate_with_slab(ht->node_slab);
+}
+
+uint64_t HashTable_hash_key(HTHashFn hash_fn, const unsigned char *key,
+    size_t key_len) {
+  if (key == NULL) return 0;
+  HashFunction hash = HashFunction_get(hash_fn);
+  if (hash == NULL) return 0;
+  return hash(key, get_true_key_len(key, key_len));
+}
+
+uint64_t HashTable_hash(HashTable *ht, const unsigned char *key,
+    size_t key_len) {
+  if (ht == NULL || key == NULL) return 0;
+  return ht->hash(key, get_true_key_len(key, key_len));
 }
 
 int HashTable_num_elements(HashTable *ht) {
@@ -138,28 +408,36 @@ int HashTable_num_elements(HashTable *ht) {
   return ht->num_elems;
 }
 
-#define FNV_PRIME 0x00000100000001B3
-#define FNV_INIT 0xcbf29ce484222325
-// A public domain reference implementation of the FNV hash function can be
-// found on Landon Curt Noll's webpage:
-// <http://www.isthe.com/chongo/src/fnv/hash_64.c>
-static Hash64 FNV1a_64bit(const unsigned char *data, size_t data_len) {
-  Hash64 hash = FNV_INIT;
-  const unsigned char *current = data;
-  while (current < data + data_len) {
-    hash ^= *current;
-    hash *= FNV_PRIME;
-    current++;
+bool HashTable_reserve(HashTable *ht, size_t num_elements) {
+  if (ht == NULL || num_elements > INT_MAX) return false;
+
+  if (ht->engine == HT_ENGINE_OPEN) {
+    if (OpenTable_has_room(&ht->open, num_elements)) return true;
+    if (ht->num_iterators > 0) return false;
+    return OpenTable_reserve(&ht->open, num_elements);
   }
 
-  return hash;
+  size_t min_buckets = (num_elements + MAX_LOAD_FACTOR - 1) / MAX_LOAD_FACTOR;
+  if ((size_t)ht->num_buckets >= min_buckets) return true;
+  if (ht->num_iterators > 0 || min_buckets > MAX_BUCKETS) return false;
+
+  int new_num_buckets = ht->num_buckets;
+  while ((size_t)new_num_buckets < min_buckets) new_num_buckets *= 2;
+  // Unlike the resizes started by inserts, this one is done all at once, so
+  // that the inserts that follow don't have to pay for migrating buckets.
+  start_resize(ht, new_num_buckets);
+  if (ht->num_buckets != new_num_buckets) return false;
+  return migrate_buckets(ht, ht->old_num_buckets);
 }
 
 #if COLLISION_RESIST
-static bool advance_to_target(LLIterator *iter, Hash64 hash, unsigned char *key,
-    size_t key_len) {
+static bool advance_to_target(HashTable *ht, LLIterator *iter, Hash64 hash,
+    unsigned char *key, size_t key_len) {
 #else
-static bool advance_to_target(LLIterator *iter, Hash64 hash) {
+static bool advance_to_target(HashTable *ht, LLIterator *iter, Hash64 hash) {
+#endif
+#if !HT_STATS
+  (void)ht;
 #endif
 
   if (iter == NULL) return false;
@@ -170,10 +448,11 @@ static bool advance_to_target(LLIterator *iter, Hash64 hash) {
   
   while (LLIterator_is_valid(iter)) {
     HTEntry *current = *LLIterator_get(iter);
+    HT_STAT_ADD(ht->probes, 1);
     if (current->hash == hash) { 
 #if COLLISION_RESIST
       if (current->key_len == key_len &&
-          memcmp(current->key, key, key_len) == 0)
+          memcmp(HTEntry_key(current), key, key_len) == 0)
         return true;
 #else
       return true;
@@ -185,9 +464,167 @@ static bool advance_to_target(LLIterator *iter, Hash64 hash) {
   return false;
 }
 
-#define bucket_idx_by_hash(ht, hash) ((hash) % (ht)->num_buckets)
+static inline LinkedList **bucket_slot_by_hash(HashTable *ht, Hash64 hash) {
+  if (ht->old_buckets != NULL) {
+    int old_idx = hash & (Hash64)(ht->old_num_buckets - 1);
+    if (old_idx >= ht->migrate_idx) return &ht->old_buckets[old_idx];
+  }
+  return &ht->buckets[hash & (Hash64)(ht->num_buckets - 1)];
+}
+
+static void start_resize(HashTable *ht, int new_num_buckets) {
+  // Only one resize can be in progress at a time. Having to finish one here
+  // is rare; the migration rate is chosen so that a growing table finishes
+  // migrating before it needs to grow again.
+  if (ht->old_buckets != NULL && !migrate_buckets(ht, ht->old_num_buckets)) {
+    return;
+  }
+  if (ht->old_buckets != NULL) return;
+
+  LinkedList **new_buckets = calloc(new_num_buckets, sizeof(LinkedList *));
+  if (new_buckets == NULL) return;
+
+  ht->old_buckets = ht->buckets;
+  ht->old_num_buckets = ht->num_buckets;
+  ht->migrate_idx = 0;
+  ht->buckets = new_buckets;
+  ht->num_buckets = new_num_buckets;
+  HT_STAT_ADD(ht->resizes, 1);
+}
+
+static bool migrate_buckets(HashTable *ht, int max_buckets) {
+  int empty_visits = max_buckets * EMPTY_VISITS_PER_BUCKET;
+  while (ht->migrate_idx < ht->old_num_buckets) {
+    LinkedList *old_bucket = ht->old_buckets[ht->migrate_idx];
+    if (old_bucket == NULL) {
+      ht->migrate_idx++;
+      if (--empty_visits <= 0) return true;
+      continue;
+    }
+    if (max_buckets-- <= 0) return true;
+
+    HTEntry *entry;
+    while (LinkedList_peek_head(old_bucket, (LLPayload *)&entry)) {
+      LinkedList **new_slot =
+        &ht->buckets[entry->hash & (Hash64)(ht->num_buckets - 1)];
+      if (*new_slot == NULL) *new_slot = bucket_alloc(ht);
+      // Leave the rest of this bucket where it is, lookups still know to find
+      // it in `old_buckets` since `migrate_idx` hasn't moved past it.
+      if (*new_slot == NULL) return false;
+      LinkedList_move_head(old_bucket, *new_slot);
+    }
+
+    LinkedList_free(old_bucket, NULL);
+    ht->old_buckets[ht->migrate_idx] = NULL;
+    ht->migrate_idx++;
+  }
+
+  free(ht->old_buckets);
+  ht->old_buckets = NULL;
+  ht->old_num_buckets = 0;
+  ht->migrate_idx = 0;
+  return true;
+}
+
+static inline void resize_step(HashTable *ht) {
+  if (ht->old_buckets != NULL && ht->num_iterators == 0) {
+    migrate_buckets(ht, MIGRATE_BUCKETS_PER_STEP);
+  }
+}
+
+static HTEntry *open_find_or_insert(HashTable *ht, Hash64 hash,
+    unsigned char *key, size_t key_len, bool *inserted) {
+  *inserted = false;
+  HTEntry *entry = OpenTable_find(&ht->open, hash, key, key_len);
+  if (entry != NULL) return entry;
+
+  unsigned char *key_cpy = NULL;
+  if (!HTEntry_key_is_inline(key_len)) {
+    key_cpy = malloc(key_len);
+    if (key_cpy == NULL) return NULL;
+  }
+  entry = OpenTable_claim(&ht->open, hash);
+  if (entry == NULL) {
+    free(key_cpy);
+    return NULL;
+  }
+
+  HTEntry_init(entry, hash, key, key_len, key_cpy, NULL);
+  ht->num_elems++;
+  *inserted = true;
+  return entry;
+}
+
+static bool open_remove(HashTable *ht, Hash64 hash, unsigned char *key,
+    size_t key_len, HTValue *old_value) {
+  HTEntry *entry = OpenTable_find(&ht->open, hash, key, key_len);
+  if (entry == NULL) return false;
+
+  if (old_value != NULL) *old_value = entry->value;
+  HTEntry_free_key(entry);
+  OpenTable_release(&ht->open, entry);
+  ht->num_elems--;
+
+  if (ht->num_iterators == 0) OpenTable_maybe_shrink(&ht->open);
+  return true;
+}
+
+static HTEntry *find_or_insert(HashTable *ht, Hash64 hash, unsigned char *key,
+    size_t key_len, bool *inserted) {
+  HT_STAT_ADD(ht->lookups, 1);
+  if (ht->engine == HT_ENGINE_OPEN) {
+    return open_find_or_insert(ht, hash, key, key_len, inserted);
+  }
+
+  // Finding an existing entry never allocates.
+  *inserted = false;
+  LinkedList **bucket_slot = bucket_slot_by_hash(ht, hash);
+  LLIterator bucket_iter;
+  if (LLIterator_init(&bucket_iter, *bucket_slot)) {
+#if COLLISION_RESIST
+    if (advance_to_target(ht, &bucket_iter, hash, key, key_len)) {
+#else
+    if (advance_to_target(ht, &bucket_iter, hash)) {
+#endif
+      return *LLIterator_get(&bucket_iter);
+    }
+  }
+
+  if (*bucket_slot == NULL) *bucket_slot = bucket_alloc(ht);
+  if (*bucket_slot == NULL) return NULL;
+
+  // Short keys are stored inline, so most inserts only need to allocate the
+  // entry itself.
+  HTEntry *new_entry = entry_alloc(ht);
+  if (new_entry == NULL) return NULL;
+  unsigned char *key_cpy = NULL;
+  if (!HTEntry_key_is_inline(key_len)) {
+    key_cpy = malloc(key_len);
+    if (key_cpy == NULL) {
+      entry_free(ht, new_entry);
+      return NULL;
+    }
+  }
+  HTEntry_init(new_entry, hash, key, key_len, key_cpy, NULL);
+
+  if (!LinkedList_prepend(*bucket_slot, new_entry)) {
+    HTEntry_free_key(new_entry);
+    entry_free(ht, new_entry);
+    return NULL;
+  }
+  ht->num_elems++;
+  if (key_cpy != NULL) ht->num_heap_keys++;
+  *inserted = true;
+
+  // Entries are allocated individually, so resizing doesn't move new_entry.
+  resize_step(ht);
+  if (ht->num_iterators == 0 &&
+      ht->num_elems > ht->num_buckets * MAX_LOAD_FACTOR) {
+    start_resize(ht, ht->num_buckets * 2);
+  }
+  return new_entry;
+}
 
-// FIXME way to deal with malloc failure
 bool HashTable_insert(HashTable *ht, unsigned char *key, size_t key_len,
     HTValue new_value, HTValue *old_value) {
   if (ht == NULL || key == NULL) return false;
@@ -195,150 +632,513 @@ bool HashTable_insert(HashTable *ht, unsigned char *key, size_t key_len,
   // If the user is using the "length zero -> C string" short hand, find the
   // actual length of the string.
   size_t true_key_len = get_true_key_len(key, key_len);
+  return HashTable_insert_hashed(ht, ht->hash(key, true_key_len), key,
+      true_key_len, new_value, old_value);
+}
 
-  // Set up HTEntry members
-  Hash64 hash = FNV1a_64bit(key, true_key_len);
-  unsigned char *key_cpy = malloc(true_key_len);
-  memcpy(key_cpy, key, true_key_len);
+bool HashTable_insert_hashed(HashTable *ht, uint64_t hash, unsigned char *key,
+    size_t key_len, HTValue new_value, HTValue *old_value) {
+  if (ht == NULL || key == NULL) return false;
 
-  HTEntry *new_entry = malloc(sizeof(HTEntry));
-  new_entry->hash = hash;
-  new_entry->key = key_cpy;
-  new_entry->key_len = true_key_len;
-  new_entry->value = new_value;
-  
-  bool found = false;
-  LinkedList *bucket = ht->buckets[bucket_idx_by_hash(ht, hash)];
-  LLIterator *bucket_iter = LLIterator_allocate(bucket);
+  // FIXME there's no way to report allocation failure to the caller, since
+  // false already means "key wasn't previously present".
+  bool inserted;
+  HTEntry *entry = find_or_insert(ht, hash, key,
+      get_true_key_len(key, key_len), &inserted);
+  if (entry == NULL) return false;
+
+  // Overwriting an existing entry is done in place, so it never allocates.
+  if (!inserted && old_value != NULL) *old_value = entry->value;
+  entry->value = new_value;
+  return !inserted;
+}
+
+HTValue *HashTable_entry(HashTable *ht, unsigned char *key, size_t key_len,
+    bool *inserted) {
+  if (ht == NULL || key == NULL) return NULL;
+
+  size_t true_key_len = get_true_key_len(key, key_len);
+  return HashTable_entry_hashed(ht, ht->hash(key, true_key_len), key,
+      true_key_len, inserted);
+}
+
+HTValue *HashTable_entry_hashed(HashTable *ht, uint64_t hash,
+    unsigned char *key, size_t key_len, bool *inserted) {
+  if (ht == NULL || key == NULL) return NULL;
+
+  bool was_inserted;
+  HTEntry *entry = find_or_insert(ht, hash, key,
+      get_true_key_len(key, key_len), &was_inserted);
+  if (entry == NULL) return NULL;
+  if (inserted != NULL) *inserted = was_inserted;
+  return &entry->value;
+}
+
+static HTEntry *find_entry(HashTable *ht, Hash64 hash, unsigned char *key,
+    size_t key_len) {
+  HT_STAT_ADD(ht->lookups, 1);
+  if (ht->engine == HT_ENGINE_OPEN) {
+    return OpenTable_find(&ht->open, hash, key, key_len);
+  }
+
+  LLIterator bucket_iter;
+  if (!LLIterator_init(&bucket_iter, *bucket_slot_by_hash(ht, hash))) {
+    return NULL;
+  }
 #if COLLISION_RESIST
-  if (advance_to_target(bucket_iter, hash, key, true_key_len)) {
+  bool found = advance_to_target(ht, &bucket_iter, hash, key, key_len);
 #else
-  if (advance_to_target(bucket_iter, hash)) {
+  bool found = advance_to_target(ht, &bucket_iter, hash);
 #endif
-    found = true;
-    HTEntry *old_entry;
-    LLIterator_remove(bucket_iter, (LLPayload *)&old_entry);
-    if (old_value != NULL) *old_value = old_entry->value;
-    free(old_entry->key);
-    free(old_entry);
-  }
-  LLIterator_free(bucket_iter);
-
-  LinkedList_prepend(bucket, new_entry);
-  if (!found) ht->num_elems++;
-
-  return found;
+  if (!found) return NULL;
+  return *LLIterator_get(&bucket_iter);
 }
 
-// FIXME way to deal with LLIterator_allocate failure
 HTValue *HashTable_find(HashTable *ht, unsigned char *key, size_t key_len) {
   if (ht == NULL || key == NULL) return NULL;
 
   size_t true_key_len = get_true_key_len(key, key_len);
-  Hash64 hash = FNV1a_64bit(key, true_key_len);
-  
-  LLIterator *bucket_iter =
-    LLIterator_allocate(ht->buckets[bucket_idx_by_hash(ht, hash)]);
-#if COLLISION_RESIST
-  bool found = advance_to_target(bucket_iter, hash, key, true_key_len);
-#else
-  bool found = advance_to_target(bucket_iter, hash);
-#endif 
+  Hash64 hash = ht->hash(key, true_key_len);
+  HTEntry *entry = find_entry(ht, hash, key, true_key_len);
+  return entry != NULL ? &entry->value : NULL;
+}
+
+HTValue *HashTable_find_hashed(HashTable *ht, uint64_t hash,
+    unsigned char *key, size_t key_len) {
+  if (ht == NULL || key == NULL) return NULL;
 
-  HTEntry **entry_ptr = (HTEntry **)LLIterator_get(bucket_iter);
-  LLIterator_free(bucket_iter);
-  return found ? &(*entry_ptr)->value : NULL;
+  HTEntry *entry = find_entry(ht, hash, key, get_true_key_len(key, key_len));
+  return entry != NULL ? &entry->value : NULL;
+}
+
+size_t HashTable_find_many(HashTable *ht, unsigned char *const keys[],
+    const size_t key_lens[], size_t num_keys, HTValue *values_out[]) {
+  if (ht == NULL || keys == NULL || values_out == NULL) return 0;
+
+  size_t num_found = 0;
+  for (size_t start = 0; start < num_keys; start += FIND_MANY_BATCH) {
+    size_t batch_len = num_keys - start;
+    if (batch_len > FIND_MANY_BATCH) batch_len = FIND_MANY_BATCH;
+    unsigned char *const *batch_keys = &keys[start];
+    Hash64 hashes[FIND_MANY_BATCH];
+    size_t true_key_lens[FIND_MANY_BATCH];
+
+    // Each pass below only touches memory that the previous pass prefetched,
+    // so every pass can have the whole batch's cache misses in flight at once.
+    // First, hash everything and prefetch the start of each probe.
+    for (size_t i = 0; i < batch_len; i++) {
+      if (batch_keys[i] == NULL) continue;
+      size_t key_len = key_lens != NULL ? key_lens[start + i] : 0;
+      true_key_lens[i] = get_true_key_len(batch_keys[i], key_len);
+      hashes[i] = ht->hash(batch_keys[i], true_key_lens[i]);
+      if (ht->engine == HT_ENGINE_OPEN) {
+        OpenTable_prefetch_ctrl(&ht->open, hashes[i]);
+      } else {
+        __builtin_prefetch(bucket_slot_by_hash(ht, hashes[i]));
+      }
+    }
+
+    // Then prefetch whatever the first step of each probe points to
+    for (size_t i = 0; i < batch_len; i++) {
+      if (batch_keys[i] == NULL) continue;
+      if (ht->engine == HT_ENGINE_OPEN) {
+        OpenTable_prefetch_slots(&ht->open, hashes[i]);
+      } else {
+        __builtin_prefetch(*bucket_slot_by_hash(ht, hashes[i]));
+      }
+    }
+
+    for (size_t i = 0; i < batch_len; i++) {
+      HTEntry *entry = NULL;
+      if (batch_keys[i] != NULL) {
+        entry = find_entry(ht, hashes[i], batch_keys[i], true_key_lens[i]);
+      }
+      values_out[start + i] = entry != NULL ? &entry->value : NULL;
+      if (entry != NULL) num_found++;
+    }
+  }
+  return num_found;
 }
 
-// FIXME way to deal with LLIterator_allocate failure
 bool HashTable_remove(HashTable *ht, unsigned char *key, size_t key_len,
     HTValue *old_value) {
   if (ht == NULL || key == NULL) return false;
 
   size_t true_key_len = get_true_key_len(key, key_len);
-  Hash64 hash = FNV1a_64bit(key, true_key_len);
+  return HashTable_remove_hashed(ht, ht->hash(key, true_key_len), key,
+      true_key_len, old_value);
+}
+
+bool HashTable_remove_hashed(HashTable *ht, uint64_t hash, unsigned char *key,
+    size_t key_len, HTValue *old_value) {
+  if (ht == NULL || key == NULL) return false;
+
+  size_t true_key_len = get_true_key_len(key, key_len);
+  HT_STAT_ADD(ht->lookups, 1);
+  if (ht->engine == HT_ENGINE_OPEN) {
+    return open_remove(ht, hash, key, true_key_len, old_value);
+  }
   
-  LLIterator *bucket_iter =
-    LLIterator_allocate(ht->buckets[bucket_idx_by_hash(ht, hash)]);
+  LLIterator bucket_iter;
+  if (!LLIterator_init(&bucket_iter, *bucket_slot_by_hash(ht, hash))) {
+    return false;
+  }
 #if COLLISION_RESIST
-  bool found = advance_to_target(bucket_iter, hash, key, true_key_len);
+  bool found = advance_to_target(ht, &bucket_iter, hash, key, true_key_len);
 #else
-  bool found = advance_to_target(bucket_iter, hash);
+  bool found = advance_to_target(ht, &bucket_iter, hash);
 #endif 
+  if (!found) return false;
+
+  HTEntry *old_entry;
+  LLIterator_remove(&bucket_iter, (LLPayload *)&old_entry);
+  if (old_value != NULL) *old_value = old_entry->value;
+
+  if (!HTEntry_key_is_inline(old_entry->key_len)) ht->num_heap_keys--;
+  HTEntry_free_key(old_entry);
+  entry_free(ht, old_entry);
+  ht->num_elems--;
+
+  resize_step(ht);
+  maybe_start_shrink(ht);
+  return true;
+}
+
+static inline void maybe_start_shrink(HashTable *ht) {
+  if (ht->num_iterators == 0 && ht->num_buckets > DEFAULT_BUCKETS &&
+      ht->num_elems < ht->num_buckets / MIN_LOAD_FACTOR_INV) {
+    start_resize(ht, ht->num_buckets / 2);
+  }
+}
 
-  if (found) {
-    HTEntry *old_entry;
+static int ideal_num_buckets(int num_elems) {
+  int num_buckets = DEFAULT_BUCKETS;
+  while (num_buckets < MAX_BUCKETS &&
+      num_buckets * MAX_LOAD_FACTOR < num_elems) {
+    num_buckets *= 2;
+  }
+  return num_buckets;
+}
 
-    LLIterator_remove(bucket_iter, (LLPayload *)&old_entry);
-    if (old_value != NULL) *old_value = old_entry->value;
+static bool rebuild_slabs(HashTable *ht, int new_num_buckets) {
+  Slab *entry_slab = Slab_allocate(sizeof(HTEntry));
+  Slab *node_slab = Slab_allocate(LinkedList_node_size());
+  LinkedList **buckets = calloc(new_num_buckets, sizeof(LinkedList *));
+  bool ok = entry_slab != NULL && node_slab != NULL && buckets != NULL;
 
-    free(old_entry->key);
-    free(old_entry);
-    ht->num_elems--;
+  for (int i = 0; ok && i < ht->num_buckets; i++) {
+    LLIterator iter;
+    if (!LLIterator_init(&iter, ht->buckets[i])) continue;
+    for (; ok && LLIterator_is_valid(&iter); LLIterator_next(&iter)) {
+      HTEntry *old_entry = *LLIterator_get(&iter);
+      LinkedList **slot =
+        &buckets[old_entry->hash & (Hash64)(new_num_buckets - 1)];
+      if (*slot == NULL) *slot = LinkedList_allocate_with_slab(node_slab);
+      HTEntry *entry = Slab_alloc_object(entry_slab);
+      // The copy shares its key with the old entry, which is fine since the
+      // old entries are released without freeing their keys.
+      ok = *slot != NULL && entry != NULL && LinkedList_append(*slot, entry);
+      if (ok) *entry = *old_entry;
+    }
+  }
+
+  // Whichever set of buckets is being thrown away, their entries and nodes
+  // live in Slabs that are freed along with them.
+  LinkedList **dead_buckets = ok ? ht->buckets : buckets;
+  int num_dead_buckets = ok ? ht->num_buckets : new_num_buckets;
+  if (dead_buckets != NULL) {
+    for (int i = 0; i < num_dead_buckets; i++) {
+      LinkedList_free(dead_buckets[i], NULL);
+    }
+  }
+  free(dead_buckets);
+  if (!ok) {
+    Slab_free(entry_slab);
+    Slab_free(node_slab);
+    return false;
+  }
+
+  Slab_free(ht->entry_slab);
+  Slab_free(ht->node_slab);
+  ht->entry_slab = entry_slab;
+  ht->node_slab = node_slab;
+  ht->buckets = buckets;
+  ht->num_buckets = new_num_buckets;
+  HT_STAT_ADD(ht->resizes, 1);
+  return true;
+}
+
+bool HashTable_compact(HashTable *ht) {
+  if (ht == NULL || ht->num_iterators > 0) return false;
+
+  if (ht->engine == HT_ENGINE_OPEN) return OpenTable_compact(&ht->open);
+
+  // Finish any resize that's in progress, so that there's only one bucket
+  // array left to deal with
+  if (ht->old_buckets != NULL && !migrate_buckets(ht, ht->old_num_buckets)) {
+    return false;
+  }
+
+  int new_num_buckets = ideal_num_buckets(ht->num_elems);
+  if (ht->entry_slab != NULL) return rebuild_slabs(ht, new_num_buckets);
+
+  if (new_num_buckets != ht->num_buckets) {
+    start_resize(ht, new_num_buckets);
+    if (ht->num_buckets != new_num_buckets ||
+        !migrate_buckets(ht, ht->old_num_buckets)) {
+      return false;
+    }
+  }
+  // Buckets that have been emptied by removals keep their (empty) lists
+  for (int i = 0; i < ht->num_buckets; i++) {
+    if (ht->buckets[i] != NULL &&
+        LinkedList_num_elements(ht->buckets[i]) == 0) {
+      LinkedList_free(ht->buckets[i], NULL);
+      ht->buckets[i] = NULL;
+    }
+  }
+  return true;
+}
+
+// Adds a chain of length `len` to the histogram/max/total being built up by
+// HashTable_get_stats. Chains of length 0 only go into the histogram.
+static void add_chain(HTStats *stats, size_t len, size_t *total_len,
+    size_t *num_chains) {
+  size_t row = len < HT_STATS_HISTOGRAM_LEN ? len : HT_STATS_HISTOGRAM_LEN - 1;
+  stats->histogram[row]++;
+  if (len == 0) return;
+  if (len > stats->max_chain_len) stats->max_chain_len = len;
+  *total_len += len;
+  (*num_chains)++;
+}
+
+bool HashTable_get_stats(HashTable *ht, HTStats *stats) {
+  if (ht == NULL || stats == NULL) return false;
+
+  memset(stats, 0, sizeof(HTStats));
+  stats->engine = ht->engine;
+  stats->num_elements = ht->num_elems;
+  size_t total_len = 0;
+  size_t num_chains = 0;
+
+  if (ht->engine == HT_ENGINE_OPEN) {
+    // Every element's probe is a chain of its own
+    const OpenTable *ot = &ht->open;
+    stats->num_buckets = ot->capacity;
+    for (size_t slot = 0; slot < ot->capacity; slot++) {
+      if (!OpenTable_slot_is_full(ot, slot)) continue;
+      add_chain(stats, OpenTable_probe_length(ot, slot), &total_len,
+          &num_chains);
+    }
+  } else {
+    // Buckets in `old_buckets` before `migrate_idx` have already been moved
+    // into `buckets`, so they aren't counted.
+    stats->num_buckets = ht->num_buckets;
+    for (int i = 0; i < ht->num_buckets; i++) {
+      LinkedList *bucket = ht->buckets[i];
+      add_chain(stats, bucket != NULL ? LinkedList_num_elements(bucket) : 0,
+          &total_len, &num_chains);
+    }
+    if (ht->old_buckets != NULL) {
+      stats->num_buckets += ht->old_num_buckets - ht->migrate_idx;
+      for (int i = ht->migrate_idx; i < ht->old_num_buckets; i++) {
+        LinkedList *bucket = ht->old_buckets[i];
+        add_chain(stats,
+            bucket != NULL ? LinkedList_num_elements(bucket) : 0,
+            &total_len, &num_chains);
+      }
+    }
+  }
+
+  stats->load_factor = (double)stats->num_elements / stats->num_buckets;
+  if (num_chains > 0) stats->avg_chain_len = (double)total_len / num_chains;
+
+#if HT_STATS
+  stats->counters_enabled = true;
+  stats->lookups = ht->lookups;
+  if (ht->engine == HT_ENGINE_OPEN) {
+    stats->probes = ht->open.probes;
+    stats->resizes = ht->open.resizes;
+  } else {
+    stats->probes = ht->probes;
+    stats->resizes = ht->resizes;
+  }
+#endif
+  return true;
+}
+
+// Appends printf style text to the buffer being filled in by
+// HashTable_format_stats. `*len` is the length of the text so far, and keeps
+// counting once the buffer is full.
+static void append_stats(char *buf, size_t buf_len, size_t *len,
+    const char *fmt, ...) {
+  size_t room = *len < buf_len ? buf_len - *len : 0;
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(room > 0 ? buf + *len : NULL, room, fmt, args);
+  va_end(args);
+  if (n > 0) *len += n;
+}
+
+size_t HashTable_format_stats(HashTable *ht, char *buf, size_t buf_len) {
+  HTStats stats;
+  if (!HashTable_get_stats(ht, &stats)) return 0;
+  if (buf_len > 0) buf[0] = '\0';
+
+  size_t len = 0;
+  bool open = stats.engine == HT_ENGINE_OPEN;
+  append_stats(buf, buf_len, &len, "HashTable (%s engine)\n",
+      open ? "open" : "chained");
+  append_stats(buf, buf_len, &len, "  elements:     %d\n",
+      stats.num_elements);
+  append_stats(buf, buf_len, &len, "  %s     %zu (load factor %.3f)\n",
+      open ? "slots:   " : "buckets: ", stats.num_buckets, stats.load_factor);
+  append_stats(buf, buf_len, &len, "  chain length: max %zu, avg %.3f %s\n",
+      stats.max_chain_len, stats.avg_chain_len, open ? "groups" : "entries");
+  if (stats.counters_enabled) {
+    double probes_per_lookup = stats.lookups > 0 ?
+      (double)stats.probes / stats.lookups : 0;
+    append_stats(buf, buf_len, &len,
+        "  lookups:      %" PRIu64 " (%.3f probes per lookup)\n",
+        stats.lookups, probes_per_lookup);
+    append_stats(buf, buf_len, &len, "  resizes:      %" PRIu64 "\n",
+        stats.resizes);
+  } else {
+    append_stats(buf, buf_len, &len,
+        "  lookups:      not counted (build with HT_STATS=1)\n");
+  }
+
+  // Rows past the last non-empty one are left out, as is row 0 with
+  // HT_ENGINE_OPEN since probes always take at least one group
+  int num_rows = HT_STATS_HISTOGRAM_LEN;
+  while (num_rows > 1 && stats.histogram[num_rows - 1] == 0) num_rows--;
+  append_stats(buf, buf_len, &len, "  %s\n", open ?
+      "entries by groups probed:" : "buckets by number of entries:");
+  for (int i = open ? 1 : 0; i < num_rows; i++) {
+    bool last = i == HT_STATS_HISTOGRAM_LEN - 1;
+    append_stats(buf, buf_len, &len, "    %3d%s %zu\n", i,
+        last ? "+:" : ":", stats.histogram[i]);
+  }
+  return len;
+}
+
+// HTIterators walk a "virtual" array of buckets: while a resize is in
+// progress, indices [0, old_num_buckets) refer to `old_buckets` and the rest
+// refer to `buckets`. Buckets can't be migrated while an iterator is live, so
+// this mapping stays fixed for the iterator's lifetime.
+static inline int num_virtual_buckets(HashTable *ht) {
+  return ht->num_buckets + (ht->old_buckets != NULL ? ht->old_num_buckets : 0);
+}
+static inline LinkedList *virtual_bucket(HashTable *ht, int idx) {
+  if (ht->old_buckets != NULL) {
+    if (idx < ht->old_num_buckets) return ht->old_buckets[idx];
+    idx -= ht->old_num_buckets;
+  }
+  return ht->buckets[idx];
+}
+
+// Points `hti->bucket_iter` at the first element in the first non-empty
+// bucket at or after `hti->bucket_idx`, or moves `hti->bucket_idx` past the
+// last bucket if there aren't any.
+static void seek_nonempty_bucket(HTIterator *hti) {
+  int total = num_virtual_buckets(hti->table);
+  for (; hti->bucket_idx < total; hti->bucket_idx++) {
+    LinkedList *bucket = virtual_bucket(hti->table, hti->bucket_idx);
+    if (bucket != NULL && LinkedList_num_elements(bucket) > 0) {
+      LLIterator_init(&hti->bucket_iter, bucket);
+      return;
+    }
   }
-  LLIterator_free(bucket_iter);
-  return found;
 }
 
 HTIterator *HTIterator_allocate(HashTable *ht) {
   if (ht == NULL) return NULL;
   HTIterator *iter = malloc(sizeof(HTIterator));
+  if (iter == NULL) return NULL;
+  HTIterator_init(iter, ht);
+  return iter;
+}
+
+bool HTIterator_init(HTIterator *hti, HashTable *ht) {
+  if (hti == NULL || ht == NULL) return false;
+  hti->table = ht;
+  hti->bucket_idx = 0;
+  hti->entry_idx = 0;
+  ht->num_iterators++;
+
+  if (ht->engine == HT_ENGINE_OPEN) {
+    hti->entry_idx = OpenTable_next_full(&ht->open, 0);
+    return true;
+  }
+
   if (ht->num_elems == 0) {
     // If the hash table is empty, just return an invalid iterator.
-    iter->table = ht;
-    iter->bucket_iter = NULL;
-    return iter;
-  }
-  iter->table = ht;
-
-  // Start at -1 so the first run of the do-while sets it to zero. For tables
-  // with few elements, not all buckets will have elements, so we need to skip
-  // over the empty buckets.
-  iter->bucket_idx = -1;
-  do {
-    iter->bucket_idx++;
-    iter->bucket_iter = LLIterator_allocate(ht->buckets[iter->bucket_idx]);
-  } while (!LLIterator_is_valid(iter->bucket_iter));
-  return iter;
+    hti->bucket_idx = num_virtual_buckets(ht);
+    return true;
+  }
+
+  // For tables with few elements, not all buckets will have elements, so we
+  // need to skip over the empty buckets.
+  seek_nonempty_bucket(hti);
+  return true;
+}
+
+void HTIterator_release(HTIterator *hti) {
+  if (hti == NULL || hti->table == NULL) return;
+  HashTable *ht = hti->table;
+  hti->table = NULL;
+
+  // Removals through iterators don't shrink the table, so catch up on that
+  // now that nothing is stopping it. A traversal that removed nothing leaves
+  // the table as it was, e.g. keeping space set aside by HashTable_reserve.
+  if (--ht->num_iterators > 0 || !ht->removed_by_iterator) return;
+  ht->removed_by_iterator = false;
+  if (ht->engine == HT_ENGINE_OPEN) {
+    OpenTable_maybe_shrink(&ht->open);
+  } else {
+    maybe_start_shrink(ht);
+  }
 }
 
 void HTIterator_free(HTIterator *hti) {
-  if (hti == NULL) return;
-  LLIterator_free(hti->bucket_iter);
+  HTIterator_release(hti);
   free(hti);
 }
 
 bool HTIterator_is_valid(HTIterator *hti) {
-  if (hti == NULL) return false;
+  if (hti == NULL || hti->table == NULL) return false;
   if (hti->table->num_elems == 0) return false;
-  return hti->bucket_iter != NULL;
+  if (hti->table->engine == HT_ENGINE_OPEN) {
+    return hti->entry_idx < hti->table->open.num_entries;
+  }
+  return hti->bucket_idx < num_virtual_buckets(hti->table);
 }
 
 bool HTIterator_next(HTIterator *hti) {
   if (hti == NULL) return false;
   if (!HTIterator_is_valid(hti)) return false;
-  if (!LLIterator_next(hti->bucket_iter)) {
-    LLIterator_free(hti->bucket_iter);
-    do {
-      // If there aren't any more buckets to iterate, set bucket_iter to NULL to
-      // signal the iterator is invalid and return.
-      if (hti->bucket_idx == hti->table->num_buckets - 1) {
-        hti->bucket_iter = NULL;
-        return false;
-      }
-      hti->bucket_idx++; 
-      hti->bucket_iter =
-        LLIterator_allocate(hti->table->buckets[hti->bucket_idx]);
-    } while(!LLIterator_is_valid(hti->bucket_iter));
+  if (hti->table->engine == HT_ENGINE_OPEN) {
+    OpenTable *ot = &hti->table->open;
+    hti->entry_idx = OpenTable_next_full(ot, hti->entry_idx + 1);
+    return hti->entry_idx < ot->num_entries;
   }
-  return true;
+  if (!LLIterator_next(&hti->bucket_iter)) {
+    hti->bucket_idx++;
+    seek_nonempty_bucket(hti);
+  }
+  return HTIterator_is_valid(hti);
 }
 
 bool HTIterator_get(HTIterator *hti, const unsigned char **key_out,
     size_t *key_len_out, HTValue *value_out) {
   if (hti == NULL || !HTIterator_is_valid(hti)) return false;
-  HTEntry *entry = *LLIterator_get(hti->bucket_iter);
-  if (key_out != NULL) *key_out = entry->key;
+  HTEntry *entry;
+  if (hti->table->engine == HT_ENGINE_OPEN) {
+    entry = &hti->table->open.entries[hti->entry_idx];
+  } else {
+    entry = *LLIterator_get(&hti->bucket_iter);
+  }
+  if (key_out != NULL) *key_out = HTEntry_key(entry);
   if (key_len_out != NULL) *key_len_out = entry->key_len;
   if (value_out != NULL) *value_out = entry->value;
   return true;
@@ -348,23 +1148,54 @@ bool HTIterator_remove(HTIterator *hti, unsigned char **key_out,
     size_t *key_len_out, HTValue *value_out) {
   if (hti == NULL || !HTIterator_is_valid(hti)) return false;
 
-  unsigned char *key;
-  size_t key_len;
-  if (!HTIterator_get(hti, (const unsigned char **)&key, &key_len, NULL)) {
-    return false;
+  HashTable *ht = hti->table;
+  HTEntry *entry;
+  if (ht->engine == HT_ENGINE_OPEN) {
+    entry = &ht->open.entries[hti->entry_idx];
+  } else {
+    entry = *LLIterator_get(&hti->bucket_iter);
   }
 
-  HTIterator_next(hti);
-  
-  // HashTable remove frees the key in the HTEntry struct, so the pointer
-  // into that struct we got from HTIterator_get is no longer valid. Therefore,
-  // we make a copy before returning it to the caller
-  unsigned char *key_cpy = malloc(key_len);
-  memcpy(key_cpy, key, key_len);
-
-  if (key_out != NULL) *key_out = key_cpy;
-  if (key_len_out != NULL) *key_len_out = key_len;
-  HashTable_remove(hti->table, key, key_len, value_out);
+  // Heap keys are handed straight to the caller, but inline keys live in the
+  // entry itself and have to be copied out before it's released. This is the
+  // only step that can fail, so it's done before anything is unlinked.
+  bool inline_key = HTEntry_key_is_inline(entry->key_len);
+  if (key_out != NULL) {
+    if (inline_key) {
+      unsigned char *key_cpy = malloc(entry->key_len > 0 ? entry->key_len : 1);
+      if (key_cpy == NULL) return false;
+      memcpy(key_cpy, entry->key.bytes, entry->key_len);
+      *key_out = key_cpy;
+    } else {
+      *key_out = entry->key.ptr;
+    }
+  } else {
+    HTEntry_free_key(entry);
+  }
+  if (key_len_out != NULL) *key_len_out = entry->key_len;
+  if (value_out != NULL) *value_out = entry->value;
+
+  // The entry is unlinked in place, without hashing its key or looking it up
+  // again. Nothing is resized, since hti itself is a live iterator.
+  if (ht->engine == HT_ENGINE_OPEN) {
+    OpenTable_release(&ht->open, entry);
+    hti->entry_idx = OpenTable_next_full(&ht->open, hti->entry_idx + 1);
+  } else {
+    // Removing a bucket's last node leaves bucket_iter on its predecessor,
+    // which has already been visited, so check for that up front.
+    LLIterator probe = hti->bucket_iter;
+    bool was_last = !LLIterator_next(&probe);
+    LLPayload unused;
+    LLIterator_remove(&hti->bucket_iter, &unused);
+    if (!inline_key) ht->num_heap_keys--;
+    entry_free(ht, entry);
+    if (was_last) {
+      hti->bucket_idx++;
+      seek_nonempty_bucket(hti);
+    }
+  }
+  ht->num_elems--;
+  ht->removed_by_iterator = true;
   return true;
 }
 
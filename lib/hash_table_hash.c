@@ -0,0 +1,273 @@
+/* Provides the hash functions HashTable can be configured to use.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _XOPEN_SOURCE 700
+
+#include "hash_table_internal.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
+#include <unistd.h>
+
+// Per-process keys for the seeded hash functions. These are written exactly
+// once, by init_seeds, and only read afterwards.
+static uint64_t sip_k0, sip_k1;
+static uint64_t wy_seed;
+static pthread_once_t seeds_once = PTHREAD_ONCE_INIT;
+
+// Fills in the per-process keys, preferring the kernel's CSPRNG. If that
+// fails the keys are derived from the time and pid, which is at least
+// different between runs.
+static void init_seeds(void);
+
+// Computes the hash of data using the Fowler-Noll-Vo 1a Hash with a hash length
+// of 64 bits. Unseeded.
+static Hash64 FNV1a_64bit(const unsigned char *data, size_t data_len);
+// Computes SipHash-1-3 of data, keyed with (sip_k0, sip_k1).
+static Hash64 SipHash13_64bit(const unsigned char *data, size_t data_len);
+// Computes wyhash (final version 4) of data, seeded with wy_seed.
+static Hash64 WyHash_64bit(const unsigned char *data, size_t data_len);
+
+static inline uint64_t read64_le(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+static inline uint64_t read32_le(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap32(v);
+#endif
+  return v;
+}
+
+static inline uint64_t rotl64(uint64_t x, int b) {
+  return (x << b) | (x >> (64 - b));
+}
+
+// splitmix64, used to stretch the fallback seed material into keys.
+static uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+static void init_seeds(void) {
+  uint64_t keys[3];
+  size_t filled = 0;
+  while (filled < sizeof(keys)) {
+    ssize_t got = getrandom((unsigned char *)keys + filled,
+        sizeof(keys) - filled, 0);
+    if (got <= 0) break;
+    filled += got;
+  }
+
+  if (filled < sizeof(keys)) {
+    FILE *urandom = fopen("/dev/urandom", "rb");
+    if (urandom != NULL) {
+      filled = fread(keys, 1, sizeof(keys), urandom);
+      fclose(urandom);
+    }
+  }
+
+  if (filled < sizeof(keys)) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t state = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    state ^= (uint64_t)getpid() << 32;
+    state ^= (uint64_t)(uintptr_t)&state;
+    for (int i = 0; i < 3; i++) keys[i] = splitmix64(&state);
+  }
+
+  sip_k0 = keys[0];
+  sip_k1 = keys[1];
+  wy_seed = keys[2];
+}
+
+HashFunction HashFunction_get(HTHashFn hash_fn) {
+  pthread_once(&seeds_once, init_seeds);
+  switch (hash_fn) {
+    case HT_HASH_SIPHASH:
+      return SipHash13_64bit;
+    case HT_HASH_WYHASH:
+      return WyHash_64bit;
+    case HT_HASH_FNV1A:
+      return FNV1a_64bit;
+    default:
+      return NULL;
+  }
+}
+
+#define FNV_PRIME 0x00000100000001B3
+#define FNV_INIT 0xcbf29ce484222325
+// A public domain reference implementation of the FNV hash function can be
+// found on Landon Curt Noll's webpage:
+// <http://www.isthe.com/chongo/src/fnv/hash_64.c>
+static Hash64 FNV1a_64bit(const unsigned char *data, size_t data_len) {
+  Hash64 hash = FNV_INIT;
+  const unsigned char *current = data;
+  while (current < data + data_len) {
+    hash ^= *current;
+    hash *= FNV_PRIME;
+    current++;
+  }
+
+  return hash;
+}
+
+// SipHash was designed by Jean-Philippe Aumasson and Daniel J. Bernstein, see
+// <https://www.aumasson.jp/siphash/siphash.pdf>. The 1-3 variant (one round
+// per 8-byte block, three finalization rounds) is the one used for hash tables
+// by Python and Rust.
+#define SIPROUND \
+  do { \
+    v0 += v1; v1 = rotl64(v1, 13); v1 ^= v0; v0 = rotl64(v0, 32); \
+    v2 += v3; v3 = rotl64(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = rotl64(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = rotl64(v1, 17); v1 ^= v2; v2 = rotl64(v2, 32); \
+  } while (0)
+
+static Hash64 SipHash13_64bit(const unsigned char *data, size_t data_len) {
+  uint64_t v0 = 0x736f6d6570736575 ^ sip_k0;
+  uint64_t v1 = 0x646f72616e646f6d ^ sip_k1;
+  uint64_t v2 = 0x6c7967656e657261 ^ sip_k0;
+  uint64_t v3 = 0x7465646279746573 ^ sip_k1;
+
+  const unsigned char *end = data + (data_len & ~(size_t)7);
+  for (; data < end; data += 8) {
+    uint64_t m = read64_le(data);
+    v3 ^= m;
+    SIPROUND;
+    v0 ^= m;
+  }
+
+  // The last block holds the remaining 0-7 bytes, with the length in the top
+  // byte.
+  uint64_t b = (uint64_t)data_len << 56;
+  switch (data_len & 7) {
+    case 7: b |= (uint64_t)data[6] << 48;  // fall through
+    case 6: b |= (uint64_t)data[5] << 40;  // fall through
+    case 5: b |= (uint64_t)data[4] << 32;  // fall through
+    case 4: b |= (uint64_t)data[3] << 24;  // fall through
+    case 3: b |= (uint64_t)data[2] << 16;  // fall through
+    case 2: b |= (uint64_t)data[1] << 8;  // fall through
+    case 1: b |= (uint64_t)data[0];  // fall through
+    case 0: break;
+  }
+  v3 ^= b;
+  SIPROUND;
+  v0 ^= b;
+
+  v2 ^= 0xff;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// wyhash was written by Wang Yi and released into the public domain, see
+// <https://github.com/wangyi-fudan/wyhash>. This follows version 4 of the
+// reference implementation with its default secret.
+static const uint64_t wy_secret[4] = {
+  0x2d358dccaa6c78a5, 0x8bb84b93962eacc9,
+  0x4b33a62ed433d4a3, 0x4d5a2da51de1aa47,
+};
+
+// Sets *a and *b to the low and high halves of the 128-bit product *a * *b.
+static inline void wy_mum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32;
+  uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t wy_mix(uint64_t a, uint64_t b) {
+  wy_mum(&a, &b);
+  return a ^ b;
+}
+
+static Hash64 WyHash_64bit(const unsigned char *data, size_t data_len) {
+  const unsigned char *p = data;
+  uint64_t seed = wy_seed ^ wy_mix(wy_seed ^ wy_secret[0], wy_secret[1]);
+  uint64_t a, b;
+
+  if (data_len <= 16) {
+    if (data_len >= 4) {
+      size_t mid = (data_len >> 3) << 2;
+      a = (read32_le(p) << 32) | read32_le(p + mid);
+      b = (read32_le(p + data_len - 4) << 32) |
+        read32_le(p + data_len - 4 - mid);
+    } else if (data_len > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[data_len >> 1] << 8) |
+        p[data_len - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = data_len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = wy_mix(read64_le(p) ^ wy_secret[1], read64_le(p + 8) ^ seed);
+        see1 = wy_mix(read64_le(p + 16) ^ wy_secret[2],
+            read64_le(p + 24) ^ see1);
+        see2 = wy_mix(read64_le(p + 32) ^ wy_secret[3],
+            read64_le(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = wy_mix(read64_le(p) ^ wy_secret[1], read64_le(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = read64_le(p + i - 16);
+    b = read64_le(p + i - 8);
+  }
+
+  a ^= wy_secret[1];
+  b ^= seed;
+  wy_mum(&a, &b);
+  return wy_mix(a ^ wy_secret[0] ^ data_len, b ^ wy_secret[1]);
+}
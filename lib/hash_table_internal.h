@@ -0,0 +1,249 @@
+/* Declares the internals shared between the HashTable storage engines.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// This header is private to lib/; it is intentionally not in lib/include.
+
+#ifndef SUPER_GLUE_LIB_HASH_TABLE_INTERNAL_H_
+#define SUPER_GLUE_LIB_HASH_TABLE_INTERNAL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_table.h"
+
+// Change to `1` if there are errors with hash collisions. This will have a
+// performance penalty because instead of just checking the hashes, if two
+// hashes match the full key will be checked as well.
+#ifndef COLLISION_RESIST
+#define COLLISION_RESIST 1
+#endif
+
+// Change to `1` (e.g., with `make HT_STATS=1`) to count lookups, probes and
+// resizes for HashTable_get_stats. Off by default, in which case the counters
+// aren't even part of the table's structs.
+#ifndef HT_STATS
+#define HT_STATS 0
+#endif
+
+// Adds `n` to one of the HT_STATS counters. Expands to nothing (without
+// evaluating its arguments) when HT_STATS is off.
+#if HT_STATS
+#define HT_STAT_ADD(counter, n) ((counter) += (n))
+#else
+#define HT_STAT_ADD(counter, n) ((void)0)
+#endif
+
+typedef uint64_t Hash64;
+
+// Arrays of HTEntrys are allocated with this alignment, so that checking
+// whether an entry holds a key (HTEntry_matches) touches a single cache line
+// whenever the key is stored inline. Individually allocated entries just use
+// malloc, since glibc's aligned allocation of small objects is slow enough to
+// cost more than it saves.
+#define HT_ENTRY_ALIGN 64
+
+typedef struct {
+  Hash64 hash;
+  size_t key_len;
+  // Use HTEntry_key to get at the key, rather than accessing this directly.
+  // HT_INLINE_KEY_LEN is chosen so that an HTEntry is exactly one cache line.
+  union {
+    unsigned char *ptr;  // Used when key_len > HT_INLINE_KEY_LEN
+    unsigned char bytes[HT_INLINE_KEY_LEN];
+  } key;
+  HTValue value;
+} HTEntry;
+
+_Static_assert(sizeof(HTEntry) == HT_ENTRY_ALIGN,
+    "HTEntry should fill exactly one cache line");
+
+// Checks if a key of length `key_len` is stored inline in its HTEntry.
+static inline bool HTEntry_key_is_inline(size_t key_len) {
+  return key_len <= HT_INLINE_KEY_LEN;
+}
+
+// Returns a pointer to the key held by `entry`.
+static inline unsigned char *HTEntry_key(const HTEntry *entry) {
+  return HTEntry_key_is_inline(entry->key_len) ?
+    (unsigned char *)entry->key.bytes : entry->key.ptr;
+}
+
+// Fills in `entry` with a copy of the given key, and the given hash/value.
+//
+// heap_key - If the key isn't short enough to be stored inline, a buffer of
+//            at least `key_len` bytes that the entry takes ownership of and
+//            copies the key into. Otherwise it must be NULL. Allocating this
+//            is left to the caller so that the caller can handle allocation
+//            failure before touching the table.
+static inline void HTEntry_init(HTEntry *entry, Hash64 hash,
+    const unsigned char *key, size_t key_len, unsigned char *heap_key,
+    HTValue value) {
+  entry->hash = hash;
+  entry->key_len = key_len;
+  if (heap_key != NULL) {
+    memcpy(heap_key, key, key_len);
+    entry->key.ptr = heap_key;
+  } else {
+    memcpy(entry->key.bytes, key, key_len);
+  }
+  entry->value = value;
+}
+
+// Frees the heap allocated copy of the entry's key, if it has one.
+static inline void HTEntry_free_key(HTEntry *entry) {
+  if (!HTEntry_key_is_inline(entry->key_len)) free(entry->key.ptr);
+}
+
+// Hashes `data_len` bytes of `data`.
+typedef Hash64 (*HashFunction)(const unsigned char *data, size_t data_len);
+
+// Returns the implementation of `hash_fn`, or NULL if it isn't a valid
+// HTHashFn. Seeds the per-process keys the first time it's called, so the
+// returned function must not be called before this has returned. See
+// hash_table_hash.c.
+HashFunction HashFunction_get(HTHashFn hash_fn);
+
+// Checks if `entry` holds the given key. The key itself is only compared if
+// COLLISION_RESIST is enabled.
+static inline bool HTEntry_matches(const HTEntry *entry, Hash64 hash,
+    const unsigned char *key, size_t key_len) {
+  if (entry->hash != hash) return false;
+#if COLLISION_RESIST
+  return entry->key_len == key_len &&
+    memcmp(HTEntry_key(entry), key, key_len) == 0;
+#else
+  (void)key;
+  (void)key_len;
+  return true;
+#endif
+}
+
+// =============================================================================
+// Open addressing engine (HT_ENGINE_OPEN), see hash_table_open.c
+
+// The number of control bytes that are probed at once.
+#define OT_GROUP_WIDTH 16
+
+// An open addressing table in the style of Abseil's "Swiss tables", laid out
+// like CPython's compact dicts. Each slot has a control byte that's either
+// empty, deleted, or holds the low 7 bits of the hash of the entry in that
+// slot. Lookups compare a group of OT_GROUP_WIDTH control bytes against the
+// hash at once, and only look at slots whose control bytes match.
+//
+// The slots themselves only hold the index of their entry; the entries are
+// kept densely packed in a separate array, in the order they were inserted.
+// Removing an entry leaves a hole in that array, which is closed up the next
+// time the table is rehashed. This keeps the part of the table that's probed
+// small, and lets iteration be a linear scan over the entries.
+typedef struct {
+  // `capacity + OT_GROUP_WIDTH` control bytes. The last OT_GROUP_WIDTH are
+  // copies of the first ones so that groups can wrap around the end of the
+  // table without any special casing.
+  uint8_t *ctrl;
+  // `capacity` indices into `entries`, only meaningful for full slots.
+  uint32_t *indices;
+  // Room for as many entries as the table can hold before it has to rehash
+  // (see OpenTable_claim), whether or not some of them have since been
+  // removed.
+  HTEntry *entries;
+  size_t capacity;  // Always a power of two, and at least OT_GROUP_WIDTH
+  size_t size;
+  // How many entries at the start of `entries` are in use, holes included.
+  size_t num_entries;
+#if HT_STATS
+  uint64_t probes;   // Groups probed by OpenTable_find
+  uint64_t resizes;  // Rehashes, including those done in place
+#endif
+} OpenTable;
+
+// Initializes an empty OpenTable able to hold at least `min_size` entries
+// without rehashing.
+//
+// Returns false if memory couldn't be allocated.
+bool OpenTable_init(OpenTable *ot, size_t min_size);
+
+// Frees the memory owned by `ot` itself. Doesn't touch the keys/values of any
+// entries in the table, callers should free those first if needed.
+void OpenTable_destroy(OpenTable *ot);
+
+// Finds the entry with the given hash/key.
+//
+// Returns a pointer to the entry, or NULL if it isn't in the table.
+HTEntry *OpenTable_find(OpenTable *ot, Hash64 hash, const unsigned char *key,
+    size_t key_len);
+
+// Prefetches the first group of control bytes that OpenTable_find would probe
+// when looking up `hash`, along with the group's indices.
+void OpenTable_prefetch_ctrl(const OpenTable *ot, Hash64 hash);
+
+// Prefetches the entries held by the slots in the first probed group whose
+// control bytes match `hash`. This reads the control bytes and indices, so it
+// should be called a while after OpenTable_prefetch_ctrl for the same hash to
+// avoid stalling on them.
+void OpenTable_prefetch_slots(const OpenTable *ot, Hash64 hash);
+
+// Claims an entry for a new key with the given hash, growing or rehashing the
+// table first if needed. The new entry comes after every other entry in the
+// table. The caller must have already checked that the key isn't in the
+// table, and must fill in the returned entry.
+//
+// Returns the claimed entry, or NULL if the table needed to grow and memory
+// couldn't be allocated.
+HTEntry *OpenTable_claim(OpenTable *ot, Hash64 hash);
+
+// Releases `entry`, which must point to one of the table's live entries. The
+// entry's key/value are not freed.
+void OpenTable_release(OpenTable *ot, HTEntry *entry);
+
+// Checks if `ot` can hold `min_size` entries without rehashing.
+bool OpenTable_has_room(const OpenTable *ot, size_t min_size);
+
+// Rehashes `ot` if needed so that it can hold `min_size` entries without
+// rehashing again.
+//
+// Returns false if memory couldn't be allocated, in which case `ot` is left
+// untouched.
+bool OpenTable_reserve(OpenTable *ot, size_t min_size);
+
+// Rehashes `ot` into the smallest table that holds its entries, closing up
+// any holes, unless it's already that size and has no holes.
+//
+// Returns false if memory couldn't be allocated, in which case `ot` is left
+// untouched.
+bool OpenTable_compact(OpenTable *ot);
+
+// Rehashes into a smaller table if `ot` has become sparse. Failure to allocate
+// the smaller table is ignored.
+void OpenTable_maybe_shrink(OpenTable *ot);
+
+// Returns the index in `ot->entries` of the first live entry at or after
+// `from`, or `ot->num_entries` if there are none.
+size_t OpenTable_next_full(const OpenTable *ot, size_t from);
+
+// Returns the number of groups OpenTable_find probes to find the entry in
+// slot `slot`, which must be full.
+size_t OpenTable_probe_length(const OpenTable *ot, size_t slot);
+
+// Checks if slot `slot` of `ot` holds an entry.
+bool OpenTable_slot_is_full(const OpenTable *ot, size_t slot);
+
+#endif  // SUPER_GLUE_LIB_HASH_TABLE_INTERNAL_H_
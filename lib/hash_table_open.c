@@ -0,0 +1,359 @@
+/* Provides the open addressing storage engine for HashTable.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "hash_table_internal.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Control byte values. Full slots hold the low 7 bits of their entry's hash,
+// so they always have the high bit clear, whereas both of these have it set.
+#define CTRL_EMPTY ((uint8_t)0x80)
+#define CTRL_DELETED ((uint8_t)0xFE)
+
+// Removed entries are left in `entries` as holes, marked with this key length
+// (which no real key can have).
+#define HOLE_KEY_LEN SIZE_MAX
+
+// The hash is split in two: the high bits pick where probing starts, and the
+// low 7 bits are stored in the control byte.
+#define H1(hash) ((hash) >> 7)
+#define H2(hash) ((uint8_t)((hash) & 0x7F))
+
+// A bitmask over a group of control bytes, where bit `i` corresponds to the
+// `i`th slot of the group.
+typedef uint32_t GroupMask;
+
+// Returns the mask of slots in the group starting at `ctrl` whose control byte
+// is equal to `h2`.
+static inline GroupMask group_match(const uint8_t *ctrl, uint8_t h2);
+// Returns the mask of slots in the group starting at `ctrl` that are empty.
+static inline GroupMask group_match_empty(const uint8_t *ctrl);
+// Returns the mask of slots in the group starting at `ctrl` that are empty or
+// deleted.
+static inline GroupMask group_match_empty_or_deleted(const uint8_t *ctrl);
+
+// Sets the control byte for slot `idx`, along with its mirrored copy if it
+// has one.
+static inline void set_ctrl(OpenTable *ot, size_t idx, uint8_t value);
+// Finds the first empty or deleted slot in the probe sequence for `hash`.
+static size_t find_insert_slot(const OpenTable *ot, Hash64 hash);
+// Finds the slot whose index points to `entries[entry_idx]`, which must be a
+// live entry with the given hash.
+static size_t find_slot_of(const OpenTable *ot, Hash64 hash,
+    size_t entry_idx);
+// Allocates the arrays for an empty table with `capacity` slots, leaving `ot`
+// untouched on failure.
+static bool alloc_table(OpenTable *ot, size_t capacity);
+// Rehashes every entry in `ot` into newly allocated arrays with
+// `new_capacity` slots, closing up any holes in `entries`. On failure, `ot` is
+// left untouched.
+static bool resize(OpenTable *ot, size_t new_capacity);
+// Returns the smallest valid capacity that can hold `min_size` entries
+// without rehashing.
+static size_t capacity_for(size_t min_size);
+
+// The table is rehashed once it's more than 7/8 full. Since every slot that
+// isn't empty (including tombstones) was filled by appending an entry, this
+// is also how much room `entries` needs.
+static inline size_t capacity_to_growth(size_t capacity) {
+  return capacity - capacity / 8;
+}
+
+#ifdef __SSE2__
+static inline GroupMask group_match(const uint8_t *ctrl, uint8_t h2) {
+  __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), group));
+}
+
+static inline GroupMask group_match_empty(const uint8_t *ctrl) {
+  __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+  return _mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_set1_epi8((char)CTRL_EMPTY), group));
+}
+
+static inline GroupMask group_match_empty_or_deleted(const uint8_t *ctrl) {
+  // Only empty and deleted control bytes have their high bit set
+  return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+}
+#else
+// Portable fallbacks, for when SSE2 isn't available.
+static inline GroupMask group_match(const uint8_t *ctrl, uint8_t h2) {
+  GroupMask mask = 0;
+  for (int i = 0; i < OT_GROUP_WIDTH; i++) {
+    if (ctrl[i] == h2) mask |= (GroupMask)1 << i;
+  }
+  return mask;
+}
+
+static inline GroupMask group_match_empty(const uint8_t *ctrl) {
+  return group_match(ctrl, CTRL_EMPTY);
+}
+
+static inline GroupMask group_match_empty_or_deleted(const uint8_t *ctrl) {
+  GroupMask mask = 0;
+  for (int i = 0; i < OT_GROUP_WIDTH; i++) {
+    if (ctrl[i] & 0x80) mask |= (GroupMask)1 << i;
+  }
+  return mask;
+}
+#endif
+
+static inline void set_ctrl(OpenTable *ot, size_t idx, uint8_t value) {
+  ot->ctrl[idx] = value;
+  if (idx < OT_GROUP_WIDTH) ot->ctrl[ot->capacity + idx] = value;
+}
+
+static size_t capacity_for(size_t min_size) {
+  size_t capacity = OT_GROUP_WIDTH;
+  while (capacity_to_growth(capacity) < min_size) capacity *= 2;
+  return capacity;
+}
+
+static bool alloc_table(OpenTable *ot, size_t capacity) {
+  uint8_t *ctrl = malloc(capacity + OT_GROUP_WIDTH);
+  uint32_t *indices = malloc(capacity * sizeof(uint32_t));
+  HTEntry *entries = aligned_alloc(HT_ENTRY_ALIGN,
+      capacity_to_growth(capacity) * sizeof(HTEntry));
+  if (ctrl == NULL || indices == NULL || entries == NULL) {
+    free(ctrl);
+    free(indices);
+    free(entries);
+    return false;
+  }
+
+  memset(ctrl, CTRL_EMPTY, capacity + OT_GROUP_WIDTH);
+  ot->ctrl = ctrl;
+  ot->indices = indices;
+  ot->entries = entries;
+  ot->capacity = capacity;
+  ot->size = 0;
+  ot->num_entries = 0;
+  return true;
+}
+
+bool OpenTable_init(OpenTable *ot, size_t min_size) {
+  if (!alloc_table(ot, capacity_for(min_size))) return false;
+#if HT_STATS
+  ot->probes = 0;
+  ot->resizes = 0;
+#endif
+  return true;
+}
+
+void OpenTable_destroy(OpenTable *ot) {
+  free(ot->ctrl);
+  free(ot->indices);
+  free(ot->entries);
+  ot->ctrl = NULL;
+  ot->indices = NULL;
+  ot->entries = NULL;
+}
+
+// Probing visits groups at triangular offsets (pos, pos + 16, pos + 48, ...).
+// Since the number of groups is a power of two, this visits every group before
+// repeating, and the table always has at least one empty slot, so all of the
+// probe loops below terminate.
+HTEntry *OpenTable_find(OpenTable *ot, Hash64 hash, const unsigned char *key,
+    size_t key_len) {
+  size_t mask = ot->capacity - 1;
+  size_t pos = H1(hash) & mask;
+  size_t stride = 0;
+  while (true) {
+    HT_STAT_ADD(ot->probes, 1);
+    // The indices for a group are contiguous, so they can be fetched at the
+    // same time as its control bytes rather than only after they've been
+    // matched.
+    __builtin_prefetch(&ot->indices[pos]);
+    const uint8_t *group = &ot->ctrl[pos];
+    for (GroupMask m = group_match(group, H2(hash)); m != 0; m &= m - 1) {
+      size_t slot = (pos + __builtin_ctz(m)) & mask;
+      HTEntry *candidate = &ot->entries[ot->indices[slot]];
+      if (HTEntry_matches(candidate, hash, key, key_len)) return candidate;
+    }
+    if (group_match_empty(group) != 0) return NULL;
+
+    stride += OT_GROUP_WIDTH;
+    pos = (pos + stride) & mask;
+  }
+}
+
+void OpenTable_prefetch_ctrl(const OpenTable *ot, Hash64 hash) {
+  size_t pos = H1(hash) & (ot->capacity - 1);
+  __builtin_prefetch(&ot->ctrl[pos]);
+  __builtin_prefetch(&ot->indices[pos]);
+}
+
+void OpenTable_prefetch_slots(const OpenTable *ot, Hash64 hash) {
+  size_t mask = ot->capacity - 1;
+  size_t pos = H1(hash) & mask;
+  for (GroupMask m = group_match(&ot->ctrl[pos], H2(hash)); m != 0;
+      m &= m - 1) {
+    __builtin_prefetch(
+        &ot->entries[ot->indices[(pos + __builtin_ctz(m)) & mask]]);
+  }
+}
+
+static size_t find_insert_slot(const OpenTable *ot, Hash64 hash) {
+  size_t mask = ot->capacity - 1;
+  size_t pos = H1(hash) & mask;
+  size_t stride = 0;
+  while (true) {
+    GroupMask m = group_match_empty_or_deleted(&ot->ctrl[pos]);
+    if (m != 0) return (pos + __builtin_ctz(m)) & mask;
+
+    stride += OT_GROUP_WIDTH;
+    pos = (pos + stride) & mask;
+  }
+}
+
+static size_t find_slot_of(const OpenTable *ot, Hash64 hash,
+    size_t entry_idx) {
+  size_t mask = ot->capacity - 1;
+  size_t pos = H1(hash) & mask;
+  size_t stride = 0;
+  while (true) {
+    for (GroupMask m = group_match(&ot->ctrl[pos], H2(hash)); m != 0;
+        m &= m - 1) {
+      size_t slot = (pos + __builtin_ctz(m)) & mask;
+      if (ot->indices[slot] == entry_idx) return slot;
+    }
+
+    stride += OT_GROUP_WIDTH;
+    pos = (pos + stride) & mask;
+  }
+}
+
+static bool resize(OpenTable *ot, size_t new_capacity) {
+  OpenTable new_ot;
+  if (!alloc_table(&new_ot, new_capacity)) return false;
+
+  for (size_t i = OpenTable_next_full(ot, 0); i < ot->num_entries;
+      i = OpenTable_next_full(ot, i + 1)) {
+    Hash64 hash = ot->entries[i].hash;
+    size_t slot = find_insert_slot(&new_ot, hash);
+    set_ctrl(&new_ot, slot, H2(hash));
+    new_ot.indices[slot] = new_ot.num_entries;
+    new_ot.entries[new_ot.num_entries++] = ot->entries[i];
+  }
+  new_ot.size = new_ot.num_entries;
+#if HT_STATS
+  new_ot.probes = ot->probes;
+  new_ot.resizes = ot->resizes + 1;
+#endif
+
+  OpenTable_destroy(ot);
+  *ot = new_ot;
+  return true;
+}
+
+HTEntry *OpenTable_claim(OpenTable *ot, Hash64 hash) {
+  if (ot->num_entries == capacity_to_growth(ot->capacity)) {
+    // If closing up the holes would leave the table at most half of its max
+    // load, rehash in place instead of growing.
+    size_t new_capacity = ot->capacity;
+    if (ot->size + 1 > capacity_to_growth(ot->capacity) / 2) {
+      new_capacity *= 2;
+    }
+    if (!resize(ot, new_capacity)) return NULL;
+  }
+
+  size_t slot = find_insert_slot(ot, hash);
+  set_ctrl(ot, slot, H2(hash));
+  ot->indices[slot] = ot->num_entries;
+  ot->size++;
+  return &ot->entries[ot->num_entries++];
+}
+
+void OpenTable_release(OpenTable *ot, HTEntry *entry) {
+  size_t mask = ot->capacity - 1;
+  size_t entry_idx = entry - ot->entries;
+  size_t idx = find_slot_of(ot, entry->hash, entry_idx);
+
+  // A slot can be marked empty (rather than deleted) only if no probe could
+  // have ever passed over it, i.e., if it isn't part of a run of
+  // OT_GROUP_WIDTH consecutive non-empty slots. Otherwise a lookup that probed
+  // past this slot could stop early and miss its target.
+  GroupMask empty_after = group_match_empty(&ot->ctrl[idx]);
+  GroupMask empty_before =
+    group_match_empty(&ot->ctrl[(idx - OT_GROUP_WIDTH) & mask]);
+  bool never_probed_past = empty_after != 0 && empty_before != 0 &&
+    (__builtin_ctz(empty_after) +
+     (__builtin_clz(empty_before) - (32 - OT_GROUP_WIDTH))) < OT_GROUP_WIDTH;
+  set_ctrl(ot, idx, never_probed_past ? CTRL_EMPTY : CTRL_DELETED);
+  ot->size--;
+  entry->key_len = HOLE_KEY_LEN;
+}
+
+bool OpenTable_has_room(const OpenTable *ot, size_t min_size) {
+  // Every new entry is appended to `entries`, even if earlier ones have left
+  // holes.
+  size_t new_entries = min_size > ot->size ? min_size - ot->size : 0;
+  return ot->num_entries + new_entries <= capacity_to_growth(ot->capacity);
+}
+
+bool OpenTable_reserve(OpenTable *ot, size_t min_size) {
+  if (OpenTable_has_room(ot, min_size)) return true;
+  return resize(ot, capacity_for(min_size > ot->size ? min_size : ot->size));
+}
+
+bool OpenTable_compact(OpenTable *ot) {
+  size_t new_capacity = capacity_for(ot->size);
+  if (new_capacity == ot->capacity && ot->num_entries == ot->size) {
+    return true;
+  }
+  return resize(ot, new_capacity);
+}
+
+void OpenTable_maybe_shrink(OpenTable *ot) {
+  if (ot->capacity > OT_GROUP_WIDTH && ot->size < ot->capacity / 8) {
+    resize(ot, capacity_for(ot->size * 2));
+  }
+}
+
+size_t OpenTable_next_full(const OpenTable *ot, size_t from) {
+  for (size_t i = from; i < ot->num_entries; i++) {
+    if (ot->entries[i].key_len != HOLE_KEY_LEN) return i;
+  }
+  return ot->num_entries;
+}
+
+size_t OpenTable_probe_length(const OpenTable *ot, size_t slot) {
+  size_t mask = ot->capacity - 1;
+  size_t pos = H1(ot->entries[ot->indices[slot]].hash) & mask;
+  size_t stride = 0;
+  size_t groups = 1;
+  while (((slot - pos) & mask) >= OT_GROUP_WIDTH) {
+    stride += OT_GROUP_WIDTH;
+    pos = (pos + stride) & mask;
+    groups++;
+  }
+  return groups;
+}
+
+bool OpenTable_slot_is_full(const OpenTable *ot, size_t slot) {
+  return (ot->ctrl[slot] & 0x80) == 0;
+}
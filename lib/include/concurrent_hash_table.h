@@ -0,0 +1,115 @@
+/* Provides a hash table that can be shared between threads.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// A ConcurrentHashTable may be used from any number of threads at once
+// without any external locking. Lookups never take a lock or write to shared
+// memory, so they scale with the number of reading threads. Writers lock one
+// of a fixed number of lock stripes, so writers only contend when they touch
+// keys in the same stripe. Memory for removed entries is reclaimed using
+// epoch-based reclamation (see epoch.h).
+//
+// The table grows automatically, but never shrinks. Growing copies every
+// entry while holding all of the writer locks, so writers stall while it
+// happens; readers carry on using the old entries until it's done.
+
+#ifndef SUPER_GLUE_LIB_INCLUDE_CONCURRENT_HASH_TABLE_H_
+#define SUPER_GLUE_LIB_INCLUDE_CONCURRENT_HASH_TABLE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "hash_table.h"
+
+typedef struct _CHT ConcurrentHashTable;
+
+// Allocates a new ConcurrentHashTable. Caller assumes responsibility of
+// eventually passing the returned pointer to ConcurrentHashTable_free.
+//
+// hash_fn - The hash function to use for keys, see HTHashFn.
+//
+// Returns a pointer to a newly allocated ConcurrentHashTable, or NULL on
+// failure (such as being out of memory or an invalid hash_fn).
+ConcurrentHashTable *ConcurrentHashTable_allocate(HTHashFn hash_fn);
+
+// Frees a ConcurrentHashTable, and optionally all values in it. No other
+// thread may be using the table when this is called.
+//
+// cht        - The table to free. NO OP if NULL.
+// value_free - Each value in the table is passed to this function to be
+//              freed. If NULL, the values aren't freed.
+void ConcurrentHashTable_free(ConcurrentHashTable *cht,
+    HTValue_free value_free);
+
+// Returns the number of elements in a ConcurrentHashTable. If other threads
+// are modifying the table, the result is only a snapshot.
+//
+// cht - The table to query.
+//
+// Returns the number of elements in cht, or -1 if cht is NULL.
+int ConcurrentHashTable_num_elements(ConcurrentHashTable *cht);
+
+// Inserts an entry into the table with the given key/value, overwriting the
+// value of any existing entry with the given key. Same semantics as
+// HashTable_insert.
+//
+// cht       - The table to insert into. If NULL, returns false.
+// key       - The key for this value. A copy is made. If NULL, returns false.
+// key_len   - The length of key in unsigned chars. If zero, key is assumed to
+//             end with a '\0', which isn't considered part of the key.
+// new_value - The value that key will map to.
+// old_value - If key was already in the table, set to the previous value.
+//             Ignored if NULL.
+//
+// Returns true if there was previously an entry for key, i.e., when
+// *old_value has been populated.
+bool ConcurrentHashTable_insert(ConcurrentHashTable *cht, unsigned char *key,
+    size_t key_len, HTValue new_value, HTValue *old_value);
+
+// Looks up the value for a key. Never blocks.
+//
+// Since another thread could remove the entry right after it's found, the
+// value is copied out rather than returning a pointer into the table. If
+// values point to memory that's freed once they're removed from the table,
+// readers should call this inside an Epoch_enter/Epoch_exit critical section
+// and keep using the value only until Epoch_exit, and whoever removes values
+// should free them with Epoch_retire rather than directly.
+//
+// cht       - The table to query. If NULL, returns false.
+// key       - The key to look up. If NULL, returns false.
+// key_len   - The length of key in unsigned chars. If zero, key is assumed to
+//             end with a '\0'.
+// value_out - Set to the key's value if it's found. Ignored if NULL.
+//
+// Returns true if the key was found.
+bool ConcurrentHashTable_find(ConcurrentHashTable *cht, unsigned char *key,
+    size_t key_len, HTValue *value_out);
+
+// Removes the entry with the given key.
+//
+// cht       - The table to remove from. If NULL, returns false.
+// key       - The key of the entry to remove. If NULL, returns false.
+// key_len   - The length of key in unsigned chars. If zero, key is assumed to
+//             end with a '\0'.
+// old_value - Set to the removed value. Ignored if NULL.
+//
+// Returns true if an entry was removed, false if key wasn't in the table.
+bool ConcurrentHashTable_remove(ConcurrentHashTable *cht, unsigned char *key,
+    size_t key_len, HTValue *old_value);
+
+#endif  // SUPER_GLUE_LIB_INCLUDE_CONCURRENT_HASH_TABLE_H_
@@ -0,0 +1,121 @@
+/* Provides a double-ended queue stored in fixed-size blocks.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// A Deque holds payload pointers in order, like a LinkedList used as a queue
+// or stack, but stores them in blocks of DEQUE_BLOCK_SLOTS contiguous slots
+// rather than a node per element. Adding or removing an element at either end
+// is O(1) and only touches memory when it crosses into another block, so
+// pushing at one end and popping at the other allocates once per block at
+// most, and in a queue that stays under a block's worth of elements, not at
+// all: a block that's emptied is kept for reuse instead of being freed.
+
+#ifndef SUPER_GLUE_LIB_INCLUDE_DEQUE_H_
+#define SUPER_GLUE_LIB_INCLUDE_DEQUE_H_
+
+#include <stdbool.h>
+
+// The number of payloads stored per block. A block is this many pointers plus
+// two links, which makes it four 64-byte cache lines.
+#define DEQUE_BLOCK_SLOTS 30
+
+typedef struct _dq Deque;
+typedef void *DequePayload;
+typedef void(*DequePayloadFreeFn)(DequePayload payload);
+
+// Allocates a new, empty Deque. Caller assumes responsibility for later
+// passing the returned pointer to `Deque_free`.
+//
+// Returns NULL if out of memory, a pointer to a newly allocated Deque
+// otherwise.
+Deque *Deque_allocate();
+
+// Frees a given Deque. Each payload still in it is passed to `payload_free`.
+//
+// dq           - The deque to free. If NULL this function is safe to call, and
+//                results in a NO OP.
+// payload_free - If not NULL, each payload still in the deque is passed to
+//                this function, from head to tail.
+void Deque_free(Deque *dq, DequePayloadFreeFn payload_free);
+
+// Returns the number of elements in a Deque. Returns -1 if `dq` is NULL.
+int Deque_num_elements(Deque *dq);
+
+// Prepends (i.e., inserts at the head of the deque) an element to `dq`.
+//
+// dq      - The deque to add an element to.
+// payload - The element to add.
+//
+// Returns true if the payload is successfully added, false otherwise (e.g.,
+// if `dq` is NULL or a new block is needed and there's not enough memory to
+// allocate it). If false is returned, the deque is unchanged.
+bool Deque_prepend(Deque *dq, DequePayload payload);
+
+// Appends (i.e., inserts at the end of the deque) an element to `dq`.
+//
+// dq      - The deque to add an element to.
+// payload - The element to add.
+//
+// Returns true if the payload is successfully added, false otherwise (e.g.,
+// if `dq` is NULL or a new block is needed and there's not enough memory to
+// allocate it). If false is returned, the deque is unchanged.
+bool Deque_append(Deque *dq, DequePayload payload);
+
+// Removes an element from the front of a Deque. Never allocates memory.
+//
+// dq          - The deque to remove an element from.
+// payload_out - An output parameter. The removed element is returned through
+//               this parameter. If this parameter is NULL, this function
+//               returns false without modifying the deque.
+//
+// Returns true on success, false otherwise (e.g., `dq` is NULL or empty).
+// If `false` is returned then the deque is not modified.
+bool Deque_pop_head(Deque *dq, DequePayload *payload_out);
+
+// Removes an element from the end of a Deque. Never allocates memory.
+//
+// dq          - The deque to remove an element from.
+// payload_out - An output parameter. The removed element is returned through
+//               this parameter. If this parameter is NULL, this function
+//               returns false without modifying the deque.
+//
+// Returns true on success, false otherwise (e.g., `dq` is NULL or empty).
+// If `false` is returned then the deque is not modified.
+bool Deque_pop_tail(Deque *dq, DequePayload *payload_out);
+
+// Reads the element at the front of a Deque without removing it.
+//
+// dq          - The deque to query.
+// payload_out - An output parameter set to the payload of the head of `dq`.
+//               If this parameter is NULL, this function returns false.
+//
+// Returns true on success, false otherwise (e.g., `dq` is NULL or empty).
+// If `false` is returned then `*payload_out` is not modified.
+bool Deque_peek_head(Deque *dq, DequePayload *payload_out);
+
+// Reads the element at the end of a Deque without removing it.
+//
+// dq          - The deque to query.
+// payload_out - An output parameter set to the payload of the tail of `dq`.
+//               If this parameter is NULL, this function returns false.
+//
+// Returns true on success, false otherwise (e.g., `dq` is NULL or empty).
+// If `false` is returned then `*payload_out` is not modified.
+bool Deque_peek_tail(Deque *dq, DequePayload *payload_out);
+
+#endif  // SUPER_GLUE_LIB_INCLUDE_DEQUE_H_
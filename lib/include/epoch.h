@@ -0,0 +1,78 @@
+/* Provides epoch-based memory reclamation for lock-free readers.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Epoch-based reclamation lets threads read shared data structures without
+// taking locks, while still letting writers free the memory they unlink.
+//
+// Readers wrap each access to shared data in Epoch_enter/Epoch_exit. Writers
+// that unlink an object pass it to Epoch_retire instead of freeing it, and the
+// object is only reclaimed once every thread that was reading when it was
+// retired has since called Epoch_exit. Critical sections should therefore be
+// kept short: a thread that stays inside one holds up reclamation for every
+// other thread.
+//
+// There's a single, process-wide epoch shared by every data structure. Each
+// thread that uses it is registered the first time it calls into this module,
+// and that registration (a few dozen bytes) is recycled for other threads
+// once the thread exits.
+
+#ifndef SUPER_GLUE_LIB_INCLUDE_EPOCH_H_
+#define SUPER_GLUE_LIB_INCLUDE_EPOCH_H_
+
+#include <stdint.h>
+
+typedef struct EpochEntry EpochEntry;
+
+// Called to reclaim an object once it's safe to do so.
+typedef void(*Epoch_reclaim)(EpochEntry *);
+
+// Embedded in objects that can be retired, so that retiring never needs to
+// allocate. Users shouldn't access its members.
+struct EpochEntry {
+  EpochEntry *next;
+  uint64_t epoch;
+  Epoch_reclaim reclaim;
+};
+
+// Marks the start of a read-side critical section on the calling thread. Any
+// object reachable from shared data structures at this point won't be
+// reclaimed until the matching call to Epoch_exit. Critical sections may be
+// nested.
+void Epoch_enter();
+
+// Marks the end of a read-side critical section started by Epoch_enter.
+// Pointers obtained inside the critical section must not be used afterwards.
+void Epoch_exit();
+
+// Schedules an object that has already been unlinked from every shared data
+// structure to be reclaimed, once no thread can still be reading it. Objects
+// are reclaimed in batches on the thread that retired them, during later
+// calls to Epoch_retire or Epoch_barrier, or when the thread exits.
+//
+// entry   - The EpochEntry embedded in the object to reclaim. NO OP if NULL.
+// reclaim - Called with `entry` once it's safe to free the object containing
+//           it. Must not call Epoch_enter or Epoch_retire.
+void Epoch_retire(EpochEntry *entry, Epoch_reclaim reclaim);
+
+// Waits until every object retired by the calling thread has been reclaimed.
+// Must not be called from inside a critical section, since it would wait on
+// itself forever.
+void Epoch_barrier();
+
+#endif  // SUPER_GLUE_LIB_INCLUDE_EPOCH_H_
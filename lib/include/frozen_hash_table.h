@@ -0,0 +1,83 @@
+/* Provides an immutable hash table with perfect hashing.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// A FrozenHashTable is a read-only snapshot of a HashTable, meant for data
+// that's built once and then only looked up, like the contents of config
+// files. It's built in the style of CHD ("compress, hash, and displace"),
+// which finds a minimal perfect hash function for the table's keys: every key
+// maps to a different slot, and there are exactly as many slots as keys. So
+// a lookup hashes the key, reads one displacement, and compares against the
+// single entry in the slot the key maps to, without any probing or chain
+// walking, and the table takes no more space than the entries themselves
+// plus about one byte per key.
+//
+// Since nothing can be inserted or removed, a FrozenHashTable may be read
+// from any number of threads at once without locking.
+
+#ifndef SUPER_GLUE_LIB_INCLUDE_FROZEN_HASH_TABLE_H_
+#define SUPER_GLUE_LIB_INCLUDE_FROZEN_HASH_TABLE_H_
+
+#include <stddef.h>
+
+#include "hash_table.h"
+
+typedef struct _FHT FrozenHashTable;
+
+// Builds a FrozenHashTable holding the same entries as a HashTable. Caller
+// assumes responsibility of eventually passing the returned pointer to
+// FrozenHashTable_free.
+//
+// Building takes time roughly linear in the number of entries, but is
+// considerably slower than inserting them into a HashTable, so it's only
+// worth it for tables that are looked up many more times than they're built.
+//
+// ht - The table to freeze. It isn't modified (in particular, it isn't
+//      resized, so pointers from HashTable_find stay valid), and can be used
+//      or freed independently of the returned table afterwards. Keys are
+//      copied, but values are shared with ht, so at most one of the two
+//      tables should be freed with a value_free function.
+//
+// Returns a pointer to a newly allocated FrozenHashTable, or NULL on failure
+// (such as ht being NULL, being out of memory, or two of ht's keys having
+// identical 64-bit hashes, which prevents them from being hashed perfectly).
+FrozenHashTable *HashTable_freeze(HashTable *ht);
+
+// Frees a FrozenHashTable, and optionally all values in it.
+//
+// fht        - The table to free. NO OP if NULL.
+// value_free - Each value in the table is passed to this function to be
+//              freed. If NULL, the values aren't freed.
+void FrozenHashTable_free(FrozenHashTable *fht, HTValue_free value_free);
+
+// Returns the number of elements in a FrozenHashTable, or -1 if fht is NULL.
+int FrozenHashTable_num_elements(FrozenHashTable *fht);
+
+// Searches a FrozenHashTable for a given key. Never allocates memory.
+//
+// fht     - The table to query. If NULL, this function returns NULL.
+// key     - The key to look up. If NULL, this function returns NULL.
+// key_len - The length of the key in unsigned chars. If zero, key is assumed
+//           to end with a '\0', useful for NUL terminated strings as keys.
+//
+// Returns a pointer to the value associated with the key, which stays valid
+// until fht is freed, or NULL if the key isn't present in fht.
+const HTValue *FrozenHashTable_find(FrozenHashTable *fht, unsigned char *key,
+    size_t key_len);
+
+#endif  // SUPER_GLUE_LIB_INCLUDE_FROZEN_HASH_TABLE_H_
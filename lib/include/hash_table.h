@@ -22,6 +22,15 @@ along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "linked_list.h"
+
+// Keys up to this many bytes long are stored inside the table's entries, so
+// inserting them doesn't need a separate allocation for a copy of the key, and
+// comparing against them doesn't need to follow a pointer. Longer keys are
+// copied to the heap.
+#define HT_INLINE_KEY_LEN 40
 
 typedef struct _HT HashTable;
 typedef struct _HTIt HTIterator;
@@ -30,9 +39,81 @@ typedef void *HTValue;
 
 typedef void(*HTValue_free)(HTValue);
 
+// Typedef'd to HTIterator. The members are only exposed so that an HTIterator
+// can live in caller-owned storage (see HTIterator_init); they should not be
+// accessed directly.
+struct _HTIt {
+  HashTable *table;  // NULL once released
+  // Used with HT_ENGINE_CHAINED. Only meaningful while bucket_idx is less than
+  // the number of (virtual) buckets, otherwise the iterator is past the end.
+  LLIterator bucket_iter;
+  int bucket_idx;
+  // Used with HT_ENGINE_OPEN, the index into the table's entries
+  size_t entry_idx;
+};
+
+// Selects how a HashTable stores its entries.
+typedef enum {
+  // Each bucket is a LinkedList of individually allocated entries. Pointers
+  // returned by HashTable_find stay valid until that entry is removed.
+  HT_ENGINE_CHAINED = 0,
+  // Entries are stored in a flat array in insertion order, and found through
+  // a separate open addressing index whose buckets are probed 16 at a time
+  // using SIMD comparisons of per-slot hash tags. Lookups touch far fewer
+  // cache lines than HT_ENGINE_CHAINED, and iterating visits entries in the
+  // order they were inserted, but a pointer returned by HashTable_find is
+  // only valid until the next insert or remove on the table.
+  HT_ENGINE_OPEN,
+} HTEngine;
+
+// Selects the function a HashTable uses to hash keys.
+typedef enum {
+  // SipHash-1-3, keyed with a random per-process key. Processes 8 bytes at a
+  // time and is designed so that an attacker who can't observe the key can't
+  // craft keys that collide, which would otherwise degrade the table to a
+  // linear scan.
+  HT_HASH_SIPHASH = 0,
+  // wyhash, seeded with a random per-process seed. Considerably faster than
+  // HT_HASH_SIPHASH, especially on long keys, but makes no cryptographic
+  // guarantees. Prefer it for keys that don't come from untrusted input.
+  HT_HASH_WYHASH,
+  // 64-bit FNV-1a. Unseeded and processes one byte at a time; this is what
+  // HashTable used before hash functions were configurable, and is kept for
+  // callers that need hashes to be stable across processes.
+  HT_HASH_FNV1A,
+} HTHashFn;
+
+// Options that control how a HashTable is set up. Always pass an HTOptions
+// to HTOptions_init before setting any of its fields, so that fields added in
+// the future get sensible defaults.
+typedef struct {
+  // The storage engine to use. Defaults to HT_ENGINE_CHAINED, unless the
+  // library was compiled with HT_DEFAULT_ENGINE defined to something else
+  // (e.g., `make HT_ENGINE=open`).
+  HTEngine engine;
+  // The hash function to use. Defaults to HT_HASH_SIPHASH, unless the library
+  // was compiled with HT_DEFAULT_HASH defined to something else.
+  HTHashFn hash_fn;
+  // If true, a table using HT_ENGINE_CHAINED allocates its entries and the
+  // nodes of its buckets from Slabs of its own (see slab.h), rather than with
+  // malloc. This makes inserts and removals cheaper, keeps long-lived tables
+  // from fragmenting the heap, and lets HashTable_free release everything at
+  // once instead of entry by entry. The memory isn't returned to the system
+  // until the table is freed, so a table that shrinks keeps its peak
+  // footprint. Ignored by HT_ENGINE_OPEN, which keeps its entries in a single
+  // array anyway. Defaults to false.
+  bool use_slab;
+} HTOptions;
+
 // Allocates a new HashTable structure. Caller assumesresponsibility of
 // eventually passing the returned pointer to HashTable_free.
 //
+// The table starts out small and grows/shrinks automatically to keep its load
+// factor bounded. With HT_ENGINE_CHAINED, resizing is done incrementally, a
+// few buckets at a time during calls to HashTable_insert and HashTable_remove,
+// so no single call pays for rehashing the entire table.
+// HT_ENGINE_OPEN rehashes all at once, for an amortized O(1) cost per insert.
+//
 // Returns a pointer to a newly allocated HashTable structure, or NULL on
 // failure (such as being out of memory).
 HashTable *HashTable_allocate();
@@ -45,6 +126,88 @@ HashTable *HashTable_allocate();
 //              none of the HT_Values in it are.
 void HashTable_free(HashTable *ht, HTValue_free value_free);
 
+// Fills in an HTOptions with the default options.
+//
+// opts - The options to initialize. NO OP if NULL.
+void HTOptions_init(HTOptions *opts);
+
+// Allocates a new HashTable structure configured according to `opts`. Caller
+// assumes responsibility of eventually passing the returned pointer to
+// HashTable_free.
+//
+// opts - The options for the new table, which should have been set up using
+//        HTOptions_init. If NULL, the defaults are used, which is equivalent
+//        to calling HashTable_allocate.
+//
+// Returns a pointer to a newly allocated HashTable structure, or NULL on
+// failure (such as being out of memory or an invalid option).
+HashTable *HashTable_allocate_with_options(const HTOptions *opts);
+
+// Allocates a new HashTable holding the given key/value pairs, as if by
+// allocating it with HashTable_allocate_with_options, reserving room for every
+// pair with HashTable_reserve, and inserting them one by one, but without any
+// of the per-call overhead. Caller assumes responsibility of eventually
+// passing the returned pointer to HashTable_free.
+//
+// This is meant for loading a large table at startup, e.g. from a file. The
+// table is sized for every pair up front, so it never resizes while it's being
+// filled. With HT_ENGINE_OPEN, every entry goes into a single array allocated
+// up front; with HT_ENGINE_CHAINED, set HTOptions.use_slab to have entries and
+// bucket nodes carved out of large chunks rather than allocated one by one.
+// Either way, only keys longer than HT_INLINE_KEY_LEN need allocations of
+// their own.
+//
+// opts        - The options for the new table, as with
+//               HashTable_allocate_with_options. If NULL, the defaults are
+//               used.
+// keys        - An array of `num_entries` keys, copied into the table. If a
+//               key appears more than once, the value that comes last wins,
+//               and the caller remains responsible for the earlier ones. If
+//               the array, or any key in it, is NULL, returns NULL (unless
+//               num_entries is zero).
+// key_lens    - An array of `num_entries` key lengths, in unsigned chars. As
+//               with HashTable_insert, a length of zero means the key ends
+//               with a '\0'. If NULL, every key is assumed to end with a '\0'.
+// values      - An array of `num_entries` values, where values[i] is the value
+//               for keys[i]. If NULL, every value is NULL.
+// num_entries - The number of key/value pairs.
+//
+// Returns a pointer to a newly allocated HashTable structure, or NULL on
+// failure (such as being out of memory, an invalid option, or a NULL key). If
+// NULL is returned, none of the values have been passed to the table, so the
+// caller still owns all of them.
+HashTable *HashTable_allocate_from(const HTOptions *opts,
+    unsigned char *const keys[], const size_t key_lens[],
+    const HTValue values[], size_t num_entries);
+
+// Hashes a key the same way a HashTable configured to use `hash_fn` would.
+// The seeded hash functions use a key that's chosen randomly when the process
+// first needs it, so their results differ between runs and shouldn't be
+// persisted or sent to other processes.
+//
+// hash_fn - The hash function to use.
+// key     - The key to hash.
+// key_len - The length of key in unsigned chars. If zero, key is assumed to
+//           end with a '\0', just like with HashTable_insert.
+//
+// Returns the key's hash, or 0 if key is NULL or hash_fn is invalid.
+uint64_t HashTable_hash_key(HTHashFn hash_fn, const unsigned char *key,
+    size_t key_len);
+
+// Hashes a key the same way a particular HashTable does, for use with the
+// HashTable_*_hashed functions. Tables configured with the same hash function
+// hash keys identically (within a process), so the result can be passed to
+// any of them.
+//
+// ht      - The table whose hash function to use.
+// key     - The key to hash.
+// key_len - The length of key in unsigned chars. If zero, key is assumed to
+//           end with a '\0', just like with HashTable_insert.
+//
+// Returns the key's hash, or 0 if ht or key is NULL.
+uint64_t HashTable_hash(HashTable *ht, const unsigned char *key,
+    size_t key_len);
+
 // Returns the number of elements in a HashTable.
 //
 // ht - The HashTable to query.
@@ -52,6 +215,117 @@ void HashTable_free(HashTable *ht, HTValue_free value_free);
 // Returns the number of elements in a HashTable. If ht is NULL, returns -1.
 int HashTable_num_elements(HashTable *ht);
 
+// Makes room for a HashTable to hold `num_elements` elements, so that
+// inserting new keys until it has that many never resizes the table. The
+// table may still shrink again if elements are removed.
+//
+// If the table needs to grow, it's resized on the spot: with
+// HT_ENGINE_CHAINED, this rehashes every element at once instead of a few
+// buckets at a time during later calls, so reserving room in a table that
+// already holds many elements takes time proportional to their number.
+//
+// ht           - The HashTable to grow. If NULL, returns false.
+// num_elements - The number of elements the table should have room for,
+//                including the ones it already holds. If it already has room
+//                for this many, nothing is done.
+//
+// Returns true if the table now has room for `num_elements` elements, false
+// otherwise (e.g., memory couldn't be allocated, or the table needed to grow
+// while an HTIterator on it is live). If false is returned, the table is
+// still usable, it just may have to resize during later inserts.
+bool HashTable_reserve(HashTable *ht, size_t num_elements);
+
+// Rebuilds a HashTable's storage at the right size for the elements it holds
+// now, returning the memory that's been left behind by removals.
+//
+// Tables already shrink on their own as elements are removed, but only once
+// they're mostly empty, and only so far: the bucket lists of HT_ENGINE_CHAINED
+// tables stay allocated once their buckets are emptied, and Slabs never give
+// back the memory of removed entries (see HTOptions.use_slab). Compacting
+// frees empty buckets, shrinks the bucket array or slot array to the smallest
+// size that holds the table's elements without exceeding its maximum load,
+// and with HTOptions.use_slab, moves every entry into freshly allocated Slabs
+// so the old ones can be freed.
+//
+// This takes time proportional to the number of elements (and, with
+// HT_ENGINE_CHAINED, buckets), all in one go, so it's meant to be called at a
+// quiet moment, e.g. once a burst of traffic has died down, rather than after
+// every removal. Pointers returned by HashTable_find are invalidated with
+// HT_ENGINE_OPEN or HTOptions.use_slab.
+//
+// ht - The HashTable to compact. If NULL, returns false.
+//
+// Returns true on success, false otherwise (e.g., memory couldn't be
+// allocated for the new storage, or an HTIterator on the table is live). If
+// false is returned, the table is still usable, and holds the same elements.
+bool HashTable_compact(HashTable *ht);
+
+// The number of rows in HTStats.histogram.
+#define HT_STATS_HISTOGRAM_LEN 16
+
+// A snapshot of how a HashTable is laid out and how hard it's been working,
+// for tracking down slow lookups. Filled in by HashTable_get_stats.
+//
+// A "chain" is what a lookup has to search through to find a key: with
+// HT_ENGINE_CHAINED it's the list of entries in a bucket, and with
+// HT_ENGINE_OPEN it's the sequence of 16 slot groups probed before reaching
+// the key's slot. Long chains with a low load factor point at a poor hash
+// function (or keys crafted to collide); long chains with a high load factor
+// just mean the table is full.
+typedef struct {
+  HTEngine engine;
+  int num_elements;
+  // The number of buckets with HT_ENGINE_CHAINED (counting both bucket arrays
+  // while a resize is in progress), or of slots with HT_ENGINE_OPEN.
+  size_t num_buckets;
+  double load_factor;  // num_elements / num_buckets
+  // histogram[i] is the number of chains of length i: with HT_ENGINE_CHAINED,
+  // the number of buckets holding i entries, and with HT_ENGINE_OPEN, the
+  // number of entries found after probing i groups (so row 0 is always
+  // empty). The last row also counts every longer chain.
+  size_t histogram[HT_STATS_HISTOGRAM_LEN];
+  // The longest chain, and the average length of the chains that elements are
+  // on (i.e., of non-empty buckets, or of the probes for each element).
+  size_t max_chain_len;
+  double avg_chain_len;
+
+  // The counters below are only kept if the library was compiled with
+  // HT_STATS defined to 1 (`make HT_STATS=1`), and are all zero otherwise.
+  // Tables don't pay anything for them unless they're compiled in.
+  bool counters_enabled;
+  // Lookups done by finds, inserts and removals (including HashTable_entry
+  // and the _hashed variants), and the number of probes those lookups made
+  // in total: entries compared against with HT_ENGINE_CHAINED, or groups
+  // probed with HT_ENGINE_OPEN.
+  uint64_t lookups;
+  uint64_t probes;
+  // Times the table has been resized or rehashed, whether to grow, to shrink,
+  // or by HashTable_reserve/HashTable_compact.
+  uint64_t resizes;
+} HTStats;
+
+// Fills in `stats` with the current state of a HashTable. This walks every
+// bucket or slot in the table, so it takes time proportional to the table's
+// size; it's meant for diagnostics, not for calling on every operation.
+//
+// ht    - The HashTable to inspect. If NULL, returns false.
+// stats - Where to store the statistics. If NULL, returns false.
+//
+// Returns true on success, false otherwise.
+bool HashTable_get_stats(HashTable *ht, HTStats *stats);
+
+// Writes a HashTable's statistics (see HashTable_get_stats) into `buf` as
+// human readable text, e.g. for an interactive session to print on request.
+// Like snprintf, the text is truncated to fit and always '\0' terminated.
+//
+// ht      - The HashTable to describe. If NULL, returns 0.
+// buf     - Where to write the text. May only be NULL if buf_len is zero.
+// buf_len - The size of buf, in chars.
+//
+// Returns the length the full text has (not counting the '\0'), so a return
+// value of buf_len or more means it was truncated.
+size_t HashTable_format_stats(HashTable *ht, char *buf, size_t buf_len);
+
 // Inserts an entry into the hash table with the given key/value. If an entry
 // already exists with the given key, it is overwritten.
 //
@@ -73,15 +347,41 @@ int HashTable_num_elements(HashTable *ht);
 //             if key did not previously exist in the HashTable. Ignored if
 //             NULL.
 //
+// Overwriting the value of a key that's already in the table is done in place
+// and never allocates memory.
+//
 // Returns true if there was previously an entry for key in ht. In other words,
 // returns true when *old_value has been populated.
 bool HashTable_insert(HashTable *ht, unsigned char *key, size_t key_len,
     HTValue new_value, HTValue *old_value);
 
+// Finds the entry for a given key, inserting one with a NULL value if there
+// isn't one yet, and returns a pointer to its value so that the caller can
+// read or update it in place. This does a "find, then insert if missing"
+// with a single hash of the key and a single probe of the table. The
+// returned pointer has the same lifetime as one returned by HashTable_find.
+//
+// ht          - The HashTable to search/insert into. If NULL, this function
+//               returns NULL.
+// key         - The key to look up. Copied into the table if it's inserted.
+//               If NULL, this function returns NULL.
+// key_len     - The length of key, in unsigned chars. If zero, key is assumed
+//               to end with a '\0', just like with HashTable_insert.
+// inserted    - An output parameter set to true if the key wasn't in the
+//               table and has just been inserted (so its value is NULL), or
+//               false if it was already there. Ignored if NULL.
+//
+// Returns a pointer to the value associated with key, or NULL on failure
+// (e.g., if the key needed to be inserted but memory couldn't be allocated).
+HTValue *HashTable_entry(HashTable *ht, unsigned char *key, size_t key_len,
+    bool *inserted);
+
 // Searches a HashTable for a given key. If an entry with the key exists, a
 // pointer to its value is returned. Note, this is a pointer into the HashTable,
 // so do not attempt to free it, and remember that any modifications to the
-// underlying data will be reflected when the key is looked up again.
+// underlying data will be reflected when the key is looked up again. For
+// tables using HT_ENGINE_OPEN, the pointer is invalidated by the next insert
+// into or removal from the table. This function never allocates memory.
 //
 // ht      - The HashTable to query. If NULL, this function returns NULL.
 // key     - A pointer to the key to lookup. If NULL, this function returns
@@ -93,6 +393,30 @@ bool HashTable_insert(HashTable *ht, unsigned char *key, size_t key_len,
 // the key isn't present in ht.
 HTValue *HashTable_find(HashTable *ht, unsigned char *key, size_t key_len);
 
+// Looks up several keys at once, with the same semantics as calling
+// HashTable_find on each of them. All of the keys are hashed up front and the
+// parts of the table each lookup will touch are prefetched before any of them
+// are resolved, so the cache misses of the lookups overlap instead of being
+// paid one after another. This is faster than separate calls whenever the
+// table is too large to stay in cache. This function never allocates memory.
+//
+// ht         - The HashTable to query. If NULL, this function returns 0
+//              without doing anything.
+// keys       - An array of `num_keys` keys to look up. A NULL key is never
+//              found. If the array itself is NULL, this function returns 0
+//              without doing anything.
+// key_lens   - An array of `num_keys` key lengths, in unsigned chars. As with
+//              HashTable_find, a length of zero means the key ends with a
+//              '\0'. If NULL, every key is assumed to end with a '\0'.
+// num_keys   - The number of keys to look up.
+// values_out - An array of `num_keys` output parameters. values_out[i] is set
+//              to what HashTable_find would return for keys[i]. If NULL, this
+//              function returns 0 without doing anything.
+//
+// Returns the number of keys that were found.
+size_t HashTable_find_many(HashTable *ht, unsigned char *const keys[],
+    const size_t key_lens[], size_t num_keys, HTValue *values_out[]);
+
 // Removes an entry from a HashTable with a given key.
 //
 // ht        - The HashTable to remove from.
@@ -109,11 +433,39 @@ HTValue *HashTable_find(HashTable *ht, unsigned char *key, size_t key_len);
 bool HashTable_remove(HashTable *ht, unsigned char *key, size_t key_len,
     HTValue *old_value);
 
-// Allocates a new HTIterator. This iterator will iterate over a HashTable in
-// an arbitrary order (not necessarily the order of element insertion). If an
-// element is added or removed during the lifetime of this iterator, its further
-// use is undefined. The caller takes responsibility of eventually passing the
-// pointer returned by this function to HTIterator_free.
+// The following functions behave exactly like their counterparts without the
+// `_hashed` suffix, except that they take the key's hash instead of computing
+// it, so that a key that's used with several tables only needs to be hashed
+// once. `hash` must be what HashTable_hash returns for ht and the key (or,
+// equivalently, what HashTable_hash_key returns for ht's hash function);
+// passing anything else leaves the table in an unspecified state.
+
+// Same as HashTable_insert, with a precomputed hash.
+bool HashTable_insert_hashed(HashTable *ht, uint64_t hash, unsigned char *key,
+    size_t key_len, HTValue new_value, HTValue *old_value);
+
+// Same as HashTable_entry, with a precomputed hash.
+HTValue *HashTable_entry_hashed(HashTable *ht, uint64_t hash,
+    unsigned char *key, size_t key_len, bool *inserted);
+
+// Same as HashTable_find, with a precomputed hash.
+HTValue *HashTable_find_hashed(HashTable *ht, uint64_t hash,
+    unsigned char *key, size_t key_len);
+
+// Same as HashTable_remove, with a precomputed hash.
+bool HashTable_remove_hashed(HashTable *ht, uint64_t hash, unsigned char *key,
+    size_t key_len, HTValue *old_value);
+
+// Allocates a new HTIterator. With HT_ENGINE_OPEN, this iterator will iterate
+// over a HashTable in the order its elements were inserted (overwriting an
+// element's value doesn't move it). With HT_ENGINE_CHAINED, the order is
+// arbitrary. Advancing the iterator never allocates memory. If an element is
+// added or removed during the lifetime of this iterator, other than through
+// HTIterator_remove, its further use is undefined. The caller takes
+// responsibility of eventually passing the pointer returned by this function
+// to HTIterator_free, which must happen before ht is passed to
+// HashTable_free. The table won't resize itself while it has live iterators,
+// so they should not be kept around longer than needed.
 //
 // ht - The HashTable to iterate over.
 //
@@ -121,7 +473,31 @@ bool HashTable_remove(HashTable *ht, unsigned char *key, size_t key_len,
 // failure (e.g., out of memory, ht is NULL).
 HTIterator *HTIterator_allocate(HashTable *ht);
 
-// Frees a HTIterator.
+// Initializes an HTIterator in caller-owned storage (e.g., on the stack) for
+// the given table. This has the same semantics as HTIterator_allocate, except
+// that no memory is allocated: the iterator must be passed to
+// HTIterator_release rather than HTIterator_free once the caller is done with
+// it, which must happen before ht is passed to HashTable_free.
+//
+// hti - The storage to initialize.
+// ht  - The HashTable to iterate over.
+//
+// Returns true on success, false if `hti` or `ht` is NULL.
+bool HTIterator_init(HTIterator *hti, HashTable *ht);
+
+// Releases an HTIterator initialized with HTIterator_init, without freeing its
+// storage. This has the same effect on the table as HTIterator_free, and
+// leaves `hti` invalid. NO OP if `hti` is NULL or has already been released.
+//
+// hti - The iterator to release.
+void HTIterator_release(HTIterator *hti);
+
+// Frees a HTIterator. If this was the last live iterator on its table, and
+// removals through iterators have left the table sparse, the table starts
+// shrinking, just as it would have after a HashTable_remove. With
+// HT_ENGINE_OPEN this rehashes right away, so pointers returned by
+// HashTable_find may be invalidated. Iterating without removing anything never
+// resizes the table.
 //
 // hti - The iterator to free.
 void HTIterator_free(HTIterator *hti);
@@ -160,16 +536,26 @@ bool HTIterator_get(HTIterator *hti, const unsigned char **key_out,
 // passed back to the caller through the output parameters; the caller assumes
 // responsibility for the associated memory.
 //
+// The entry is unlinked directly, in constant time, without hashing its key
+// or searching the table for it again. The table isn't resized while hti is
+// live, so removing most of a table this way leaves it oversized until the
+// last iterator on it is freed, at which point it starts shrinking.
+//
 // hti         - The iterator to query.
 // key_out     - An output parameter set to the key. This buffer must be freed
-//               by the caller. Ignored if NULL.
+//               by the caller. Keys longer than HT_INLINE_KEY_LEN are handed
+//               over as-is, while shorter ones are copied into a newly
+//               allocated buffer. If NULL, the key is freed and no memory is
+//               allocated.
 // key_len_out - An output parameter set to the length of the key. Ignored if
 //               NULL.
 // value_out   - An output parameter set to the entry's value. Ignored if NULL.
 //
 // Returns true if an element was removed, false otherwise (hti is
-// NULL/invalid). On success, hti is advanced to the next entry, and may now
-// be invalid if the removed element was the last entry in the table.
+// NULL/invalid, or a short key couldn't be copied into key_out, in which case
+// the table and hti are unchanged). On success, hti is advanced to the next
+// entry, and may now be invalid if the removed element was the last entry in
+// the table.
 bool HTIterator_remove(HTIterator *hti, unsigned char **key_out,
     size_t *key_len_out, HTValue *value_out);
 
@@ -0,0 +1,258 @@
+/* Provides a doubly linked list whose links live inside its elements.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// An IntrusiveList is a LinkedList whose nodes are provided by the caller: each
+// element embeds an ILLink, and the list just strings those links together.
+// Nothing is ever allocated, so pushing and popping can't fail for lack of
+// memory, and walking the list touches only the elements themselves rather than
+// a node and then the payload it points to. This suits queues of objects that
+// already exist, like connections waiting to be serviced.
+//
+//   typedef struct {
+//     int fd;
+//     ILLink link;
+//   } Connection;
+//
+//   IntrusiveList ready;
+//   IntrusiveList_init(&ready);
+//   IntrusiveList_append(&ready, &conn->link);
+//   ...
+//   ILLink *link;
+//   if (IntrusiveList_pop_head(&ready, &link)) {
+//     Connection *conn = IL_ENTRY(link, Connection, link);
+//   }
+//
+// An element can be in as many lists at once as it has ILLinks, but each
+// ILLink can only be in one list at a time. The caller owns the memory of
+// both the list and its elements, and must keep an element alive while it's
+// in a list.
+
+#ifndef SUPER_GLUE_LIB_INCLUDE_INTRUSIVE_LIST_H_
+#define SUPER_GLUE_LIB_INCLUDE_INTRUSIVE_LIST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct _il IntrusiveList;
+typedef struct _ill ILLink;
+typedef struct _ili ILIterator;
+
+// Typedef'd to ILLink. Embed one in each struct that's to be put in an
+// IntrusiveList. The members should not be accessed directly.
+//
+// An ILLink must be zeroed (e.g., `= {0}`, or memory from calloc) before it's
+// first added to a list. Once removed from a list, it can be added to another
+// one right away.
+struct _ill {
+  ILLink *next, *prev;
+  IntrusiveList *list;  // NULL if not in a list
+};
+
+// Typedef'd to IntrusiveList. The members are only exposed so that a list can
+// live in caller-owned storage (see IntrusiveList_init); they should not be
+// accessed directly.
+struct _il {
+  ILLink *head, *tail;
+  int num_elems;
+};
+
+// Typedef'd to ILIterator. The members are only exposed so that an ILIterator
+// can live in caller-owned storage (see ILIterator_init); they should not be
+// accessed directly.
+struct _ili {
+  IntrusiveList *list;
+  ILLink *current;
+};
+
+// Evaluates to a pointer to the `type` that embeds `link` as its `member`.
+#define IL_ENTRY(link, type, member) \
+  ((type *)((char *)(link) - offsetof(type, member)))
+
+// Initializes an empty IntrusiveList in caller-owned storage. There's nothing
+// to free afterwards; the list can simply go out of scope once it's empty.
+//
+// list - The storage to initialize.
+//
+// Returns true on success, false if `list` is NULL.
+bool IntrusiveList_init(IntrusiveList *list);
+
+// Returns the number of elements in an IntrusiveList. Returns -1 if `list` is
+// NULL.
+int IntrusiveList_num_elements(IntrusiveList *list);
+
+// Prepends (i.e., inserts at the head of the list) an element to `list`. Never
+// allocates memory.
+//
+// list - The list to add an element to.
+// link - The link embedded in the element to add.
+//
+// Returns true if the element is successfully added, false otherwise (e.g.,
+// if `list` or `link` is NULL, or `link` is already in a list).
+bool IntrusiveList_prepend(IntrusiveList *list, ILLink *link);
+
+// Appends (i.e., inserts at the end of the list) an element to `list`. Never
+// allocates memory.
+//
+// list - The list to add an element to.
+// link - The link embedded in the element to add.
+//
+// Returns true if the element is successfully added, false otherwise (e.g.,
+// if `list` or `link` is NULL, or `link` is already in a list).
+bool IntrusiveList_append(IntrusiveList *list, ILLink *link);
+
+// Removes an element from the front of an IntrusiveList.
+//
+// list     - The list to remove an element from.
+// link_out - An output parameter. The removed element's link is returned
+//            through this parameter. If this parameter is NULL, this function
+//            returns false without modifying the list.
+//
+// Returns true on success, false otherwise (e.g., `list` is NULL or empty).
+// If `false` is returned then the list is not modified.
+bool IntrusiveList_pop_head(IntrusiveList *list, ILLink **link_out);
+
+// Removes an element from the end of an IntrusiveList.
+//
+// list     - The list to remove an element from.
+// link_out - An output parameter. The removed element's link is returned
+//            through this parameter. If this parameter is NULL, this function
+//            returns false without modifying the list.
+//
+// Returns true on success, false otherwise (e.g., `list` is NULL or empty).
+// If `false` is returned then the list is not modified.
+bool IntrusiveList_pop_tail(IntrusiveList *list, ILLink **link_out);
+
+// Reads the element at the front of an IntrusiveList without removing it.
+//
+// list     - The list to query.
+// link_out - An output parameter set to the link of the head of `list`. If
+//            this parameter is NULL, this function returns false.
+//
+// Returns true on success, false otherwise (e.g., `list` is NULL or empty).
+// If `false` is returned then `*link_out` is not modified.
+bool IntrusiveList_peek_head(IntrusiveList *list, ILLink **link_out);
+
+// Removes a given element from an IntrusiveList in constant time, wherever it
+// is in the list. Iterators pointing at the element must not be used
+// afterwards; use ILIterator_remove to remove while iterating.
+//
+// list - The list to remove an element from.
+// link - The link embedded in the element to remove.
+//
+// Returns true on success, false otherwise (e.g., either argument is NULL, or
+// `link` isn't in `list`). If `false` is returned then the list is not
+// modified.
+bool IntrusiveList_remove(IntrusiveList *list, ILLink *link);
+
+// Moves the element at the front of `src` to the front of `dst`.
+//
+// src - The list to take the head element from.
+// dst - The list to prepend the element to.
+//
+// Returns true on success, false otherwise (e.g., either list is NULL, `src`
+// is empty, or `src` and `dst` are the same list). If `false` is returned then
+// neither list is modified.
+bool IntrusiveList_move_head(IntrusiveList *src, IntrusiveList *dst);
+
+// Initializes an ILIterator in caller-owned storage (e.g., on the stack) for
+// the given list, pointing at its first element. Don't attempt to use this
+// iterator if the underlying list is modified using IntrusiveList_* methods;
+// the only way to safely modify the list is using ILIterator_* methods or to
+// initialize the iterator again after the modification.
+//
+// ili  - The storage to initialize.
+// list - The list to iterate over.
+//
+// Returns true on success, false if `ili` or `list` is NULL.
+bool ILIterator_init(ILIterator *ili, IntrusiveList *list);
+
+// Checks if the given ILIterator is valid. An iterator is said to be valid when
+// it is "pointing" at an element in the list. An example of an invalid iterator
+// would be one where it was pointing at the end of the list and then advanced
+// to the next element, or an iterator for an empty list.
+//
+// ili - The iterator to query
+//
+// Returns true if the iterator is valid, false if it is invalid or NULL.
+bool ILIterator_is_valid(ILIterator *ili);
+
+// Returns the link of the element that `ili` is "pointing" to, or NULL on
+// failure (e.g., `ili` is invalid).
+ILLink *ILIterator_get(ILIterator *ili);
+
+// Removes the element that `ili` is pointing to from the underlying list and
+// returns its link through an output parameter. The iterator is left in the
+// same state as LLIterator_remove leaves an LLIterator:
+// - `ili` was pointing at the only element in the list; in this case `ili`
+//   becomes an invalid iterator.
+// - `ili` was pointing at the end of the list with >= 2 elements; in this case
+//   `ili` is now pointing at the original element's predecessor.
+// - Otherwise, `ili` is pointing at the element that was originally after the
+//   element removed.
+//
+// ili      - The iterator to remove an element at.
+// link_out - An output parameter, `*link_out` is set to be the link of the
+//            removed element. If this parameter is NULL then false is returned
+//            by this function and the underlying list is not modified.
+//
+// Returns true on success, false otherwise (e.g., an invalid iterator). If
+// false is returned then the underlying list has not been modified.
+bool ILIterator_remove(ILIterator *ili, ILLink **link_out);
+
+// Moves the element `ili` is pointing at to the front of the list, leaving the
+// other elements in the same order. `ili` keeps pointing at the same element.
+//
+// ili - The iterator pointing at the element to move.
+//
+// Returns true on success, false otherwise (e.g., `ili` is NULL or invalid).
+bool ILIterator_move_to_head(ILIterator *ili);
+
+// Advances `ili` to the next element in the list.
+//
+// ili - The iterator to advance.
+//
+// Returns true if `ili` is a valid iterator after this operation, false
+// otherwise (including if `ili` was invalid/NULL when the method was called).
+bool ILIterator_next(ILIterator *ili);
+
+// Moves `ili` to the previous element in the list.
+//
+// ili - The iterator to move.
+//
+// Returns true if `ili` is a valid iterator after this operation, false
+// otherwise (including if `ili` was invalid/NULL when the method was called).
+bool ILIterator_prev(ILIterator *ili);
+
+// Rewinds `ili` to the first element in the list.
+//
+// ili - The iterator to rewind.
+//
+// Returns true if `ili` is a valid iterator after this operation, false
+// otherwise (e.g., the underlying list is empty, `ili` is NULL).
+bool ILIterator_rewind(ILIterator *ili);
+
+// Fast forwards `ili` to the last element in the list.
+//
+// ili - The iterator to fast forward.
+//
+// Returns true if `ili` is a valid iterator after this operation, false
+// otherwise (e.g., the underlying list is empty, `ili` is NULL).
+bool ILIterator_fast_forward(ILIterator *ili);
+
+#endif  // SUPER_GLUE_LIB_INCLUDE_INTRUSIVE_LIST_H_
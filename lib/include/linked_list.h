@@ -21,12 +21,23 @@ along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
 #define SUPER_GLUE_LIB_INCLUDE_LINKED_LIST_H_
 
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "slab.h"
 
 typedef struct _ll LinkedList;
 typedef struct _lli LLIterator;
 typedef void* LLPayload;
 typedef void(*LLPayloadFreeFn)(LLPayload payload);
 
+// Typedef'd to LLIterator. The members are only exposed so that an LLIterator
+// can live in caller-owned storage (see LLIterator_init); they should not be
+// accessed directly.
+struct _lli {
+  LinkedList *list;
+  struct lln *current;
+};
+
 // Allocates a new LinkedList. Caller assumes responsibility for later passing
 // the returned pointer to `LinkedList_free`.
 //
@@ -34,6 +45,28 @@ typedef void(*LLPayloadFreeFn)(LLPayload payload);
 // otherwise.
 LinkedList *LinkedList_allocate(); 
 
+// Allocates a new LinkedList whose nodes are allocated from `node_slab`
+// rather than with malloc. Any number of lists may share a Slab. Caller
+// assumes responsibility for later passing the returned pointer to
+// `LinkedList_free`, which must happen before `node_slab` is freed.
+//
+// When a list whose nodes come from a Slab is freed without a `payload_free`
+// function, all of its nodes are handed back to the Slab at once, in constant
+// time.
+//
+// node_slab - The Slab to allocate nodes from. Its objects must be at least
+//             LinkedList_node_size() bytes. If NULL, nodes are allocated with
+//             malloc, just like with LinkedList_allocate.
+//
+// Returns NULL if out of memory or `node_slab`'s objects are too small, a
+// pointer to a newly allocated LinkedList otherwise.
+LinkedList *LinkedList_allocate_with_slab(Slab *node_slab);
+
+// Returns the size, in bytes, of the node a LinkedList allocates for each
+// element. A Slab passed to LinkedList_allocate_with_slab must hand out
+// objects at least this big.
+size_t LinkedList_node_size();
+
 // Frees a given LinkedList structure. The payload of each node in the linked
 // list is passed to `payload_free`.
 //
@@ -95,6 +128,29 @@ bool LinkedList_pop_head(LinkedList *list, LLPayload *payload_out);
 // If `false` is returned then the list is not modified.
 bool LinkedList_pop_tail(LinkedList *list, LLPayload *payload_out);
 
+// Reads the element at the front of a LinkedList without removing it.
+//
+// list        - The list to query.
+// payload_out - An output parameter set to the payload of the head of `list`.
+//               If this parameter is NULL, this function returns false.
+//
+// Returns true on success, false otherwise (e.g., `list` is NULL or empty).
+// If `false` is returned then `*payload_out` is not modified.
+bool LinkedList_peek_head(LinkedList *list, LLPayload *payload_out);
+
+// Moves the element at the front of `src` to the front of `dst`. The node that
+// holds the element is relinked rather than reallocated, so this function
+// never allocates memory and cannot fail due to lack of memory.
+//
+// src - The list to take the head element from.
+// dst - The list to prepend the element to.
+//
+// Returns true on success, false otherwise (e.g., either list is NULL, `src`
+// is empty, `src` and `dst` are the same list, or they don't allocate their
+// nodes from the same Slab). If `false` is returned then neither list is
+// modified.
+bool LinkedList_move_head(LinkedList *src, LinkedList *dst);
+
 // Allocates a new LLIterator struct for the given list. Don't attempt to use
 // this iterator if the underlying list is modified using LinkedList_* methods;
 // the only way to safely modify the list is using LLIterator_* methods or
@@ -104,6 +160,17 @@ bool LinkedList_pop_tail(LinkedList *list, LLPayload *payload_out);
 // `list` is NULL or there's not enough memory).
 LLIterator *LLIterator_allocate(LinkedList *list);
 
+// Initializes an LLIterator in caller-owned storage (e.g., on the stack) for
+// the given list, pointing at its first node. This has the same semantics as
+// LLIterator_allocate, except that no memory is allocated, and the iterator
+// must not be passed to LLIterator_free.
+//
+// lli  - The storage to initialize.
+// list - The list to iterate over.
+//
+// Returns true on success, false if `lli` or `list` is NULL.
+bool LLIterator_init(LLIterator *lli, LinkedList *list);
+
 // Frees a LLIterator struct without modifying the underlying list. NO OP if the
 // provided iterator is NULL.
 void LLIterator_free(LLIterator *lli);
@@ -152,6 +219,17 @@ LLPayload *LLIterator_get(LLIterator *lli);
 // false is returned then the underlying list has not been modified.
 bool LLIterator_remove(LLIterator *lli, LLPayload *payload_out);
 
+// Moves the element `lli` is pointing at to the front of the list, leaving
+// the other elements in the same order. The node that holds the element is
+// relinked rather than reallocated, so `lli` keeps pointing at the same
+// element, as do any other iterators over the list. This function never
+// allocates memory.
+//
+// lli - The iterator pointing at the element to move.
+//
+// Returns true on success, false otherwise (e.g., `lli` is NULL or invalid).
+bool LLIterator_move_to_head(LLIterator *lli);
+
 // Advances `lli` to the next node in the list.
 //
 // lli - The iterator to advance.
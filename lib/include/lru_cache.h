@@ -0,0 +1,131 @@
+/* Provides a size-bounded cache that evicts its least recently used entries.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// An LRUCache maps keys to values like a HashTable, but holds at most a
+// fixed number of bytes' worth of entries. Whenever an insertion takes it
+// over that limit, the least recently used entries are evicted until it fits
+// again, and each evicted entry is handed to a callback so that its value can
+// be freed (or written back somewhere).
+//
+// Every entry is charged for its key's length plus however many bytes the
+// caller says its value takes up. The cache's own bookkeeping, which is
+// roughly 200 bytes per entry, isn't charged.
+//
+// Lookups, insertions and removals all take constant time: the entries are
+// kept in a HashTable, and also in a LinkedList ordered from most to least
+// recently used, which a lookup updates by moving the entry's node to the
+// front of the list.
+
+#ifndef SUPER_GLUE_LIB_INCLUDE_LRU_CACHE_H_
+#define SUPER_GLUE_LIB_INCLUDE_LRU_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "hash_table.h"
+
+typedef struct _LRU LRUCache;
+
+// Called with each entry that's evicted from an LRUCache, after it has been
+// removed from the cache. The key is only valid until the function returns;
+// the value is handed over to the function.
+typedef void(*LRUEvictFn)(const unsigned char *key, size_t key_len,
+    HTValue value);
+
+// Allocates a new LRUCache. Caller assumes responsibility of eventually
+// passing the returned pointer to LRUCache_free.
+//
+// capacity - The most bytes' worth of entries the cache may hold, see above.
+// on_evict - Called with every entry that's evicted. If NULL, evicted values
+//            are just dropped.
+//
+// Returns a pointer to a newly allocated LRUCache, or NULL on failure (such
+// as being out of memory).
+LRUCache *LRUCache_allocate(size_t capacity, LRUEvictFn on_evict);
+
+// Frees an LRUCache, and optionally all values in it. The eviction callback
+// isn't called.
+//
+// cache      - The cache to free. NO OP if NULL.
+// value_free - Each value in the cache is passed to this function to be
+//              freed. If NULL, the values aren't freed.
+void LRUCache_free(LRUCache *cache, HTValue_free value_free);
+
+// Returns the number of entries in an LRUCache, or -1 if cache is NULL.
+int LRUCache_num_elements(LRUCache *cache);
+
+// Returns the number of bytes charged for the entries in an LRUCache, which
+// never exceeds its capacity, or 0 if cache is NULL.
+size_t LRUCache_size(LRUCache *cache);
+
+// Returns the capacity an LRUCache was allocated with, or 0 if cache is NULL.
+size_t LRUCache_capacity(LRUCache *cache);
+
+// Inserts an entry into the cache as its most recently used one, overwriting
+// the value and charge of any existing entry with the given key, and then
+// evicts least recently used entries until the cache is within its capacity.
+// An entry that's bigger than the whole cache is evicted right away, without
+// evicting any other entries (though it replaces any existing entry for key).
+//
+// cache     - The cache to insert into. If NULL, returns false.
+// key       - The key for this value. A copy is made. If NULL, returns false.
+// key_len   - The length of key in unsigned chars. If zero, key is assumed to
+//             end with a '\0', which isn't considered part of the key.
+// new_value - The value that key will map to.
+// charge    - The number of bytes the value takes up. The entry is charged
+//             this plus key_len.
+// old_value - If key was already in the cache, set to the previous value,
+//             which isn't passed to the eviction callback. Ignored if NULL.
+//
+// Returns true if there was previously an entry for key, i.e., when
+// *old_value has been populated. If memory can't be allocated for a new
+// entry, the cache is left unchanged and false is returned.
+bool LRUCache_insert(LRUCache *cache, unsigned char *key, size_t key_len,
+    HTValue new_value, size_t charge, HTValue *old_value);
+
+// Looks up a key, marking its entry as the most recently used one if it's
+// found.
+//
+// cache   - The cache to query. If NULL, returns NULL.
+// key     - The key to look up. If NULL, returns NULL.
+// key_len - The length of key in unsigned chars. If zero, key is assumed to
+//           end with a '\0'.
+//
+// Returns a pointer to the value associated with key, or NULL if key isn't in
+// the cache. The pointer is valid until the next insertion into or removal
+// from the cache.
+HTValue *LRUCache_find(LRUCache *cache, unsigned char *key, size_t key_len);
+
+// Same as LRUCache_find, except that it doesn't count as a use of the entry,
+// so its place in line for eviction doesn't change.
+HTValue *LRUCache_peek(LRUCache *cache, unsigned char *key, size_t key_len);
+
+// Removes the entry with the given key. The eviction callback isn't called.
+//
+// cache     - The cache to remove from. If NULL, returns false.
+// key       - The key of the entry to remove. If NULL, returns false.
+// key_len   - The length of key in unsigned chars. If zero, key is assumed to
+//             end with a '\0'.
+// old_value - Set to the removed value. Ignored if NULL.
+//
+// Returns true if an entry was removed, false if key wasn't in the cache.
+bool LRUCache_remove(LRUCache *cache, unsigned char *key, size_t key_len,
+    HTValue *old_value);
+
+#endif  // SUPER_GLUE_LIB_INCLUDE_LRU_CACHE_H_
@@ -0,0 +1,120 @@
+/* Provides a lock-free multi-producer, single-consumer queue.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// An MPSCQueue hands objects from any number of producer threads to a single
+// consumer thread, in FIFO order per producer, without locks. It's Dmitry
+// Vyukov's intrusive MPSC queue: pushing is a single atomic exchange, so it's
+// wait-free, and popping is a handful of plain loads and stores. Like
+// IntrusiveList, the queue never allocates; each object embeds an MPSCLink.
+//
+//   typedef struct {
+//     MPSCLink link;
+//     size_t len;
+//     char buf[];
+//   } Message;
+//
+//   // On any thread
+//   MPSCQueue_push(queue, &msg->link);
+//
+//   // On the consumer thread
+//   MPSCLink *links[64];
+//   size_t n = MPSCQueue_pop_many(queue, links, 64);
+//   for (size_t i = 0; i < n; i++) {
+//     Message *msg = MPSC_ENTRY(links[i], Message, link);
+//     ...
+//   }
+//
+// The queue doesn't wake the consumer up; a consumer that runs out of work
+// has to poll, or be signalled separately.
+
+#ifndef SUPER_GLUE_LIB_INCLUDE_MPSC_QUEUE_H_
+#define SUPER_GLUE_LIB_INCLUDE_MPSC_QUEUE_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct _mpsc MPSCQueue;
+typedef struct MPSCLink MPSCLink;
+
+// Embedded in objects that are passed through an MPSCQueue, so that pushing
+// never needs to allocate. Users shouldn't access its members, and an
+// MPSCLink can only be in one queue at a time.
+struct MPSCLink {
+  _Atomic(MPSCLink *) next;
+};
+
+// Evaluates to a pointer to the `type` that embeds `link` as its `member`.
+#define MPSC_ENTRY(link, type, member) \
+  ((type *)((char *)(link) - offsetof(type, member)))
+
+// Allocates a new, empty MPSCQueue. Caller assumes responsibility for later
+// passing the returned pointer to `MPSCQueue_free`.
+//
+// Returns NULL if out of memory, a pointer to a newly allocated MPSCQueue
+// otherwise.
+MPSCQueue *MPSCQueue_allocate();
+
+// Frees a given MPSCQueue. Objects still in the queue belong to the caller,
+// and aren't touched; pop them first if they need to be freed. No thread may
+// be using the queue anymore.
+//
+// queue - The queue to free. NO OP if NULL.
+void MPSCQueue_free(MPSCQueue *queue);
+
+// Adds an object to the back of the queue. Safe to call from any number of
+// threads at once, and never blocks or waits on other threads.
+//
+// queue - The queue to add to.
+// link  - The link embedded in the object to add. Must not currently be in a
+//         queue.
+//
+// Returns true on success, false if either argument is NULL.
+bool MPSCQueue_push(MPSCQueue *queue, MPSCLink *link);
+
+// Removes the object at the front of the queue. Must only be called from one
+// thread at a time (the consumer).
+//
+// An object is guaranteed to be visible to the consumer once the call that
+// pushed it has returned. While a push is still in progress, it may briefly
+// hide the objects pushed after it, in which case this returns false even
+// though the queue isn't empty; they'll be returned by a later call.
+//
+// queue    - The queue to remove from.
+// link_out - An output parameter set to the link of the removed object. If
+//            NULL, returns false without modifying the queue.
+//
+// Returns true on success, false otherwise (e.g., `queue` is NULL or nothing
+// could be removed).
+bool MPSCQueue_pop(MPSCQueue *queue, MPSCLink **link_out);
+
+// Removes up to `max` objects from the front of the queue, in order. Must only
+// be called from the consumer thread. Equivalent to calling MPSCQueue_pop
+// until it fails or `max` objects have been removed, but cheaper per object.
+//
+// queue     - The queue to remove from.
+// links_out - Set to the links of the removed objects, front first. Must have
+//             room for `max` links.
+// max       - The most objects to remove.
+//
+// Returns the number of objects removed, which is 0 if the queue is empty or
+// either pointer argument is NULL.
+size_t MPSCQueue_pop_many(MPSCQueue *queue, MPSCLink **links_out, size_t max);
+
+#endif  // SUPER_GLUE_LIB_INCLUDE_MPSC_QUEUE_H_
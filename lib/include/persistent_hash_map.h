@@ -0,0 +1,130 @@
+/* Provides a persistent hash map with cheap snapshots.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// A PersistentHashMap maps keys to values like a HashTable, but taking a
+// snapshot of one (PersistentHashMap_snapshot) is O(1), no matter how big it
+// is. This suits data that's read far more often than it's changed, and whose
+// readers want a consistent view while it changes, like a config that's
+// reloaded while requests are still being served with the old one, or stats
+// that are copied out periodically.
+//
+// It's a hash array mapped trie (Bagwell, "Ideal Hash Trees", 2001): each
+// level of the trie uses 5 more bits of the key's hash to pick one of up to 32
+// children, and nodes only store the children they have. A lookup or update
+// visits O(log32 n) nodes, which for any realistic table is at most a handful.
+//
+// A map and its snapshots share every node they have in common. Updating a
+// map copies only the nodes on the path to the key, if they're shared with a
+// snapshot, and updates them in place if they aren't, so a map with no live
+// snapshots is updated about as cheaply as a HashTable. Nodes are reference
+// counted, and are freed as soon as no map or snapshot holds them anymore.
+//
+// A map and its snapshots are independent handles: each one may only be used
+// by one thread at a time, but different handles may be used (and freed) from
+// different threads at once, even though they share nodes.
+
+#ifndef SUPER_GLUE_LIB_INCLUDE_PERSISTENT_HASH_MAP_H_
+#define SUPER_GLUE_LIB_INCLUDE_PERSISTENT_HASH_MAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "hash_table.h"
+
+typedef struct _PHM PersistentHashMap;
+
+// Allocates a new, empty PersistentHashMap. Caller assumes responsibility of
+// eventually passing the returned pointer to PersistentHashMap_free.
+//
+// hash_fn    - The hash function to use for keys, see HTHashFn.
+// value_free - If not NULL, each value is passed to this function once no
+//              version of the map holds it anymore: when the last map or
+//              snapshot holding it is freed, or has the value's key removed
+//              or overwritten. Since values are only tracked per key, a value
+//              mustn't be held under more than one key at once if this is
+//              set. Inherited by snapshots.
+//
+// Returns a pointer to a newly allocated PersistentHashMap, or NULL on failure
+// (such as being out of memory or an invalid hash_fn).
+PersistentHashMap *PersistentHashMap_allocate(HTHashFn hash_fn,
+    HTValue_free value_free);
+
+// Frees a PersistentHashMap or snapshot. Nodes it shares with other versions
+// of the map are left alone; the rest are freed, along with their values if
+// the map has a value_free function.
+//
+// map - The map to free. NO OP if NULL.
+void PersistentHashMap_free(PersistentHashMap *map);
+
+// Takes a snapshot of a PersistentHashMap in O(1) time. The snapshot is a map
+// of its own, which starts out holding the same entries as `map`. Either one
+// can then be read, updated or freed without affecting the other. Caller
+// assumes responsibility of eventually passing the returned pointer to
+// PersistentHashMap_free.
+//
+// map - The map to take a snapshot of. If NULL, returns NULL.
+//
+// Returns the snapshot, or NULL on failure (map is NULL, or out of memory).
+PersistentHashMap *PersistentHashMap_snapshot(PersistentHashMap *map);
+
+// Returns the number of elements in a PersistentHashMap, or -1 if map is NULL.
+int PersistentHashMap_num_elements(PersistentHashMap *map);
+
+// Inserts an entry into the map with the given key/value, overwriting the
+// value of any existing entry with the given key. Snapshots of the map aren't
+// affected.
+//
+// map     - The map to insert into. If NULL, returns false.
+// key     - The key for this value. A copy is made. If NULL, returns false.
+// key_len - The length of key in unsigned chars. If zero, key is assumed to
+//           end with a '\0', which isn't considered part of the key.
+// value   - The value that key will map to.
+//
+// Returns true on success, false otherwise (e.g., out of memory). If false is
+// returned, the map is unchanged.
+bool PersistentHashMap_insert(PersistentHashMap *map, unsigned char *key,
+    size_t key_len, HTValue value);
+
+// Looks up the value for a key. Never allocates memory.
+//
+// map     - The map to query. If NULL, returns NULL.
+// key     - The key to look up. If NULL, returns NULL.
+// key_len - The length of key in unsigned chars. If zero, key is assumed to
+//           end with a '\0'.
+//
+// Returns a pointer to the key's value, which stays valid until the next
+// insert or remove on `map`, or until it's freed, or NULL if the key isn't in
+// the map.
+const HTValue *PersistentHashMap_find(PersistentHashMap *map,
+    unsigned char *key, size_t key_len);
+
+// Removes the entry with the given key. Snapshots of the map aren't affected.
+//
+// map     - The map to remove from. If NULL, returns false.
+// key     - The key of the entry to remove. If NULL, returns false.
+// key_len - The length of key in unsigned chars. If zero, key is assumed to
+//           end with a '\0'.
+//
+// Returns true if an entry was removed, false otherwise (the key wasn't in the
+// map, or memory couldn't be allocated to copy nodes shared with a snapshot).
+// If false is returned, the map is unchanged.
+bool PersistentHashMap_remove(PersistentHashMap *map, unsigned char *key,
+    size_t key_len);
+
+#endif  // SUPER_GLUE_LIB_INCLUDE_PERSISTENT_HASH_MAP_H_
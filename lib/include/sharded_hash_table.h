@@ -0,0 +1,123 @@
+/* Provides a hash table of counters, sharded for write-heavy workloads.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// A ShardedHashTable maps keys to 64-bit counters that are updated far more
+// often than they're read, like per-client request counts for rate limiting.
+//
+// Even with a ConcurrentHashTable, threads incrementing the same counter keep
+// stealing its cache line from each other. Instead, a ShardedHashTable has a
+// number of shards, each a HashTable of its own, and each writing thread adds
+// to the counters in its own shard, so a counter's cache line stays with the
+// thread that's writing it. Shards are aligned to cache lines so that threads
+// writing to neighbouring shards don't get in each other's way either.
+//
+// A counter's value is the sum of its value in each shard. Reads can either
+// add up every shard (ShardedHashTable_get), or read a merged table that
+// ShardedHashTable_merge periodically folds the shards into
+// (ShardedHashTable_get_merged), which is faster but out of date by however
+// long it's been since the last merge.
+//
+// Every function may be called from any thread at once. Each shard has a
+// lock, but it's only contended when another thread reads or merges that
+// shard, or if several threads write to the same shard.
+
+#ifndef SUPER_GLUE_LIB_INCLUDE_SHARDED_HASH_TABLE_H_
+#define SUPER_GLUE_LIB_INCLUDE_SHARDED_HASH_TABLE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _SHT ShardedHashTable;
+
+// Allocates a new ShardedHashTable. Caller assumes responsibility of
+// eventually passing the returned pointer to ShardedHashTable_free.
+//
+// num_shards - The number of shards, usually the number of writing threads.
+//              Must be positive.
+//
+// Returns a pointer to a newly allocated ShardedHashTable, or NULL on failure
+// (such as being out of memory or num_shards not being positive).
+ShardedHashTable *ShardedHashTable_allocate(int num_shards);
+
+// Frees a ShardedHashTable. No other thread may be using the table when this
+// is called.
+//
+// sht - The table to free. NO OP if NULL.
+void ShardedHashTable_free(ShardedHashTable *sht);
+
+// Returns the number of shards in a ShardedHashTable, or -1 if sht is NULL.
+int ShardedHashTable_num_shards(ShardedHashTable *sht);
+
+// Adds to a key's counter in one shard. Counters start out at zero.
+//
+// sht     - The table to update. If NULL, returns false.
+// shard   - The shard to update, in [0, num_shards). Each writing thread
+//           should stick to a shard of its own.
+// key     - The counter's key. Copied if the key isn't in the shard yet. If
+//           NULL, returns false.
+// key_len - The length of key in unsigned chars. If zero, key is assumed to
+//           end with a '\0', which isn't considered part of the key.
+// delta   - The amount to add to the counter. May be negative.
+//
+// Returns true on success, false otherwise (e.g., shard is out of range, or
+// memory couldn't be allocated for the key). If false is returned, the
+// counter isn't changed.
+bool ShardedHashTable_add(ShardedHashTable *sht, int shard,
+    unsigned char *key, size_t key_len, int64_t delta);
+
+// Gets the current value of a key's counter by adding up its value in every
+// shard. This briefly takes each shard's lock in turn, so it's much slower
+// than ShardedHashTable_add, and slows down writers while it runs.
+//
+// sht     - The table to query. If NULL, returns 0.
+// key     - The counter's key. If NULL, returns 0.
+// key_len - The length of key in unsigned chars. If zero, key is assumed to
+//           end with a '\0'.
+//
+// Returns the counter's value, which is 0 for keys that were never added to.
+int64_t ShardedHashTable_get(ShardedHashTable *sht, unsigned char *key,
+    size_t key_len);
+
+// Gets the value of a key's counter as of the last call to
+// ShardedHashTable_merge. Doesn't touch any shards, so it never slows down
+// writers.
+//
+// sht     - The table to query. If NULL, returns 0.
+// key     - The counter's key. If NULL, returns 0.
+// key_len - The length of key in unsigned chars. If zero, key is assumed to
+//           end with a '\0'.
+//
+// Returns the counter's merged value.
+int64_t ShardedHashTable_get_merged(ShardedHashTable *sht, unsigned char *key,
+    size_t key_len);
+
+// Folds every shard's counters into the merged table and empties the shards.
+// Each shard is only locked for long enough to swap it for an empty one, so
+// writers are hardly held up. Meant to be called periodically, e.g. by a
+// timer, by one thread at a time (concurrent merges just take turns).
+//
+// sht - The table to merge. If NULL, returns false.
+//
+// Returns true on success, false otherwise (sht is NULL, or memory couldn't
+// be allocated). If false is returned, some shards may not have been merged,
+// but no counts are lost, and the next merge picks up where this one left off.
+bool ShardedHashTable_merge(ShardedHashTable *sht);
+
+#endif  // SUPER_GLUE_LIB_INCLUDE_SHARDED_HASH_TABLE_H_
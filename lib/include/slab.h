@@ -0,0 +1,88 @@
+/* Provides an allocator for many objects of the same size.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// A Slab hands out fixed-size objects carved out of large chunks of memory,
+// rather than calling malloc for each one. Freed objects go on a free list to
+// be reused by later allocations, so a long-running program that keeps
+// allocating and freeing objects of the same size doesn't fragment the heap.
+//
+// Each thread using a Slab keeps a small free list of its own, so allocating
+// and freeing usually doesn't take any locks. Objects can be freed from a
+// different thread than the one that allocated them.
+//
+// The memory behind a Slab's objects is only returned to the system by
+// Slab_free, which releases all of it at once without visiting the objects
+// individually.
+
+#ifndef SUPER_GLUE_LIB_INCLUDE_SLAB_H_
+#define SUPER_GLUE_LIB_INCLUDE_SLAB_H_
+
+#include <stddef.h>
+
+typedef struct _Slab Slab;
+
+// Allocates a new Slab. Caller assumes responsibility for later passing the
+// returned pointer to Slab_free.
+//
+// obj_size - The size of the objects the Slab hands out, in bytes. Objects
+//            are aligned to the largest power of two (up to 64) that divides
+//            obj_size, and to at least alignof(max_align_t).
+//
+// Returns a pointer to a newly allocated Slab, or NULL on failure (such as
+// being out of memory, or if obj_size is zero).
+Slab *Slab_allocate(size_t obj_size);
+
+// Frees a Slab, along with every object that was ever allocated from it.
+// No thread may use the Slab, or any object allocated from it, afterwards.
+//
+// slab - The Slab to free. NO OP if NULL.
+void Slab_free(Slab *slab);
+
+// Returns the size of the objects handed out by a Slab, which may be larger
+// than the size it was allocated with. Returns 0 if slab is NULL.
+size_t Slab_object_size(Slab *slab);
+
+// Allocates an object from a Slab. May be called from any thread. The
+// object's contents are unspecified.
+//
+// slab - The Slab to allocate from. If NULL, returns NULL.
+//
+// Returns a pointer to the new object, or NULL if out of memory.
+void *Slab_alloc_object(Slab *slab);
+
+// Returns an object to the Slab it was allocated from, so that it can be
+// handed out again. May be called from any thread.
+//
+// slab - The Slab that obj was allocated from. NO OP if NULL.
+// obj  - The object to free. NO OP if NULL.
+void Slab_free_object(Slab *slab, void *obj);
+
+// Returns a chain of objects to the Slab they were allocated from all at once,
+// in constant time. The objects must already be linked together through a
+// pointer stored at the very start of each one: `first` points to the next
+// object, which points to the one after that, and so on up to `last`, just
+// like the nodes of a singly linked list whose `next` member comes first.
+//
+// slab  - The Slab that the objects were allocated from. NO OP if NULL.
+// first - The first object in the chain. NO OP if NULL.
+// last  - The last object in the chain. Its link doesn't need to be set.
+// count - The number of objects in the chain, including first and last.
+void Slab_free_chain(Slab *slab, void *first, void *last, size_t count);
+
+#endif  // SUPER_GLUE_LIB_INCLUDE_SLAB_H_
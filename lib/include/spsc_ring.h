@@ -0,0 +1,132 @@
+/* Provides a bounded single-producer, single-consumer ring buffer.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// An SPSCRing passes payload pointers from exactly one producer thread to
+// exactly one consumer thread, in order, through a fixed number of slots. It
+// never allocates after SPSCRing_allocate and never takes a lock: each side
+// owns one index, and only reads the other side's index when the copy it last
+// read says the ring is full (producer) or empty (consumer). Pushing or
+// popping in batches publishes the whole batch at once.
+//
+// A ring can optionally be allocated with wakeups, which lets an idle consumer
+// sleep in SPSCRing_wait instead of spinning. Producers then only make a
+// system call when the consumer is actually asleep. Wakeups use eventfd, and
+// are only available on Linux.
+//
+//   // Producer thread
+//   while (!SPSCRing_push(ring, msg)) sched_yield();
+//
+//   // Consumer thread
+//   void *msgs[64];
+//   for (;;) {
+//     size_t n = SPSCRing_pop_many(ring, msgs, 64);
+//     if (n == 0) SPSCRing_wait(ring, -1);
+//     ...
+//   }
+
+#ifndef SUPER_GLUE_LIB_INCLUDE_SPSC_RING_H_
+#define SUPER_GLUE_LIB_INCLUDE_SPSC_RING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct _spsc SPSCRing;
+typedef void *SPSCRingPayload;
+typedef void(*SPSCRingPayloadFreeFn)(SPSCRingPayload payload);
+
+// Allocates a new, empty SPSCRing. Caller assumes responsibility for later
+// passing the returned pointer to `SPSCRing_free`.
+//
+// capacity - The minimum number of payloads the ring must hold. Rounded up to
+//            a power of two.
+// wakeup   - Whether the consumer may sleep in SPSCRing_wait. Costs an
+//            eventfd, and a memory fence per push or push_many.
+//
+// Returns a pointer to a newly allocated SPSCRing, or NULL if `capacity` is 0
+// or too large, if out of memory, or if `wakeup` is true and an eventfd can't
+// be created (including on systems without eventfd).
+SPSCRing *SPSCRing_allocate(size_t capacity, bool wakeup);
+
+// Frees a given SPSCRing. Neither thread may be using the ring anymore.
+//
+// ring         - The ring to free. If NULL this function is safe to call, and
+//                results in a NO OP.
+// payload_free - If not NULL, each payload still in the ring is passed to this
+//                function, oldest first.
+void SPSCRing_free(SPSCRing *ring, SPSCRingPayloadFreeFn payload_free);
+
+// Returns the number of payloads `ring` can hold, or 0 if `ring` is NULL.
+size_t SPSCRing_capacity(SPSCRing *ring);
+
+// Adds a payload to the ring. Must only be called from the producer thread.
+//
+// ring    - The ring to add to.
+// payload - The payload to add.
+//
+// Returns true on success, false if `ring` is NULL or full.
+bool SPSCRing_push(SPSCRing *ring, SPSCRingPayload payload);
+
+// Adds as many of `payloads` as fit to the ring, in order, and makes them
+// visible to the consumer all at once. Must only be called from the producer
+// thread.
+//
+// ring     - The ring to add to.
+// payloads - The payloads to add.
+// num      - The number of payloads in `payloads`.
+//
+// Returns the number of payloads added (the first that many of `payloads`),
+// which is 0 if the ring is full or either pointer argument is NULL.
+size_t SPSCRing_push_many(SPSCRing *ring, const SPSCRingPayload *payloads,
+    size_t num);
+
+// Removes the oldest payload from the ring. Must only be called from the
+// consumer thread.
+//
+// ring        - The ring to remove from.
+// payload_out - An output parameter set to the removed payload. If NULL, this
+//               function returns false without modifying the ring.
+//
+// Returns true on success, false otherwise (e.g., `ring` is NULL or empty).
+bool SPSCRing_pop(SPSCRing *ring, SPSCRingPayload *payload_out);
+
+// Removes up to `max` of the oldest payloads from the ring, in order. Must
+// only be called from the consumer thread.
+//
+// ring         - The ring to remove from.
+// payloads_out - Set to the removed payloads, oldest first. Must have room for
+//                `max` payloads.
+// max          - The most payloads to remove.
+//
+// Returns the number of payloads removed, which is 0 if the ring is empty or
+// either pointer argument is NULL.
+size_t SPSCRing_pop_many(SPSCRing *ring, SPSCRingPayload *payloads_out,
+    size_t max);
+
+// Blocks the consumer thread until the ring isn't empty. Must only be called
+// from the consumer thread, on a ring allocated with `wakeup`.
+//
+// ring       - The ring to wait on.
+// timeout_ms - The most time to wait for, in milliseconds. If negative, waits
+//              indefinitely; if 0, only checks whether the ring is empty.
+//
+// Returns true if the ring isn't empty, false if the timeout expired, `ring`
+// is NULL or wasn't allocated with `wakeup`, or waiting failed.
+bool SPSCRing_wait(SPSCRing *ring, int timeout_ms);
+
+#endif  // SUPER_GLUE_LIB_INCLUDE_SPSC_RING_H_
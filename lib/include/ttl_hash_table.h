@@ -0,0 +1,146 @@
+/* Provides a hash table whose entries expire after a deadline.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// A TTLHashTable is a HashTable where every entry has a deadline, after which
+// it's removed automatically. It's meant for things like session tokens,
+// rate-limiting windows and idempotency keys, which only matter for a while.
+//
+// A TTLHashTable has no clock of its own. Time is whatever the caller says it
+// is: a uint64_t in any unit (milliseconds, say), which only moves forward
+// when the caller passes a later time to TTLHashTable_tick, typically from an
+// event loop. Each tick removes every entry whose deadline has been reached.
+//
+// Deadlines are tracked with a hierarchical timing wheel rather than by
+// scanning the table, so inserting, rescheduling and removing entries take
+// constant time, and ticks only do work for the entries that expire (plus a
+// few moves of each entry between the wheel's levels as its deadline
+// approaches), no matter how many entries there are or how far time moves.
+
+#ifndef SUPER_GLUE_LIB_INCLUDE_TTL_HASH_TABLE_H_
+#define SUPER_GLUE_LIB_INCLUDE_TTL_HASH_TABLE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hash_table.h"
+
+typedef struct _TTLHT TTLHashTable;
+
+// Allocates a new TTLHashTable. Caller assumes responsibility of eventually
+// passing the returned pointer to TTLHashTable_free.
+//
+// now - The current time.
+//
+// Returns a pointer to a newly allocated TTLHashTable, or NULL on failure
+// (such as being out of memory).
+TTLHashTable *TTLHashTable_allocate(uint64_t now);
+
+// Frees a TTLHashTable, and optionally all values in it, whether or not their
+// deadlines have passed.
+//
+// tt         - The table to free. NO OP if NULL.
+// value_free - Each value in the table is passed to this function to be
+//              freed. If NULL, the values aren't freed.
+void TTLHashTable_free(TTLHashTable *tt, HTValue_free value_free);
+
+// Returns the number of elements in a TTLHashTable, or -1 if tt is NULL.
+int TTLHashTable_num_elements(TTLHashTable *tt);
+
+// Returns the current time of a TTLHashTable, i.e. the `now` of the latest
+// call to TTLHashTable_tick, or of TTLHashTable_allocate if there weren't
+// any. Returns 0 if tt is NULL.
+uint64_t TTLHashTable_now(TTLHashTable *tt);
+
+// Inserts an entry into the table with the given key/value/deadline,
+// overwriting the value and deadline of any existing entry with the given
+// key.
+//
+// tt        - The table to insert into. If NULL, returns false.
+// key       - The key for this value. A copy is made. If NULL, returns false.
+// key_len   - The length of key in unsigned chars. If zero, key is assumed to
+//             end with a '\0', which isn't considered part of the key.
+// new_value - The value that key will map to.
+// deadline  - The time at which the entry expires. Deadlines at or before the
+//             table's current time expire at the next tick that moves time
+//             forward.
+// old_value - If key was already in the table, set to the previous value.
+//             Ignored if NULL.
+//
+// Returns true if there was previously an entry for key, i.e., when
+// *old_value has been populated. If memory can't be allocated for a new
+// entry, the table is left unchanged and false is returned.
+bool TTLHashTable_insert(TTLHashTable *tt, unsigned char *key, size_t key_len,
+    HTValue new_value, uint64_t deadline, HTValue *old_value);
+
+// Searches a TTLHashTable for a given key. Entries stay in the table until a
+// tick reaches their deadlines, so this finds entries whose deadline has
+// passed in real time if TTLHashTable_tick hasn't been told yet.
+//
+// tt           - The table to query. If NULL, returns NULL.
+// key          - The key to look up. If NULL, returns NULL.
+// key_len      - The length of key in unsigned chars. If zero, key is assumed
+//                to end with a '\0'.
+// deadline_out - Set to the entry's deadline if it's found. Ignored if NULL.
+//
+// Returns a pointer to the value associated with key, which stays valid until
+// the entry is removed or expires, or NULL if key isn't in the table.
+HTValue *TTLHashTable_find(TTLHashTable *tt, unsigned char *key,
+    size_t key_len, uint64_t *deadline_out);
+
+// Changes the deadline of an existing entry, e.g. to extend a session on
+// activity, without touching its value.
+//
+// tt       - The table to update. If NULL, returns false.
+// key      - The key of the entry to update. If NULL, returns false.
+// key_len  - The length of key in unsigned chars. If zero, key is assumed to
+//            end with a '\0'.
+// deadline - The entry's new deadline, same as for TTLHashTable_insert.
+//
+// Returns true if the entry was found and updated, false if key isn't in the
+// table.
+bool TTLHashTable_set_deadline(TTLHashTable *tt, unsigned char *key,
+    size_t key_len, uint64_t deadline);
+
+// Removes the entry with the given key before its deadline.
+//
+// tt        - The table to remove from. If NULL, returns false.
+// key       - The key of the entry to remove. If NULL, returns false.
+// key_len   - The length of key in unsigned chars. If zero, key is assumed to
+//             end with a '\0'.
+// old_value - Set to the removed value. Ignored if NULL.
+//
+// Returns true if an entry was removed, false if key wasn't in the table.
+bool TTLHashTable_remove(TTLHashTable *tt, unsigned char *key, size_t key_len,
+    HTValue *old_value);
+
+// Advances a TTLHashTable's time, removing every entry whose deadline is at
+// or before `now`.
+//
+// tt         - The table to advance. If NULL, returns -1.
+// now        - The new current time. If it's before the table's current time,
+//              nothing happens.
+// value_free - The value of each expired entry is passed to this function,
+//              after the entry is removed from the table, so that it can be
+//              freed. It must not use tt. If NULL, the values aren't freed.
+//
+// Returns the number of entries that expired, or -1 if tt is NULL.
+int TTLHashTable_tick(TTLHashTable *tt, uint64_t now, HTValue_free value_free);
+
+#endif  // SUPER_GLUE_LIB_INCLUDE_TTL_HASH_TABLE_H_
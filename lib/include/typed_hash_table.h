@@ -0,0 +1,366 @@
+/* Provides hash tables specialized for fixed key and value types.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// HashTable takes keys as byte strings and values as HTValues, so a table
+// keyed by, say, IPv4 addresses has to hash and memcmp four bytes through a
+// pointer, and a value that isn't a pointer has to be squeezed into one or
+// boxed on the heap. DEFINE_HASHTABLE instead generates a table for one
+// particular key and value type, which stores both directly in its slots and
+// calls the given hash and equality functions directly, so that the compiler
+// can inline them.
+//
+//   DEFINE_HASHTABLE(name, KeyT, ValT, hashfn, eqfn)
+//
+// name   - The name of the table type. The generated functions are all
+//          prefixed with it, and the iterator type is name##Iterator.
+// KeyT   - The key type. Keys are copied in and out by value.
+// ValT   - The value type. Values are copied in and out by value.
+// hashfn - A function or function-like macro taking a KeyT and returning a
+//          uint64_t hash of it. All 64 bits should be well mixed, since both
+//          the high and low bits are used. TypedHT_hash_u32 and
+//          TypedHT_hash_u64 are provided for integer keys.
+// eqfn   - A function or function-like macro taking two KeyTs and returning
+//          whether they're equal. TYPED_HT_EQ compares them with ==.
+//
+// For example, `DEFINE_HASHTABLE(PortTable, uint16_t, int, TypedHT_hash_u32,
+// TYPED_HT_EQ)` generates a PortTable type with these functions, which mirror
+// the HashTable functions of the same name:
+//
+//   PortTable *PortTable_allocate();
+//   void PortTable_free(PortTable *t, void (*value_free)(int));
+//   int PortTable_num_elements(PortTable *t);
+//   bool PortTable_insert(PortTable *t, uint16_t key, int new_value,
+//       int *old_value);
+//   int *PortTable_entry(PortTable *t, uint16_t key, bool *inserted);
+//   int *PortTable_find(PortTable *t, uint16_t key);
+//   bool PortTable_remove(PortTable *t, uint16_t key, int *old_value);
+//
+//   PortTableIterator *PortTableIterator_allocate(PortTable *t);
+//   void PortTableIterator_free(PortTableIterator *it);
+//   bool PortTableIterator_is_valid(PortTableIterator *it);
+//   bool PortTableIterator_next(PortTableIterator *it);
+//   bool PortTableIterator_get(PortTableIterator *it, uint16_t *key_out,
+//       int *value_out);
+//   bool PortTableIterator_remove(PortTableIterator *it, uint16_t *key_out,
+//       int *value_out);
+//
+// They behave like their HashTable counterparts, with these differences:
+//  - Since keys are passed by value, there's no key length and no NULL key.
+//  - PortTable_entry zero-fills the value of a newly inserted key.
+//  - Pointers returned by PortTable_find and PortTable_entry are invalidated
+//    by the next insert into or removal from the table, as with
+//    HT_ENGINE_OPEN.
+//  - Iteration order is arbitrary, and removing an entry through an iterator
+//    never resizes the table.
+//
+// The generated functions are static, so DEFINE_HASHTABLE can be used in any
+// number of translation units, including inside a header.
+//
+// Tables use open addressing with linear probing. Each slot has a control
+// byte holding 7 bits of its key's hash, so eqfn is only called on keys that
+// are very likely to match. Hashes aren't stored, so hashfn is called again
+// on every key when the table is resized; it's meant to be cheap.
+
+#ifndef SUPER_GLUE_LIB_INCLUDE_TYPED_HASH_TABLE_H_
+#define SUPER_GLUE_LIB_INCLUDE_TYPED_HASH_TABLE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Mixes the bits of an integer key into a hash, using the finalizer of
+// MurmurHash3. This is unseeded, so keys chosen by an attacker can be made to
+// collide; tables keyed by untrusted input should hash with
+// HashTable_hash_key instead.
+static inline uint64_t TypedHT_hash_u64(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xFF51AFD7ED558CCDULL;
+  key ^= key >> 33;
+  key *= 0xC4CEB9FE1A85EC53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+// Same as TypedHT_hash_u64, for 32-bit (and smaller) integer keys.
+static inline uint64_t TypedHT_hash_u32(uint32_t key) {
+  return TypedHT_hash_u64(key);
+}
+
+// Compares two keys with ==, for integer and pointer keys.
+#define TYPED_HT_EQ(a, b) ((a) == (b))
+
+// Control byte values. Full slots hold the low 7 bits of their key's hash, so
+// they always have the high bit clear, whereas both of these have it set.
+#define TYPED_HT_EMPTY ((uint8_t)0x80)
+#define TYPED_HT_DELETED ((uint8_t)0xFE)
+// The smallest number of slots a table has.
+#define TYPED_HT_MIN_CAPACITY 16
+
+// A table is rehashed once more than 3/4 of its slots are full or deleted.
+// Linear probing degrades quickly at higher loads than that.
+static inline size_t TypedHT_capacity_to_growth(size_t capacity) {
+  return capacity - capacity / 4;
+}
+
+// Returns the smallest valid capacity that can hold `min_size` entries
+// without rehashing.
+static inline size_t TypedHT_capacity_for(size_t min_size) {
+  size_t capacity = TYPED_HT_MIN_CAPACITY;
+  while (TypedHT_capacity_to_growth(capacity) < min_size) capacity *= 2;
+  return capacity;
+}
+
+#define DEFINE_HASHTABLE(name, KeyT, ValT, hashfn, eqfn) \
+  typedef struct { \
+    KeyT key; \
+    ValT value; \
+  } name##Slot; \
+  \
+  typedef struct { \
+    uint8_t *ctrl; \
+    name##Slot *slots; \
+    size_t capacity; \
+    size_t size; /* Full slots */ \
+    size_t used; /* Full and deleted slots */ \
+  } name; \
+  \
+  typedef struct { \
+    name *table; \
+    size_t idx; \
+  } name##Iterator; \
+  \
+  static inline bool name##_alloc_slots(name *t, size_t capacity) { \
+    uint8_t *ctrl = malloc(capacity); \
+    name##Slot *slots = malloc(capacity * sizeof(name##Slot)); \
+    if (ctrl == NULL || slots == NULL) { \
+      free(ctrl); \
+      free(slots); \
+      return false; \
+    } \
+    memset(ctrl, TYPED_HT_EMPTY, capacity); \
+    t->ctrl = ctrl; \
+    t->slots = slots; \
+    t->capacity = capacity; \
+    t->size = 0; \
+    t->used = 0; \
+    return true; \
+  } \
+  \
+  /* Returns the first empty or deleted slot in the probe sequence for \
+     `hash`. */ \
+  static inline size_t name##_insert_slot(const name *t, uint64_t hash) { \
+    size_t mask = t->capacity - 1; \
+    size_t idx = (hash >> 7) & mask; \
+    while (!(t->ctrl[idx] & 0x80)) idx = (idx + 1) & mask; \
+    return idx; \
+  } \
+  \
+  /* Rehashes every entry into `new_capacity` slots, dropping tombstones. \
+     On failure, `t` is left untouched. */ \
+  static inline bool name##_resize(name *t, size_t new_capacity) { \
+    name new_t; \
+    if (!name##_alloc_slots(&new_t, new_capacity)) return false; \
+    for (size_t i = 0; i < t->capacity; i++) { \
+      if (t->ctrl[i] & 0x80) continue; \
+      uint64_t hash = hashfn(t->slots[i].key); \
+      size_t idx = name##_insert_slot(&new_t, hash); \
+      new_t.ctrl[idx] = (uint8_t)(hash & 0x7F); \
+      new_t.slots[idx] = t->slots[i]; \
+    } \
+    new_t.size = t->size; \
+    new_t.used = t->size; \
+    free(t->ctrl); \
+    free(t->slots); \
+    *t = new_t; \
+    return true; \
+  } \
+  \
+  /* Returns the slot holding `key`, or SIZE_MAX if it isn't there. The \
+     table always has an empty slot, so probing terminates. */ \
+  static inline size_t name##_slot_of(const name *t, KeyT key, \
+      uint64_t hash) { \
+    size_t mask = t->capacity - 1; \
+    uint8_t h2 = (uint8_t)(hash & 0x7F); \
+    for (size_t idx = (hash >> 7) & mask;; idx = (idx + 1) & mask) { \
+      uint8_t ctrl = t->ctrl[idx]; \
+      if (ctrl == h2 && eqfn(t->slots[idx].key, key)) return idx; \
+      if (ctrl == TYPED_HT_EMPTY) return SIZE_MAX; \
+    } \
+  } \
+  \
+  /* Empties slot `idx`. A slot can be marked empty rather than deleted if \
+     the next one is empty, since no probe could have gone past it. */ \
+  static inline void name##_release(name *t, size_t idx) { \
+    size_t next = (idx + 1) & (t->capacity - 1); \
+    if (t->ctrl[next] == TYPED_HT_EMPTY) { \
+      t->ctrl[idx] = TYPED_HT_EMPTY; \
+      t->used--; \
+    } else { \
+      t->ctrl[idx] = TYPED_HT_DELETED; \
+    } \
+    t->size--; \
+  } \
+  \
+  static inline name *name##_allocate() { \
+    name *t = malloc(sizeof(name)); \
+    if (t == NULL) return NULL; \
+    if (!name##_alloc_slots(t, TYPED_HT_MIN_CAPACITY)) { \
+      free(t); \
+      return NULL; \
+    } \
+    return t; \
+  } \
+  \
+  static inline void name##_free(name *t, void (*value_free)(ValT)) { \
+    if (t == NULL) return; \
+    if (value_free != NULL) { \
+      for (size_t i = 0; i < t->capacity; i++) { \
+        if (!(t->ctrl[i] & 0x80)) value_free(t->slots[i].value); \
+      } \
+    } \
+    free(t->ctrl); \
+    free(t->slots); \
+    free(t); \
+  } \
+  \
+  static inline int name##_num_elements(name *t) { \
+    if (t == NULL) return -1; \
+    return (int)t->size; \
+  } \
+  \
+  static inline ValT *name##_entry(name *t, KeyT key, bool *inserted) { \
+    if (t == NULL) return NULL; \
+    uint64_t hash = hashfn(key); \
+    size_t mask = t->capacity - 1; \
+    uint8_t h2 = (uint8_t)(hash & 0x7F); \
+    size_t first_deleted = SIZE_MAX; \
+    size_t idx = (hash >> 7) & mask; \
+    for (;; idx = (idx + 1) & mask) { \
+      uint8_t ctrl = t->ctrl[idx]; \
+      if (ctrl == h2 && eqfn(t->slots[idx].key, key)) { \
+        if (inserted != NULL) *inserted = false; \
+        return &t->slots[idx].value; \
+      } \
+      if (ctrl == TYPED_HT_EMPTY) break; \
+      if (ctrl == TYPED_HT_DELETED && first_deleted == SIZE_MAX) { \
+        first_deleted = idx; \
+      } \
+    } \
+    \
+    if (first_deleted != SIZE_MAX) { \
+      idx = first_deleted; \
+    } else if (t->used + 1 > TypedHT_capacity_to_growth(t->capacity)) { \
+      /* If dropping the tombstones would leave the table at most half of \
+         its max load, rehash in place instead of growing. */ \
+      size_t new_capacity = t->capacity; \
+      if (t->size + 1 > TypedHT_capacity_to_growth(t->capacity) / 2) { \
+        new_capacity *= 2; \
+      } \
+      if (!name##_resize(t, new_capacity)) return NULL; \
+      idx = name##_insert_slot(t, hash); \
+      t->used++; \
+    } else { \
+      t->used++; \
+    } \
+    t->ctrl[idx] = h2; \
+    t->slots[idx].key = key; \
+    memset(&t->slots[idx].value, 0, sizeof(ValT)); \
+    t->size++; \
+    if (inserted != NULL) *inserted = true; \
+    return &t->slots[idx].value; \
+  } \
+  \
+  static inline bool name##_insert(name *t, KeyT key, ValT new_value, \
+      ValT *old_value) { \
+    bool inserted; \
+    ValT *value = name##_entry(t, key, &inserted); \
+    if (value == NULL) return false; \
+    if (!inserted && old_value != NULL) *old_value = *value; \
+    *value = new_value; \
+    return !inserted; \
+  } \
+  \
+  static inline ValT *name##_find(name *t, KeyT key) { \
+    if (t == NULL) return NULL; \
+    size_t idx = name##_slot_of(t, key, hashfn(key)); \
+    return idx != SIZE_MAX ? &t->slots[idx].value : NULL; \
+  } \
+  \
+  static inline bool name##_remove(name *t, KeyT key, ValT *old_value) { \
+    if (t == NULL) return false; \
+    size_t idx = name##_slot_of(t, key, hashfn(key)); \
+    if (idx == SIZE_MAX) return false; \
+    if (old_value != NULL) *old_value = t->slots[idx].value; \
+    name##_release(t, idx); \
+    if (t->capacity > TYPED_HT_MIN_CAPACITY && t->size < t->capacity / 8) { \
+      name##_resize(t, TypedHT_capacity_for(t->size * 2)); \
+    } \
+    return true; \
+  } \
+  \
+  /* Returns the first full slot at or after `from`, or t->capacity if \
+     there isn't one. */ \
+  static inline size_t name##_next_full(const name *t, size_t from) { \
+    while (from < t->capacity && (t->ctrl[from] & 0x80)) from++; \
+    return from; \
+  } \
+  \
+  static inline name##Iterator *name##Iterator_allocate(name *t) { \
+    if (t == NULL) return NULL; \
+    name##Iterator *it = malloc(sizeof(name##Iterator)); \
+    if (it == NULL) return NULL; \
+    it->table = t; \
+    it->idx = name##_next_full(t, 0); \
+    return it; \
+  } \
+  \
+  static inline void name##Iterator_free(name##Iterator *it) { \
+    free(it); \
+  } \
+  \
+  static inline bool name##Iterator_is_valid(name##Iterator *it) { \
+    return it != NULL && it->idx < it->table->capacity; \
+  } \
+  \
+  static inline bool name##Iterator_next(name##Iterator *it) { \
+    if (!name##Iterator_is_valid(it)) return false; \
+    it->idx = name##_next_full(it->table, it->idx + 1); \
+    return name##Iterator_is_valid(it); \
+  } \
+  \
+  static inline bool name##Iterator_get(name##Iterator *it, KeyT *key_out, \
+      ValT *value_out) { \
+    if (!name##Iterator_is_valid(it)) return false; \
+    name##Slot *slot = &it->table->slots[it->idx]; \
+    if (key_out != NULL) *key_out = slot->key; \
+    if (value_out != NULL) *value_out = slot->value; \
+    return true; \
+  } \
+  \
+  static inline bool name##Iterator_remove(name##Iterator *it, \
+      KeyT *key_out, ValT *value_out) { \
+    if (!name##Iterator_get(it, key_out, value_out)) return false; \
+    name##_release(it->table, it->idx); \
+    it->idx = name##_next_full(it->table, it->idx + 1); \
+    return true; \
+  }
+
+#endif  // SUPER_GLUE_LIB_INCLUDE_TYPED_HASH_TABLE_H_
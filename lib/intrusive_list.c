@@ -0,0 +1,197 @@
+/* Implements a doubly linked list whose links live inside its elements.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "intrusive_list.h"
+
+#include <stddef.h>
+
+// Links `link` into `list` between `prev` and `next`, either of which may be
+// NULL at the ends of the list.
+static inline void link_insert(IntrusiveList *list, ILLink *link,
+    ILLink *prev, ILLink *next) {
+  link->prev = prev;
+  link->next = next;
+  link->list = list;
+  if (prev != NULL) {
+    prev->next = link;
+  } else {
+    list->head = link;
+  }
+  if (next != NULL) {
+    next->prev = link;
+  } else {
+    list->tail = link;
+  }
+  list->num_elems++;
+}
+
+// Unlinks `link` from the list it's in, leaving it ready to be added again.
+static inline void link_remove(ILLink *link) {
+  IntrusiveList *list = link->list;
+  if (link->prev != NULL) {
+    link->prev->next = link->next;
+  } else {
+    list->head = link->next;
+  }
+  if (link->next != NULL) {
+    link->next->prev = link->prev;
+  } else {
+    list->tail = link->prev;
+  }
+  list->num_elems--;
+
+  link->next = NULL;
+  link->prev = NULL;
+  link->list = NULL;
+}
+
+bool IntrusiveList_init(IntrusiveList *list) {
+  if (list == NULL) return false;
+
+  list->head = NULL;
+  list->tail = NULL;
+  list->num_elems = 0;
+  return true;
+}
+
+int IntrusiveList_num_elements(IntrusiveList *list) {
+  if (list == NULL) return -1;
+  return list->num_elems;
+}
+
+bool IntrusiveList_prepend(IntrusiveList *list, ILLink *link) {
+  if (list == NULL || link == NULL || link->list != NULL) return false;
+
+  link_insert(list, link, NULL, list->head);
+  return true;
+}
+
+bool IntrusiveList_append(IntrusiveList *list, ILLink *link) {
+  if (list == NULL || link == NULL || link->list != NULL) return false;
+
+  link_insert(list, link, list->tail, NULL);
+  return true;
+}
+
+bool IntrusiveList_pop_head(IntrusiveList *list, ILLink **link_out) {
+  if (list == NULL || link_out == NULL) return false;
+  if (list->num_elems == 0) return false;
+
+  *link_out = list->head;
+  link_remove(list->head);
+  return true;
+}
+
+bool IntrusiveList_pop_tail(IntrusiveList *list, ILLink **link_out) {
+  if (list == NULL || link_out == NULL) return false;
+  if (list->num_elems == 0) return false;
+
+  *link_out = list->tail;
+  link_remove(list->tail);
+  return true;
+}
+
+bool IntrusiveList_peek_head(IntrusiveList *list, ILLink **link_out) {
+  if (list == NULL || link_out == NULL) return false;
+  if (list->num_elems == 0) return false;
+
+  *link_out = list->head;
+  return true;
+}
+
+bool IntrusiveList_remove(IntrusiveList *list, ILLink *link) {
+  if (list == NULL || link == NULL || link->list != list) return false;
+
+  link_remove(link);
+  return true;
+}
+
+bool IntrusiveList_move_head(IntrusiveList *src, IntrusiveList *dst) {
+  if (src == NULL || dst == NULL || src == dst) return false;
+  if (src->num_elems == 0) return false;
+
+  ILLink *to_move = src->head;
+  link_remove(to_move);
+  link_insert(dst, to_move, NULL, dst->head);
+  return true;
+}
+
+bool ILIterator_init(ILIterator *ili, IntrusiveList *list) {
+  if (ili == NULL || list == NULL) return false;
+
+  ili->list = list;
+  ili->current = list->head;
+  return true;
+}
+
+bool ILIterator_is_valid(ILIterator *ili) {
+  if (ili == NULL) return false;
+  return ili->current != NULL;
+}
+
+ILLink *ILIterator_get(ILIterator *ili) {
+  if (ili == NULL) return NULL;
+  return ili->current;
+}
+
+bool ILIterator_remove(ILIterator *ili, ILLink **link_out) {
+  if (ili == NULL || link_out == NULL || ili->current == NULL) return false;
+
+  ILLink *to_remove = ili->current;
+  ili->current = to_remove->next != NULL ? to_remove->next : to_remove->prev;
+  link_remove(to_remove);
+  *link_out = to_remove;
+  return true;
+}
+
+bool ILIterator_move_to_head(ILIterator *ili) {
+  if (ili == NULL || ili->current == NULL) return false;
+
+  ILLink *link = ili->current;
+  IntrusiveList *list = ili->list;
+  if (link == list->head) return true;
+
+  link_remove(link);
+  link_insert(list, link, NULL, list->head);
+  return true;
+}
+
+bool ILIterator_next(ILIterator *ili) {
+  if (ili == NULL || ili->current == NULL) return false;
+  ili->current = ili->current->next;
+  return ili->current != NULL;
+}
+
+bool ILIterator_prev(ILIterator *ili) {
+  if (ili == NULL || ili->current == NULL) return false;
+  ili->current = ili->current->prev;
+  return ili->current != NULL;
+}
+
+bool ILIterator_rewind(ILIterator *ili) {
+  if (ili == NULL || ili->list->num_elems == 0) return false;
+  ili->current = ili->list->head;
+  return true;
+}
+
+bool ILIterator_fast_forward(ILIterator *ili) {
+  if (ili == NULL || ili->list->num_elems == 0) return false;
+  ili->current = ili->list->tail;
+  return true;
+}
@@ -19,37 +19,77 @@ along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "linked_list.h"
 
+#include <stddef.h>
 #include <stdlib.h>
 
+#include "slab.h"
+
 typedef struct lln {
   struct lln *next, *prev;
   LLPayload payload;
 } LLNode;
 
+// Lets a list's nodes be handed back to a Slab as a single chain
+_Static_assert(offsetof(LLNode, next) == 0,
+    "LLNode must start with its next pointer");
+
 // Typedef'd to LinkedList in "linked_list.h"
 struct _ll {
   LLNode *head, *tail;
   int num_elems;
+  Slab *node_slab;  // NULL if nodes are allocated with malloc
 };
 
-// Typedef'd to LLIterator in "linked_list.h"
-struct _lli {
-  LinkedList *list;
-  LLNode *current;
-};
+static inline LLNode *node_alloc(LinkedList *list) {
+  if (list->node_slab != NULL) return Slab_alloc_object(list->node_slab);
+  return malloc(sizeof(LLNode));
+}
+
+static inline void node_free(LinkedList *list, LLNode *node) {
+  if (list->node_slab != NULL) {
+    Slab_free_object(list->node_slab, node);
+  } else {
+    free(node);
+  }
+}
 
 LinkedList *LinkedList_allocate() {
+  return LinkedList_allocate_with_slab(NULL);
+}
+
+LinkedList *LinkedList_allocate_with_slab(Slab *node_slab) {
+  if (node_slab != NULL && Slab_object_size(node_slab) < sizeof(LLNode)) {
+    return NULL;
+  }
+
   LinkedList *ll = malloc(sizeof(LinkedList));
   if (ll == NULL) return NULL;
 
   ll->head = NULL;
   ll->tail = NULL;
   ll->num_elems = 0;
+  ll->node_slab = node_slab;
   return ll;
 }
 
+size_t LinkedList_node_size() {
+  return sizeof(LLNode);
+}
+
 void LinkedList_free(LinkedList *list, LLPayloadFreeFn payload_free) {
   if (list == NULL) return;
+
+  // The nodes are already chained together through their `next` pointers, so
+  // there's no need to visit them one at a time.
+  if (list->node_slab != NULL && payload_free == NULL) {
+    if (list->num_elems > 0) {
+      Slab_free_chain(list->node_slab, list->head, list->tail,
+          list->num_elems);
+    }
+    free(list);
+    return;
+  }
+
   LLNode *curr = list->head;
 
   // Doesn't use an LLIterator since there's a possibility LLIterator_allocate()
@@ -59,7 +99,7 @@ void LinkedList_free(LinkedList *list, LLPayloadFreeFn payload_free) {
       payload_free(curr->payload);
     }
     LLNode *next = curr->next;
-    free(curr);
+    node_free(list, curr);
     curr = next;
   }
 
@@ -74,7 +114,7 @@ int LinkedList_num_elements(LinkedList *list) {
 bool LinkedList_prepend(LinkedList *list, LLPayload payload) {
   if (list == NULL) return false;
 
-  LLNode *new = malloc(sizeof(LLNode));
+  LLNode *new = node_alloc(list);
   if (new == NULL) return false;
   new->prev = NULL;
   new->next = list->head;
@@ -93,7 +133,7 @@ bool LinkedList_prepend(LinkedList *list, LLPayload payload) {
 bool LinkedList_append(LinkedList *list, LLPayload payload) {
   if (list == NULL) return false;
 
-  LLNode *new = malloc(sizeof(LLNode));
+  LLNode *new = node_alloc(list);
   if (new == NULL) return false;
   new->next = NULL;
   new->prev = list->tail;
@@ -123,7 +163,7 @@ bool LinkedList_pop_head(LinkedList *list, LLPayload *payload_out) {
   }
 
   *payload_out = to_pop->payload;
-  free(to_pop);
+  node_free(list, to_pop);
   list->num_elems--;
   return true;
 }
@@ -142,18 +182,63 @@ bool LinkedList_pop_tail(LinkedList *list, LLPayload *payload_out) {
   }
 
   *payload_out = to_pop->payload;
-  free(to_pop);
+  node_free(list, to_pop);
   list->num_elems--;
   return true;
 }
 
+bool LinkedList_peek_head(LinkedList *list, LLPayload *payload_out) {
+  if (list == NULL || payload_out == NULL) return false;
+  if (list->num_elems == 0) return false;
+
+  *payload_out = list->head->payload;
+  return true;
+}
+
+bool LinkedList_move_head(LinkedList *src, LinkedList *dst) {
+  if (src == NULL || dst == NULL || src == dst) return false;
+  if (src->node_slab != dst->node_slab) return false;
+  if (src->num_elems == 0) return false;
+
+  // Unlink the node from `src`
+  LLNode *to_move = src->head;
+  if (src->num_elems != 1) {
+    src->head = to_move->next;
+    src->head->prev = NULL;
+  } else {
+    src->head = NULL;
+    src->tail = NULL;
+  }
+  src->num_elems--;
+
+  // Link it in at the front of `dst`
+  to_move->prev = NULL;
+  to_move->next = dst->head;
+  if (dst->num_elems == 0) {
+    dst->tail = to_move;
+  } else {
+    dst->head->prev = to_move;
+  }
+  dst->head = to_move;
+  dst->num_elems++;
+  return true;
+}
+
 LLIterator *LLIterator_allocate(LinkedList *list) {
   if (list == NULL) return NULL;
 
   LLIterator *lli = malloc(sizeof(LLIterator));
+  if (lli == NULL) return NULL;
+  LLIterator_init(lli, list);
+  return lli;
+}
+
+bool LLIterator_init(LLIterator *lli, LinkedList *list) {
+  if (lli == NULL || list == NULL) return false;
+
   lli->list = list;
   lli->current = list->head;
-  return lli;
+  return true;
 }
 
 void LLIterator_free(LLIterator *lli) {
@@ -194,7 +279,29 @@ bool LLIterator_remove(LLIterator *lli, LLPayload *payload_out) {
   lli->current = to_remove->next;
 
   *payload_out = to_remove->payload;
-  free(to_remove);
+  node_free(lli->list, to_remove);
+  return true;
+}
+
+bool LLIterator_move_to_head(LLIterator *lli) {
+  if (lli == NULL || lli->current == NULL) return false;
+
+  LLNode *node = lli->current;
+  LinkedList *list = lli->list;
+  if (node == list->head) return true;
+
+  // Unlink node, which has a predecessor since it isn't the head
+  node->prev->next = node->next;
+  if (node == list->tail) {
+    list->tail = node->prev;
+  } else {
+    node->next->prev = node->prev;
+  }
+
+  node->prev = NULL;
+  node->next = list->head;
+  list->head->prev = node;
+  list->head = node;
   return true;
 }
 
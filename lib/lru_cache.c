@@ -0,0 +1,191 @@
+/* Implements a size-bounded cache that evicts its least recently used entries.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "lru_cache.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_table.h"
+#include "linked_list.h"
+
+// An entry in the cache. The HashTable maps keys to these, and each one is
+// the payload of a node in the recency list. The key is kept here as well so
+// that evicted entries can be removed from the HashTable.
+typedef struct {
+  LLIterator node;  // Points at this entry's node in the recency list
+  HTValue value;
+  size_t charge;  // Includes key_len
+  uint64_t hash;
+  size_t key_len;
+  unsigned char key[];
+} LRUEntry;
+
+// Typedef'd to LRUCache in lru_cache.h
+struct _LRU {
+  HashTable *table;  // Maps keys to LRUEntry pointers
+  LinkedList *recency;  // Most recently used entry first
+  size_t capacity;
+  size_t size;
+  LRUEvictFn on_evict;
+};
+
+LRUCache *LRUCache_allocate(size_t capacity, LRUEvictFn on_evict) {
+  LRUCache *cache = malloc(sizeof(LRUCache));
+  if (cache == NULL) return NULL;
+
+  HTOptions opts;
+  HTOptions_init(&opts);
+  opts.engine = HT_ENGINE_OPEN;
+  cache->table = HashTable_allocate_with_options(&opts);
+  cache->recency = LinkedList_allocate();
+  if (cache->table == NULL || cache->recency == NULL) {
+    HashTable_free(cache->table, NULL);
+    LinkedList_free(cache->recency, NULL);
+    free(cache);
+    return NULL;
+  }
+  cache->capacity = capacity;
+  cache->size = 0;
+  cache->on_evict = on_evict;
+  return cache;
+}
+
+void LRUCache_free(LRUCache *cache, HTValue_free value_free) {
+  if (cache == NULL) return;
+  LLPayload payload;
+  while (LinkedList_pop_head(cache->recency, &payload)) {
+    LRUEntry *entry = payload;
+    if (value_free != NULL) value_free(entry->value);
+    free(entry);
+  }
+  LinkedList_free(cache->recency, NULL);
+  HashTable_free(cache->table, NULL);
+  free(cache);
+}
+
+int LRUCache_num_elements(LRUCache *cache) {
+  if (cache == NULL) return -1;
+  return HashTable_num_elements(cache->table);
+}
+
+size_t LRUCache_size(LRUCache *cache) {
+  if (cache == NULL) return 0;
+  return cache->size;
+}
+
+size_t LRUCache_capacity(LRUCache *cache) {
+  if (cache == NULL) return 0;
+  return cache->capacity;
+}
+
+// Evicts least recently used entries until the cache is within its capacity.
+static void evict_to_fit(LRUCache *cache) {
+  LLPayload payload;
+  while (cache->size > cache->capacity &&
+      LinkedList_pop_tail(cache->recency, &payload)) {
+    LRUEntry *entry = payload;
+    HashTable_remove_hashed(cache->table, entry->hash, entry->key,
+        entry->key_len, NULL);
+    cache->size -= entry->charge;
+    if (cache->on_evict != NULL) {
+      cache->on_evict(entry->key, entry->key_len, entry->value);
+    }
+    free(entry);
+  }
+}
+
+bool LRUCache_insert(LRUCache *cache, unsigned char *key, size_t key_len,
+    HTValue new_value, size_t charge, HTValue *old_value) {
+  if (cache == NULL || key == NULL) return false;
+  if (key_len == 0) key_len = strlen((char *)key);
+
+  // An entry that can never fit is evicted on its own, rather than being
+  // linked in first and pushing out every other entry on its way out
+  if (charge > cache->capacity || key_len > cache->capacity - charge) {
+    bool existed = LRUCache_remove(cache, key, key_len, old_value);
+    if (cache->on_evict != NULL) cache->on_evict(key, key_len, new_value);
+    return existed;
+  }
+
+  uint64_t hash = HashTable_hash(cache->table, key, key_len);
+  bool inserted;
+  HTValue *slot = HashTable_entry_hashed(cache->table, hash, key, key_len,
+      &inserted);
+  if (slot == NULL) return false;
+
+  LRUEntry *entry;
+  if (inserted) {
+    entry = malloc(sizeof(LRUEntry) + key_len);
+    if (entry == NULL || !LinkedList_prepend(cache->recency, entry)) {
+      free(entry);
+      HashTable_remove_hashed(cache->table, hash, key, key_len, NULL);
+      return false;
+    }
+    LLIterator_init(&entry->node, cache->recency);
+    entry->hash = hash;
+    entry->key_len = key_len;
+    memcpy(entry->key, key, key_len);
+    *slot = entry;
+  } else {
+    entry = *slot;
+    if (old_value != NULL) *old_value = entry->value;
+    cache->size -= entry->charge;
+    LLIterator_move_to_head(&entry->node);
+  }
+  entry->value = new_value;
+  entry->charge = charge + key_len;
+  cache->size += entry->charge;
+
+  evict_to_fit(cache);
+  return !inserted;
+}
+
+HTValue *LRUCache_find(LRUCache *cache, unsigned char *key, size_t key_len) {
+  if (cache == NULL || key == NULL) return NULL;
+  HTValue *slot = HashTable_find(cache->table, key, key_len);
+  if (slot == NULL) return NULL;
+  LRUEntry *entry = *slot;
+  LLIterator_move_to_head(&entry->node);
+  return &entry->value;
+}
+
+HTValue *LRUCache_peek(LRUCache *cache, unsigned char *key, size_t key_len) {
+  if (cache == NULL || key == NULL) return NULL;
+  HTValue *slot = HashTable_find(cache->table, key, key_len);
+  if (slot == NULL) return NULL;
+  LRUEntry *entry = *slot;
+  return &entry->value;
+}
+
+bool LRUCache_remove(LRUCache *cache, unsigned char *key, size_t key_len,
+    HTValue *old_value) {
+  if (cache == NULL || key == NULL) return false;
+  HTValue removed;
+  if (!HashTable_remove(cache->table, key, key_len, &removed)) return false;
+  LRUEntry *entry = removed;
+  LLPayload payload;
+  LLIterator_remove(&entry->node, &payload);
+  cache->size -= entry->charge;
+  if (old_value != NULL) *old_value = entry->value;
+  free(entry);
+  return true;
+}
@@ -0,0 +1,143 @@
+/* Implements a lock-free multi-producer, single-consumer queue.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "mpsc_queue.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+// The queue is a singly linked list from `front` (oldest) to `back` (newest),
+// which always holds at least one link: either the oldest object, or `stub`,
+// a dummy that's pushed whenever the consumer would otherwise take the last
+// link. Producers swap themselves in as `back` and then link the previous back
+// to themselves. Between those two steps, the list is cut in two, which is why
+// a pop can briefly fail while a push is in progress.
+
+// Typedef'd to MPSCQueue in "mpsc_queue.h"
+struct _mpsc {
+  // Written by every producer. On its own cache line so that producers don't
+  // slow down the consumer by false sharing.
+  alignas(64) _Atomic(MPSCLink *) back;
+  // Only accessed by the consumer
+  alignas(64) MPSCLink *front;
+  MPSCLink stub;
+};
+
+MPSCQueue *MPSCQueue_allocate() {
+  MPSCQueue *queue = aligned_alloc(alignof(MPSCQueue), sizeof(MPSCQueue));
+  if (queue == NULL) return NULL;
+
+  atomic_init(&queue->stub.next, NULL);
+  atomic_init(&queue->back, &queue->stub);
+  queue->front = &queue->stub;
+  return queue;
+}
+
+void MPSCQueue_free(MPSCQueue *queue) {
+  free(queue);
+}
+
+// Does the work of MPSCQueue_push, without checking its arguments.
+static inline void push(MPSCQueue *queue, MPSCLink *link) {
+  atomic_store_explicit(&link->next, NULL, memory_order_relaxed);
+  // acq_rel: releases link->next = NULL (and the object's contents) to
+  // whoever links to `link` next, and acquires `prev` from whoever pushed it.
+  MPSCLink *prev =
+    atomic_exchange_explicit(&queue->back, link, memory_order_acq_rel);
+  atomic_store_explicit(&prev->next, link, memory_order_release);
+}
+
+bool MPSCQueue_push(MPSCQueue *queue, MPSCLink *link) {
+  if (queue == NULL || link == NULL) return false;
+  push(queue, link);
+  return true;
+}
+
+// Does the work of MPSCQueue_pop, without checking its arguments.
+//
+// Returns the removed link, or NULL if nothing could be removed.
+static inline MPSCLink *pop(MPSCQueue *queue) {
+  MPSCLink *front = queue->front;
+  MPSCLink *next = atomic_load_explicit(&front->next, memory_order_acquire);
+
+  // Skip over the stub, which isn't a real object
+  if (front == &queue->stub) {
+    if (next == NULL) return NULL;
+    queue->front = next;
+    front = next;
+    next = atomic_load_explicit(&front->next, memory_order_acquire);
+  }
+
+  if (next != NULL) {
+    queue->front = next;
+    return front;
+  }
+
+  // `front` is the last link we can see. If it isn't the back of the queue, a
+  // producer has swapped in a new back, but hasn't linked it up to `front` yet.
+  if (front != atomic_load_explicit(&queue->back, memory_order_acquire)) {
+    return NULL;
+  }
+
+  // Otherwise, put the stub behind `front` so that the list isn't left empty
+  // once `front` is taken.
+  push(queue, &queue->stub);
+  next = atomic_load_explicit(&front->next, memory_order_acquire);
+  if (next != NULL) {
+    queue->front = next;
+    return front;
+  }
+  // Another producer swapped itself in between the check above and pushing
+  // the stub, and is linking itself to `front`
+  return NULL;
+}
+
+bool MPSCQueue_pop(MPSCQueue *queue, MPSCLink **link_out) {
+  if (queue == NULL || link_out == NULL) return false;
+
+  MPSCLink *link = pop(queue);
+  if (link == NULL) return false;
+  *link_out = link;
+  return true;
+}
+
+size_t MPSCQueue_pop_many(MPSCQueue *queue, MPSCLink **links_out, size_t max) {
+  if (queue == NULL || links_out == NULL) return 0;
+
+  // Walk the links that are already linked up without going through pop(),
+  // leaving the last one, which may need the stub pushed behind it, to pop()
+  size_t num_popped = 0;
+  MPSCLink *front = queue->front;
+  while (num_popped < max) {
+    MPSCLink *next = atomic_load_explicit(&front->next, memory_order_acquire);
+    if (next == NULL) break;
+    if (front != &queue->stub) links_out[num_popped++] = front;
+    front = next;
+  }
+  queue->front = front;
+
+  if (num_popped < max) {
+    MPSCLink *link = pop(queue);
+    if (link != NULL) links_out[num_popped++] = link;
+  }
+  return num_popped;
+}
@@ -0,0 +1,578 @@
+/* Implements a persistent hash map with cheap snapshots.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "persistent_hash_map.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_table_internal.h"
+
+// How many bits of the hash each level of the trie uses
+#define BITS_PER_LEVEL 5
+#define LEVEL_MASK ((1 << BITS_PER_LEVEL) - 1)
+// Once this many bits of the hash have been used up, the keys that are left
+// all have identical hashes, and they're kept in a "collision node": a node at
+// depth MAX_SHIFT or more, which is just an unordered array of leaves.
+#define MAX_SHIFT 64
+
+// Leaves and nodes both start with their reference count, so that code that
+// only adjusts reference counts doesn't need to know which one it has. A
+// reference count of 1 means whoever holds the one reference is free to
+// modify the leaf or node in place; anything more means it's shared with
+// another version of the map and has to be treated as immutable.
+typedef struct {
+  atomic_uint refs;
+  Hash64 hash;
+  HTValue value;
+  size_t key_len;
+  unsigned char key[];
+} PHMLeaf;
+
+// An interior node. Each of the 32 possible values of the node's 5 bits of the
+// hash is either absent, a leaf (bit set in `datamap`) or a child node (bit
+// set in `nodemap`). `slots` holds the leaves in order of their bits, followed
+// by the children in order of theirs, so the index of a slot is found by
+// counting the bits set below its own. Collision nodes have neither map set,
+// and `slots` holds their leaves.
+//
+// Apart from the root, every node holds at least 2 leaves somewhere below it:
+// a node left with a single leaf by a removal is replaced by that leaf.
+typedef struct {
+  atomic_uint refs;
+  uint32_t datamap;
+  uint32_t nodemap;
+  uint32_t len;  // Number of slots
+  void *slots[];
+} PHMNode;
+
+// Typedef'd to PersistentHashMap in persistent_hash_map.h
+struct _PHM {
+  PHMNode *root;  // Never NULL; an empty map has a root with no slots
+  int num_elems;
+  HashFunction hash;
+  HTValue_free value_free;
+};
+
+// An insert or removal in progress, passed down the trie.
+typedef struct {
+  Hash64 hash;
+  const unsigned char *key;
+  size_t key_len;
+  HTValue value;  // Only used by inserts
+  HTValue_free value_free;
+  // Set by inserts that add a new key, and removals that find their key
+  bool changed_size;
+} PHMUpdate;
+
+static inline uint32_t bit_for(Hash64 hash, int shift) {
+  return (uint32_t)1 << ((hash >> shift) & LEVEL_MASK);
+}
+
+// Returns the index in `slots` of the leaf for `bit`, given the node's
+// datamap.
+static inline int data_index(uint32_t datamap, uint32_t bit) {
+  return __builtin_popcount(datamap & (bit - 1));
+}
+
+// Returns the index in `slots` of the child for `bit`, given the node's maps.
+static inline int child_index(uint32_t datamap, uint32_t nodemap,
+    uint32_t bit) {
+  return __builtin_popcount(datamap) + __builtin_popcount(nodemap & (bit - 1));
+}
+
+// Returns the number of leaves at the start of a node's slots.
+static inline int num_leaves(const PHMNode *node, int shift) {
+  return shift >= MAX_SHIFT ? (int)node->len :
+    __builtin_popcount(node->datamap);
+}
+
+// Takes a new reference to a leaf or node.
+static inline void acquire(void *leaf_or_node) {
+  atomic_fetch_add_explicit((atomic_uint *)leaf_or_node, 1,
+      memory_order_relaxed);
+}
+
+// Checks if whoever holds a reference to a leaf or node holds the only one.
+// The acquire pairs with the releases in leaf_release/node_release, so that
+// anything another thread did with the leaf or node before dropping its
+// reference happens before it's modified.
+static inline bool is_unique(void *leaf_or_node) {
+  return atomic_load_explicit((atomic_uint *)leaf_or_node,
+      memory_order_acquire) == 1;
+}
+
+static void leaf_release(PHMLeaf *leaf, HTValue_free value_free) {
+  if (atomic_fetch_sub_explicit(&leaf->refs, 1, memory_order_acq_rel) != 1) {
+    return;
+  }
+  if (value_free != NULL) value_free(leaf->value);
+  free(leaf);
+}
+
+// Drops a reference to `node`, which is at depth `shift`, freeing it (and
+// dropping its references to its slots) if that was the last one.
+static void node_release(PHMNode *node, int shift, HTValue_free value_free) {
+  if (atomic_fetch_sub_explicit(&node->refs, 1, memory_order_acq_rel) != 1) {
+    return;
+  }
+  int leaves = num_leaves(node, shift);
+  for (int i = 0; i < leaves; i++) leaf_release(node->slots[i], value_free);
+  for (uint32_t i = leaves; i < node->len; i++) {
+    node_release(node->slots[i], shift + BITS_PER_LEVEL, value_free);
+  }
+  free(node);
+}
+
+// Checks if a node holds nothing but a single leaf.
+static inline bool is_singleton(const PHMNode *node) {
+  return node->nodemap == 0 && node->len == 1;
+}
+
+static PHMNode *node_alloc(uint32_t len) {
+  PHMNode *node = malloc(sizeof(PHMNode) + len * sizeof(void *));
+  if (node == NULL) return NULL;
+  atomic_init(&node->refs, 1);
+  node->datamap = 0;
+  node->nodemap = 0;
+  node->len = len;
+  return node;
+}
+
+// Allocates a leaf for the key/value of an insert.
+static PHMLeaf *leaf_alloc(const PHMUpdate *upd) {
+  PHMLeaf *leaf = malloc(sizeof(PHMLeaf) + upd->key_len);
+  if (leaf == NULL) return NULL;
+  atomic_init(&leaf->refs, 1);
+  leaf->hash = upd->hash;
+  leaf->value = upd->value;
+  leaf->key_len = upd->key_len;
+  memcpy(leaf->key, upd->key, upd->key_len);
+  return leaf;
+}
+
+static inline bool leaf_matches(const PHMLeaf *leaf, Hash64 hash,
+    const unsigned char *key, size_t key_len) {
+  return leaf->hash == hash && leaf->key_len == key_len &&
+    memcmp(leaf->key, key, key_len) == 0;
+}
+
+// Returns a version of `node` with the given maps, and with slot `remove_idx`
+// taken out and `insert` put in at index `insert_idx` of the result. Either
+// index may be -1 to skip that step.
+//
+// If `owned` (whoever holds `node` holds the only path to it from any map),
+// `node` itself is reused when the number of slots stays the same, and
+// otherwise it's freed once its slots have been moved into the new node. The
+// caller is left holding the removed slot's reference. Otherwise, `node` is
+// left untouched, and a new node is returned that takes its own references to
+// the slots it keeps.
+//
+// Either way, the returned node takes over the caller's reference to `insert`.
+//
+// Returns NULL if memory couldn't be allocated, in which case nothing has
+// changed.
+static PHMNode *node_edit(PHMNode *node, bool owned, uint32_t datamap,
+    uint32_t nodemap, int remove_idx, int insert_idx, void *insert) {
+  uint32_t len = node->len - (remove_idx >= 0) + (insert_idx >= 0);
+
+  if (owned && len == node->len) {
+    void **slots = node->slots;
+    if (remove_idx < insert_idx) {
+      memmove(&slots[remove_idx], &slots[remove_idx + 1],
+          (insert_idx - remove_idx) * sizeof(void *));
+    } else if (remove_idx > insert_idx) {
+      memmove(&slots[insert_idx + 1], &slots[insert_idx],
+          (remove_idx - insert_idx) * sizeof(void *));
+    }
+    if (insert_idx >= 0) slots[insert_idx] = insert;
+    node->datamap = datamap;
+    node->nodemap = nodemap;
+    return node;
+  }
+
+  PHMNode *out = node_alloc(len);
+  if (out == NULL) return NULL;
+  out->datamap = datamap;
+  out->nodemap = nodemap;
+  uint32_t src = 0;
+  for (uint32_t dst = 0; dst < len; dst++) {
+    if ((int)dst == insert_idx) {
+      out->slots[dst] = insert;
+      continue;
+    }
+    if ((int)src == remove_idx) src++;
+    out->slots[dst] = node->slots[src++];
+    if (!owned) acquire(out->slots[dst]);
+  }
+  if (owned) free(node);
+  return out;
+}
+
+// Frees the nodes built by pair_node, without touching the leaves in them.
+static void pair_node_free(PHMNode *node) {
+  while (node != NULL) {
+    PHMNode *next = node->nodemap != 0 ? node->slots[0] : NULL;
+    free(node);
+    node = next;
+  }
+}
+
+// Builds the subtree at depth `shift` holding just the leaves `a` and `b`,
+// which take the new nodes' references to them. Since the leaves' hashes can
+// agree on several levels' worth of bits, this may take a chain of nodes.
+//
+// Returns NULL if memory couldn't be allocated.
+static PHMNode *pair_node(int shift, PHMLeaf *a, PHMLeaf *b) {
+  if (shift >= MAX_SHIFT) {
+    PHMNode *node = node_alloc(2);
+    if (node == NULL) return NULL;
+    node->slots[0] = a;
+    node->slots[1] = b;
+    return node;
+  }
+
+  uint32_t bit_a = bit_for(a->hash, shift);
+  uint32_t bit_b = bit_for(b->hash, shift);
+  if (bit_a == bit_b) {
+    PHMNode *child = pair_node(shift + BITS_PER_LEVEL, a, b);
+    if (child == NULL) return NULL;
+    PHMNode *node = node_alloc(1);
+    if (node == NULL) {
+      pair_node_free(child);
+      return NULL;
+    }
+    node->nodemap = bit_a;
+    node->slots[0] = child;
+    return node;
+  }
+
+  PHMNode *node = node_alloc(2);
+  if (node == NULL) return NULL;
+  node->datamap = bit_a | bit_b;
+  node->slots[0] = bit_a < bit_b ? a : b;
+  node->slots[1] = bit_a < bit_b ? b : a;
+  return node;
+}
+
+// Puts the insert's value in place of the leaf in slot `idx` of `node`, which
+// holds the insert's key. Same semantics as node_insert.
+static PHMNode *replace_leaf(PHMNode *node, bool owned, int idx,
+    PHMUpdate *upd) {
+  PHMLeaf *leaf = node->slots[idx];
+  // Putting a new leaf with the same value in place of a shared one would
+  // have it freed along with the old leaf, so it's left as is.
+  if (leaf->value == upd->value) return node;
+  if (owned && is_unique(leaf)) {
+    HTValue old_value = leaf->value;
+    leaf->value = upd->value;
+    if (upd->value_free != NULL) upd->value_free(old_value);
+    return node;
+  }
+
+  PHMLeaf *new_leaf = leaf_alloc(upd);
+  if (new_leaf == NULL) return NULL;
+  PHMNode *out = node_edit(node, owned, node->datamap, node->nodemap, idx, idx,
+      new_leaf);
+  if (out == NULL) {
+    free(new_leaf);
+    return NULL;
+  }
+  if (owned) leaf_release(leaf, upd->value_free);
+  return out;
+}
+
+// Puts `new_child`, the result of updating `child`, in place of `child` in
+// the slot for `bit` of `node`, at depth `shift`. If `new_child` is left with
+// a single leaf, the leaf takes its place instead. Same semantics as
+// node_insert.
+static PHMNode *replace_child(PHMNode *node, int shift, bool owned,
+    uint32_t bit, PHMNode *child, bool child_owned, PHMNode *new_child,
+    PHMUpdate *upd) {
+  int child_shift = shift + BITS_PER_LEVEL;
+  int idx = child_index(node->datamap, node->nodemap, bit);
+  PHMNode *out;
+  if (is_singleton(new_child)) {
+    PHMLeaf *leaf = new_child->slots[0];
+    uint32_t datamap = node->datamap | bit;
+    out = node_edit(node, owned, datamap, node->nodemap & ~bit, idx,
+        data_index(datamap, bit), leaf);
+    if (out != NULL) acquire(leaf);
+  } else {
+    out = node_edit(node, owned, node->datamap, node->nodemap, idx, idx,
+        new_child);
+    // The new child's reference now belongs to `out`
+    if (out != NULL) new_child = NULL;
+  }
+
+  // If the new child is being thrown away, any leaf only it holds is the
+  // insert's new leaf, whose value still belongs to the caller.
+  if (new_child != NULL) node_release(new_child, child_shift, NULL);
+  if (out == NULL) return NULL;
+  if (owned && !child_owned) node_release(child, child_shift, upd->value_free);
+  return out;
+}
+
+// Inserts the key/value of `upd` into the subtree rooted at `node`, at depth
+// `shift`.
+//
+// If `owned` (whoever holds `node` holds the only path to it from any map),
+// `node` may be updated in place, or replaced by a new node and freed; either
+// way the caller's reference to `node` is taken over by the returned node.
+// Otherwise, `node` is left untouched, and the returned node is either `node`
+// itself if nothing needed to change, or a new node holding a reference of its
+// own.
+//
+// Returns the node that should take `node`'s place, or NULL if memory couldn't
+// be allocated, in which case nothing has changed.
+static PHMNode *node_insert(PHMNode *node, int shift, bool owned,
+    PHMUpdate *upd) {
+  if (shift >= MAX_SHIFT) {
+    for (uint32_t i = 0; i < node->len; i++) {
+      if (leaf_matches(node->slots[i], upd->hash, upd->key, upd->key_len)) {
+        return replace_leaf(node, owned, i, upd);
+      }
+    }
+    PHMLeaf *new_leaf = leaf_alloc(upd);
+    if (new_leaf == NULL) return NULL;
+    PHMNode *out = node_edit(node, owned, 0, 0, -1, node->len, new_leaf);
+    if (out == NULL) {
+      free(new_leaf);
+      return NULL;
+    }
+    upd->changed_size = true;
+    return out;
+  }
+
+  uint32_t bit = bit_for(upd->hash, shift);
+  if (node->nodemap & bit) {
+    PHMNode *child =
+      node->slots[child_index(node->datamap, node->nodemap, bit)];
+    bool child_owned = owned && is_unique(child);
+    PHMNode *new_child = node_insert(child, shift + BITS_PER_LEVEL,
+        child_owned, upd);
+    if (new_child == NULL) return NULL;
+    if (new_child == child) return node;
+    return replace_child(node, shift, owned, bit, child, child_owned,
+        new_child, upd);
+  }
+
+  int idx = data_index(node->datamap, bit);
+  if (!(node->datamap & bit)) {
+    PHMLeaf *new_leaf = leaf_alloc(upd);
+    if (new_leaf == NULL) return NULL;
+    PHMNode *out = node_edit(node, owned, node->datamap | bit, node->nodemap,
+        -1, idx, new_leaf);
+    if (out == NULL) {
+      free(new_leaf);
+      return NULL;
+    }
+    upd->changed_size = true;
+    return out;
+  }
+
+  PHMLeaf *leaf = node->slots[idx];
+  if (leaf_matches(leaf, upd->hash, upd->key, upd->key_len)) {
+    return replace_leaf(node, owned, idx, upd);
+  }
+
+  // Another key is in the way, so both of them move down into a new child
+  PHMLeaf *new_leaf = leaf_alloc(upd);
+  if (new_leaf == NULL) return NULL;
+  PHMNode *pair = pair_node(shift + BITS_PER_LEVEL, leaf, new_leaf);
+  if (pair == NULL) {
+    free(new_leaf);
+    return NULL;
+  }
+  uint32_t datamap = node->datamap & ~bit;
+  uint32_t nodemap = node->nodemap | bit;
+  PHMNode *out = node_edit(node, owned, datamap, nodemap, idx,
+      child_index(datamap, nodemap, bit), pair);
+  if (out == NULL) {
+    pair_node_free(pair);
+    free(new_leaf);
+    return NULL;
+  }
+  // When owned, the reference `node` had to the old leaf moved to `pair`
+  if (!owned) acquire(leaf);
+  upd->changed_size = true;
+  return out;
+}
+
+// Removes the key of `upd` from the subtree rooted at `node`, at depth
+// `shift`. Same semantics as node_insert, except that upd->changed_size is
+// only set if the key was found.
+static PHMNode *node_remove(PHMNode *node, int shift, bool owned,
+    PHMUpdate *upd) {
+  int idx = -1;
+  uint32_t datamap = 0;
+  if (shift >= MAX_SHIFT) {
+    for (uint32_t i = 0; i < node->len; i++) {
+      if (leaf_matches(node->slots[i], upd->hash, upd->key, upd->key_len)) {
+        idx = i;
+        break;
+      }
+    }
+  } else {
+    uint32_t bit = bit_for(upd->hash, shift);
+    if (node->nodemap & bit) {
+      PHMNode *child =
+        node->slots[child_index(node->datamap, node->nodemap, bit)];
+      bool child_owned = owned && is_unique(child);
+      PHMNode *new_child = node_remove(child, shift + BITS_PER_LEVEL,
+          child_owned, upd);
+      if (new_child == NULL) return NULL;
+      if (!upd->changed_size) return node;
+      // A child that's updated in place may still need collapsing
+      if (new_child == child && !is_singleton(child)) return node;
+      return replace_child(node, shift, owned, bit, child, child_owned,
+          new_child, upd);
+    }
+    if ((node->datamap & bit) &&
+        leaf_matches(node->slots[data_index(node->datamap, bit)], upd->hash,
+          upd->key, upd->key_len)) {
+      idx = data_index(node->datamap, bit);
+      datamap = node->datamap & ~bit;
+    }
+  }
+  if (idx < 0) return node;
+
+  PHMLeaf *leaf = node->slots[idx];
+  PHMNode *out = node_edit(node, owned, datamap, node->nodemap, idx, -1,
+      NULL);
+  if (out == NULL) return NULL;
+  if (owned) leaf_release(leaf, upd->value_free);
+  upd->changed_size = true;
+  return out;
+}
+
+PersistentHashMap *PersistentHashMap_allocate(HTHashFn hash_fn,
+    HTValue_free value_free) {
+  HashFunction hash = HashFunction_get(hash_fn);
+  if (hash == NULL) return NULL;
+
+  PersistentHashMap *map = malloc(sizeof(PersistentHashMap));
+  if (map == NULL) return NULL;
+  map->root = node_alloc(0);
+  if (map->root == NULL) {
+    free(map);
+    return NULL;
+  }
+  map->num_elems = 0;
+  map->hash = hash;
+  map->value_free = value_free;
+  return map;
+}
+
+void PersistentHashMap_free(PersistentHashMap *map) {
+  if (map == NULL) return;
+  node_release(map->root, 0, map->value_free);
+  free(map);
+}
+
+PersistentHashMap *PersistentHashMap_snapshot(PersistentHashMap *map) {
+  if (map == NULL) return NULL;
+  PersistentHashMap *snapshot = malloc(sizeof(PersistentHashMap));
+  if (snapshot == NULL) return NULL;
+  *snapshot = *map;
+  acquire(map->root);
+  return snapshot;
+}
+
+int PersistentHashMap_num_elements(PersistentHashMap *map) {
+  if (map == NULL) return -1;
+  return map->num_elems;
+}
+
+// Fills in the parts of a PHMUpdate that describe its key.
+static void update_init(PHMUpdate *upd, PersistentHashMap *map,
+    const unsigned char *key, size_t key_len) {
+  if (key_len == 0) key_len = strlen((const char *)key);
+  upd->hash = map->hash(key, key_len);
+  upd->key = key;
+  upd->key_len = key_len;
+  upd->value = NULL;
+  upd->value_free = map->value_free;
+  upd->changed_size = false;
+}
+
+bool PersistentHashMap_insert(PersistentHashMap *map, unsigned char *key,
+    size_t key_len, HTValue value) {
+  if (map == NULL || key == NULL) return false;
+
+  PHMUpdate upd;
+  update_init(&upd, map, key, key_len);
+  upd.value = value;
+  bool owned = is_unique(map->root);
+  PHMNode *root = node_insert(map->root, 0, owned, &upd);
+  if (root == NULL) return false;
+  // A new root means the map's reference to the old one was either handed
+  // over to the new one (if owned) or needs to be dropped
+  if (root != map->root && !owned) {
+    node_release(map->root, 0, map->value_free);
+  }
+  map->root = root;
+  if (upd.changed_size) map->num_elems++;
+  return true;
+}
+
+const HTValue *PersistentHashMap_find(PersistentHashMap *map,
+    unsigned char *key, size_t key_len) {
+  if (map == NULL || key == NULL) return NULL;
+
+  if (key_len == 0) key_len = strlen((const char *)key);
+  Hash64 hash = map->hash(key, key_len);
+  const PHMNode *node = map->root;
+  for (int shift = 0; shift < MAX_SHIFT; shift += BITS_PER_LEVEL) {
+    uint32_t bit = bit_for(hash, shift);
+    if (node->datamap & bit) {
+      PHMLeaf *leaf = node->slots[data_index(node->datamap, bit)];
+      return leaf_matches(leaf, hash, key, key_len) ? &leaf->value : NULL;
+    }
+    if (!(node->nodemap & bit)) return NULL;
+    node = node->slots[child_index(node->datamap, node->nodemap, bit)];
+  }
+
+  for (uint32_t i = 0; i < node->len; i++) {
+    PHMLeaf *leaf = node->slots[i];
+    if (leaf_matches(leaf, hash, key, key_len)) return &leaf->value;
+  }
+  return NULL;
+}
+
+bool PersistentHashMap_remove(PersistentHashMap *map, unsigned char *key,
+    size_t key_len) {
+  if (map == NULL || key == NULL) return false;
+
+  PHMUpdate upd;
+  update_init(&upd, map, key, key_len);
+  bool owned = is_unique(map->root);
+  PHMNode *root = node_remove(map->root, 0, owned, &upd);
+  if (root == NULL || !upd.changed_size) return false;
+  if (root != map->root && !owned) {
+    node_release(map->root, 0, map->value_free);
+  }
+  map->root = root;
+  map->num_elems--;
+  return true;
+}
@@ -0,0 +1,255 @@
+/* Implements a hash table of counters, sharded for write-heavy workloads.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "sharded_hash_table.h"
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_table.h"
+
+// Counters are stored directly in their HashTable's values, so that adding to
+// one never allocates anything beyond the table's entry for the key.
+_Static_assert(sizeof(HTValue) >= sizeof(int64_t),
+    "Counters must fit in an HTValue");
+
+typedef struct {
+  alignas(64) pthread_mutex_t lock;
+  HashTable *counts;  // Counts added since the shard was last merged
+} SHTShard;
+
+// Typedef'd to ShardedHashTable in sharded_hash_table.h
+//
+// Every table uses the default hash function, so a key's hash can be reused
+// across all of them.
+struct _SHT {
+  // Held while reading or modifying `merged` or `pending`, and by
+  // ShardedHashTable_get for its whole duration, so that it can't see a count
+  // in both a shard and the merged table, or in neither, because of a merge.
+  pthread_mutex_t merge_lock;
+  HashTable *merged;
+  // A shard's table that's been taken out of the shard, but hasn't been
+  // completely folded into `merged` yet because memory ran out. NULL except
+  // after a failed merge.
+  HashTable *pending;
+  int num_shards;
+  SHTShard shards[];
+};
+
+static inline int64_t load_counter(const HTValue *slot) {
+  int64_t counter;
+  memcpy(&counter, slot, sizeof(counter));
+  return counter;
+}
+
+// Adds `delta` to the counter in `slot`, wrapping around on overflow.
+static inline void add_to_counter(HTValue *slot, int64_t delta) {
+  int64_t counter = (int64_t)((uint64_t)load_counter(slot) + (uint64_t)delta);
+  memcpy(slot, &counter, sizeof(counter));
+}
+
+ShardedHashTable *ShardedHashTable_allocate(int num_shards) {
+  if (num_shards <= 0) return NULL;
+
+  // aligned_alloc requires the size to be a multiple of the alignment
+  size_t align = alignof(ShardedHashTable);
+  size_t bytes = sizeof(ShardedHashTable) + num_shards * sizeof(SHTShard);
+  bytes = (bytes + align - 1) / align * align;
+  ShardedHashTable *sht = aligned_alloc(align, bytes);
+  if (sht == NULL) return NULL;
+
+  sht->merged = HashTable_allocate();
+  sht->pending = NULL;
+  sht->num_shards = 0;
+  if (sht->merged == NULL) {
+    ShardedHashTable_free(sht);
+    return NULL;
+  }
+  pthread_mutex_init(&sht->merge_lock, NULL);
+  for (; sht->num_shards < num_shards; sht->num_shards++) {
+    SHTShard *shard = &sht->shards[sht->num_shards];
+    shard->counts = HashTable_allocate();
+    if (shard->counts == NULL) {
+      ShardedHashTable_free(sht);
+      return NULL;
+    }
+    pthread_mutex_init(&shard->lock, NULL);
+  }
+  return sht;
+}
+
+void ShardedHashTable_free(ShardedHashTable *sht) {
+  if (sht == NULL) return;
+  for (int i = 0; i < sht->num_shards; i++) {
+    pthread_mutex_destroy(&sht->shards[i].lock);
+    HashTable_free(sht->shards[i].counts, NULL);
+  }
+  if (sht->merged != NULL) pthread_mutex_destroy(&sht->merge_lock);
+  HashTable_free(sht->pending, NULL);
+  HashTable_free(sht->merged, NULL);
+  free(sht);
+}
+
+int ShardedHashTable_num_shards(ShardedHashTable *sht) {
+  if (sht == NULL) return -1;
+  return sht->num_shards;
+}
+
+bool ShardedHashTable_add(ShardedHashTable *sht, int shard,
+    unsigned char *key, size_t key_len, int64_t delta) {
+  if (sht == NULL || key == NULL) return false;
+  if (shard < 0 || shard >= sht->num_shards) return false;
+
+  SHTShard *s = &sht->shards[shard];
+  pthread_mutex_lock(&s->lock);
+  HTValue *slot = HashTable_entry(s->counts, key, key_len, NULL);
+  if (slot != NULL) add_to_counter(slot, delta);
+  pthread_mutex_unlock(&s->lock);
+  return slot != NULL;
+}
+
+// Returns the counter for the key with the given hash in `ht`, or 0 if it
+// isn't there.
+static int64_t find_counter(HashTable *ht, uint64_t hash, unsigned char *key,
+    size_t key_len) {
+  if (ht == NULL) return 0;
+  HTValue *slot = HashTable_find_hashed(ht, hash, key, key_len);
+  return slot != NULL ? load_counter(slot) : 0;
+}
+
+int64_t ShardedHashTable_get(ShardedHashTable *sht, unsigned char *key,
+    size_t key_len) {
+  if (sht == NULL || key == NULL) return 0;
+  uint64_t hash = HashTable_hash(sht->merged, key, key_len);
+
+  pthread_mutex_lock(&sht->merge_lock);
+  uint64_t total = find_counter(sht->merged, hash, key, key_len);
+  total += find_counter(sht->pending, hash, key, key_len);
+  for (int i = 0; i < sht->num_shards; i++) {
+    SHTShard *s = &sht->shards[i];
+    pthread_mutex_lock(&s->lock);
+    total += find_counter(s->counts, hash, key, key_len);
+    pthread_mutex_unlock(&s->lock);
+  }
+  pthread_mutex_unlock(&sht->merge_lock);
+  return (int64_t)total;
+}
+
+int64_t ShardedHashTable_get_merged(ShardedHashTable *sht, unsigned char *key,
+    size_t key_len) {
+  if (sht == NULL || key == NULL) return 0;
+  pthread_mutex_lock(&sht->merge_lock);
+  HTValue *slot = HashTable_find(sht->merged, key, key_len);
+  int64_t value = slot != NULL ? load_counter(slot) : 0;
+  pthread_mutex_unlock(&sht->merge_lock);
+  return value;
+}
+
+// Adds every counter in sht->pending to sht->merged. Must be called with the
+// merge lock held.
+//
+// Returns true on success, in which case sht->pending can be freed. Returns
+// false if memory ran out, in which case the counters that haven't been added
+// yet are left in sht->pending, and the rest are removed from it.
+static bool fold_pending(ShardedHashTable *sht) {
+  // The counters are read without removing them, since removals through an
+  // iterator would make releasing it shrink the table for nothing
+  HTIterator hti;
+  HTIterator_init(&hti, sht->pending);
+  int num_folded = 0;
+  for (; HTIterator_is_valid(&hti); HTIterator_next(&hti), num_folded++) {
+    const unsigned char *key;
+    size_t key_len;
+    HTValue count;
+    HTIterator_get(&hti, &key, &key_len, &count);
+    HTValue *slot = HashTable_entry(sht->merged, (unsigned char *)key,
+        key_len, NULL);
+    if (slot == NULL) break;
+    add_to_counter(slot, load_counter(&count));
+  }
+  bool ok = !HTIterator_is_valid(&hti);
+  HTIterator_release(&hti);
+  if (ok) return true;
+
+  // Iterating again visits the counters in the same order, so the ones that
+  // have already been folded in come first
+  HTIterator_init(&hti, sht->pending);
+  for (int i = 0; i < num_folded; i++) {
+    HTIterator_remove(&hti, NULL, NULL, NULL);
+  }
+  HTIterator_release(&hti);
+  return false;
+}
+
+bool ShardedHashTable_merge(ShardedHashTable *sht) {
+  if (sht == NULL) return false;
+  pthread_mutex_lock(&sht->merge_lock);
+
+  // Leftovers from a failed merge go first
+  if (sht->pending != NULL) {
+    if (!fold_pending(sht)) {
+      pthread_mutex_unlock(&sht->merge_lock);
+      return false;
+    }
+    HashTable_free(sht->pending, NULL);
+    sht->pending = NULL;
+  }
+
+  // Each shard's table is swapped for an empty one that has room reserved
+  // for as many counters as the old one held, so that shards with a steady
+  // set of keys rarely need to grow their tables from scratch. The old table
+  // is freed once it's been folded into `merged`.
+  bool ok = true;
+  for (int i = 0; i < sht->num_shards; i++) {
+    SHTShard *s = &sht->shards[i];
+    pthread_mutex_lock(&s->lock);
+    int num_counters = HashTable_num_elements(s->counts);
+    pthread_mutex_unlock(&s->lock);
+    if (num_counters == 0) continue;
+
+    // Allocated without holding the shard's lock, so that writers aren't
+    // held up. If reserving fails, the table just grows as it's filled.
+    HashTable *fresh = HashTable_allocate();
+    if (fresh == NULL) {
+      ok = false;
+      break;
+    }
+    HashTable_reserve(fresh, num_counters);
+
+    pthread_mutex_lock(&s->lock);
+    sht->pending = s->counts;
+    s->counts = fresh;
+    pthread_mutex_unlock(&s->lock);
+
+    if (!fold_pending(sht)) {
+      ok = false;
+      break;
+    }
+    HashTable_free(sht->pending, NULL);
+    sht->pending = NULL;
+  }
+
+  pthread_mutex_unlock(&sht->merge_lock);
+  return ok;
+}
@@ -0,0 +1,315 @@
+/* Provides an allocator for many objects of the same size.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _XOPEN_SOURCE 700
+
+#include "slab.h"
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Chunks are allocated with this alignment, and their objects start this far
+// into the chunk, after its header.
+#define CHUNK_ALIGN 64
+// The first chunk holds this many objects, and each chunk after that holds
+// twice as many as the one before, until chunks reach MAX_CHUNK_BYTES.
+// Starting small keeps Slabs that only ever hold a few objects cheap. Staying
+// below malloc's mmap threshold (128 KiB by default in glibc) means chunks
+// reuse memory the process already has, rather than each one being freshly
+// mapped and faulted in.
+#define FIRST_CHUNK_OBJECTS 16
+#define MAX_CHUNK_BYTES (64 * 1024)
+// Once a thread's own free list holds more than this many objects, half of
+// them are moved to the Slab's shared free list. When it runs out, half this
+// many are taken from the shared free list (or a chunk) at once.
+#define CACHE_MAX_OBJECTS 64
+// How many Slabs each thread can find its free list for without taking a
+// lock. Using more Slabs than this from one thread still works, it just takes
+// the Slabs' locks more often.
+#define THREAD_SLOTS 8
+
+// Overlaid on the start of every free object
+typedef struct SlabFree {
+  struct SlabFree *next;
+} SlabFree;
+
+// Header at the start of every chunk
+typedef struct SlabChunk {
+  struct SlabChunk *next;
+} SlabChunk;
+
+// A thread's own free list for one Slab. The Slab owns the caches of every
+// thread that has used it, and frees them along with itself. A thread that
+// exits leaves its cache behind, and whichever thread is next given the same
+// pthread_t takes it over.
+typedef struct SlabCache {
+  // Only accessed while holding the Slab's lock
+  struct SlabCache *next;
+  pthread_t owner;
+
+  // Only accessed by the owner
+  SlabFree *free;
+  size_t num_free;
+} SlabCache;
+
+// Typedef'd to Slab in slab.h
+struct _Slab {
+  uint64_t id;  // Never reused, even after the Slab is freed
+  size_t obj_size;
+
+  pthread_mutex_t lock;
+  // Everything below is only accessed while holding `lock`
+  SlabChunk *chunks;
+  size_t next_chunk_objects;
+  // The part of the newest chunk that has never been handed out
+  unsigned char *unused;
+  unsigned char *unused_end;
+  SlabFree *free;
+  SlabCache *caches;
+};
+
+// Where this thread's cache for a Slab is, indexed by the Slab's id. Since ids
+// are never reused, a slot left over from a Slab that has been freed just
+// never matches again.
+typedef struct {
+  uint64_t slab_id;
+  SlabCache *cache;
+} ThreadSlot;
+
+static _Thread_local ThreadSlot thread_slots[THREAD_SLOTS];
+// Starts at 1 so that the zero-initialized thread_slots don't match anything
+static _Atomic uint64_t next_slab_id = 1;
+
+// Returns the calling thread's cache for `slab`, creating it if needed.
+//
+// Returns NULL if the cache couldn't be allocated, in which case the caller
+// should use the shared free list directly.
+static SlabCache *get_cache(Slab *slab);
+// Takes a chain of up to `max` objects from the shared free list, or carves
+// them out of a chunk if the free list is empty. Must be called while holding
+// slab->lock.
+//
+// Returns the first object in the chain, whose last link is NULL, and sets
+// *count to the number of objects in it. Returns NULL if out of memory.
+static SlabFree *take_shared(Slab *slab, size_t max, size_t *count);
+// Moves all but `keep` of the objects in `cache` to the shared free list.
+static void flush_cache(Slab *slab, SlabCache *cache, size_t keep);
+
+Slab *Slab_allocate(size_t obj_size) {
+  if (obj_size == 0 || obj_size > SIZE_MAX / (4 * FIRST_CHUNK_OBJECTS)) {
+    return NULL;
+  }
+
+  Slab *slab = malloc(sizeof(Slab));
+  if (slab == NULL) return NULL;
+  if (pthread_mutex_init(&slab->lock, NULL) != 0) {
+    free(slab);
+    return NULL;
+  }
+
+  // Rounding up to alignof(max_align_t) also makes sure that free objects
+  // have room for a SlabFree. Objects are then laid out back to back starting
+  // CHUNK_ALIGN bytes into each chunk, which gives them the alignment
+  // promised in slab.h.
+  const size_t min_align = alignof(max_align_t);
+  slab->id = atomic_fetch_add(&next_slab_id, 1);
+  slab->obj_size = (obj_size + min_align - 1) / min_align * min_align;
+  slab->chunks = NULL;
+  slab->next_chunk_objects = FIRST_CHUNK_OBJECTS;
+  slab->unused = NULL;
+  slab->unused_end = NULL;
+  slab->free = NULL;
+  slab->caches = NULL;
+  return slab;
+}
+
+void Slab_free(Slab *slab) {
+  if (slab == NULL) return;
+
+  SlabChunk *chunk = slab->chunks;
+  while (chunk != NULL) {
+    SlabChunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  SlabCache *cache = slab->caches;
+  while (cache != NULL) {
+    SlabCache *next = cache->next;
+    free(cache);
+    cache = next;
+  }
+
+  pthread_mutex_destroy(&slab->lock);
+  free(slab);
+}
+
+size_t Slab_object_size(Slab *slab) {
+  if (slab == NULL) return 0;
+  return slab->obj_size;
+}
+
+static SlabCache *get_cache(Slab *slab) {
+  ThreadSlot *slot = &thread_slots[slab->id % THREAD_SLOTS];
+  if (slot->slab_id == slab->id) return slot->cache;
+
+  pthread_t self = pthread_self();
+  pthread_mutex_lock(&slab->lock);
+  SlabCache *cache = slab->caches;
+  while (cache != NULL && !pthread_equal(cache->owner, self)) {
+    cache = cache->next;
+  }
+  if (cache == NULL) {
+    cache = malloc(sizeof(SlabCache));
+    if (cache != NULL) {
+      cache->owner = self;
+      cache->free = NULL;
+      cache->num_free = 0;
+      cache->next = slab->caches;
+      slab->caches = cache;
+    }
+  }
+  pthread_mutex_unlock(&slab->lock);
+
+  if (cache != NULL) {
+    slot->slab_id = slab->id;
+    slot->cache = cache;
+  }
+  return cache;
+}
+
+static SlabFree *take_shared(Slab *slab, size_t max, size_t *count) {
+  *count = 0;
+  if (slab->free != NULL) {
+    SlabFree *first = slab->free;
+    SlabFree *last = first;
+    *count = 1;
+    while (*count < max && last->next != NULL) {
+      last = last->next;
+      (*count)++;
+    }
+    slab->free = last->next;
+    last->next = NULL;
+    return first;
+  }
+
+  if (slab->unused == slab->unused_end) {
+    size_t objects = slab->next_chunk_objects;
+    size_t bytes = CHUNK_ALIGN + objects * slab->obj_size;
+    // aligned_alloc requires the size to be a multiple of the alignment
+    bytes = (bytes + CHUNK_ALIGN - 1) / CHUNK_ALIGN * CHUNK_ALIGN;
+    SlabChunk *chunk = aligned_alloc(CHUNK_ALIGN, bytes);
+    if (chunk == NULL) return NULL;
+
+    chunk->next = slab->chunks;
+    slab->chunks = chunk;
+    slab->unused = (unsigned char *)chunk + CHUNK_ALIGN;
+    slab->unused_end = slab->unused + objects * slab->obj_size;
+    if ((objects * 2) * slab->obj_size <= MAX_CHUNK_BYTES) {
+      slab->next_chunk_objects = objects * 2;
+    }
+  }
+
+  SlabFree *first = (SlabFree *)slab->unused;
+  SlabFree *last = NULL;
+  while (*count < max && slab->unused != slab->unused_end) {
+    SlabFree *obj = (SlabFree *)slab->unused;
+    if (last != NULL) last->next = obj;
+    last = obj;
+    slab->unused += slab->obj_size;
+    (*count)++;
+  }
+  last->next = NULL;
+  return first;
+}
+
+static void flush_cache(Slab *slab, SlabCache *cache, size_t keep) {
+  if (cache->num_free <= keep) return;
+
+  // Find the chain of objects after the first `keep`
+  SlabFree **split = &cache->free;
+  for (size_t i = 0; i < keep; i++) split = &(*split)->next;
+  SlabFree *first = *split;
+  SlabFree *last = first;
+  while (last->next != NULL) last = last->next;
+  *split = NULL;
+  cache->num_free = keep;
+
+  pthread_mutex_lock(&slab->lock);
+  last->next = slab->free;
+  slab->free = first;
+  pthread_mutex_unlock(&slab->lock);
+}
+
+void *Slab_alloc_object(Slab *slab) {
+  if (slab == NULL) return NULL;
+
+  SlabCache *cache = get_cache(slab);
+  if (cache != NULL && cache->free != NULL) {
+    SlabFree *obj = cache->free;
+    cache->free = obj->next;
+    cache->num_free--;
+    return obj;
+  }
+
+  size_t count;
+  pthread_mutex_lock(&slab->lock);
+  SlabFree *objs =
+    take_shared(slab, cache != NULL ? CACHE_MAX_OBJECTS / 2 : 1, &count);
+  pthread_mutex_unlock(&slab->lock);
+  if (objs == NULL) return NULL;
+
+  // Keep the rest of the chain for later allocations
+  if (cache != NULL) {
+    cache->free = objs->next;
+    cache->num_free = count - 1;
+  }
+  return objs;
+}
+
+void Slab_free_object(Slab *slab, void *obj) {
+  if (slab == NULL || obj == NULL) return;
+  Slab_free_chain(slab, obj, obj, 1);
+}
+
+void Slab_free_chain(Slab *slab, void *first, void *last, size_t count) {
+  if (slab == NULL || first == NULL || last == NULL || count == 0) return;
+
+  // Long chains go straight to the shared free list, since they'd just be
+  // flushed from the cache anyway.
+  SlabCache *cache = count <= CACHE_MAX_OBJECTS / 2 ? get_cache(slab) : NULL;
+  if (cache != NULL) {
+    ((SlabFree *)last)->next = cache->free;
+    cache->free = first;
+    cache->num_free += count;
+    if (cache->num_free > CACHE_MAX_OBJECTS) {
+      flush_cache(slab, cache, CACHE_MAX_OBJECTS / 2);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&slab->lock);
+  ((SlabFree *)last)->next = slab->free;
+  slab->free = first;
+  pthread_mutex_unlock(&slab->lock);
+}
@@ -0,0 +1,278 @@
+/* Implements a bounded single-producer, single-consumer ring buffer.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _XOPEN_SOURCE 700
+
+#include "spsc_ring.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#define CACHE_LINE_SIZE 64
+
+// `head` and `tail` count every payload ever popped and pushed, and are only
+// reduced modulo the capacity (by masking) to index into `slots`, so the ring
+// holds `tail - head` payloads and is full when that's the capacity.
+//
+// To wake the consumer, the two sides use the usual store-fence-load pattern:
+// the consumer sets `sleeping` before its last check for payloads, and the
+// producer checks `sleeping` after publishing payloads, with a seq_cst fence
+// between the store and the load on both sides. At least one of them is then
+// guaranteed to see the other's store, so either the consumer doesn't go to
+// sleep, or the producer writes to the eventfd.
+
+// Typedef'd to SPSCRing in "spsc_ring.h"
+struct _spsc {
+  // Only written by the producer
+  alignas(CACHE_LINE_SIZE) _Atomic size_t tail;
+  size_t cached_head;  // The last value of `head` the producer read
+  // Only written by the consumer
+  alignas(CACHE_LINE_SIZE) _Atomic size_t head;
+  size_t cached_tail;  // The last value of `tail` the consumer read
+  // Written by the consumer when it sleeps and by the producer when it wakes
+  // it up, so that neither is written on every push or pop
+  alignas(CACHE_LINE_SIZE) atomic_bool sleeping;
+  // Never written after SPSCRing_allocate
+  alignas(CACHE_LINE_SIZE) SPSCRingPayload *slots;
+  size_t mask;  // The capacity minus one
+  int efd;  // -1 if the ring was allocated without wakeups
+};
+
+SPSCRing *SPSCRing_allocate(size_t capacity, bool wakeup) {
+  if (capacity == 0 || capacity > SIZE_MAX / 2 / sizeof(SPSCRingPayload)) {
+    return NULL;
+  }
+  size_t rounded = 1;
+  while (rounded < capacity) rounded <<= 1;
+
+  SPSCRing *ring = aligned_alloc(alignof(SPSCRing), sizeof(SPSCRing));
+  if (ring == NULL) return NULL;
+  // aligned_alloc needs the size to be a multiple of the alignment
+  size_t slots_size = rounded * sizeof(SPSCRingPayload);
+  slots_size = (slots_size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE
+    * CACHE_LINE_SIZE;
+  ring->slots = aligned_alloc(CACHE_LINE_SIZE, slots_size);
+  if (ring->slots == NULL) {
+    free(ring);
+    return NULL;
+  }
+
+  ring->efd = -1;
+  if (wakeup) {
+#ifdef __linux__
+    ring->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+    if (ring->efd < 0) {
+      free(ring->slots);
+      free(ring);
+      return NULL;
+    }
+  }
+
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->sleeping, false);
+  ring->cached_head = 0;
+  ring->cached_tail = 0;
+  ring->mask = rounded - 1;
+  return ring;
+}
+
+void SPSCRing_free(SPSCRing *ring, SPSCRingPayloadFreeFn payload_free) {
+  if (ring == NULL) return;
+
+  if (payload_free != NULL) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    for (; head != tail; head++) payload_free(ring->slots[head & ring->mask]);
+  }
+  if (ring->efd >= 0) close(ring->efd);
+  free(ring->slots);
+  free(ring);
+}
+
+size_t SPSCRing_capacity(SPSCRing *ring) {
+  if (ring == NULL) return 0;
+  return ring->mask + 1;
+}
+
+// Returns the number of free slots, as seen by the producer. Only rereads
+// `head` if fewer than `wanted` slots were free last time it was read.
+static inline size_t producer_space(SPSCRing *ring, size_t tail,
+    size_t wanted) {
+  size_t capacity = ring->mask + 1;
+  size_t space = capacity - (tail - ring->cached_head);
+  if (space >= wanted) return space;
+
+  // acquire: the consumer must be done reading the slots it has freed before
+  // they're overwritten
+  ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  return capacity - (tail - ring->cached_head);
+}
+
+// Returns the number of payloads available, as seen by the consumer. Only
+// rereads `tail` if fewer than `wanted` were available last time it was read.
+static inline size_t consumer_available(SPSCRing *ring, size_t head,
+    size_t wanted) {
+  size_t available = ring->cached_tail - head;
+  if (available >= wanted) return available;
+
+  // acquire: pairs with the release in publish(), so the slots are filled in
+  ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  return ring->cached_tail - head;
+}
+
+// Makes every payload before `tail` visible to the consumer, and wakes it up
+// if it's asleep.
+static inline void publish(SPSCRing *ring, size_t tail) {
+  atomic_store_explicit(&ring->tail, tail, memory_order_release);
+  if (ring->efd < 0) return;
+
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&ring->sleeping, memory_order_relaxed) &&
+      atomic_exchange_explicit(&ring->sleeping, false, memory_order_relaxed)) {
+    // Can only fail if the counter would overflow, in which case the consumer
+    // has a wakeup pending anyway
+    uint64_t one = 1;
+    ssize_t ignored = write(ring->efd, &one, sizeof(one));
+    (void)ignored;
+  }
+}
+
+bool SPSCRing_push(SPSCRing *ring, SPSCRingPayload payload) {
+  if (ring == NULL) return false;
+
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  if (producer_space(ring, tail, 1) == 0) return false;
+  ring->slots[tail & ring->mask] = payload;
+  publish(ring, tail + 1);
+  return true;
+}
+
+size_t SPSCRing_push_many(SPSCRing *ring, const SPSCRingPayload *payloads,
+    size_t num) {
+  if (ring == NULL || payloads == NULL || num == 0) return 0;
+
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t space = producer_space(ring, tail, num);
+  if (space < num) num = space;
+  if (num == 0) return 0;
+
+  // Copy in at most two runs, splitting where the slots wrap around
+  size_t start = tail & ring->mask;
+  size_t first = ring->mask + 1 - start;
+  if (first > num) first = num;
+  memcpy(&ring->slots[start], payloads, first * sizeof(SPSCRingPayload));
+  memcpy(ring->slots, payloads + first,
+      (num - first) * sizeof(SPSCRingPayload));
+  publish(ring, tail + num);
+  return num;
+}
+
+bool SPSCRing_pop(SPSCRing *ring, SPSCRingPayload *payload_out) {
+  if (ring == NULL || payload_out == NULL) return false;
+
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  if (consumer_available(ring, head, 1) == 0) return false;
+  *payload_out = ring->slots[head & ring->mask];
+  // release: the slot has been read before the producer can reuse it
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return true;
+}
+
+size_t SPSCRing_pop_many(SPSCRing *ring, SPSCRingPayload *payloads_out,
+    size_t max) {
+  if (ring == NULL || payloads_out == NULL || max == 0) return 0;
+
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t num = consumer_available(ring, head, max);
+  if (num > max) num = max;
+  if (num == 0) return 0;
+
+  size_t start = head & ring->mask;
+  size_t first = ring->mask + 1 - start;
+  if (first > num) first = num;
+  memcpy(payloads_out, &ring->slots[start], first * sizeof(SPSCRingPayload));
+  memcpy(payloads_out + first, ring->slots,
+      (num - first) * sizeof(SPSCRingPayload));
+  atomic_store_explicit(&ring->head, head + num, memory_order_release);
+  return num;
+}
+
+// Returns the current time on a monotonic clock, in milliseconds.
+static int64_t now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+bool SPSCRing_wait(SPSCRing *ring, int timeout_ms) {
+  if (ring == NULL || ring->efd < 0) return false;
+
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  int64_t deadline = timeout_ms > 0 ? now_ms() + timeout_ms : 0;
+  for (;;) {
+    if (consumer_available(ring, head, 1) > 0) return true;
+
+    int poll_ms = -1;
+    if (timeout_ms == 0) return false;
+    if (timeout_ms > 0) {
+      int64_t remaining = deadline - now_ms();
+      if (remaining <= 0) {
+        atomic_store_explicit(&ring->sleeping, false, memory_order_relaxed);
+        return false;
+      }
+      poll_ms = (int)remaining;
+    }
+
+    atomic_store_explicit(&ring->sleeping, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (consumer_available(ring, head, 1) > 0) {
+      atomic_store_explicit(&ring->sleeping, false, memory_order_relaxed);
+      return true;
+    }
+
+    struct pollfd pfd = {.fd = ring->efd, .events = POLLIN};
+    int ret = poll(&pfd, 1, poll_ms);
+    if (ret < 0 && errno != EINTR) {
+      atomic_store_explicit(&ring->sleeping, false, memory_order_relaxed);
+      return false;
+    }
+    if (ret > 0) {
+      // Resets the counter. The wakeup may be left over from an earlier wait
+      // that found payloads without sleeping, so check the ring again.
+      uint64_t count;
+      ssize_t ignored = read(ring->efd, &count, sizeof(count));
+      (void)ignored;
+    }
+  }
+}
@@ -0,0 +1,339 @@
+/* Implements a hash table whose entries expire after a deadline.
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ttl_hash_table.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_table.h"
+
+// How the timing wheel works: level k of the wheel has WHEEL_SLOTS slots, each
+// covering 2^(WHEEL_BITS * k) units of time. An entry goes in the lowest level
+// where its deadline agrees with the current time on every bit above that
+// level's bits, in the slot picked out by the deadline's bits for that level.
+// Since the deadline is in the future, that slot always comes after the one
+// the current time is in. When time reaches the start of a slot, its entries
+// are either expired (on level 0, where a slot is a single unit of time) or
+// moved down to the level that now suits them. So an entry is moved at most
+// once per level before it expires.
+//
+// Deadlines too far in the future for even the top level go on an overflow
+// list, which is only looked at once time reaches the earliest of them.
+//
+// Each level keeps a bitmap of its non-empty slots, so a tick can skip
+// straight to the next slot that needs handling instead of visiting every
+// unit of time in between.
+
+// log2 of the number of slots per level
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+// With 6 levels, the wheel covers deadlines up to 2^36 units of time ahead,
+// which is a little over two years in milliseconds.
+#define WHEEL_LEVELS 6
+#define WHEEL_SPAN_BITS (WHEEL_BITS * WHEEL_LEVELS)
+// The `level` of an entry on the overflow list
+#define OVERFLOW_LEVEL WHEEL_LEVELS
+
+// An entry in the table. The HashTable maps keys to these, and each one is
+// also on one of the wheel's lists. The key is kept here as well so that
+// expired entries can be removed from the HashTable.
+typedef struct _TTLEntry {
+  struct _TTLEntry *next;
+  struct _TTLEntry **pprev;  // Points to whatever points to this entry
+  uint64_t deadline;
+  uint64_t hash;
+  HTValue value;
+  size_t key_len;
+  uint8_t level;
+  uint8_t slot;
+  unsigned char key[];
+} TTLEntry;
+
+// Typedef'd to TTLHashTable in ttl_hash_table.h
+struct _TTLHT {
+  HashTable *table;  // Maps keys to TTLEntry pointers
+  uint64_t now;
+  uint64_t occupied[WHEEL_LEVELS];  // Bit i is set iff slots[level][i] != NULL
+  TTLEntry *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+  TTLEntry *overflow;
+  // No greater than the earliest deadline on the overflow list. Removing
+  // entries from the list doesn't update this, so it may be too early, which
+  // only costs an unnecessary look at the list.
+  uint64_t overflow_min;
+};
+
+static void unlink_entry(TTLHashTable *tt, TTLEntry *entry) {
+  *entry->pprev = entry->next;
+  if (entry->next != NULL) entry->next->pprev = entry->pprev;
+  if (entry->level != OVERFLOW_LEVEL &&
+      tt->slots[entry->level][entry->slot] == NULL) {
+    tt->occupied[entry->level] &= ~(UINT64_C(1) << entry->slot);
+  }
+}
+
+static void push_entry(TTLEntry **head, TTLEntry *entry) {
+  entry->next = *head;
+  if (*head != NULL) (*head)->pprev = &entry->next;
+  entry->pprev = head;
+  *head = entry;
+}
+
+// Puts an entry on the wheel list that suits its deadline, which must be
+// after tt->now (unless tt->now is UINT64_MAX, in which case the entry can
+// never expire and just goes on the overflow list).
+static void schedule(TTLHashTable *tt, TTLEntry *entry) {
+  uint64_t diff = entry->deadline ^ tt->now;
+  int level = OVERFLOW_LEVEL;
+  if (diff != 0) level = (63 - __builtin_clzll(diff)) / WHEEL_BITS;
+  if (level >= WHEEL_LEVELS || entry->deadline <= tt->now) {
+    entry->level = OVERFLOW_LEVEL;
+    push_entry(&tt->overflow, entry);
+    if (entry->deadline < tt->overflow_min) {
+      tt->overflow_min = entry->deadline;
+    }
+    return;
+  }
+  int slot = (entry->deadline >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+  entry->level = level;
+  entry->slot = slot;
+  push_entry(&tt->slots[level][slot], entry);
+  tt->occupied[level] |= UINT64_C(1) << slot;
+}
+
+// Finds the next time after tt->now at which some list on the wheel needs to
+// be looked at.
+//
+// Returns true and sets *next_out if there is one, false if the wheel is
+// empty.
+static bool next_event(TTLHashTable *tt, uint64_t *next_out) {
+  bool found = false;
+  uint64_t next = UINT64_MAX;
+  for (int level = 0; level < WHEEL_LEVELS; level++) {
+    int shift = WHEEL_BITS * level;
+    int current = (tt->now >> shift) & (WHEEL_SLOTS - 1);
+    // Every occupied slot comes after the current one, see schedule
+    uint64_t later = tt->occupied[level] & ~((UINT64_C(2) << current) - 1);
+    if (later == 0) continue;
+    uint64_t slot_start = (tt->now >> (shift + WHEEL_BITS)) <<
+        (shift + WHEEL_BITS);
+    slot_start |= (uint64_t)__builtin_ctzll(later) << shift;
+    if (slot_start < next) next = slot_start;
+    found = true;
+  }
+  if (tt->overflow != NULL &&
+      tt->overflow_min >> WHEEL_SPAN_BITS != tt->now >> WHEEL_SPAN_BITS) {
+    uint64_t start = tt->overflow_min >> WHEEL_SPAN_BITS << WHEEL_SPAN_BITS;
+    if (start < next) next = start;
+    found = true;
+  }
+  *next_out = next;
+  return found;
+}
+
+// Removes an entry whose deadline has passed from the table, and frees it.
+static void expire(TTLHashTable *tt, TTLEntry *entry, HTValue_free value_free) {
+  HashTable_remove_hashed(tt->table, entry->hash, entry->key, entry->key_len,
+      NULL);
+  HTValue value = entry->value;
+  free(entry);
+  if (value_free != NULL) value_free(value);
+}
+
+// Takes every entry off of `*head` and either expires it or schedules it
+// again, now that tt->now has moved.
+//
+// Returns the number of entries that expired.
+static int reschedule_list(TTLHashTable *tt, TTLEntry **head,
+    HTValue_free value_free) {
+  TTLEntry *entry = *head;
+  *head = NULL;
+  int num_expired = 0;
+  while (entry != NULL) {
+    TTLEntry *next = entry->next;
+    if (entry->deadline <= tt->now) {
+      expire(tt, entry, value_free);
+      num_expired++;
+    } else {
+      schedule(tt, entry);
+    }
+    entry = next;
+  }
+  return num_expired;
+}
+
+// Handles every list on the wheel that starts at tt->now.
+//
+// Returns the number of entries that expired.
+static int handle_event(TTLHashTable *tt, HTValue_free value_free) {
+  int num_expired = 0;
+  if (tt->overflow != NULL &&
+      tt->overflow_min >> WHEEL_SPAN_BITS == tt->now >> WHEEL_SPAN_BITS) {
+    tt->overflow_min = UINT64_MAX;
+    num_expired += reschedule_list(tt, &tt->overflow, value_free);
+  }
+  // Top down, so that entries moved down from one level never land in a slot
+  // that's handled later in this same call
+  for (int level = WHEEL_LEVELS - 1; level >= 0; level--) {
+    int shift = WHEEL_BITS * level;
+    if ((tt->now & ((UINT64_C(1) << shift) - 1)) != 0) continue;
+    int slot = (tt->now >> shift) & (WHEEL_SLOTS - 1);
+    if ((tt->occupied[level] & (UINT64_C(1) << slot)) == 0) continue;
+    tt->occupied[level] &= ~(UINT64_C(1) << slot);
+    num_expired += reschedule_list(tt, &tt->slots[level][slot], value_free);
+  }
+  return num_expired;
+}
+
+TTLHashTable *TTLHashTable_allocate(uint64_t now) {
+  TTLHashTable *tt = malloc(sizeof(TTLHashTable));
+  if (tt == NULL) return NULL;
+  tt->table = HashTable_allocate();
+  if (tt->table == NULL) {
+    free(tt);
+    return NULL;
+  }
+  tt->now = now;
+  memset(tt->occupied, 0, sizeof(tt->occupied));
+  memset(tt->slots, 0, sizeof(tt->slots));
+  tt->overflow = NULL;
+  tt->overflow_min = UINT64_MAX;
+  return tt;
+}
+
+// Frees every entry on a wheel list.
+static void free_list(TTLEntry *entry, HTValue_free value_free) {
+  while (entry != NULL) {
+    TTLEntry *next = entry->next;
+    if (value_free != NULL) value_free(entry->value);
+    free(entry);
+    entry = next;
+  }
+}
+
+void TTLHashTable_free(TTLHashTable *tt, HTValue_free value_free) {
+  if (tt == NULL) return;
+  for (int level = 0; level < WHEEL_LEVELS; level++) {
+    for (int slot = 0; slot < WHEEL_SLOTS; slot++) {
+      free_list(tt->slots[level][slot], value_free);
+    }
+  }
+  free_list(tt->overflow, value_free);
+  HashTable_free(tt->table, NULL);
+  free(tt);
+}
+
+int TTLHashTable_num_elements(TTLHashTable *tt) {
+  if (tt == NULL) return -1;
+  return HashTable_num_elements(tt->table);
+}
+
+uint64_t TTLHashTable_now(TTLHashTable *tt) {
+  if (tt == NULL) return 0;
+  return tt->now;
+}
+
+// Sets an entry's deadline, pushing deadlines that have already passed to the
+// next unit of time.
+static void set_deadline(TTLHashTable *tt, TTLEntry *entry,
+    uint64_t deadline) {
+  if (deadline <= tt->now && tt->now != UINT64_MAX) deadline = tt->now + 1;
+  entry->deadline = deadline;
+}
+
+bool TTLHashTable_insert(TTLHashTable *tt, unsigned char *key, size_t key_len,
+    HTValue new_value, uint64_t deadline, HTValue *old_value) {
+  if (tt == NULL || key == NULL) return false;
+  if (key_len == 0) key_len = strlen((char *)key);
+
+  uint64_t hash = HashTable_hash(tt->table, key, key_len);
+  bool inserted;
+  HTValue *slot = HashTable_entry_hashed(tt->table, hash, key, key_len,
+      &inserted);
+  if (slot == NULL) return false;
+
+  TTLEntry *entry;
+  if (inserted) {
+    entry = malloc(sizeof(TTLEntry) + key_len);
+    if (entry == NULL) {
+      HashTable_remove_hashed(tt->table, hash, key, key_len, NULL);
+      return false;
+    }
+    entry->hash = hash;
+    entry->key_len = key_len;
+    memcpy(entry->key, key, key_len);
+    *slot = entry;
+  } else {
+    entry = *slot;
+    if (old_value != NULL) *old_value = entry->value;
+    unlink_entry(tt, entry);
+  }
+  entry->value = new_value;
+  set_deadline(tt, entry, deadline);
+  schedule(tt, entry);
+  return !inserted;
+}
+
+HTValue *TTLHashTable_find(TTLHashTable *tt, unsigned char *key,
+    size_t key_len, uint64_t *deadline_out) {
+  if (tt == NULL || key == NULL) return NULL;
+  HTValue *slot = HashTable_find(tt->table, key, key_len);
+  if (slot == NULL) return NULL;
+  TTLEntry *entry = *slot;
+  if (deadline_out != NULL) *deadline_out = entry->deadline;
+  return &entry->value;
+}
+
+bool TTLHashTable_set_deadline(TTLHashTable *tt, unsigned char *key,
+    size_t key_len, uint64_t deadline) {
+  if (tt == NULL || key == NULL) return false;
+  HTValue *slot = HashTable_find(tt->table, key, key_len);
+  if (slot == NULL) return false;
+  TTLEntry *entry = *slot;
+  unlink_entry(tt, entry);
+  set_deadline(tt, entry, deadline);
+  schedule(tt, entry);
+  return true;
+}
+
+bool TTLHashTable_remove(TTLHashTable *tt, unsigned char *key, size_t key_len,
+    HTValue *old_value) {
+  if (tt == NULL || key == NULL) return false;
+  HTValue removed;
+  if (!HashTable_remove(tt->table, key, key_len, &removed)) return false;
+  TTLEntry *entry = removed;
+  unlink_entry(tt, entry);
+  if (old_value != NULL) *old_value = entry->value;
+  free(entry);
+  return true;
+}
+
+int TTLHashTable_tick(TTLHashTable *tt, uint64_t now, HTValue_free value_free) {
+  if (tt == NULL) return -1;
+  int num_expired = 0;
+  uint64_t next;
+  while (tt->now < now && next_event(tt, &next) && next <= now) {
+    tt->now = next;
+    num_expired += handle_event(tt, value_free);
+  }
+  if (now > tt->now) tt->now = now;
+  return num_expired;
+}
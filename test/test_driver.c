@@ -20,9 +20,22 @@ along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "test_concurrent_hash_table.h"
+#include "test_deque.h"
+#include "test_epoch.h"
+#include "test_frozen_hash_table.h"
 #include "test_hash_table.h"
+#include "test_intrusive_list.h"
 #include "test_linked_list.h"
+#include "test_lru_cache.h"
+#include "test_mpsc_queue.h"
+#include "test_persistent_hash_map.h"
 #include "test_process_args.h"
+#include "test_sharded_hash_table.h"
+#include "test_slab.h"
+#include "test_spsc_ring.h"
+#include "test_ttl_hash_table.h"
+#include "test_typed_hash_table.h"
 
 int main(int argc, char *argv[]) {
   if (argc != 1) {
@@ -32,6 +45,19 @@ int main(int argc, char *argv[]) {
 
   SRunner *runner = srunner_create(hash_table_tests());
   srunner_add_suite(runner, linked_list_tests());
+  srunner_add_suite(runner, intrusive_list_tests());
+  srunner_add_suite(runner, deque_tests());
+  srunner_add_suite(runner, mpsc_queue_tests());
+  srunner_add_suite(runner, spsc_ring_tests());
+  srunner_add_suite(runner, slab_tests());
+  srunner_add_suite(runner, frozen_hash_table_tests());
+  srunner_add_suite(runner, ttl_hash_table_tests());
+  srunner_add_suite(runner, lru_cache_tests());
+  srunner_add_suite(runner, epoch_tests());
+  srunner_add_suite(runner, concurrent_hash_table_tests());
+  srunner_add_suite(runner, sharded_hash_table_tests());
+  srunner_add_suite(runner, typed_hash_table_tests());
+  srunner_add_suite(runner, persistent_hash_map_tests());
   srunner_add_suite(runner, process_args_tests());
   srunner_run_all(runner, CK_NORMAL);
 
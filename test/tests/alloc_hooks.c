@@ -0,0 +1,79 @@
+/* Provides hooks for counting heap allocations made during tests
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// The test executable defines its own malloc, calloc, realloc and
+// aligned_alloc, which take precedence over libc's for every object in the
+// process, including the super-glue shared object. They count calls while
+// counting is enabled, then forward to glibc's underlying implementations.
+// free is left alone since the memory still comes from glibc's allocator.
+
+#include "alloc_hooks.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define ALLOC_HOOKS_ENABLED 0
+#else
+#define ALLOC_HOOKS_ENABLED 1
+#endif
+
+static _Thread_local bool counting = false;
+static _Thread_local size_t count = 0;
+
+#if ALLOC_HOOKS_ENABLED
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size) {
+  if (counting) count++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  if (counting) count++;
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  if (counting) count++;
+  return __libc_realloc(ptr, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  if (counting) count++;
+  return __libc_memalign(alignment, size);
+}
+#endif
+
+bool alloc_hooks_available() {
+  return ALLOC_HOOKS_ENABLED;
+}
+
+void alloc_hooks_start() {
+  count = 0;
+  counting = true;
+}
+
+size_t alloc_hooks_stop() {
+  counting = false;
+  return count;
+}
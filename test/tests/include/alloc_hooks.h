@@ -0,0 +1,40 @@
+/* Declares hooks for counting heap allocations made during tests
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SUPER_GLUE_TEST_TESTS_INCLUDE_ALLOC_HOOKS_H_
+#define SUPER_GLUE_TEST_TESTS_INCLUDE_ALLOC_HOOKS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Returns true if allocations can be counted in this build. Sanitizers replace
+// malloc themselves, so counting is disabled when building with them.
+bool alloc_hooks_available();
+
+// Starts counting calls to malloc, calloc, realloc and aligned_alloc made by
+// the calling thread, resetting the count to zero.
+void alloc_hooks_start();
+
+// Stops counting allocations.
+//
+// Returns the number of allocations made by the calling thread since the last
+// call to alloc_hooks_start.
+size_t alloc_hooks_stop();
+
+#endif  // SUPER_GLUE_TEST_TESTS_INCLUDE_ALLOC_HOOKS_H_
@@ -0,0 +1,263 @@
+/* Provides tests for `concurrent_hash_table.c`
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "test_concurrent_hash_table.h"
+
+#include <check.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "concurrent_hash_table.h"
+#include "epoch.h"
+
+// Helper variables
+static ConcurrentHashTable *cht;
+
+void cht_setup() {
+  cht = ConcurrentHashTable_allocate(HT_HASH_SIPHASH);
+  ck_assert(cht != NULL);
+}
+void cht_teardown() {
+  ConcurrentHashTable_free(cht, NULL);
+  // Reclaim anything retired by this test, so that it isn't reported as leaked
+  Epoch_barrier();
+}
+
+// Bogus input test cases
+START_TEST(allocate_invalid_hash_fn) {
+  ck_assert(ConcurrentHashTable_allocate((HTHashFn)-1) == NULL);
+} END_TEST
+
+START_TEST(free_null) {
+  ConcurrentHashTable_free(NULL, NULL);
+  ConcurrentHashTable_free(NULL, &free);
+} END_TEST
+
+START_TEST(num_elements_null) {
+  ck_assert(ConcurrentHashTable_num_elements(NULL) == -1);
+} END_TEST
+
+START_TEST(insert_null) {
+  ck_assert(!ConcurrentHashTable_insert(NULL, (unsigned char *)"k", 0, NULL,
+        NULL));
+  ck_assert(!ConcurrentHashTable_insert(cht, NULL, 1, NULL, NULL));
+  ck_assert(ConcurrentHashTable_num_elements(cht) == 0);
+} END_TEST
+
+START_TEST(find_null) {
+  HTValue value = (HTValue)0xDEADBEEF;
+  ck_assert(!ConcurrentHashTable_find(NULL, (unsigned char *)"k", 0, &value));
+  ck_assert(!ConcurrentHashTable_find(cht, NULL, 1, &value));
+  ck_assert(value == (HTValue)0xDEADBEEF);
+} END_TEST
+
+START_TEST(remove_null) {
+  ck_assert(!ConcurrentHashTable_remove(NULL, (unsigned char *)"k", 0, NULL));
+  ck_assert(!ConcurrentHashTable_remove(cht, NULL, 1, NULL));
+} END_TEST
+
+START_TEST(find_non_existent_entry) {
+  HTValue value = (HTValue)0xDEADBEEF;
+  ck_assert(!ConcurrentHashTable_find(cht, (unsigned char *)"k", 0, &value));
+  ck_assert(value == (HTValue)0xDEADBEEF);
+  ck_assert(!ConcurrentHashTable_remove(cht, (unsigned char *)"k", 0, NULL));
+} END_TEST
+
+// Entry handling test cases
+START_TEST(insert_find_remove) {
+  HTValue value;
+  ck_assert(!ConcurrentHashTable_insert(cht, (unsigned char *)"one", 0,
+        (HTValue)1, NULL));
+  ck_assert(!ConcurrentHashTable_insert(cht, (unsigned char *)"two", 0,
+        (HTValue)2, NULL));
+  ck_assert(ConcurrentHashTable_num_elements(cht) == 2);
+
+  ck_assert(ConcurrentHashTable_find(cht, (unsigned char *)"one", 3, &value));
+  ck_assert(value == (HTValue)1);
+  ck_assert(ConcurrentHashTable_find(cht, (unsigned char *)"two", 0, NULL));
+
+  ck_assert(ConcurrentHashTable_remove(cht, (unsigned char *)"one", 0,
+        &value));
+  ck_assert(value == (HTValue)1);
+  ck_assert(!ConcurrentHashTable_find(cht, (unsigned char *)"one", 0, NULL));
+  ck_assert(ConcurrentHashTable_num_elements(cht) == 1);
+} END_TEST
+
+START_TEST(insert_overwrite) {
+  HTValue old_value = NULL;
+  ck_assert(!ConcurrentHashTable_insert(cht, (unsigned char *)"key", 0,
+        (HTValue)1, &old_value));
+  ck_assert(old_value == NULL);
+  ck_assert(ConcurrentHashTable_insert(cht, (unsigned char *)"key", 0,
+        (HTValue)2, &old_value));
+  ck_assert(old_value == (HTValue)1);
+  ck_assert(ConcurrentHashTable_num_elements(cht) == 1);
+
+  HTValue value;
+  ck_assert(ConcurrentHashTable_find(cht, (unsigned char *)"key", 0, &value));
+  ck_assert(value == (HTValue)2);
+} END_TEST
+
+START_TEST(grow) {
+  const uint32_t num_keys = 20000;
+  for (uint32_t key = 0; key < num_keys; key++) {
+    ck_assert(!ConcurrentHashTable_insert(cht, (unsigned char *)&key,
+          sizeof(key), (HTValue)(uintptr_t)key, NULL));
+  }
+  ck_assert(ConcurrentHashTable_num_elements(cht) == (int)num_keys);
+  for (uint32_t key = 0; key < num_keys; key++) {
+    HTValue value;
+    ck_assert(ConcurrentHashTable_find(cht, (unsigned char *)&key,
+          sizeof(key), &value));
+    ck_assert(value == (HTValue)(uintptr_t)key);
+  }
+} END_TEST
+
+START_TEST(free_values) {
+  ck_assert(!ConcurrentHashTable_insert(cht, (unsigned char *)"key", 0,
+        malloc(16), NULL));
+  ConcurrentHashTable_free(cht, &free);
+  cht = NULL;
+} END_TEST
+
+// Concurrency test cases
+// Readers look up a set of stable keys, which writers keep overwriting with
+// one of two values, while writers also insert and remove their own keys.
+#define NUM_READERS 4
+#define NUM_WRITERS 4
+#define NUM_STABLE_KEYS 1000
+#define CHURN_KEYS_PER_WRITER 5000
+
+static atomic_bool writers_done;
+static atomic_int reader_errors;
+
+static inline HTValue stable_value(uint32_t key, int version) {
+  return (HTValue)(uintptr_t)(key * 2 + version + 1);
+}
+
+static void *reader_thread(void *arg) {
+  (void)arg;
+  do {
+    for (uint32_t key = 0; key < NUM_STABLE_KEYS; key++) {
+      HTValue value;
+      if (!ConcurrentHashTable_find(cht, (unsigned char *)&key, sizeof(key),
+            &value) ||
+          (value != stable_value(key, 0) && value != stable_value(key, 1))) {
+        atomic_fetch_add(&reader_errors, 1);
+      }
+    }
+  } while (!atomic_load(&writers_done));
+  return NULL;
+}
+
+static void *writer_thread(void *arg) {
+  uint32_t id = (uint32_t)(uintptr_t)arg;
+  uint32_t first = NUM_STABLE_KEYS + id * CHURN_KEYS_PER_WRITER;
+  for (uint32_t key = first; key < first + CHURN_KEYS_PER_WRITER; key++) {
+    ConcurrentHashTable_insert(cht, (unsigned char *)&key, sizeof(key),
+        (HTValue)(uintptr_t)key, NULL);
+    uint32_t stable = key % NUM_STABLE_KEYS;
+    ConcurrentHashTable_insert(cht, (unsigned char *)&stable, sizeof(stable),
+        stable_value(stable, key % 2), NULL);
+    // Remove every other key again, some time after it was inserted
+    if (key % 2 == 0 && key >= first + 100) {
+      uint32_t old_key = key - 100;
+      ConcurrentHashTable_remove(cht, (unsigned char *)&old_key,
+          sizeof(old_key), NULL);
+    }
+  }
+  return NULL;
+}
+
+START_TEST(readers_and_writers) {
+  atomic_store(&writers_done, false);
+  atomic_store(&reader_errors, 0);
+  for (uint32_t key = 0; key < NUM_STABLE_KEYS; key++) {
+    ck_assert(!ConcurrentHashTable_insert(cht, (unsigned char *)&key,
+          sizeof(key), stable_value(key, 0), NULL));
+  }
+
+  pthread_t readers[NUM_READERS];
+  pthread_t writers[NUM_WRITERS];
+  for (int i = 0; i < NUM_READERS; i++) {
+    ck_assert(pthread_create(&readers[i], NULL, &reader_thread, NULL) == 0);
+  }
+  for (int i = 0; i < NUM_WRITERS; i++) {
+    ck_assert(pthread_create(&writers[i], NULL, &writer_thread,
+          (void *)(uintptr_t)i) == 0);
+  }
+  for (int i = 0; i < NUM_WRITERS; i++) pthread_join(writers[i], NULL);
+  atomic_store(&writers_done, true);
+  for (int i = 0; i < NUM_READERS; i++) pthread_join(readers[i], NULL);
+
+  ck_assert_int_eq(atomic_load(&reader_errors), 0);
+
+  // Every writer leaves behind its odd keys, and the last 100 keys it
+  // inserted, half of which are even.
+  int expected = NUM_STABLE_KEYS +
+    NUM_WRITERS * (CHURN_KEYS_PER_WRITER / 2 + 50);
+  ck_assert_int_eq(ConcurrentHashTable_num_elements(cht), expected);
+  for (int i = 0; i < NUM_WRITERS; i++) {
+    uint32_t first = NUM_STABLE_KEYS + i * CHURN_KEYS_PER_WRITER;
+    for (uint32_t key = first; key < first + CHURN_KEYS_PER_WRITER; key++) {
+      bool should_exist =
+        key % 2 == 1 || key >= first + CHURN_KEYS_PER_WRITER - 100;
+      HTValue value;
+      bool found = ConcurrentHashTable_find(cht, (unsigned char *)&key,
+          sizeof(key), &value);
+      ck_assert(found == should_exist);
+      if (found) ck_assert(value == (HTValue)(uintptr_t)key);
+    }
+  }
+} END_TEST
+
+Suite *concurrent_hash_table_tests() {
+  Suite *s = suite_create("ConcurrentHashTable");
+
+  TCase *tc_bogus = tcase_create("bogus input");
+  tcase_add_checked_fixture(tc_bogus, &cht_setup, &cht_teardown);
+  tcase_add_test(tc_bogus, allocate_invalid_hash_fn);
+  tcase_add_test(tc_bogus, free_null);
+  tcase_add_test(tc_bogus, num_elements_null);
+  tcase_add_test(tc_bogus, insert_null);
+  tcase_add_test(tc_bogus, find_null);
+  tcase_add_test(tc_bogus, remove_null);
+  tcase_add_test(tc_bogus, find_non_existent_entry);
+  suite_add_tcase(s, tc_bogus);
+
+  TCase *tc_entry = tcase_create("entry handling");
+  tcase_add_checked_fixture(tc_entry, &cht_setup, &cht_teardown);
+  tcase_add_test(tc_entry, insert_find_remove);
+  tcase_add_test(tc_entry, insert_overwrite);
+  tcase_add_test(tc_entry, grow);
+  tcase_add_test(tc_entry, free_values);
+  suite_add_tcase(s, tc_entry);
+
+  TCase *tc_concurrent = tcase_create("concurrency");
+  tcase_add_checked_fixture(tc_concurrent, &cht_setup, &cht_teardown);
+  tcase_set_timeout(tc_concurrent, 60);
+  tcase_add_test(tc_concurrent, readers_and_writers);
+  suite_add_tcase(s, tc_concurrent);
+
+  return s;
+}
@@ -0,0 +1,327 @@
+/* Provides tests for `deque.c`
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "test_deque.h"
+
+#include <check.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "alloc_hooks.h"
+#include "deque.h"
+
+// Enough elements to span several blocks
+#define NUM_MANY (DEQUE_BLOCK_SLOTS * 5 + 7)
+
+// Helper variables
+static Deque *dq;
+
+// Helper functions
+static DequePayload payload_of(uintptr_t i) {
+  return (DequePayload)(i + 1);
+}
+
+// Empties `dq` from the head, checking that it held exactly the payloads
+// payload_of(first), payload_of(first + step), ... in order.
+static void assert_drains(uintptr_t first, intptr_t step, int len) {
+  ck_assert_int_eq(Deque_num_elements(dq), len);
+  DequePayload out;
+  for (int i = 0; i < len; i++) {
+    ck_assert(Deque_pop_head(dq, &out));
+    ck_assert(out == payload_of(first + i * step));
+  }
+  ck_assert(!Deque_pop_head(dq, &out));
+  ck_assert_int_eq(Deque_num_elements(dq), 0);
+}
+
+static void common_setup() {
+  dq = Deque_allocate();
+  ck_assert(dq != NULL);
+}
+static void common_teardown() {
+  Deque_free(dq, NULL);
+}
+
+// Bogus input test cases
+static void bogus_input_setup() {
+  common_setup();
+}
+static void bogus_input_teardown() {
+  common_teardown();
+}
+
+START_TEST(free_null) {
+  // Segfaults on failure
+  Deque_free(NULL, &free);
+} END_TEST
+
+START_TEST(num_elements_null) {
+  ck_assert_int_eq(Deque_num_elements(NULL), -1);
+} END_TEST
+
+START_TEST(add_null) {
+  ck_assert(!Deque_prepend(NULL, payload_of(0)));
+  ck_assert(!Deque_append(NULL, payload_of(0)));
+} END_TEST
+
+START_TEST(pop_null) {
+  DequePayload out = NULL;
+  ck_assert(!Deque_pop_head(NULL, &out));
+  ck_assert(!Deque_pop_tail(NULL, &out));
+  ck_assert(out == NULL);
+
+  Deque_append(dq, payload_of(0));
+  ck_assert(!Deque_pop_head(dq, NULL));
+  ck_assert(!Deque_pop_tail(dq, NULL));
+  ck_assert_int_eq(Deque_num_elements(dq), 1);
+} END_TEST
+
+START_TEST(pop_empty) {
+  DequePayload out = NULL;
+  ck_assert(!Deque_pop_head(dq, &out));
+  ck_assert(!Deque_pop_tail(dq, &out));
+  ck_assert(out == NULL);
+  ck_assert_int_eq(Deque_num_elements(dq), 0);
+} END_TEST
+
+START_TEST(peek_null) {
+  DequePayload out = NULL;
+  ck_assert(!Deque_peek_head(NULL, &out));
+  ck_assert(!Deque_peek_tail(NULL, &out));
+  ck_assert(!Deque_peek_head(dq, &out));
+  ck_assert(!Deque_peek_tail(dq, &out));
+  ck_assert(out == NULL);
+
+  Deque_append(dq, payload_of(0));
+  ck_assert(!Deque_peek_head(dq, NULL));
+  ck_assert(!Deque_peek_tail(dq, NULL));
+} END_TEST
+
+// Deque manipulation test cases
+static void manipulation_setup() {
+  common_setup();
+}
+static void manipulation_teardown() {
+  common_teardown();
+}
+
+START_TEST(append_pop_head) {
+  for (uintptr_t i = 0; i < NUM_MANY; i++) {
+    ck_assert(Deque_append(dq, payload_of(i)));
+    ck_assert_int_eq(Deque_num_elements(dq), i + 1);
+  }
+  assert_drains(0, 1, NUM_MANY);
+} END_TEST
+
+START_TEST(prepend_pop_head) {
+  for (uintptr_t i = 0; i < NUM_MANY; i++) {
+    ck_assert(Deque_prepend(dq, payload_of(i)));
+  }
+  assert_drains(NUM_MANY - 1, -1, NUM_MANY);
+} END_TEST
+
+START_TEST(append_pop_tail) {
+  for (uintptr_t i = 0; i < NUM_MANY; i++) {
+    ck_assert(Deque_append(dq, payload_of(i)));
+  }
+  DequePayload out;
+  for (uintptr_t i = NUM_MANY; i > 0; i--) {
+    ck_assert(Deque_pop_tail(dq, &out));
+    ck_assert(out == payload_of(i - 1));
+  }
+  ck_assert(!Deque_pop_tail(dq, &out));
+  ck_assert_int_eq(Deque_num_elements(dq), 0);
+} END_TEST
+
+START_TEST(peek) {
+  DequePayload out;
+  for (uintptr_t i = 0; i < NUM_MANY; i++) {
+    Deque_append(dq, payload_of(i));
+    ck_assert(Deque_peek_head(dq, &out));
+    ck_assert(out == payload_of(0));
+    ck_assert(Deque_peek_tail(dq, &out));
+    ck_assert(out == payload_of(i));
+  }
+  Deque_prepend(dq, payload_of(NUM_MANY));
+  ck_assert(Deque_peek_head(dq, &out));
+  ck_assert(out == payload_of(NUM_MANY));
+  ck_assert_int_eq(Deque_num_elements(dq), NUM_MANY + 1);
+} END_TEST
+
+START_TEST(both_ends) {
+  // Builds NUM_MANY - 1, ..., 1, 0 with evens prepended and odds appended,
+  // i.e. ..., 4, 2, 0, 1, 3, 5, ...
+  for (uintptr_t i = 0; i < NUM_MANY; i++) {
+    if (i % 2 == 0) {
+      ck_assert(Deque_prepend(dq, payload_of(i)));
+    } else {
+      ck_assert(Deque_append(dq, payload_of(i)));
+    }
+  }
+
+  // Taking from both ends meets in the middle
+  DequePayload head, tail;
+  uintptr_t expect_head = NUM_MANY % 2 == 0 ? NUM_MANY - 2 : NUM_MANY - 1;
+  uintptr_t expect_tail = NUM_MANY % 2 == 0 ? NUM_MANY - 1 : NUM_MANY - 2;
+  while (Deque_num_elements(dq) >= 2) {
+    ck_assert(Deque_pop_head(dq, &head));
+    ck_assert(Deque_pop_tail(dq, &tail));
+    ck_assert(head == payload_of(expect_head));
+    ck_assert(tail == payload_of(expect_tail));
+    expect_head -= 2;
+    expect_tail -= 2;
+  }
+  ck_assert_int_eq(Deque_num_elements(dq), NUM_MANY % 2);
+} END_TEST
+
+START_TEST(reuse_after_empty) {
+  DequePayload out;
+  for (int round = 0; round < 3; round++) {
+    for (uintptr_t i = 0; i < NUM_MANY; i++) Deque_append(dq, payload_of(i));
+    for (uintptr_t i = 0; i < NUM_MANY; i++) {
+      ck_assert(Deque_pop_tail(dq, &out));
+    }
+    ck_assert_int_eq(Deque_num_elements(dq), 0);
+
+    for (uintptr_t i = 0; i < NUM_MANY; i++) Deque_prepend(dq, payload_of(i));
+    assert_drains(NUM_MANY - 1, -1, NUM_MANY);
+  }
+} END_TEST
+
+START_TEST(fifo_window) {
+  // A queue that keeps a few elements in it while marching through blocks
+  const uintptr_t window = 5;
+  uintptr_t next_in = 0, next_out = 0;
+  DequePayload out;
+  for (; next_in < window; next_in++) Deque_append(dq, payload_of(next_in));
+  for (int i = 0; i < NUM_MANY * 3; i++) {
+    ck_assert(Deque_pop_head(dq, &out));
+    ck_assert(out == payload_of(next_out++));
+    ck_assert(Deque_append(dq, payload_of(next_in++)));
+    ck_assert_int_eq(Deque_num_elements(dq), window);
+  }
+  assert_drains(next_out, 1, window);
+} END_TEST
+
+START_TEST(free_payload) {
+  // Spread over several blocks, starting and ending partway through one
+  for (int i = 0; i < NUM_MANY; i++) {
+    int *payload = malloc(sizeof(int));
+    ck_assert(payload != NULL);
+    *payload = i;
+    if (i % 3 == 0) {
+      ck_assert(Deque_prepend(dq, payload));
+    } else {
+      ck_assert(Deque_append(dq, payload));
+    }
+  }
+  // Leak checkers catch payloads that aren't freed
+  Deque_free(dq, &free);
+  dq = NULL;
+} END_TEST
+
+// Allocation test cases
+static void alloc_setup() {
+  common_setup();
+}
+static void alloc_teardown() {
+  common_teardown();
+}
+
+START_TEST(pop_no_alloc) {
+  if (!alloc_hooks_available()) return;
+
+  for (uintptr_t i = 0; i < NUM_MANY; i++) Deque_append(dq, payload_of(i));
+  DequePayload out;
+  alloc_hooks_start();
+  for (uintptr_t i = 0; i < NUM_MANY / 2; i++) {
+    ck_assert(Deque_pop_head(dq, &out));
+    ck_assert(Deque_pop_tail(dq, &out));
+  }
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Popping made %zu allocations", allocs);
+} END_TEST
+
+START_TEST(appends_per_block) {
+  if (!alloc_hooks_available()) return;
+
+  alloc_hooks_start();
+  for (uintptr_t i = 0; i < NUM_MANY; i++) Deque_append(dq, payload_of(i));
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs <= NUM_MANY / DEQUE_BLOCK_SLOTS + 1,
+      "Appending %d elements made %zu allocations", NUM_MANY, allocs);
+} END_TEST
+
+START_TEST(fifo_recycles_blocks) {
+  if (!alloc_hooks_available()) return;
+
+  // Once the queue has crossed a block boundary, the block it leaves behind
+  // is reused for the next one
+  const uintptr_t window = 3;
+  DequePayload out;
+  for (uintptr_t i = 0; i < window; i++) Deque_append(dq, payload_of(i));
+  for (uintptr_t i = 0; i < 2 * DEQUE_BLOCK_SLOTS; i++) {
+    Deque_append(dq, payload_of(i));
+    Deque_pop_head(dq, &out);
+  }
+  alloc_hooks_start();
+  for (uintptr_t i = 0; i < NUM_MANY * 10; i++) {
+    ck_assert(Deque_append(dq, payload_of(i)));
+    ck_assert(Deque_pop_head(dq, &out));
+  }
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "A steady queue made %zu allocations", allocs);
+} END_TEST
+
+Suite *deque_tests() {
+  Suite *s = suite_create("Deque");
+  TCase *tc_bogus = tcase_create("bogus input");
+  tcase_add_checked_fixture(tc_bogus, &bogus_input_setup,
+      &bogus_input_teardown);
+  tcase_add_test(tc_bogus, free_null);
+  tcase_add_test(tc_bogus, num_elements_null);
+  tcase_add_test(tc_bogus, add_null);
+  tcase_add_test(tc_bogus, pop_null);
+  tcase_add_test(tc_bogus, pop_empty);
+  tcase_add_test(tc_bogus, peek_null);
+  suite_add_tcase(s, tc_bogus);
+
+  TCase *tc_deque = tcase_create("deque manipulation");
+  tcase_add_checked_fixture(tc_deque, &manipulation_setup,
+      &manipulation_teardown);
+  tcase_add_test(tc_deque, append_pop_head);
+  tcase_add_test(tc_deque, prepend_pop_head);
+  tcase_add_test(tc_deque, append_pop_tail);
+  tcase_add_test(tc_deque, peek);
+  tcase_add_test(tc_deque, both_ends);
+  tcase_add_test(tc_deque, reuse_after_empty);
+  tcase_add_test(tc_deque, fifo_window);
+  tcase_add_test(tc_deque, free_payload);
+  suite_add_tcase(s, tc_deque);
+
+  TCase *tc_alloc = tcase_create("allocations");
+  tcase_add_checked_fixture(tc_alloc, &alloc_setup, &alloc_teardown);
+  tcase_add_test(tc_alloc, pop_no_alloc);
+  tcase_add_test(tc_alloc, appends_per_block);
+  tcase_add_test(tc_alloc, fifo_recycles_blocks);
+  suite_add_tcase(s, tc_alloc);
+
+  return s;
+}
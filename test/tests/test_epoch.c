@@ -0,0 +1,175 @@
+/* Provides tests for `epoch.c`
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "test_epoch.h"
+
+#include <check.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "epoch.h"
+
+// Enough retirements to make sure the retiring thread tries to advance the
+// epoch and reclaim things a few times over.
+#define NUM_FILLER 1000
+
+// Helper variables
+static EpochEntry target;
+static atomic_int target_reclaimed;
+static EpochEntry filler[NUM_FILLER];
+static atomic_int filler_reclaimed;
+
+// Helper functions
+static void reclaim_target(EpochEntry *entry) {
+  ck_assert(entry == &target);
+  atomic_fetch_add(&target_reclaimed, 1);
+}
+static void reclaim_filler(EpochEntry *entry) {
+  (void)entry;
+  atomic_fetch_add(&filler_reclaimed, 1);
+}
+static void retire_filler() {
+  for (int i = 0; i < NUM_FILLER; i++) {
+    Epoch_retire(&filler[i], &reclaim_filler);
+  }
+}
+
+// Used to hold a reader inside of a critical section on another thread.
+static pthread_mutex_t reader_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reader_cond = PTHREAD_COND_INITIALIZER;
+static bool reader_entered;
+static bool reader_may_exit;
+
+static void *pinned_reader(void *arg) {
+  (void)arg;
+  // Nested critical sections only end at the outermost Epoch_exit
+  Epoch_enter();
+  Epoch_enter();
+  Epoch_exit();
+
+  pthread_mutex_lock(&reader_lock);
+  reader_entered = true;
+  pthread_cond_broadcast(&reader_cond);
+  while (!reader_may_exit) pthread_cond_wait(&reader_cond, &reader_lock);
+  pthread_mutex_unlock(&reader_lock);
+
+  Epoch_exit();
+  return NULL;
+}
+
+static void *retire_and_exit(void *arg) {
+  (void)arg;
+  Epoch_retire(&target, &reclaim_target);
+  return NULL;
+}
+
+void epoch_setup() {
+  atomic_store(&target_reclaimed, 0);
+  atomic_store(&filler_reclaimed, 0);
+  reader_entered = false;
+  reader_may_exit = false;
+}
+void epoch_teardown() {
+  Epoch_barrier();
+}
+
+// Bogus input test cases
+START_TEST(retire_null) {
+  Epoch_retire(NULL, &reclaim_target);
+} END_TEST
+
+START_TEST(exit_without_enter) {
+  // Shouldn't leave the thread thinking it's in a critical section
+  Epoch_exit();
+  Epoch_retire(&target, &reclaim_target);
+  Epoch_barrier();
+  ck_assert(atomic_load(&target_reclaimed) == 1);
+} END_TEST
+
+// Reclamation test cases
+START_TEST(barrier_reclaims) {
+  Epoch_retire(&target, &reclaim_target);
+  retire_filler();
+  Epoch_barrier();
+  ck_assert(atomic_load(&target_reclaimed) == 1);
+  ck_assert(atomic_load(&filler_reclaimed) == NUM_FILLER);
+} END_TEST
+
+START_TEST(reclaim_after_exit) {
+  // Objects are only reclaimed after the critical section has ended, even
+  // though the object was retired from inside of it.
+  Epoch_enter();
+  Epoch_retire(&target, &reclaim_target);
+  retire_filler();
+  ck_assert(atomic_load(&target_reclaimed) == 0);
+  Epoch_exit();
+
+  Epoch_barrier();
+  ck_assert(atomic_load(&target_reclaimed) == 1);
+} END_TEST
+
+START_TEST(reader_blocks_reclaim) {
+  pthread_t reader;
+  ck_assert(pthread_create(&reader, NULL, &pinned_reader, NULL) == 0);
+  pthread_mutex_lock(&reader_lock);
+  while (!reader_entered) pthread_cond_wait(&reader_cond, &reader_lock);
+  pthread_mutex_unlock(&reader_lock);
+
+  Epoch_retire(&target, &reclaim_target);
+  retire_filler();
+  ck_assert(atomic_load(&target_reclaimed) == 0);
+
+  pthread_mutex_lock(&reader_lock);
+  reader_may_exit = true;
+  pthread_cond_broadcast(&reader_cond);
+  pthread_mutex_unlock(&reader_lock);
+  pthread_join(reader, NULL);
+
+  Epoch_barrier();
+  ck_assert(atomic_load(&target_reclaimed) == 1);
+} END_TEST
+
+START_TEST(thread_exit_reclaims) {
+  pthread_t retirer;
+  ck_assert(pthread_create(&retirer, NULL, &retire_and_exit, NULL) == 0);
+  pthread_join(retirer, NULL);
+  ck_assert(atomic_load(&target_reclaimed) == 1);
+} END_TEST
+
+Suite *epoch_tests() {
+  Suite *s = suite_create("Epoch");
+
+  TCase *tc_bogus = tcase_create("bogus input");
+  tcase_add_checked_fixture(tc_bogus, &epoch_setup, &epoch_teardown);
+  tcase_add_test(tc_bogus, retire_null);
+  tcase_add_test(tc_bogus, exit_without_enter);
+  suite_add_tcase(s, tc_bogus);
+
+  TCase *tc_reclaim = tcase_create("reclamation");
+  tcase_add_checked_fixture(tc_reclaim, &epoch_setup, &epoch_teardown);
+  tcase_add_test(tc_reclaim, barrier_reclaims);
+  tcase_add_test(tc_reclaim, reclaim_after_exit);
+  tcase_add_test(tc_reclaim, reader_blocks_reclaim);
+  tcase_add_test(tc_reclaim, thread_exit_reclaims);
+  suite_add_tcase(s, tc_reclaim);
+
+  return s;
+}
@@ -0,0 +1,280 @@
+/* Provides tests for `frozen_hash_table.c`
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "test_frozen_hash_table.h"
+
+#include <check.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc_hooks.h"
+#include "frozen_hash_table.h"
+#include "hash_table.h"
+
+// Enough keys to make every bucket size CHD deals with show up
+#define NUM_KEYS 20000
+#define KEY_BUF_LEN 64
+
+// Helper variables
+static HashTable *ht;
+static FrozenHashTable *fht;
+static unsigned char keys[NUM_KEYS][KEY_BUF_LEN];
+static int values[NUM_KEYS];
+
+void frozen_setup() {
+  ht = HashTable_allocate();
+  ck_assert(ht != NULL);
+  fht = NULL;
+}
+void frozen_teardown() {
+  FrozenHashTable_free(fht, NULL);
+  HashTable_free(ht, NULL);
+}
+
+// Writes the i-th test key into `keys`. Every seventh key is too long to be
+// stored inline in an entry, so both kinds of key get frozen.
+static void make_key(int i) {
+  if (i % 7 == 0) {
+    snprintf((char *)keys[i], KEY_BUF_LEN,
+        "a rather long key that will not fit inline, number %d", i);
+  } else {
+    snprintf((char *)keys[i], KEY_BUF_LEN, "key%d", i);
+  }
+}
+
+// Inserts the first `n` test keys into `table`, with values pointing into
+// `values`.
+static void fill(HashTable *table, int n) {
+  for (int i = 0; i < n; i++) {
+    make_key(i);
+    values[i] = i;
+    ck_assert(!HashTable_insert(table, keys[i], 0, &values[i], NULL));
+  }
+}
+
+// Checks that the first `n` test keys are all in fht with the right values.
+static void check_all_found(int n) {
+  ck_assert_int_eq(FrozenHashTable_num_elements(fht), n);
+  for (int i = 0; i < n; i++) {
+    const HTValue *value = FrozenHashTable_find(fht, keys[i], 0);
+    ck_assert_msg(value != NULL, "key %s not found", keys[i]);
+    ck_assert_ptr_eq(*value, &values[i]);
+  }
+}
+
+// Bogus input test cases
+START_TEST(freeze_null) {
+  ck_assert(HashTable_freeze(NULL) == NULL);
+} END_TEST
+
+START_TEST(free_null) {
+  FrozenHashTable_free(NULL, NULL);
+  FrozenHashTable_free(NULL, &free);
+} END_TEST
+
+START_TEST(num_elements_null) {
+  ck_assert_int_eq(FrozenHashTable_num_elements(NULL), -1);
+} END_TEST
+
+START_TEST(find_null) {
+  fill(ht, 10);
+  fht = HashTable_freeze(ht);
+  ck_assert(fht != NULL);
+  ck_assert(FrozenHashTable_find(NULL, keys[0], 0) == NULL);
+  ck_assert(FrozenHashTable_find(fht, NULL, 0) == NULL);
+} END_TEST
+
+// Lookup test cases
+START_TEST(freeze_empty) {
+  fht = HashTable_freeze(ht);
+  ck_assert(fht != NULL);
+  ck_assert_int_eq(FrozenHashTable_num_elements(fht), 0);
+  ck_assert(FrozenHashTable_find(fht, (unsigned char *)"key", 0) == NULL);
+} END_TEST
+
+START_TEST(freeze_one) {
+  fill(ht, 1);
+  fht = HashTable_freeze(ht);
+  ck_assert(fht != NULL);
+  check_all_found(1);
+  ck_assert(FrozenHashTable_find(fht, (unsigned char *)"key1", 0) == NULL);
+} END_TEST
+
+START_TEST(find_all) {
+  fill(ht, NUM_KEYS);
+  fht = HashTable_freeze(ht);
+  ck_assert(fht != NULL);
+  check_all_found(NUM_KEYS);
+} END_TEST
+
+START_TEST(find_with_length) {
+  fill(ht, 100);
+  fht = HashTable_freeze(ht);
+  ck_assert(fht != NULL);
+  for (int i = 0; i < 100; i++) {
+    size_t len = strlen((char *)keys[i]);
+    const HTValue *value = FrozenHashTable_find(fht, keys[i], len);
+    ck_assert(value != NULL);
+    ck_assert_ptr_eq(*value, &values[i]);
+    // Counting the terminating NUL makes it a different key
+    ck_assert(FrozenHashTable_find(fht, keys[i], len + 1) == NULL);
+  }
+} END_TEST
+
+START_TEST(find_missing) {
+  fill(ht, NUM_KEYS);
+  fht = HashTable_freeze(ht);
+  ck_assert(fht != NULL);
+  // Every missing key still maps to some slot, so this makes sure that the
+  // key in that slot is actually compared against.
+  unsigned char missing[KEY_BUF_LEN];
+  for (int i = NUM_KEYS; i < 2 * NUM_KEYS; i++) {
+    snprintf((char *)missing, KEY_BUF_LEN, "key%d", i);
+    ck_assert(FrozenHashTable_find(fht, missing, 0) == NULL);
+  }
+} END_TEST
+
+START_TEST(find_no_alloc) {
+  if (!alloc_hooks_available()) return;
+  fill(ht, 1000);
+  fht = HashTable_freeze(ht);
+  ck_assert(fht != NULL);
+  alloc_hooks_start();
+  for (int i = 0; i < 1000; i++) FrozenHashTable_find(fht, keys[i], 0);
+  FrozenHashTable_find(fht, (unsigned char *)"missing", 0);
+  ck_assert_uint_eq(alloc_hooks_stop(), 0);
+} END_TEST
+
+START_TEST(freeze_open_engine) {
+  HTOptions opts;
+  HTOptions_init(&opts);
+  opts.engine = HT_ENGINE_OPEN;
+  opts.hash_fn = HT_HASH_FNV1A;
+  HashTable *open = HashTable_allocate_with_options(&opts);
+  ck_assert(open != NULL);
+  fill(open, NUM_KEYS);
+  fht = HashTable_freeze(open);
+  HashTable_free(open, NULL);
+  ck_assert(fht != NULL);
+  check_all_found(NUM_KEYS);
+} END_TEST
+
+// Ownership test cases
+START_TEST(source_unchanged) {
+  fill(ht, 1000);
+  fht = HashTable_freeze(ht);
+  ck_assert(fht != NULL);
+  ck_assert_int_eq(HashTable_num_elements(ht), 1000);
+  for (int i = 0; i < 1000; i++) {
+    HTValue *value = HashTable_find(ht, keys[i], 0);
+    ck_assert(value != NULL);
+    ck_assert_ptr_eq(*value, &values[i]);
+  }
+
+  // The frozen table has its own copy of the keys
+  HashTable_free(ht, NULL);
+  ht = NULL;
+  check_all_found(1000);
+} END_TEST
+
+START_TEST(source_not_resized) {
+  // A sparse table, as left by HashTable_reserve, mustn't be shrunk by being
+  // frozen, since that would invalidate pointers from HashTable_find
+  static const HTEngine engines[] = {HT_ENGINE_CHAINED, HT_ENGINE_OPEN};
+  for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+    HTOptions opts;
+    HTOptions_init(&opts);
+    opts.engine = engines[e];
+    HashTable *table = HashTable_allocate_with_options(&opts);
+    ck_assert(table != NULL);
+    ck_assert(HashTable_reserve(table, 100000));
+    fill(table, 10);
+    HTValue *found = HashTable_find(table, keys[3], 0);
+    ck_assert(found != NULL);
+    HTStats before, after;
+    ck_assert(HashTable_get_stats(table, &before));
+
+    fht = HashTable_freeze(table);
+    ck_assert(fht != NULL);
+    ck_assert(HashTable_get_stats(table, &after));
+    ck_assert(after.num_buckets == before.num_buckets);
+    ck_assert(after.resizes == before.resizes);
+    ck_assert(HashTable_find(table, keys[3], 0) == found);
+
+    FrozenHashTable_free(fht, NULL);
+    fht = NULL;
+    HashTable_free(table, NULL);
+  }
+} END_TEST
+
+START_TEST(free_values) {
+  for (int i = 0; i < 100; i++) {
+    make_key(i);
+    int *value = malloc(sizeof(int));
+    ck_assert(value != NULL);
+    *value = i;
+    ck_assert(!HashTable_insert(ht, keys[i], 0, value, NULL));
+  }
+  fht = HashTable_freeze(ht);
+  ck_assert(fht != NULL);
+  for (int i = 0; i < 100; i++) {
+    const HTValue *value = FrozenHashTable_find(fht, keys[i], 0);
+    ck_assert(value != NULL);
+    ck_assert_int_eq(*(int *)*value, i);
+  }
+  // The values are shared, so only one of the tables frees them
+  FrozenHashTable_free(fht, &free);
+  fht = NULL;
+} END_TEST
+
+Suite *frozen_hash_table_tests() {
+  Suite *s = suite_create("FrozenHashTable");
+
+  TCase *tc_bogus = tcase_create("bogus input");
+  tcase_add_checked_fixture(tc_bogus, &frozen_setup, &frozen_teardown);
+  tcase_add_test(tc_bogus, freeze_null);
+  tcase_add_test(tc_bogus, free_null);
+  tcase_add_test(tc_bogus, num_elements_null);
+  tcase_add_test(tc_bogus, find_null);
+  suite_add_tcase(s, tc_bogus);
+
+  TCase *tc_find = tcase_create("lookup");
+  tcase_add_checked_fixture(tc_find, &frozen_setup, &frozen_teardown);
+  tcase_add_test(tc_find, freeze_empty);
+  tcase_add_test(tc_find, freeze_one);
+  tcase_add_test(tc_find, find_all);
+  tcase_add_test(tc_find, find_with_length);
+  tcase_add_test(tc_find, find_missing);
+  tcase_add_test(tc_find, find_no_alloc);
+  tcase_add_test(tc_find, freeze_open_engine);
+  suite_add_tcase(s, tc_find);
+
+  TCase *tc_owner = tcase_create("ownership");
+  tcase_add_checked_fixture(tc_owner, &frozen_setup, &frozen_teardown);
+  tcase_add_test(tc_owner, source_unchanged);
+  tcase_add_test(tc_owner, source_not_resized);
+  tcase_add_test(tc_owner, free_values);
+  suite_add_tcase(s, tc_owner);
+
+  return s;
+}
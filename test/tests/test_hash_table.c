@@ -23,15 +23,50 @@ along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
 #include "test_hash_table.h"
 
 #include <check.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc_hooks.h"
 #include "hash_table.h"
 
 // Helpers
 HashTable *ht;
 HTIterator *hti;
 
+// Every test case is run once per storage engine. Test cases for engines other
+// than HT_ENGINE_CHAINED get an extra fixture that switches `engine` over.
+static HTEngine engine = HT_ENGINE_CHAINED;
+static void open_engine_setup() {
+  engine = HT_ENGINE_OPEN;
+}
+static void open_engine_teardown() {
+  engine = HT_ENGINE_CHAINED;
+}
+
+// Likewise, chained tables are tested again with HTOptions.use_slab set.
+static bool use_slab = false;
+static void slab_setup() {
+  use_slab = true;
+}
+static void slab_teardown() {
+  use_slab = false;
+}
+
+// Fills in `opts` to select the engine currently under test.
+static void init_options(HTOptions *opts) {
+  HTOptions_init(opts);
+  opts->engine = engine;
+  opts->use_slab = use_slab;
+}
+
+// Allocates a HashTable using the engine currently under test.
+static HashTable *new_table() {
+  HTOptions opts;
+  init_options(&opts);
+  return HashTable_allocate_with_options(&opts);
+}
+
 void common_setup() {
   ht = NULL;
   hti = NULL;
@@ -72,7 +107,7 @@ START_TEST(insert_into_null) {
 } END_TEST
 
 START_TEST(insert_null_key) {
-  ht = HashTable_allocate();
+  ht = new_table();
 
   ck_assert(!HashTable_insert(ht, NULL, 0, (HTValue)0, NULL));
   ck_assert(HashTable_num_elements(ht) == 0);
@@ -83,35 +118,112 @@ START_TEST(find_from_null) {
 } END_TEST
 
 START_TEST(find_null_key) {
-  ht = HashTable_allocate();
+  ht = new_table();
 
   ck_assert(HashTable_find(ht, NULL, 0) == NULL);
 } END_TEST
 
 START_TEST(find_non_existent_entry) {
-  ht = HashTable_allocate();
+  ht = new_table();
   ck_assert(!HashTable_insert(ht, (unsigned char *)"abc", 0, strdup("def"),
         NULL));
 
   ck_assert(HashTable_find(ht, (unsigned char *)"ghi", 0) == NULL);
 } END_TEST
 
+START_TEST(find_many_null) {
+  unsigned char *keys[] = {(unsigned char *)"abc"};
+  HTValue *values[] = {(HTValue *)0xDEADBEEF};
+  ck_assert(HashTable_find_many(NULL, keys, NULL, 1, values) == 0);
+  ck_assert(values[0] == (HTValue *)0xDEADBEEF);
+
+  ht = new_table();
+  ck_assert(!HashTable_insert(ht, keys[0], 0, strdup("def"), NULL));
+  ck_assert(HashTable_find_many(ht, NULL, NULL, 1, values) == 0);
+  ck_assert(HashTable_find_many(ht, keys, NULL, 1, NULL) == 0);
+  ck_assert(HashTable_find_many(ht, keys, NULL, 0, values) == 0);
+  ck_assert(values[0] == (HTValue *)0xDEADBEEF);
+} END_TEST
+
 START_TEST(remove_from_null) {
   ck_assert(!HashTable_remove(NULL, (unsigned char *)"abc", 0, NULL));
 } END_TEST
 
 START_TEST(remove_null_key) {
-  ht = HashTable_allocate();
+  ht = new_table();
 
   ck_assert(!HashTable_remove(ht, NULL, 0, NULL));
 } END_TEST
 
 START_TEST(remove_non_existent_entry) {
-  ht = HashTable_allocate();
+  ht = new_table();
 
   ck_assert(!HashTable_remove(ht, (unsigned char *)"abc", 0, NULL));
 } END_TEST
 
+START_TEST(entry_null) {
+  ht = new_table();
+  bool inserted = true;
+  ck_assert(HashTable_entry(NULL, (unsigned char *)"key", 0, &inserted) ==
+      NULL);
+  ck_assert(HashTable_entry(ht, NULL, 0, &inserted) == NULL);
+  ck_assert(inserted);
+  ck_assert(HashTable_num_elements(ht) == 0);
+} END_TEST
+
+START_TEST(hashed_null) {
+  ht = new_table();
+  unsigned char *key = (unsigned char *)"key";
+  uint64_t hash = HashTable_hash(ht, key, 0);
+  ck_assert(HashTable_hash(NULL, key, 0) == 0);
+  ck_assert(HashTable_hash(ht, NULL, 0) == 0);
+  ck_assert(!HashTable_insert_hashed(NULL, hash, key, 0, NULL, NULL));
+  ck_assert(!HashTable_insert_hashed(ht, hash, NULL, 0, NULL, NULL));
+  ck_assert(HashTable_entry_hashed(NULL, hash, key, 0, NULL) == NULL);
+  ck_assert(HashTable_entry_hashed(ht, hash, NULL, 0, NULL) == NULL);
+  ck_assert(HashTable_find_hashed(NULL, hash, key, 0) == NULL);
+  ck_assert(HashTable_find_hashed(ht, hash, NULL, 0) == NULL);
+  ck_assert(!HashTable_remove_hashed(NULL, hash, key, 0, NULL));
+  ck_assert(!HashTable_remove_hashed(ht, hash, NULL, 0, NULL));
+  ck_assert(HashTable_num_elements(ht) == 0);
+} END_TEST
+
+START_TEST(reserve_null) {
+  ck_assert(!HashTable_reserve(NULL, 10));
+} END_TEST
+
+START_TEST(compact_null) {
+  ck_assert(!HashTable_compact(NULL));
+} END_TEST
+
+START_TEST(stats_null) {
+  HTStats stats;
+  ck_assert(!HashTable_get_stats(NULL, &stats));
+  char buf[16] = "untouched";
+  ck_assert(HashTable_format_stats(NULL, buf, sizeof(buf)) == 0);
+  ck_assert_str_eq(buf, "untouched");
+  HashTable *table = new_table();
+  ck_assert(table != NULL);
+  ck_assert(!HashTable_get_stats(table, NULL));
+  HashTable_free(table, NULL);
+} END_TEST
+
+START_TEST(allocate_from_bogus) {
+  HTOptions opts;
+  init_options(&opts);
+  unsigned char *keys[] = {(unsigned char *)"abc", NULL};
+  ck_assert(HashTable_allocate_from(&opts, NULL, NULL, NULL, 1) == NULL);
+  ck_assert(HashTable_allocate_from(&opts, keys, NULL, NULL, 2) == NULL);
+
+  // A table can be built from nothing at all
+  ht = HashTable_allocate_from(&opts, NULL, NULL, NULL, 0);
+  ck_assert(ht != NULL);
+  ck_assert(HashTable_num_elements(ht) == 0);
+
+  opts.engine = (HTEngine)-1;
+  ck_assert(HashTable_allocate_from(&opts, keys, NULL, NULL, 1) == NULL);
+} END_TEST
+
 START_TEST(iter_allocate_null) {
   ck_assert(HTIterator_allocate(NULL) == NULL);
 } END_TEST
@@ -121,6 +233,29 @@ START_TEST(iter_free_null) {
   HTIterator_free(NULL);
 } END_TEST
 
+START_TEST(iter_init_null) {
+  HTIterator stack_hti;
+  ht = new_table();
+  ck_assert(!HTIterator_init(NULL, ht));
+  ck_assert(!HTIterator_init(&stack_hti, NULL));
+  // fails on segfault.
+  HTIterator_release(NULL);
+} END_TEST
+
+START_TEST(iter_release_twice) {
+  HTIterator stack_hti;
+  ht = new_table();
+  ck_assert(HTIterator_init(&stack_hti, ht));
+  HTIterator_release(&stack_hti);
+  ck_assert(!HTIterator_is_valid(&stack_hti));
+  ck_assert(!HTIterator_next(&stack_hti));
+
+  // Releasing again mustn't unpin the table a second time
+  hti = HTIterator_allocate(ht);
+  HTIterator_release(&stack_hti);
+  ck_assert(!HashTable_reserve(ht, 100000));
+} END_TEST
+
 START_TEST(iter_is_valid_null) {
   ck_assert(!HTIterator_is_valid(NULL));
 } END_TEST
@@ -130,7 +265,7 @@ START_TEST(iter_next_null) {
 } END_TEST
 
 START_TEST(iter_next_invalid) {
-  ht = HashTable_allocate();
+  ht = new_table();
   hti = HTIterator_allocate(ht);
   ck_assert(!HTIterator_is_valid(hti));
 
@@ -146,7 +281,7 @@ START_TEST(iter_get_null) {
 } END_TEST
 
 START_TEST(iter_get_invalid) {
-  ht = HashTable_allocate();
+  ht = new_table();
   hti = HTIterator_allocate(ht);
   ck_assert(!HTIterator_is_valid(hti));
 
@@ -166,7 +301,7 @@ START_TEST(iter_remove_null) {
 } END_TEST
 
 START_TEST(iter_remove_invalid) {
-  ht = HashTable_allocate();
+  ht = new_table();
   hti = HTIterator_allocate(ht);
   ck_assert(!HTIterator_is_valid(hti));
 
@@ -195,7 +330,7 @@ void entry_setup() {
   deux = strdup("deux");
   trois = strdup("trois");
 
-  ht = HashTable_allocate();
+  ht = new_table();
 
   ck_assert(!HashTable_insert(ht, (unsigned char *)one, 0, un, NULL)); 
   ck_assert(!HashTable_insert(ht, (unsigned char *)two, 0, deux, NULL)); 
@@ -209,7 +344,7 @@ void entry_teardown() {
 }
 
 START_TEST(num_elements_empty) {
-  HashTable *empty = HashTable_allocate();
+  HashTable *empty = new_table();
 
   ck_assert(HashTable_num_elements(empty) == 0);
 
@@ -275,11 +410,291 @@ START_TEST(key_length) {
   ck_assert(strcmp(*one_by_explicit_len_ptr, un) == 0);
 } END_TEST
 
+START_TEST(find_many) {
+  unsigned char *keys[] = {
+    (unsigned char *)one, (unsigned char *)"four", NULL,
+    (unsigned char *)three, (unsigned char *)two
+  };
+  size_t key_lens[] = {0, 0, 0, strlen(three), 0};
+  HTValue *values[5];
+  ck_assert(HashTable_find_many(ht, keys, key_lens, 5, values) == 3);
+  ck_assert(values[0] == HashTable_find(ht, (unsigned char *)one, 0));
+  ck_assert(values[1] == NULL);
+  ck_assert(values[2] == NULL);
+  ck_assert(strcmp(*values[3], trois) == 0);
+  ck_assert(strcmp(*values[4], deux) == 0);
+
+  // Without key lengths, every key is a NUL terminated string
+  ck_assert(HashTable_find_many(ht, keys, NULL, 5, values) == 3);
+  ck_assert(strcmp(*values[0], un) == 0);
+} END_TEST
+
+START_TEST(entry_existing) {
+  bool inserted = true;
+  HTValue *value = HashTable_entry(ht, (unsigned char *)two, 0, &inserted);
+  ck_assert(value != NULL);
+  ck_assert(!inserted);
+  ck_assert(*value == deux);
+  ck_assert(value == HashTable_find(ht, (unsigned char *)two, 0));
+  ck_assert(HashTable_num_elements(ht) == 3);
+} END_TEST
+
+START_TEST(entry_insert) {
+  unsigned char *key = (unsigned char *)"four";
+  bool inserted = false;
+  HTValue *value = HashTable_entry(ht, key, 0, &inserted);
+  ck_assert(value != NULL);
+  ck_assert(inserted);
+  ck_assert(*value == NULL);
+  ck_assert(HashTable_num_elements(ht) == 4);
+
+  // The value can be filled in through the returned pointer
+  *value = strdup("quatre");
+  ck_assert(strcmp(*HashTable_find(ht, key, 0), "quatre") == 0);
+
+  value = HashTable_entry(ht, key, strlen((char *)key), NULL);
+  ck_assert(value != NULL);
+  ck_assert(strcmp(*value, "quatre") == 0);
+  ck_assert(HashTable_num_elements(ht) == 4);
+} END_TEST
+
+START_TEST(entry_update_in_place) {
+  // Count occurrences of each word, the way a caller would with a "find, then
+  // insert if missing" sequence.
+  static const char *words[] = {"a", "b", "a", "c", "a", "b"};
+  HashTable *counts = new_table();
+  ck_assert(counts != NULL);
+  for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+    HTValue *count = HashTable_entry(counts, (unsigned char *)words[i], 0,
+        NULL);
+    ck_assert(count != NULL);
+    *count = (HTValue)((uintptr_t)*count + 1);
+  }
+  ck_assert(HashTable_num_elements(counts) == 3);
+  ck_assert((uintptr_t)*HashTable_find(counts, (unsigned char *)"a", 0) == 3);
+  ck_assert((uintptr_t)*HashTable_find(counts, (unsigned char *)"b", 0) == 2);
+  ck_assert((uintptr_t)*HashTable_find(counts, (unsigned char *)"c", 0) == 1);
+  HashTable_free(counts, NULL);
+} END_TEST
+
+START_TEST(reserve) {
+  // Reserving room the table already has does nothing
+  ck_assert(HashTable_reserve(ht, 0));
+  ck_assert(HashTable_reserve(ht, 3));
+
+  ck_assert(HashTable_reserve(ht, 1003));
+  ck_assert(HashTable_num_elements(ht) == 3);
+  for (uint32_t key = 0; key < 1000; key++) {
+    ck_assert(!HashTable_insert(ht, (unsigned char *)&key, sizeof(key),
+          NULL, NULL));
+  }
+  ck_assert(HashTable_num_elements(ht) == 1003);
+  for (uint32_t key = 0; key < 1000; key++) {
+    ck_assert(HashTable_find(ht, (unsigned char *)&key, sizeof(key)) != NULL);
+  }
+  ck_assert(strcmp(*HashTable_find(ht, (unsigned char *)two, 0), deux) == 0);
+} END_TEST
+
+START_TEST(reserve_with_iterator) {
+  // Growing would invalidate the iterator
+  hti = HTIterator_allocate(ht);
+  ck_assert(hti != NULL);
+  ck_assert(HashTable_reserve(ht, 3));
+  ck_assert(!HashTable_reserve(ht, 100000));
+  HTIterator_free(hti);
+  hti = NULL;
+  ck_assert(HashTable_reserve(ht, 100000));
+
+  // Same goes for iterators in caller-owned storage
+  HTIterator stack_hti;
+  ck_assert(HTIterator_init(&stack_hti, ht));
+  ck_assert(!HashTable_reserve(ht, 200000));
+  HTIterator_release(&stack_hti);
+  ck_assert(HashTable_reserve(ht, 200000));
+} END_TEST
+
+START_TEST(reserve_then_iterate) {
+  // Only removals through iterators make releasing the last one shrink the
+  // table, so a read-only traversal keeps the reserved room
+  ck_assert(HashTable_reserve(ht, 100000));
+  HTStats before, after;
+  ck_assert(HashTable_get_stats(ht, &before));
+
+  hti = HTIterator_allocate(ht);
+  ck_assert(hti != NULL);
+  int num_visited = 0;
+  for (; HTIterator_is_valid(hti); HTIterator_next(hti)) num_visited++;
+  ck_assert_int_eq(num_visited, 3);
+  HTIterator_free(hti);
+  hti = NULL;
+  ck_assert(HashTable_get_stats(ht, &after));
+  ck_assert(after.num_buckets == before.num_buckets);
+
+  HTIterator stack_hti;
+  ck_assert(HTIterator_init(&stack_hti, ht));
+  HTIterator_release(&stack_hti);
+  ck_assert(HashTable_get_stats(ht, &after));
+  ck_assert(after.num_buckets == before.num_buckets);
+} END_TEST
+
+START_TEST(allocate_from) {
+  HashTable_free(ht, &free);
+  un = deux = trois = NULL;
+
+  enum { NUM_KEYS = 5000 };
+  static uint32_t key_bufs[NUM_KEYS];
+  static unsigned char *keys[NUM_KEYS];
+  static size_t key_lens[NUM_KEYS];
+  static HTValue values[NUM_KEYS];
+  for (uint32_t i = 0; i < NUM_KEYS; i++) {
+    key_bufs[i] = i * 2654435761u;
+    keys[i] = (unsigned char *)&key_bufs[i];
+    key_lens[i] = sizeof(uint32_t);
+    values[i] = (HTValue)(uintptr_t)~i;
+  }
+
+  HTOptions opts;
+  init_options(&opts);
+  ht = HashTable_allocate_from(&opts, keys, key_lens, values, NUM_KEYS);
+  ck_assert(ht != NULL);
+  ck_assert(HashTable_num_elements(ht) == NUM_KEYS);
+  for (uint32_t i = 0; i < NUM_KEYS; i++) {
+    HTValue *value = HashTable_find(ht, keys[i], sizeof(uint32_t));
+    ck_assert_msg(value != NULL, "Key %u missing", key_bufs[i]);
+    ck_assert(*value == values[i]);
+  }
+  HashTable_free(ht, NULL);
+
+  // Without values, every value is NULL
+  ht = HashTable_allocate_from(&opts, keys, key_lens, NULL, NUM_KEYS);
+  ck_assert(ht != NULL);
+  ck_assert(*HashTable_find(ht, keys[10], sizeof(uint32_t)) == NULL);
+  HashTable_free(ht, NULL);
+  ht = NULL;
+} END_TEST
+
+START_TEST(allocate_from_strings) {
+  // Without key lengths, keys are NUL terminated strings, and later pairs
+  // overwrite earlier ones with the same key
+  unsigned char *keys[] = {
+    (unsigned char *)one, (unsigned char *)"four", (unsigned char *)one
+  };
+  HTValue values[] = {(HTValue)1, (HTValue)4, (HTValue)2};
+  HTOptions opts;
+  init_options(&opts);
+  HashTable *from = HashTable_allocate_from(&opts, keys, NULL, values, 3);
+  ck_assert(from != NULL);
+  ck_assert(HashTable_num_elements(from) == 2);
+  ck_assert(*HashTable_find(from, (unsigned char *)"one", 0) == (HTValue)2);
+  ck_assert(*HashTable_find(from, (unsigned char *)"four", 4) == (HTValue)4);
+  HashTable_free(from, NULL);
+} END_TEST
+
+START_TEST(hashed) {
+  unsigned char *key = (unsigned char *)"four";
+  uint64_t hash = HashTable_hash(ht, key, 0);
+  ck_assert(hash == HashTable_hash(ht, key, strlen((char *)key)));
+  HTOptions opts;
+  HTOptions_init(&opts);
+  ck_assert(hash == HashTable_hash_key(opts.hash_fn, key, 0));
+
+  ck_assert(HashTable_find_hashed(ht, hash, key, 0) == NULL);
+  ck_assert(!HashTable_insert_hashed(ht, hash, key, 0, strdup("quatre"),
+        NULL));
+  ck_assert(strcmp(*HashTable_find(ht, key, 0), "quatre") == 0);
+  ck_assert(strcmp(*HashTable_find_hashed(ht, hash, key, 0), "quatre") == 0);
+
+  HTValue old_value;
+  ck_assert(HashTable_insert_hashed(ht, hash, key, 0, strdup("vier"),
+        &old_value));
+  ck_assert(strcmp(old_value, "quatre") == 0);
+  free(old_value);
+
+  bool inserted = true;
+  HTValue *value = HashTable_entry_hashed(ht, hash, key, 0, &inserted);
+  ck_assert(!inserted);
+  ck_assert(strcmp(*value, "vier") == 0);
+
+  ck_assert(HashTable_remove_hashed(ht, hash, key, 0, &old_value));
+  ck_assert(strcmp(old_value, "vier") == 0);
+  free(old_value);
+  ck_assert(HashTable_find(ht, key, 0) == NULL);
+  ck_assert(!HashTable_remove_hashed(ht, hash, key, 0, NULL));
+
+  value = HashTable_entry_hashed(ht, hash, key, 0, &inserted);
+  ck_assert(inserted);
+  *value = strdup("cuatro");
+  ck_assert(strcmp(*HashTable_find(ht, key, 0), "cuatro") == 0);
+} END_TEST
+
+START_TEST(hashed_shared_between_tables) {
+  // Tables using the same hash function agree on hashes, whatever their
+  // engine.
+  HTOptions opts;
+  HTOptions_init(&opts);
+  opts.engine =
+    engine == HT_ENGINE_OPEN ? HT_ENGINE_CHAINED : HT_ENGINE_OPEN;
+  HashTable *other = HashTable_allocate_with_options(&opts);
+  ck_assert(other != NULL);
+
+  uint64_t hash = HashTable_hash(ht, (unsigned char *)one, 0);
+  ck_assert(hash == HashTable_hash(other, (unsigned char *)one, 0));
+  ck_assert(!HashTable_insert_hashed(other, hash, (unsigned char *)one, 0,
+        un, NULL));
+  ck_assert(*HashTable_find(other, (unsigned char *)one, 0) == un);
+  ck_assert(*HashTable_find_hashed(ht, hash, (unsigned char *)one, 0) == un);
+  HashTable_free(other, NULL);
+} END_TEST
+
+// Keys on either side of HT_INLINE_KEY_LEN are stored differently, so make
+// sure both kinds can be found, read back through an iterator, and removed.
+START_TEST(key_inline_boundary) {
+  static const size_t lens[] = {
+    HT_INLINE_KEY_LEN - 1, HT_INLINE_KEY_LEN, HT_INLINE_KEY_LEN + 1, 100
+  };
+  const size_t num_lens = sizeof(lens) / sizeof(lens[0]);
+  unsigned char key[100];
+  for (size_t i = 0; i < sizeof(key); i++) key[i] = (unsigned char)(i + 1);
+
+  for (size_t i = 0; i < num_lens; i++) {
+    ck_assert(!HashTable_insert(ht, key, lens[i], strdup("value"), NULL));
+  }
+  for (size_t i = 0; i < num_lens; i++) {
+    ck_assert(HashTable_find(ht, key, lens[i]) != NULL);
+  }
+
+  size_t seen = 0;
+  hti = HTIterator_allocate(ht);
+  while (HTIterator_is_valid(hti)) {
+    const unsigned char *it_key;
+    size_t it_key_len;
+    ck_assert(HTIterator_get(hti, &it_key, &it_key_len, NULL));
+    // Skip the keys put in by the fixture
+    if (it_key_len >= HT_INLINE_KEY_LEN - 1) {
+      ck_assert(memcmp(it_key, key, it_key_len) == 0);
+      seen++;
+    }
+    HTIterator_next(hti);
+  }
+  ck_assert(seen == num_lens);
+  HTIterator_free(hti);
+  hti = NULL;
+
+  for (size_t i = 0; i < num_lens; i++) {
+    HTValue old_value;
+    ck_assert(HashTable_remove(ht, key, lens[i], &old_value));
+    free(old_value);
+  }
+  for (size_t i = 0; i < num_lens; i++) {
+    ck_assert(HashTable_find(ht, key, lens[i]) == NULL);
+  }
+} END_TEST
+
 // Iterator test cases
 const uint8_t max_key = UINT8_MAX;
 HTIterator *hti;
 static void iter_setup() {
-  ht = HashTable_allocate();
+  ht = new_table();
   for (uint8_t key = 0; key < max_key; key++) {
     intptr_t val = (intptr_t) ~key;
     ck_assert(
@@ -336,10 +751,698 @@ START_TEST(iterator_remove) {
   }
 } END_TEST
 
-Suite *hash_table_tests() {
-  Suite *s = suite_create("HashTable");
+START_TEST(iterator_remove_some) {
+  // Remove every other entry, interleaving removals with plain advances so
+  // that entries get removed from the middle and ends of buckets alike.
+  uint8_t times_seen[max_key];
+  memset(times_seen, 0, sizeof(times_seen));
+  bool removed[max_key];
+  memset(removed, 0, sizeof(removed));
+  int num_removed = 0;
+
+  for (int i = 0; HTIterator_is_valid(hti); i++) {
+    const uint8_t *key_ptr;
+    ck_assert(HTIterator_get(hti, (const unsigned char **)&key_ptr, NULL,
+          NULL));
+    uint8_t key = *key_ptr;
+    times_seen[key]++;
+    if (i % 2 == 0) {
+      HTValue value;
+      ck_assert(HTIterator_remove(hti, NULL, NULL, &value));
+      ck_assert((intptr_t)value == (intptr_t) ~key);
+      removed[key] = true;
+      num_removed++;
+    } else {
+      HTIterator_next(hti);
+    }
+  }
+
+  ck_assert_int_eq(HashTable_num_elements(ht), max_key - num_removed);
+  for (uint8_t key = 0; key < max_key; key++) {
+    ck_assert(times_seen[key] == 1);
+    HTValue *value = HashTable_find(ht, &key, sizeof(uint8_t));
+    if (removed[key]) {
+      ck_assert(value == NULL);
+    } else {
+      ck_assert(value != NULL);
+      ck_assert((intptr_t)*value == (intptr_t) ~key);
+    }
+  }
+} END_TEST
+
+START_TEST(iterator_remove_long_keys) {
+  // Keys too long to be stored inline are handed over rather than copied
+  unsigned char key[2 * HT_INLINE_KEY_LEN];
+  memset(key, 'k', sizeof(key));
+  HTIterator_free(hti);
+  for (uint8_t i = 0; i < 10; i++) {
+    key[0] = i;
+    ck_assert(!HashTable_insert(ht, key, sizeof(key), (HTValue)(intptr_t)i,
+          NULL));
+  }
+  hti = HTIterator_allocate(ht);
+
+  int num_long = 0;
+  while (HTIterator_is_valid(hti)) {
+    unsigned char *key_out;
+    size_t key_len;
+    HTValue value;
+    ck_assert(HTIterator_remove(hti, &key_out, &key_len, &value));
+    if (key_len == sizeof(key)) {
+      ck_assert(key_out[0] < 10);
+      ck_assert((intptr_t)value == key_out[0]);
+      ck_assert(memcmp(key_out + 1, key + 1, sizeof(key) - 1) == 0);
+      num_long++;
+    }
+    free(key_out);
+  }
+  ck_assert_int_eq(num_long, 10);
+  ck_assert_int_eq(HashTable_num_elements(ht), 0);
+} END_TEST
+
+// Resizing test cases
+// Enough keys to force the table through many rounds of growing/shrinking.
+#define num_resize_keys 20000
+static void resize_setup() {
+  common_setup();
+  ht = new_table();
+  ck_assert(ht != NULL);
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    ck_assert(!HashTable_insert(ht, (unsigned char *)&key, sizeof(key),
+          (HTValue)(uintptr_t)~key, NULL));
+  }
+}
+static void resize_teardown() {
+  HTIterator_free(hti);
+  HashTable_free(ht, NULL);
+}
+
+START_TEST(resize_grow) {
+  ck_assert(HashTable_num_elements(ht) == num_resize_keys);
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    HTValue *value = HashTable_find(ht, (unsigned char *)&key, sizeof(key));
+    ck_assert_msg(value != NULL, "Key %u missing after growing", key);
+    ck_assert((uintptr_t)*value == (uintptr_t)~key);
+  }
+} END_TEST
+
+START_TEST(resize_overwrite) {
+  // Overwrites in the middle of a resize shouldn't create duplicates
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    HTValue old_value;
+    ck_assert(HashTable_insert(ht, (unsigned char *)&key, sizeof(key),
+          (HTValue)(uintptr_t)key, &old_value));
+    ck_assert((uintptr_t)old_value == (uintptr_t)~key);
+  }
+  ck_assert(HashTable_num_elements(ht) == num_resize_keys);
+} END_TEST
+
+START_TEST(resize_shrink) {
+  // Remove all but every 100th key, which forces the table to shrink
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    if (key % 100 == 0) continue;
+    ck_assert(HashTable_remove(ht, (unsigned char *)&key, sizeof(key), NULL));
+  }
+  ck_assert(HashTable_num_elements(ht) == num_resize_keys / 100);
+
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    HTValue *value = HashTable_find(ht, (unsigned char *)&key, sizeof(key));
+    if (key % 100 == 0) {
+      ck_assert_msg(value != NULL, "Key %u missing after shrinking", key);
+      ck_assert((uintptr_t)*value == (uintptr_t)~key);
+    } else {
+      ck_assert(value == NULL);
+    }
+  }
+} END_TEST
+
+START_TEST(resize_iterate) {
+  // Insert just enough to start another resize, then make sure iteration sees
+  // every element exactly once even though some are still in old buckets.
+  for (uint32_t key = num_resize_keys; key < 2 * num_resize_keys; key++) {
+    ck_assert(!HashTable_insert(ht, (unsigned char *)&key, sizeof(key),
+          (HTValue)(uintptr_t)~key, NULL));
+  }
 
-  TCase *tc_bogus = tcase_create("bogus input");
+  uint8_t *times_seen = calloc(2 * num_resize_keys, sizeof(uint8_t));
+  ck_assert(times_seen != NULL);
+  hti = HTIterator_allocate(ht);
+  while (HTIterator_is_valid(hti)) {
+    const unsigned char *key_ptr;
+    size_t key_size;
+    HTValue value;
+    ck_assert(HTIterator_get(hti, &key_ptr, &key_size, &value));
+    ck_assert(key_size == sizeof(uint32_t));
+
+    uint32_t key;
+    memcpy(&key, key_ptr, sizeof(key));
+    ck_assert((uintptr_t)value == (uintptr_t)~key);
+    // Lookups while iterating must not disturb the iterator
+    ck_assert(HashTable_find(ht, (unsigned char *)&key, sizeof(key)) != NULL);
+    times_seen[key]++;
+
+    HTIterator_next(hti);
+  }
+
+  for (uint32_t key = 0; key < 2 * num_resize_keys; key++) {
+    ck_assert(times_seen[key] == 1);
+  }
+  free(times_seen);
+} END_TEST
+
+START_TEST(resize_compact) {
+  // Remove all but every 100th key, then compact what's left
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    if (key % 100 == 0) continue;
+    ck_assert(HashTable_remove(ht, (unsigned char *)&key, sizeof(key), NULL));
+  }
+  ck_assert(HashTable_compact(ht));
+  // Compacting a table that's already compact changes nothing
+  ck_assert(HashTable_compact(ht));
+  ck_assert(HashTable_num_elements(ht) == num_resize_keys / 100);
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    HTValue *value = HashTable_find(ht, (unsigned char *)&key, sizeof(key));
+    if (key % 100 == 0) {
+      ck_assert_msg(value != NULL, "Key %u missing after compacting", key);
+      ck_assert((uintptr_t)*value == (uintptr_t)~key);
+    } else {
+      ck_assert(value == NULL);
+    }
+  }
+
+  // The table still grows as usual afterwards
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    HashTable_insert(ht, (unsigned char *)&key, sizeof(key),
+        (HTValue)(uintptr_t)key, NULL);
+  }
+  ck_assert(HashTable_num_elements(ht) == num_resize_keys);
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    HTValue *value = HashTable_find(ht, (unsigned char *)&key, sizeof(key));
+    ck_assert(value != NULL && *value == (HTValue)(uintptr_t)key);
+  }
+} END_TEST
+
+START_TEST(resize_compact_empty) {
+  // Long keys make sure the heap allocated copies survive a compaction
+  unsigned char long_key[HT_INLINE_KEY_LEN + 8];
+  memset(long_key, 'k', sizeof(long_key));
+  ck_assert(!HashTable_insert(ht, long_key, sizeof(long_key), NULL, NULL));
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    ck_assert(HashTable_remove(ht, (unsigned char *)&key, sizeof(key), NULL));
+  }
+  ck_assert(HashTable_compact(ht));
+  ck_assert(HashTable_num_elements(ht) == 1);
+  ck_assert(HashTable_find(ht, long_key, sizeof(long_key)) != NULL);
+  ck_assert(HashTable_remove(ht, long_key, sizeof(long_key), NULL));
+  ck_assert(HashTable_compact(ht));
+  ck_assert(HashTable_num_elements(ht) == 0);
+} END_TEST
+
+START_TEST(resize_stats) {
+  HTStats stats;
+  ck_assert(HashTable_get_stats(ht, &stats));
+  ck_assert(stats.engine == engine);
+  ck_assert_int_eq(stats.num_elements, num_resize_keys);
+  ck_assert(stats.num_buckets >= (size_t)num_resize_keys);
+  ck_assert(stats.load_factor ==
+      (double)num_resize_keys / stats.num_buckets);
+
+  // Every bucket (or with open addressing, every element) is in exactly one
+  // row of the histogram
+  size_t num_chains = 0;
+  size_t longest = 0;
+  for (int i = 0; i < HT_STATS_HISTOGRAM_LEN; i++) {
+    num_chains += stats.histogram[i];
+    if (stats.histogram[i] > 0) longest = i;
+  }
+  if (engine == HT_ENGINE_OPEN) {
+    ck_assert(stats.histogram[0] == 0);
+    ck_assert(num_chains == (size_t)num_resize_keys);
+  } else {
+    ck_assert(num_chains == stats.num_buckets);
+  }
+  ck_assert(stats.max_chain_len >= 1);
+  ck_assert(stats.max_chain_len == longest ||
+      longest == HT_STATS_HISTOGRAM_LEN - 1);
+  ck_assert(stats.avg_chain_len >= 1);
+  ck_assert(stats.avg_chain_len <= stats.max_chain_len);
+
+  if (!stats.counters_enabled) {
+    ck_assert(stats.lookups == 0 && stats.probes == 0 && stats.resizes == 0);
+    return;
+  }
+  // Growing from the default size takes many resizes
+  ck_assert(stats.resizes > 0);
+  ck_assert(stats.lookups >= (uint64_t)num_resize_keys);
+  // Every hit probes at least once
+  for (uint32_t key = 0; key < 100; key++) {
+    ck_assert(HashTable_find(ht, (unsigned char *)&key, sizeof(key)) != NULL);
+  }
+  HTStats after;
+  ck_assert(HashTable_get_stats(ht, &after));
+  ck_assert(after.lookups == stats.lookups + 100);
+  ck_assert(after.probes >= stats.probes + 100);
+  ck_assert(after.resizes == stats.resizes);
+} END_TEST
+
+START_TEST(resize_format_stats) {
+  char buf[4096];
+  size_t len = HashTable_format_stats(ht, buf, sizeof(buf));
+  ck_assert(len > 0 && len < sizeof(buf));
+  ck_assert(strlen(buf) == len);
+  ck_assert(strstr(buf, "elements:     20000\n") != NULL);
+  ck_assert(strstr(buf, engine == HT_ENGINE_OPEN ? "open" : "chained") != NULL);
+
+  // Truncated text is still terminated, and the full length is still returned
+  char small[32];
+  ck_assert(HashTable_format_stats(ht, small, sizeof(small)) == len);
+  ck_assert(strlen(small) == sizeof(small) - 1);
+  ck_assert(strncmp(small, buf, sizeof(small) - 1) == 0);
+  ck_assert(HashTable_format_stats(ht, NULL, 0) == len);
+} END_TEST
+
+START_TEST(resize_compact_with_iterator) {
+  hti = HTIterator_allocate(ht);
+  ck_assert(hti != NULL);
+  ck_assert(!HashTable_compact(ht));
+  // Sweep out most of the table through the iterator, which can't shrink it
+  // until the iterator is freed
+  for (int i = 0; HTIterator_is_valid(hti); i++) {
+    if (i % 50 == 0) {
+      HTIterator_next(hti);
+    } else {
+      ck_assert(HTIterator_remove(hti, NULL, NULL, NULL));
+    }
+  }
+  HTStats before, after;
+  ck_assert(HashTable_get_stats(ht, &before));
+  HTIterator_free(hti);
+  hti = NULL;
+  // Those removals make freeing the iterator start shrinking the table. The
+  // chained engine counts unmigrated buckets too, so its count only changes.
+  ck_assert(HashTable_get_stats(ht, &after));
+  if (engine == HT_ENGINE_OPEN) {
+    ck_assert(after.num_buckets < before.num_buckets);
+  } else {
+    ck_assert(after.num_buckets != before.num_buckets);
+  }
+  if (after.counters_enabled) ck_assert(after.resizes > before.resizes);
+  ck_assert(HashTable_num_elements(ht) == num_resize_keys / 50);
+  ck_assert(HashTable_compact(ht));
+
+  int num_found = 0;
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    HTValue *value = HashTable_find(ht, (unsigned char *)&key, sizeof(key));
+    if (value != NULL) {
+      ck_assert((uintptr_t)*value == (uintptr_t)~key);
+      num_found++;
+    }
+  }
+  ck_assert_int_eq(num_found, num_resize_keys / 50);
+} END_TEST
+
+START_TEST(resize_find_many) {
+  // Look up every key, plus as many missing ones, in batches that don't line
+  // up with the table's internal batching.
+  const size_t batch = 37;
+  uint32_t key_bufs[37];
+  unsigned char *keys[37];
+  size_t key_lens[37];
+  HTValue *values[37];
+  for (size_t i = 0; i < batch; i++) {
+    keys[i] = (unsigned char *)&key_bufs[i];
+    key_lens[i] = sizeof(uint32_t);
+  }
+
+  size_t num_found = 0;
+  for (uint32_t first = 0; first < 2 * num_resize_keys; first += batch) {
+    size_t n = 2 * num_resize_keys - first;
+    if (n > batch) n = batch;
+    for (size_t i = 0; i < n; i++) key_bufs[i] = first + i;
+    num_found += HashTable_find_many(ht, keys, key_lens, n, values);
+    for (size_t i = 0; i < n; i++) {
+      if (key_bufs[i] < num_resize_keys) {
+        ck_assert_msg(values[i] != NULL, "Key %u missing", key_bufs[i]);
+        ck_assert((uintptr_t)*values[i] == (uintptr_t)~key_bufs[i]);
+      } else {
+        ck_assert(values[i] == NULL);
+      }
+    }
+  }
+  ck_assert(num_found == num_resize_keys);
+} END_TEST
+
+// Allocation test cases
+// These reuse the resizing fixture, so that chained tables are likely to be in
+// the middle of a resize when the test runs.
+START_TEST(alloc_hooks_work) {
+  if (!alloc_hooks_available()) return;
+
+  // Make sure the hooks actually see allocations made inside the library,
+  // otherwise the tests below would pass vacuously. The key is too long to be
+  // stored inline, so every engine has to allocate a copy of it.
+  unsigned char key[HT_INLINE_KEY_LEN + 1];
+  memset(key, 'k', sizeof(key));
+  alloc_hooks_start();
+  ck_assert(!HashTable_insert(ht, key, sizeof(key), NULL, NULL));
+  ck_assert(alloc_hooks_stop() > 0);
+} END_TEST
+
+START_TEST(find_no_alloc) {
+  if (!alloc_hooks_available()) return;
+
+  alloc_hooks_start();
+  for (uint32_t key = 0; key < 2 * num_resize_keys; key++) {
+    HTValue *value = HashTable_find(ht, (unsigned char *)&key, sizeof(key));
+    ck_assert((value != NULL) == (key < num_resize_keys));
+  }
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Lookups made %zu allocations", allocs);
+} END_TEST
+
+START_TEST(overwrite_no_alloc) {
+  if (!alloc_hooks_available()) return;
+
+  alloc_hooks_start();
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    ck_assert(HashTable_insert(ht, (unsigned char *)&key, sizeof(key),
+          (HTValue)(uintptr_t)key, NULL));
+  }
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Overwrites made %zu allocations", allocs);
+
+  uint32_t key = 0;
+  ck_assert(*HashTable_find(ht, (unsigned char *)&key, sizeof(key)) ==
+      (HTValue)(uintptr_t)key);
+} END_TEST
+
+START_TEST(entry_no_alloc_when_present) {
+  if (!alloc_hooks_available()) return;
+
+  alloc_hooks_start();
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    bool inserted;
+    HTValue *value =
+      HashTable_entry(ht, (unsigned char *)&key, sizeof(key), &inserted);
+    ck_assert(value != NULL && !inserted);
+    *value = (HTValue)(uintptr_t)key;
+  }
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Entry lookups made %zu allocations", allocs);
+} END_TEST
+
+START_TEST(remove_no_alloc_when_missing) {
+  if (!alloc_hooks_available()) return;
+
+  alloc_hooks_start();
+  for (uint32_t key = num_resize_keys; key < 2 * num_resize_keys; key++) {
+    ck_assert(!HashTable_remove(ht, (unsigned char *)&key, sizeof(key), NULL));
+  }
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Failed removals made %zu allocations", allocs);
+} END_TEST
+
+START_TEST(iterate_no_alloc) {
+  if (!alloc_hooks_available()) return;
+
+  hti = HTIterator_allocate(ht);
+  ck_assert(hti != NULL);
+  int num_seen = 0;
+  alloc_hooks_start();
+  for (; HTIterator_is_valid(hti); HTIterator_next(hti)) {
+    ck_assert(HTIterator_get(hti, NULL, NULL, NULL));
+    num_seen++;
+  }
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Iterating made %zu allocations", allocs);
+  ck_assert_int_eq(num_seen, num_resize_keys);
+} END_TEST
+
+START_TEST(iterate_init_no_alloc) {
+  if (!alloc_hooks_available()) return;
+
+  // Unlike HTIterator_allocate, nothing at all is allocated, even to set up
+  HTIterator stack_hti;
+  int num_seen = 0;
+  alloc_hooks_start();
+  ck_assert(HTIterator_init(&stack_hti, ht));
+  for (; HTIterator_is_valid(&stack_hti); HTIterator_next(&stack_hti)) {
+    ck_assert(HTIterator_get(&stack_hti, NULL, NULL, NULL));
+    num_seen++;
+  }
+  HTIterator_release(&stack_hti);
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Iterating made %zu allocations", allocs);
+  ck_assert_int_eq(num_seen, num_resize_keys);
+} END_TEST
+
+START_TEST(reserve_no_alloc) {
+  if (!alloc_hooks_available()) return;
+
+  // Once room is reserved, the open addressing engine has nothing left to
+  // allocate for short keys. The chained engine still allocates each entry.
+  ck_assert(HashTable_reserve(ht, 2 * num_resize_keys));
+  alloc_hooks_start();
+  for (uint32_t key = num_resize_keys; key < 2 * num_resize_keys; key++) {
+    ck_assert(!HashTable_insert(ht, (unsigned char *)&key, sizeof(key),
+          (HTValue)(uintptr_t)~key, NULL));
+  }
+  size_t allocs = alloc_hooks_stop();
+  if (engine == HT_ENGINE_OPEN) {
+    ck_assert_msg(allocs == 0, "Inserts made %zu allocations", allocs);
+  }
+  ck_assert(HashTable_num_elements(ht) == 2 * num_resize_keys);
+} END_TEST
+
+START_TEST(iterator_remove_no_alloc) {
+  if (!alloc_hooks_available()) return;
+
+  hti = HTIterator_allocate(ht);
+  ck_assert(hti != NULL);
+  alloc_hooks_start();
+  while (HTIterator_is_valid(hti)) {
+    ck_assert(HTIterator_remove(hti, NULL, NULL, NULL));
+  }
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Removing made %zu allocations", allocs);
+  ck_assert_int_eq(HashTable_num_elements(ht), 0);
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    ck_assert(HashTable_find(ht, (unsigned char *)&key, sizeof(key)) == NULL);
+  }
+} END_TEST
+
+// Insertion order test cases, only for HT_ENGINE_OPEN
+#define num_order_keys 5000
+// Checks that iterating over `ht` visits exactly the keys in `expected`, in
+// that order, with values that are the complement of the key.
+static void check_iteration_order(const uint32_t *expected, int num_expected) {
+  ck_assert_int_eq(HashTable_num_elements(ht), num_expected);
+  hti = HTIterator_allocate(ht);
+  ck_assert(hti != NULL);
+  for (int i = 0; i < num_expected; i++) {
+    const unsigned char *key_ptr;
+    size_t key_size;
+    HTValue value;
+    ck_assert(HTIterator_get(hti, &key_ptr, &key_size, &value));
+    ck_assert(key_size == sizeof(uint32_t));
+    uint32_t key;
+    memcpy(&key, key_ptr, sizeof(key));
+    ck_assert_msg(key == expected[i], "Expected key %u at position %d, got %u",
+        expected[i], i, key);
+    ck_assert((uintptr_t)value == (uintptr_t)~key);
+    HTIterator_next(hti);
+  }
+  ck_assert(!HTIterator_is_valid(hti));
+  HTIterator_free(hti);
+  hti = NULL;
+}
+
+static void order_setup() {
+  common_setup();
+  ht = new_table();
+  ck_assert(ht != NULL);
+}
+static void order_teardown() {
+  HTIterator_free(hti);
+  HashTable_free(ht, NULL);
+}
+
+// Inserts `key` into `ht`, with its complement as the value.
+static void insert_key(uint32_t key) {
+  HashTable_insert(ht, (unsigned char *)&key, sizeof(key),
+      (HTValue)(uintptr_t)~key, NULL);
+}
+
+START_TEST(iterate_insertion_order) {
+  // Keys are inserted in a scrambled order, so that it has nothing to do with
+  // where they land in the table. The table grows several times along the
+  // way.
+  uint32_t keys[num_order_keys];
+  for (uint32_t i = 0; i < num_order_keys; i++) {
+    keys[i] = i * 2654435761u;
+    insert_key(keys[i]);
+  }
+  check_iteration_order(keys, num_order_keys);
+
+  // Overwriting a key doesn't move it
+  for (uint32_t i = 0; i < num_order_keys; i += 2) insert_key(keys[i]);
+  check_iteration_order(keys, num_order_keys);
+} END_TEST
+
+START_TEST(iterate_order_after_remove) {
+  uint32_t keys[num_order_keys];
+  for (uint32_t i = 0; i < num_order_keys; i++) {
+    keys[i] = i * 2654435761u;
+    insert_key(keys[i]);
+  }
+
+  // Remove two thirds of the keys, then insert new ones, which should come
+  // after every remaining key. Along the way, the holes left by the removed
+  // keys are closed up as the table rehashes.
+  int num_kept = 0;
+  for (int i = 0; i < num_order_keys; i++) {
+    if (i % 3 == 0) {
+      keys[num_kept++] = keys[i];
+    } else {
+      ck_assert(HashTable_remove(ht, (unsigned char *)&keys[i],
+            sizeof(uint32_t), NULL));
+    }
+  }
+  check_iteration_order(keys, num_kept);
+  for (uint32_t i = 0; num_kept < num_order_keys; i++) {
+    keys[num_kept] = (i * 2654435761u) | 1;
+    if (HashTable_find(ht, (unsigned char *)&keys[num_kept],
+          sizeof(uint32_t)) == NULL) {
+      insert_key(keys[num_kept++]);
+    }
+  }
+  check_iteration_order(keys, num_kept);
+} END_TEST
+
+START_TEST(iterate_order_after_shrink) {
+  uint32_t keys[num_order_keys];
+  for (uint32_t i = 0; i < num_order_keys; i++) {
+    keys[i] = i * 2654435761u;
+    insert_key(keys[i]);
+  }
+
+  // Removing all but a few keys makes the table shrink
+  int num_kept = 0;
+  for (int i = 0; i < num_order_keys; i++) {
+    if (i % 100 == 0) {
+      keys[num_kept++] = keys[i];
+    } else {
+      ck_assert(HashTable_remove(ht, (unsigned char *)&keys[i],
+            sizeof(uint32_t), NULL));
+    }
+  }
+  check_iteration_order(keys, num_kept);
+} END_TEST
+
+START_TEST(allocate_invalid_engine) {
+  HTOptions opts;
+  HTOptions_init(&opts);
+  opts.engine = (HTEngine)-1;
+  ck_assert(HashTable_allocate_with_options(&opts) == NULL);
+} END_TEST
+
+// Hash function test cases
+static const HTHashFn hash_fns[] = {
+  HT_HASH_SIPHASH, HT_HASH_WYHASH, HT_HASH_FNV1A
+};
+#define NUM_HASH_FNS (sizeof(hash_fns) / sizeof(hash_fns[0]))
+
+START_TEST(allocate_invalid_hash_fn) {
+  HTOptions opts;
+  HTOptions_init(&opts);
+  opts.hash_fn = (HTHashFn)-1;
+  ck_assert(HashTable_allocate_with_options(&opts) == NULL);
+} END_TEST
+
+START_TEST(hash_key_bogus) {
+  ck_assert(HashTable_hash_key(HT_HASH_SIPHASH, NULL, 1) == 0);
+  ck_assert(HashTable_hash_key((HTHashFn)-1, (unsigned char *)"a", 1) == 0);
+} END_TEST
+
+START_TEST(hash_key_fnv1a) {
+  // Known answers from the FNV reference implementation
+  ck_assert(HashTable_hash_key(HT_HASH_FNV1A, (unsigned char *)"a", 1) ==
+      0xaf63dc4c8601ec8c);
+  ck_assert(HashTable_hash_key(HT_HASH_FNV1A, (unsigned char *)"foobar", 6) ==
+      0x85944171f73967e8);
+} END_TEST
+
+START_TEST(hash_key_length_shorthand) {
+  unsigned char *key = (unsigned char *)"https://example.com/some/long/path";
+  for (size_t f = 0; f < NUM_HASH_FNS; f++) {
+    ck_assert(HashTable_hash_key(hash_fns[f], key, 0) ==
+        HashTable_hash_key(hash_fns[f], key, strlen((char *)key)));
+  }
+} END_TEST
+
+// Hashes every prefix of a buffer, which exercises each of the different tail
+// lengths the wide-word hashes have to handle, and checks that the results
+// are stable and distinct.
+START_TEST(hash_key_prefixes) {
+  unsigned char buf[200];
+  for (size_t i = 0; i < sizeof(buf); i++) buf[i] = (unsigned char)(i * 7);
+
+  for (size_t f = 0; f < NUM_HASH_FNS; f++) {
+    uint64_t hashes[sizeof(buf)];
+    for (size_t len = 1; len <= sizeof(buf); len++) {
+      hashes[len - 1] = HashTable_hash_key(hash_fns[f], buf, len);
+      ck_assert(hashes[len - 1] == HashTable_hash_key(hash_fns[f], buf, len));
+      for (size_t other = 1; other < len; other++) {
+        ck_assert(hashes[len - 1] != hashes[other - 1]);
+      }
+    }
+  }
+} END_TEST
+
+START_TEST(hash_fns_in_tables) {
+  unsigned char buf[100];
+  for (size_t i = 0; i < sizeof(buf); i++) buf[i] = (unsigned char)(i + 1);
+
+  static const HTEngine engines[] = {HT_ENGINE_CHAINED, HT_ENGINE_OPEN};
+  for (size_t i = 0; i < 2 * NUM_HASH_FNS; i++) {
+    HTOptions opts;
+    HTOptions_init(&opts);
+    opts.engine = engines[i / NUM_HASH_FNS];
+    opts.hash_fn = hash_fns[i % NUM_HASH_FNS];
+    ht = HashTable_allocate_with_options(&opts);
+    ck_assert(ht != NULL);
+
+    for (size_t len = 1; len <= sizeof(buf); len++) {
+      ck_assert(!HashTable_insert(ht, buf, len, (HTValue)len, NULL));
+    }
+    ck_assert(HashTable_num_elements(ht) == sizeof(buf));
+    for (size_t len = 1; len <= sizeof(buf); len++) {
+      HTValue *value = HashTable_find(ht, buf, len);
+      ck_assert(value != NULL && *value == (HTValue)len);
+    }
+    for (size_t len = 1; len <= sizeof(buf); len++) {
+      ck_assert(HashTable_remove(ht, buf, len, NULL));
+    }
+    ck_assert(HashTable_num_elements(ht) == 0);
+
+    HashTable_free(ht, NULL);
+    ht = NULL;
+  }
+} END_TEST
+
+// Adds the test cases for the engine currently being set up to `s`.
+//
+// names           - The names of the bogus input, entry handling, iterator,
+//                   resizing, and allocation test cases, in that order.
+// engine_setup    - A fixture that selects the engine (and any other table
+//                   options) to test, or NULL for the defaults.
+// engine_teardown - Undoes `engine_setup`.
+static void add_engine_tcases(Suite *s, const char *names[5],
+    void (*engine_setup)(), void (*engine_teardown)()) {
+  TCase *tc_bogus = tcase_create(names[0]);
+  if (engine_setup != NULL) {
+    tcase_add_checked_fixture(tc_bogus, engine_setup, engine_teardown);
+  }
   tcase_add_checked_fixture(tc_bogus, &bogus_setup, &bogus_teardown);
   tcase_add_test(tc_bogus, free_null);
   tcase_add_test(tc_bogus, free_with_null);
@@ -349,11 +1452,20 @@ Suite *hash_table_tests() {
   tcase_add_test(tc_bogus, find_from_null);
   tcase_add_test(tc_bogus, find_null_key);
   tcase_add_test(tc_bogus, find_non_existent_entry);
+  tcase_add_test(tc_bogus, find_many_null);
   tcase_add_test(tc_bogus, remove_from_null);
   tcase_add_test(tc_bogus, remove_null_key);
   tcase_add_test(tc_bogus, remove_non_existent_entry);
+  tcase_add_test(tc_bogus, entry_null);
+  tcase_add_test(tc_bogus, hashed_null);
+  tcase_add_test(tc_bogus, reserve_null);
+  tcase_add_test(tc_bogus, compact_null);
+  tcase_add_test(tc_bogus, stats_null);
+  tcase_add_test(tc_bogus, allocate_from_bogus);
   tcase_add_test(tc_bogus, iter_allocate_null);
   tcase_add_test(tc_bogus, iter_free_null);
+  tcase_add_test(tc_bogus, iter_init_null);
+  tcase_add_test(tc_bogus, iter_release_twice);
   tcase_add_test(tc_bogus, iter_is_valid_null);
   tcase_add_test(tc_bogus, iter_next_null);
   tcase_add_test(tc_bogus, iter_next_invalid);
@@ -361,24 +1473,119 @@ Suite *hash_table_tests() {
   tcase_add_test(tc_bogus, iter_get_invalid);
   tcase_add_test(tc_bogus, iter_remove_null);
   tcase_add_test(tc_bogus, iter_remove_invalid);
+  tcase_add_test(tc_bogus, allocate_invalid_engine);
   suite_add_tcase(s, tc_bogus);
 
-  TCase *tc_entry = tcase_create("entry handling");
+  TCase *tc_entry = tcase_create(names[1]);
+  if (engine_setup != NULL) {
+    tcase_add_checked_fixture(tc_entry, engine_setup, engine_teardown);
+  }
   tcase_add_checked_fixture(tc_entry, &entry_setup, &entry_teardown);
   tcase_add_test(tc_entry, num_elements_empty);
   tcase_add_test(tc_entry, num_elements);
   tcase_add_test(tc_entry, insert);
   tcase_add_test(tc_entry, insert_overwrite);
   tcase_add_test(tc_entry, find);
+  tcase_add_test(tc_entry, find_many);
   tcase_add_test(tc_entry, remove);
   tcase_add_test(tc_entry, key_length);
+  tcase_add_test(tc_entry, key_inline_boundary);
+  tcase_add_test(tc_entry, entry_existing);
+  tcase_add_test(tc_entry, entry_insert);
+  tcase_add_test(tc_entry, entry_update_in_place);
+  tcase_add_test(tc_entry, hashed);
+  tcase_add_test(tc_entry, hashed_shared_between_tables);
+  tcase_add_test(tc_entry, reserve);
+  tcase_add_test(tc_entry, reserve_with_iterator);
+  tcase_add_test(tc_entry, reserve_then_iterate);
+  tcase_add_test(tc_entry, allocate_from);
+  tcase_add_test(tc_entry, allocate_from_strings);
   suite_add_tcase(s, tc_entry);
 
-  TCase *tc_iter = tcase_create("iterator");
+  TCase *tc_iter = tcase_create(names[2]);
+  if (engine_setup != NULL) {
+    tcase_add_checked_fixture(tc_iter, engine_setup, engine_teardown);
+  }
   tcase_add_checked_fixture(tc_iter, &iter_setup, &iter_teardown);
   tcase_add_test(tc_iter, iterator_coverage); 
   tcase_add_test(tc_iter, iterator_remove); 
+  tcase_add_test(tc_iter, iterator_remove_some);
+  tcase_add_test(tc_iter, iterator_remove_long_keys);
   suite_add_tcase(s, tc_iter);
-  return s;
+
+  TCase *tc_resize = tcase_create(names[3]);
+  if (engine_setup != NULL) {
+    tcase_add_checked_fixture(tc_resize, engine_setup, engine_teardown);
+  }
+  tcase_add_checked_fixture(tc_resize, &resize_setup, &resize_teardown);
+  tcase_add_test(tc_resize, resize_grow);
+  tcase_add_test(tc_resize, resize_overwrite);
+  tcase_add_test(tc_resize, resize_shrink);
+  tcase_add_test(tc_resize, resize_iterate);
+  tcase_add_test(tc_resize, resize_find_many);
+  tcase_add_test(tc_resize, resize_compact);
+  tcase_add_test(tc_resize, resize_compact_empty);
+  tcase_add_test(tc_resize, resize_compact_with_iterator);
+  tcase_add_test(tc_resize, resize_stats);
+  tcase_add_test(tc_resize, resize_format_stats);
+  suite_add_tcase(s, tc_resize);
+
+  TCase *tc_alloc = tcase_create(names[4]);
+  if (engine_setup != NULL) {
+    tcase_add_checked_fixture(tc_alloc, engine_setup, engine_teardown);
+  }
+  tcase_add_checked_fixture(tc_alloc, &resize_setup, &resize_teardown);
+  tcase_add_test(tc_alloc, alloc_hooks_work);
+  tcase_add_test(tc_alloc, find_no_alloc);
+  tcase_add_test(tc_alloc, overwrite_no_alloc);
+  tcase_add_test(tc_alloc, entry_no_alloc_when_present);
+  tcase_add_test(tc_alloc, remove_no_alloc_when_missing);
+  tcase_add_test(tc_alloc, iterate_no_alloc);
+  tcase_add_test(tc_alloc, iterate_init_no_alloc);
+  tcase_add_test(tc_alloc, reserve_no_alloc);
+  tcase_add_test(tc_alloc, iterator_remove_no_alloc);
+  suite_add_tcase(s, tc_alloc);
 }
 
+Suite *hash_table_tests() {
+  Suite *s = suite_create("HashTable");
+
+  static const char *chained_names[] = {
+    "bogus input", "entry handling", "iterator", "resizing", "allocation"
+  };
+  add_engine_tcases(s, chained_names, NULL, NULL);
+
+  static const char *open_names[] = {
+    "bogus input (open addressing)", "entry handling (open addressing)",
+    "iterator (open addressing)", "resizing (open addressing)",
+    "allocation (open addressing)"
+  };
+  add_engine_tcases(s, open_names, &open_engine_setup, &open_engine_teardown);
+
+  TCase *tc_order = tcase_create("insertion order (open addressing)");
+  tcase_add_checked_fixture(tc_order, &open_engine_setup,
+      &open_engine_teardown);
+  tcase_add_checked_fixture(tc_order, &order_setup, &order_teardown);
+  tcase_add_test(tc_order, iterate_insertion_order);
+  tcase_add_test(tc_order, iterate_order_after_remove);
+  tcase_add_test(tc_order, iterate_order_after_shrink);
+  suite_add_tcase(s, tc_order);
+
+  static const char *slab_names[] = {
+    "bogus input (slab)", "entry handling (slab)", "iterator (slab)",
+    "resizing (slab)", "allocation (slab)"
+  };
+  add_engine_tcases(s, slab_names, &slab_setup, &slab_teardown);
+
+  TCase *tc_hash = tcase_create("hash functions");
+  tcase_add_checked_fixture(tc_hash, &common_setup, &common_teardown);
+  tcase_add_test(tc_hash, allocate_invalid_hash_fn);
+  tcase_add_test(tc_hash, hash_key_bogus);
+  tcase_add_test(tc_hash, hash_key_fnv1a);
+  tcase_add_test(tc_hash, hash_key_length_shorthand);
+  tcase_add_test(tc_hash, hash_key_prefixes);
+  tcase_add_test(tc_hash, hash_fns_in_tables);
+  suite_add_tcase(s, tc_hash);
+
+  return s;
+}
@@ -0,0 +1,527 @@
+/* Provides tests for `intrusive_list.c`
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "test_intrusive_list.h"
+
+#include <check.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "alloc_hooks.h"
+#include "intrusive_list.h"
+
+#define NUM_ITEMS 3
+
+// An element that can be in two lists at once
+typedef struct {
+  int id;
+  ILLink link;
+  ILLink other_link;
+} Item;
+
+// Helper variables
+static IntrusiveList il;
+static Item items[NUM_ITEMS];
+static ILIterator ili;
+
+// Helper functions
+static int id_of(ILLink *link) {
+  return IL_ENTRY(link, Item, link)->id;
+}
+
+// Checks that the ids of the elements in `list`, head to tail, are `ids`, and
+// that the list is linked consistently in both directions.
+static void assert_ids(IntrusiveList *list, const int *ids, int len) {
+  ck_assert_int_eq(IntrusiveList_num_elements(list), len);
+
+  ILIterator it;
+  ck_assert(ILIterator_init(&it, list));
+  for (int i = 0; i < len; i++) {
+    ck_assert(ILIterator_is_valid(&it));
+    ck_assert_int_eq(id_of(ILIterator_get(&it)), ids[i]);
+    ILIterator_next(&it);
+  }
+  ck_assert(!ILIterator_is_valid(&it));
+
+  if (len == 0) return;
+  ck_assert(ILIterator_fast_forward(&it));
+  for (int i = len - 1; i >= 0; i--) {
+    ck_assert(ILIterator_is_valid(&it));
+    ck_assert_int_eq(id_of(ILIterator_get(&it)), ids[i]);
+    ILIterator_prev(&it);
+  }
+  ck_assert(!ILIterator_is_valid(&it));
+}
+
+static void common_setup() {
+  for (int i = 0; i < NUM_ITEMS; i++) {
+    items[i] = (Item){0};
+    items[i].id = i + 1;
+  }
+  IntrusiveList_init(&il);
+}
+static void common_teardown() { }
+
+// Bogus input test cases
+static void bogus_input_setup() {
+  common_setup();
+}
+static void bogus_input_teardown() {
+  common_teardown();
+}
+
+START_TEST(init_null) {
+  ck_assert(!IntrusiveList_init(NULL));
+} END_TEST
+
+START_TEST(num_elements_null) {
+  ck_assert_int_eq(IntrusiveList_num_elements(NULL), -1);
+} END_TEST
+
+START_TEST(prepend_null) {
+  ck_assert(!IntrusiveList_prepend(NULL, &items[0].link));
+  ck_assert(!IntrusiveList_prepend(&il, NULL));
+  ck_assert_int_eq(IntrusiveList_num_elements(&il), 0);
+} END_TEST
+
+START_TEST(append_null) {
+  ck_assert(!IntrusiveList_append(NULL, &items[0].link));
+  ck_assert(!IntrusiveList_append(&il, NULL));
+  ck_assert_int_eq(IntrusiveList_num_elements(&il), 0);
+} END_TEST
+
+START_TEST(add_linked) {
+  IntrusiveList other;
+  IntrusiveList_init(&other);
+  ck_assert(IntrusiveList_append(&il, &items[0].link));
+
+  ck_assert(!IntrusiveList_append(&il, &items[0].link));
+  ck_assert(!IntrusiveList_prepend(&il, &items[0].link));
+  ck_assert(!IntrusiveList_append(&other, &items[0].link));
+  ck_assert(!IntrusiveList_prepend(&other, &items[0].link));
+  ck_assert_int_eq(IntrusiveList_num_elements(&il), 1);
+  ck_assert_int_eq(IntrusiveList_num_elements(&other), 0);
+} END_TEST
+
+START_TEST(pop_head_null_list) {
+  ILLink *out = NULL;
+  ck_assert(!IntrusiveList_pop_head(NULL, &out));
+  ck_assert(out == NULL);
+
+  IntrusiveList_append(&il, &items[0].link);
+  ck_assert(!IntrusiveList_pop_head(&il, NULL));
+  ck_assert_int_eq(IntrusiveList_num_elements(&il), 1);
+} END_TEST
+
+START_TEST(pop_head_empty_list) {
+  ILLink *out = NULL;
+  ck_assert(!IntrusiveList_pop_head(&il, &out));
+  ck_assert(out == NULL);
+} END_TEST
+
+START_TEST(pop_tail_null_list) {
+  ILLink *out = NULL;
+  ck_assert(!IntrusiveList_pop_tail(NULL, &out));
+  ck_assert(out == NULL);
+
+  IntrusiveList_append(&il, &items[0].link);
+  ck_assert(!IntrusiveList_pop_tail(&il, NULL));
+  ck_assert_int_eq(IntrusiveList_num_elements(&il), 1);
+} END_TEST
+
+START_TEST(pop_tail_empty_list) {
+  ILLink *out = NULL;
+  ck_assert(!IntrusiveList_pop_tail(&il, &out));
+  ck_assert(out == NULL);
+} END_TEST
+
+START_TEST(peek_head_null_list) {
+  ILLink *out = NULL;
+  ck_assert(!IntrusiveList_peek_head(NULL, &out));
+  ck_assert(!IntrusiveList_peek_head(&il, NULL));
+  ck_assert(!IntrusiveList_peek_head(&il, &out));
+  ck_assert(out == NULL);
+} END_TEST
+
+START_TEST(remove_null) {
+  IntrusiveList_append(&il, &items[0].link);
+  ck_assert(!IntrusiveList_remove(NULL, &items[0].link));
+  ck_assert(!IntrusiveList_remove(&il, NULL));
+  ck_assert_int_eq(IntrusiveList_num_elements(&il), 1);
+} END_TEST
+
+START_TEST(remove_not_in_list) {
+  IntrusiveList other;
+  IntrusiveList_init(&other);
+  IntrusiveList_append(&il, &items[0].link);
+  IntrusiveList_append(&other, &items[1].link);
+
+  ck_assert(!IntrusiveList_remove(&il, &items[1].link));
+  ck_assert(!IntrusiveList_remove(&il, &items[2].link));
+  ck_assert(!IntrusiveList_remove(&other, &items[0].link));
+  ck_assert_int_eq(IntrusiveList_num_elements(&il), 1);
+  ck_assert_int_eq(IntrusiveList_num_elements(&other), 1);
+} END_TEST
+
+START_TEST(move_head_null) {
+  IntrusiveList_append(&il, &items[0].link);
+  ck_assert(!IntrusiveList_move_head(NULL, &il));
+  ck_assert(!IntrusiveList_move_head(&il, NULL));
+  ck_assert_int_eq(IntrusiveList_num_elements(&il), 1);
+} END_TEST
+
+START_TEST(move_head_empty_list) {
+  IntrusiveList other;
+  IntrusiveList_init(&other);
+  ck_assert(!IntrusiveList_move_head(&other, &il));
+  ck_assert_int_eq(IntrusiveList_num_elements(&il), 0);
+} END_TEST
+
+START_TEST(move_head_same_list) {
+  IntrusiveList_append(&il, &items[0].link);
+  ck_assert(!IntrusiveList_move_head(&il, &il));
+  ck_assert_int_eq(IntrusiveList_num_elements(&il), 1);
+} END_TEST
+
+START_TEST(iterator_init_null) {
+  ILIterator it;
+  ck_assert(!ILIterator_init(NULL, &il));
+  ck_assert(!ILIterator_init(&it, NULL));
+} END_TEST
+
+START_TEST(iterator_null) {
+  ILLink *out = NULL;
+  ck_assert(!ILIterator_is_valid(NULL));
+  ck_assert(ILIterator_get(NULL) == NULL);
+  ck_assert(!ILIterator_remove(NULL, &out));
+  ck_assert(!ILIterator_move_to_head(NULL));
+  ck_assert(!ILIterator_next(NULL));
+  ck_assert(!ILIterator_prev(NULL));
+  ck_assert(!ILIterator_rewind(NULL));
+  ck_assert(!ILIterator_fast_forward(NULL));
+  ck_assert(out == NULL);
+} END_TEST
+
+START_TEST(iterator_invalid) {
+  ILIterator it;
+  ILLink *out = NULL;
+  ck_assert(ILIterator_init(&it, &il));
+  ck_assert(!ILIterator_is_valid(&it));
+  ck_assert(ILIterator_get(&it) == NULL);
+  ck_assert(!ILIterator_remove(&it, &out));
+  ck_assert(!ILIterator_move_to_head(&it));
+  ck_assert(!ILIterator_next(&it));
+  ck_assert(!ILIterator_prev(&it));
+  ck_assert(!ILIterator_rewind(&it));
+  ck_assert(!ILIterator_fast_forward(&it));
+  ck_assert(out == NULL);
+
+  IntrusiveList_append(&il, &items[0].link);
+  ck_assert(ILIterator_rewind(&it));
+  ck_assert(!ILIterator_remove(&it, NULL));
+  ck_assert_int_eq(IntrusiveList_num_elements(&il), 1);
+} END_TEST
+
+// List manipulation test cases
+static void list_manipulation_setup() {
+  common_setup();
+}
+static void list_manipulation_teardown() {
+  common_teardown();
+}
+
+START_TEST(prepend) {
+  for (int i = 0; i < NUM_ITEMS; i++) {
+    ck_assert(IntrusiveList_prepend(&il, &items[i].link));
+  }
+  assert_ids(&il, (int[]){3, 2, 1}, 3);
+} END_TEST
+
+START_TEST(append) {
+  for (int i = 0; i < NUM_ITEMS; i++) {
+    ck_assert(IntrusiveList_append(&il, &items[i].link));
+  }
+  assert_ids(&il, (int[]){1, 2, 3}, 3);
+} END_TEST
+
+START_TEST(pop_head) {
+  for (int i = 0; i < NUM_ITEMS; i++) {
+    IntrusiveList_append(&il, &items[i].link);
+  }
+
+  ILLink *out;
+  for (int i = 0; i < NUM_ITEMS; i++) {
+    ck_assert(IntrusiveList_pop_head(&il, &out));
+    ck_assert(out == &items[i].link);
+    assert_ids(&il, (int[]){2, 3} + i, NUM_ITEMS - 1 - i);
+  }
+  ck_assert(!IntrusiveList_pop_head(&il, &out));
+} END_TEST
+
+START_TEST(pop_tail) {
+  for (int i = 0; i < NUM_ITEMS; i++) {
+    IntrusiveList_append(&il, &items[i].link);
+  }
+
+  ILLink *out;
+  for (int i = NUM_ITEMS - 1; i >= 0; i--) {
+    ck_assert(IntrusiveList_pop_tail(&il, &out));
+    ck_assert(out == &items[i].link);
+    assert_ids(&il, (int[]){1, 2}, i);
+  }
+  ck_assert(!IntrusiveList_pop_tail(&il, &out));
+} END_TEST
+
+START_TEST(peek_head) {
+  IntrusiveList_append(&il, &items[0].link);
+  IntrusiveList_append(&il, &items[1].link);
+
+  ILLink *out;
+  ck_assert(IntrusiveList_peek_head(&il, &out));
+  ck_assert(out == &items[0].link);
+  ck_assert_int_eq(IntrusiveList_num_elements(&il), 2);
+} END_TEST
+
+START_TEST(remove_middle) {
+  for (int i = 0; i < NUM_ITEMS; i++) {
+    IntrusiveList_append(&il, &items[i].link);
+  }
+
+  ck_assert(IntrusiveList_remove(&il, &items[1].link));
+  assert_ids(&il, (int[]){1, 3}, 2);
+  ck_assert(!IntrusiveList_remove(&il, &items[1].link));
+
+  ck_assert(IntrusiveList_remove(&il, &items[2].link));
+  assert_ids(&il, (int[]){1}, 1);
+  ck_assert(IntrusiveList_remove(&il, &items[0].link));
+  assert_ids(&il, NULL, 0);
+} END_TEST
+
+START_TEST(readd_after_remove) {
+  IntrusiveList other;
+  IntrusiveList_init(&other);
+  IntrusiveList_append(&il, &items[0].link);
+  IntrusiveList_append(&il, &items[1].link);
+
+  ILLink *out;
+  IntrusiveList_pop_head(&il, &out);
+  ck_assert(IntrusiveList_append(&other, out));
+  IntrusiveList_remove(&il, &items[1].link);
+  ck_assert(IntrusiveList_prepend(&other, &items[1].link));
+
+  assert_ids(&il, NULL, 0);
+  assert_ids(&other, (int[]){2, 1}, 2);
+} END_TEST
+
+START_TEST(move_head) {
+  IntrusiveList other;
+  IntrusiveList_init(&other);
+  IntrusiveList_append(&il, &items[0].link);
+  IntrusiveList_append(&il, &items[1].link);
+  IntrusiveList_append(&other, &items[2].link);
+
+  ck_assert(IntrusiveList_move_head(&il, &other));
+  assert_ids(&il, (int[]){2}, 1);
+  assert_ids(&other, (int[]){1, 3}, 2);
+
+  // The moved link now belongs to `other`
+  ck_assert(!IntrusiveList_remove(&il, &items[0].link));
+  ck_assert(IntrusiveList_remove(&other, &items[0].link));
+
+  ck_assert(IntrusiveList_move_head(&il, &other));
+  assert_ids(&il, NULL, 0);
+  assert_ids(&other, (int[]){2, 3}, 2);
+} END_TEST
+
+START_TEST(multiple_links) {
+  IntrusiveList other;
+  IntrusiveList_init(&other);
+  for (int i = 0; i < NUM_ITEMS; i++) {
+    IntrusiveList_append(&il, &items[i].link);
+    IntrusiveList_prepend(&other, &items[i].other_link);
+  }
+
+  ILLink *out;
+  ck_assert(IntrusiveList_pop_head(&other, &out));
+  ck_assert_int_eq(IL_ENTRY(out, Item, other_link)->id, 3);
+  assert_ids(&il, (int[]){1, 2, 3}, 3);
+  ck_assert_int_eq(IntrusiveList_num_elements(&other), 2);
+} END_TEST
+
+START_TEST(no_allocations) {
+  if (!alloc_hooks_available()) return;
+
+  IntrusiveList other;
+  ILLink *out;
+  alloc_hooks_start();
+  IntrusiveList_init(&other);
+  for (int i = 0; i < NUM_ITEMS; i++) {
+    IntrusiveList_append(&il, &items[i].link);
+  }
+  IntrusiveList_move_head(&il, &other);
+  IntrusiveList_remove(&il, &items[2].link);
+  IntrusiveList_pop_tail(&il, &out);
+  IntrusiveList_pop_head(&other, &out);
+  ck_assert_int_eq(alloc_hooks_stop(), 0);
+} END_TEST
+
+// Iterator test cases
+static void iterator_setup() {
+  common_setup();
+  for (int i = 0; i < NUM_ITEMS; i++) {
+    IntrusiveList_append(&il, &items[i].link);
+  }
+  ILIterator_init(&ili, &il);
+}
+static void iterator_teardown() {
+  common_teardown();
+}
+
+START_TEST(iter_get) {
+  ck_assert_int_eq(id_of(ILIterator_get(&ili)), 1);
+  ck_assert(ILIterator_next(&ili));
+  ck_assert_int_eq(id_of(ILIterator_get(&ili)), 2);
+  ck_assert(ILIterator_next(&ili));
+  ck_assert_int_eq(id_of(ILIterator_get(&ili)), 3);
+  ck_assert(!ILIterator_next(&ili));
+  ck_assert(ILIterator_get(&ili) == NULL);
+
+  ck_assert(ILIterator_rewind(&ili));
+  ck_assert_int_eq(id_of(ILIterator_get(&ili)), 1);
+  ck_assert(!ILIterator_prev(&ili));
+  ck_assert(ILIterator_fast_forward(&ili));
+  ck_assert_int_eq(id_of(ILIterator_get(&ili)), 3);
+} END_TEST
+
+START_TEST(iter_remove) {
+  ILLink *out;
+
+  // Middle: moves to the successor
+  ILIterator_next(&ili);
+  ck_assert(ILIterator_remove(&ili, &out));
+  ck_assert(out == &items[1].link);
+  ck_assert_int_eq(id_of(ILIterator_get(&ili)), 3);
+  assert_ids(&il, (int[]){1, 3}, 2);
+
+  // Tail: moves to the predecessor
+  ck_assert(ILIterator_remove(&ili, &out));
+  ck_assert(out == &items[2].link);
+  ck_assert_int_eq(id_of(ILIterator_get(&ili)), 1);
+  assert_ids(&il, (int[]){1}, 1);
+
+  // Only element: becomes invalid
+  ck_assert(ILIterator_remove(&ili, &out));
+  ck_assert(out == &items[0].link);
+  ck_assert(!ILIterator_is_valid(&ili));
+  assert_ids(&il, NULL, 0);
+
+  // Removed links can go straight into another list
+  ck_assert(IntrusiveList_append(&il, &items[1].link));
+} END_TEST
+
+START_TEST(iter_remove_head) {
+  ILLink *out;
+  ck_assert(ILIterator_remove(&ili, &out));
+  ck_assert(out == &items[0].link);
+  ck_assert_int_eq(id_of(ILIterator_get(&ili)), 2);
+  assert_ids(&il, (int[]){2, 3}, 2);
+} END_TEST
+
+START_TEST(iter_remove_all) {
+  ILLink *out;
+  int num_removed = 0;
+  while (ILIterator_is_valid(&ili)) {
+    if (id_of(ILIterator_get(&ili)) % 2 == 1) {
+      ck_assert(ILIterator_remove(&ili, &out));
+      num_removed++;
+    } else {
+      ILIterator_next(&ili);
+    }
+  }
+  ck_assert_int_eq(num_removed, 2);
+  assert_ids(&il, (int[]){2}, 1);
+} END_TEST
+
+START_TEST(iter_move_to_head) {
+  ck_assert(ILIterator_move_to_head(&ili));
+  assert_ids(&il, (int[]){1, 2, 3}, 3);
+
+  ILIterator_fast_forward(&ili);
+  ck_assert(ILIterator_move_to_head(&ili));
+  ck_assert_int_eq(id_of(ILIterator_get(&ili)), 3);
+  assert_ids(&il, (int[]){3, 1, 2}, 3);
+
+  ILIterator_fast_forward(&ili);
+  ILIterator_prev(&ili);
+  ck_assert(ILIterator_move_to_head(&ili));
+  ck_assert_int_eq(id_of(ILIterator_get(&ili)), 1);
+  assert_ids(&il, (int[]){1, 3, 2}, 3);
+} END_TEST
+
+Suite *intrusive_list_tests() {
+  Suite *s = suite_create("IntrusiveList");
+  TCase *tc_bogus = tcase_create("bogus input");
+  tcase_add_checked_fixture(tc_bogus, &bogus_input_setup,
+      &bogus_input_teardown);
+  tcase_add_test(tc_bogus, init_null);
+  tcase_add_test(tc_bogus, num_elements_null);
+  tcase_add_test(tc_bogus, prepend_null);
+  tcase_add_test(tc_bogus, append_null);
+  tcase_add_test(tc_bogus, add_linked);
+  tcase_add_test(tc_bogus, pop_head_null_list);
+  tcase_add_test(tc_bogus, pop_head_empty_list);
+  tcase_add_test(tc_bogus, pop_tail_null_list);
+  tcase_add_test(tc_bogus, pop_tail_empty_list);
+  tcase_add_test(tc_bogus, peek_head_null_list);
+  tcase_add_test(tc_bogus, remove_null);
+  tcase_add_test(tc_bogus, remove_not_in_list);
+  tcase_add_test(tc_bogus, move_head_null);
+  tcase_add_test(tc_bogus, move_head_empty_list);
+  tcase_add_test(tc_bogus, move_head_same_list);
+  tcase_add_test(tc_bogus, iterator_init_null);
+  tcase_add_test(tc_bogus, iterator_null);
+  tcase_add_test(tc_bogus, iterator_invalid);
+  suite_add_tcase(s, tc_bogus);
+
+  TCase *tc_list = tcase_create("list manipulation");
+  tcase_add_checked_fixture(tc_list, &list_manipulation_setup,
+      &list_manipulation_teardown);
+  tcase_add_test(tc_list, prepend);
+  tcase_add_test(tc_list, append);
+  tcase_add_test(tc_list, pop_head);
+  tcase_add_test(tc_list, pop_tail);
+  tcase_add_test(tc_list, peek_head);
+  tcase_add_test(tc_list, remove_middle);
+  tcase_add_test(tc_list, readd_after_remove);
+  tcase_add_test(tc_list, move_head);
+  tcase_add_test(tc_list, multiple_links);
+  tcase_add_test(tc_list, no_allocations);
+  suite_add_tcase(s, tc_list);
+
+  TCase *tc_iter = tcase_create("iterator");
+  tcase_add_checked_fixture(tc_iter, &iterator_setup, &iterator_teardown);
+  tcase_add_test(tc_iter, iter_get);
+  tcase_add_test(tc_iter, iter_remove);
+  tcase_add_test(tc_iter, iter_remove_head);
+  tcase_add_test(tc_iter, iter_remove_all);
+  tcase_add_test(tc_iter, iter_move_to_head);
+  suite_add_tcase(s, tc_iter);
+
+  return s;
+}
@@ -21,9 +21,12 @@ along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <check.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+#include "alloc_hooks.h"
 #include "linked_list.h"
+#include "slab.h"
 
 // Helper variables
 static LinkedList *ll;
@@ -170,11 +173,65 @@ START_TEST(pop_tail_empty_list) {
       "not modify the output parameter");
 } END_TEST
 
+START_TEST(peek_head_null_list) {
+  LLPayload out_ref = (LLPayload)0xDEADBEEF;
+  LLPayload out = out_ref;
+  ck_assert_msg(!LinkedList_peek_head(NULL, &out), "Peeking at the head of "
+      "NULL should return false");
+  ck_assert_msg(out == out_ref, "Peeking at the head of NULL should not "
+      "modify the output parameter");
+} END_TEST
+
+START_TEST(peek_head_empty_list) {
+  LLPayload out_ref = (LLPayload)0xDEADBEEF;
+  LLPayload out = out_ref;
+  LinkedList *empty = ll;
+
+  ck_assert_msg(!LinkedList_peek_head(empty, &out), "Peeking at the head of "
+      "an empty list should return false");
+  ck_assert_msg(out == out_ref, "Peeking at the head of an empty list should "
+      "not modify the output parameter");
+} END_TEST
+
+START_TEST(move_head_null) {
+  ck_assert_msg(!LinkedList_move_head(NULL, ll), "Moving from a NULL list "
+      "should return false");
+  ck_assert_msg(!LinkedList_move_head(ll, NULL), "Moving to a NULL list "
+      "should return false");
+} END_TEST
+
+START_TEST(move_head_empty_list) {
+  LinkedList *dst = LinkedList_allocate();
+  ck_assert(dst != NULL);
+
+  ck_assert_msg(!LinkedList_move_head(ll, dst), "Moving from an empty list "
+      "should return false");
+  ck_assert(LinkedList_num_elements(dst) == 0);
+
+  LinkedList_free(dst, NULL);
+} END_TEST
+
+START_TEST(move_head_same_list) {
+  LinkedList_append(ll, one);
+
+  ck_assert_msg(!LinkedList_move_head(ll, ll), "Moving within the same list "
+      "should return false");
+  ck_assert(LinkedList_num_elements(ll) == 1);
+} END_TEST
+
 START_TEST(iterator_allocate_null) {
   ck_assert_msg(LLIterator_allocate(NULL) == NULL, "Allocating an iterator for "
       "a NULL list should return NULL");
 } END_TEST
 
+START_TEST(iterator_init_null) {
+  LLIterator lli_storage;
+  ck_assert_msg(!LLIterator_init(NULL, ll), "Initializing a NULL iterator "
+      "should return false");
+  ck_assert_msg(!LLIterator_init(&lli_storage, NULL), "Initializing an "
+      "iterator for a NULL list should return false");
+} END_TEST
+
 START_TEST(iterator_free_null) {
   // fails on segfault
   LLIterator_free(NULL);
@@ -221,6 +278,13 @@ START_TEST(iterator_remove_from_invalid) {
   LLIterator_free(invalid);
 } END_TEST
 
+START_TEST(iterator_move_to_head_null) {
+  LLIterator *invalid = LLIterator_allocate(ll);
+  ck_assert(!LLIterator_move_to_head(NULL));
+  ck_assert(!LLIterator_move_to_head(invalid));
+  LLIterator_free(invalid);
+} END_TEST
+
 START_TEST(iterator_next_null) {
   ck_assert_msg(!LLIterator_next(NULL), "Advancing a NULL iterator to the next "
       "element should return false");
@@ -377,6 +441,54 @@ START_TEST(pop_tail) {
   LinkedList_free(ll_cmp, NULL);
 } END_TEST
 
+START_TEST(peek_head) {
+  LinkedList_append(ll, one);
+  LinkedList_append(ll, two);
+
+  LLPayload out;
+  ck_assert(LinkedList_peek_head(ll, &out));
+  ck_assert(out == one);
+  ck_assert(LinkedList_num_elements(ll) == 2);
+} END_TEST
+
+START_TEST(move_head) {
+  LinkedList_append(ll, one);
+  LinkedList_append(ll, two);
+
+  LinkedList *dst = LinkedList_allocate();
+  ck_assert(dst != NULL);
+  LinkedList_append(dst, three);
+
+  LinkedList *ll_cmp = LinkedList_allocate();
+  ck_assert(ll_cmp != NULL);
+  LinkedList_append(ll_cmp, two);
+
+  LinkedList *dst_cmp = LinkedList_allocate();
+  ck_assert(dst_cmp != NULL);
+  LinkedList_append(dst_cmp, one);
+  LinkedList_append(dst_cmp, three);
+
+  ck_assert(LinkedList_move_head(ll, dst));
+  ck_assert(LinkedList_num_elements(ll) == 1);
+  ck_assert(LinkedList_num_elements(dst) == 2);
+  ck_assert(LinkedList_eq(ll, ll_cmp));
+  ck_assert(LinkedList_eq(dst, dst_cmp));
+
+  // Moving the last element should leave the source empty but usable
+  ck_assert(LinkedList_move_head(ll, dst));
+  ck_assert(LinkedList_num_elements(ll) == 0);
+  LinkedList_append(ll, one);
+  ck_assert(LinkedList_num_elements(ll) == 1);
+
+  LLPayload out;
+  ck_assert(LinkedList_pop_tail(dst, &out));
+  ck_assert(out == three);
+
+  LinkedList_free(ll_cmp, NULL);
+  LinkedList_free(dst_cmp, NULL);
+  LinkedList_free(dst, NULL);
+} END_TEST
+
 // Iterator test cases
 LLIterator *lli;
 void iterator_setup() {
@@ -414,6 +526,21 @@ START_TEST(iter_valid) {
   LinkedList_free(empty, NULL);
 } END_TEST
 
+START_TEST(iter_init) {
+  LLIterator stack_lli;
+  ck_assert(LLIterator_init(&stack_lli, ll));
+
+  ck_assert(*LLIterator_get(&stack_lli) == one);
+  ck_assert(LLIterator_next(&stack_lli));
+  ck_assert(*LLIterator_get(&stack_lli) == two);
+
+  LLPayload out;
+  ck_assert(LLIterator_remove(&stack_lli, &out));
+  ck_assert(out == two);
+  ck_assert(*LLIterator_get(&stack_lli) == three);
+  ck_assert(LinkedList_num_elements(ll) == 2);
+} END_TEST
+
 START_TEST(iter_get) {
   ck_assert(*LLIterator_get(lli) == one);
 
@@ -462,6 +589,48 @@ START_TEST(iter_remove) {
   ck_assert(!LLIterator_is_valid(lli));
 } END_TEST
 
+START_TEST(iter_move_to_head) {
+  LLIterator tail_lli;
+  ck_assert(LLIterator_init(&tail_lli, ll));
+  LLIterator_fast_forward(&tail_lli);
+
+  // Moving the head is a no-op
+  ck_assert(LLIterator_move_to_head(lli));
+  ck_assert(*LLIterator_get(lli) == one);
+
+  // 1 2 3 to 2 1 3
+  LLIterator_next(lli);
+  ck_assert(LLIterator_move_to_head(lli));
+  ck_assert(*LLIterator_get(lli) == two);
+  ck_assert(!LLIterator_prev(lli));
+  LLIterator_rewind(lli);
+  ck_assert(LLIterator_next(lli));
+  ck_assert(*LLIterator_get(lli) == one);
+
+  // 2 1 3 to 3 2 1, through another iterator
+  ck_assert(LLIterator_move_to_head(&tail_lli));
+  ck_assert(*LLIterator_get(&tail_lli) == three);
+  ck_assert(*LLIterator_get(lli) == one);
+
+  LinkedList *expected = LinkedList_allocate();
+  ck_assert(expected != NULL);
+  LinkedList_append(expected, three);
+  LinkedList_append(expected, two);
+  LinkedList_append(expected, one);
+  ck_assert(LinkedList_eq(ll, expected));
+  LinkedList_free(expected, NULL);
+
+  // The list is linked properly in both directions
+  LLPayload out;
+  ck_assert(LinkedList_pop_tail(ll, &out));
+  ck_assert(out == one);
+  ck_assert(LinkedList_pop_tail(ll, &out));
+  ck_assert(out == two);
+  ck_assert(LinkedList_pop_tail(ll, &out));
+  ck_assert(out == three);
+  ck_assert(LinkedList_num_elements(ll) == 0);
+} END_TEST
+
 START_TEST(iter_next) {
   ck_assert(LLIterator_next(lli)); // Now points at two
   ck_assert(LLIterator_next(lli)); // Now points at three
@@ -486,6 +655,102 @@ START_TEST(iter_fast_forward) {
   ck_assert(*LLIterator_get(lli) == three);
 } END_TEST
 
+// Slab test cases
+static Slab *node_slab;
+static void slab_setup() {
+  common_setup();
+  node_slab = Slab_allocate(LinkedList_node_size());
+  ck_assert(node_slab != NULL);
+  ll = LinkedList_allocate_with_slab(node_slab);
+  ck_assert(ll != NULL);
+}
+static void slab_teardown() {
+  common_teardown();
+  LinkedList_free(ll, NULL);
+  Slab_free(node_slab);
+}
+
+START_TEST(slab_too_small) {
+  Slab *small = Slab_allocate(1);
+  ck_assert(small != NULL);
+  if (Slab_object_size(small) < LinkedList_node_size()) {
+    ck_assert(LinkedList_allocate_with_slab(small) == NULL);
+  }
+  Slab_free(small);
+
+  // No Slab means nodes come from malloc
+  LinkedList *list = LinkedList_allocate_with_slab(NULL);
+  ck_assert(list != NULL);
+  ck_assert(LinkedList_prepend(list, one));
+  LinkedList_free(list, NULL);
+} END_TEST
+
+START_TEST(slab_list_manipulation) {
+  LinkedList *expected = LinkedList_allocate();
+  ck_assert(expected != NULL);
+  LinkedList_append(expected, one);
+  LinkedList_append(expected, three);
+
+  ck_assert(LinkedList_append(ll, two));
+  ck_assert(LinkedList_append(ll, three));
+  ck_assert(LinkedList_prepend(ll, one));
+  ck_assert(LinkedList_append(ll, two));
+
+  LLPayload out;
+  ck_assert(LinkedList_pop_tail(ll, &out));
+  ck_assert(out == two);
+  LLIterator iter;
+  ck_assert(LLIterator_init(&iter, ll));
+  ck_assert(LLIterator_next(&iter));
+  ck_assert(LLIterator_remove(&iter, &out));
+  ck_assert(out == two);
+  ck_assert(LinkedList_eq(ll, expected));
+
+  LinkedList_free(expected, NULL);
+} END_TEST
+
+START_TEST(slab_move_head) {
+  LinkedList *same_slab = LinkedList_allocate_with_slab(node_slab);
+  LinkedList *no_slab = LinkedList_allocate();
+  ck_assert(same_slab != NULL && no_slab != NULL);
+  LinkedList_append(ll, one);
+
+  // The node belongs to ll's Slab, so it can't move to a list without one
+  ck_assert(!LinkedList_move_head(ll, no_slab));
+  ck_assert(LinkedList_num_elements(ll) == 1);
+  ck_assert(LinkedList_move_head(ll, same_slab));
+  ck_assert(LinkedList_num_elements(same_slab) == 1);
+
+  LinkedList_free(same_slab, NULL);
+  LinkedList_free(no_slab, NULL);
+} END_TEST
+
+START_TEST(slab_free_reuses_nodes) {
+  for (uintptr_t i = 0; i < 1000; i++) {
+    ck_assert(LinkedList_append(ll, (LLPayload)i));
+  }
+  LinkedList_free(ll, NULL);
+  ll = LinkedList_allocate_with_slab(node_slab);
+  ck_assert(ll != NULL);
+
+  // All of the freed list's nodes went back to the Slab at once, so they can
+  // be reused without allocating any more memory.
+  if (alloc_hooks_available()) alloc_hooks_start();
+  for (uintptr_t i = 0; i < 1000; i++) {
+    ck_assert(LinkedList_prepend(ll, (LLPayload)i));
+  }
+  if (alloc_hooks_available()) ck_assert(alloc_hooks_stop() == 0);
+  ck_assert(LinkedList_num_elements(ll) == 1000);
+} END_TEST
+
+START_TEST(slab_free_payload) {
+  LinkedList_append(ll, malloc(64));
+  LinkedList_append(ll, malloc(64));
+  // Valgrind will detect if the payloads aren't freed.
+  LinkedList_free(ll, &free);
+  ll = NULL;
+} END_TEST
+
 Suite *linked_list_tests() {
   Suite *s = suite_create("LinkedList");
   TCase *tc_core = tcase_create("core");
@@ -505,12 +770,19 @@ Suite *linked_list_tests() {
   tcase_add_test(tc_bogus, pop_head_empty_list);
   tcase_add_test(tc_bogus, pop_tail_null_list);
   tcase_add_test(tc_bogus, pop_tail_empty_list);
+  tcase_add_test(tc_bogus, peek_head_null_list);
+  tcase_add_test(tc_bogus, peek_head_empty_list);
+  tcase_add_test(tc_bogus, move_head_null);
+  tcase_add_test(tc_bogus, move_head_empty_list);
+  tcase_add_test(tc_bogus, move_head_same_list);
   tcase_add_test(tc_bogus, iterator_allocate_null);
   tcase_add_test(tc_bogus, iterator_free_null);
+  tcase_add_test(tc_bogus, iterator_init_null);
   tcase_add_test(tc_bogus, iterator_get_null);
   tcase_add_test(tc_bogus, iterator_get_invalid);
   tcase_add_test(tc_bogus, iterator_remove_from_null);
   tcase_add_test(tc_bogus, iterator_remove_from_invalid);
+  tcase_add_test(tc_bogus, iterator_move_to_head_null);
   tcase_add_test(tc_bogus, iterator_next_null);
   tcase_add_test(tc_bogus, iterator_prev_null);
   tcase_add_test(tc_bogus, iterator_rewind_null);
@@ -529,19 +801,32 @@ Suite *linked_list_tests() {
   tcase_add_test(tc_list, pop_head);
   tcase_add_test(tc_list, pop_tail_len_one);
   tcase_add_test(tc_list, pop_tail);
+  tcase_add_test(tc_list, peek_head);
+  tcase_add_test(tc_list, move_head);
   suite_add_tcase(s, tc_list);
 
   TCase *tc_iter = tcase_create("iterator");
   tcase_add_checked_fixture(tc_iter, &iterator_setup, &iterator_teardown);
   tcase_add_test(tc_iter, iter_valid);
+  tcase_add_test(tc_iter, iter_init);
   tcase_add_test(tc_iter, iter_get);
   tcase_add_test(tc_iter, iter_remove);
+  tcase_add_test(tc_iter, iter_move_to_head);
   tcase_add_test(tc_iter, iter_next);
   tcase_add_test(tc_iter, iter_prev);
   tcase_add_test(tc_iter, iter_rewind);
   tcase_add_test(tc_iter, iter_fast_forward);
   suite_add_tcase(s, tc_iter);
 
+  TCase *tc_slab = tcase_create("slab");
+  tcase_add_checked_fixture(tc_slab, &slab_setup, &slab_teardown);
+  tcase_add_test(tc_slab, slab_too_small);
+  tcase_add_test(tc_slab, slab_list_manipulation);
+  tcase_add_test(tc_slab, slab_move_head);
+  tcase_add_test(tc_slab, slab_free_reuses_nodes);
+  tcase_add_test(tc_slab, slab_free_payload);
+  suite_add_tcase(s, tc_slab);
+
   return s;
 }
 
@@ -0,0 +1,310 @@
+/* Provides tests for `lru_cache.c`
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "test_lru_cache.h"
+
+#include <check.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lru_cache.h"
+
+// Every test key is a uint32_t, so with a charge of CHARGE each entry costs
+// ENTRY_COST bytes, and the cache fits CAPACITY_ENTRIES of them.
+#define CHARGE 12
+#define ENTRY_COST (CHARGE + sizeof(uint32_t))
+#define CAPACITY_ENTRIES 8
+#define MAX_KEYS 64
+
+// Helper variables
+static LRUCache *cache;
+static uint32_t evicted[MAX_KEYS * 64];
+static int num_evicted;
+
+// Records the keys of evicted entries, checking that their values match.
+static void record_evict(const unsigned char *key, size_t key_len,
+    HTValue value) {
+  ck_assert_int_eq(key_len, sizeof(uint32_t));
+  uint32_t k;
+  memcpy(&k, key, sizeof(k));
+  ck_assert((uintptr_t)value == (uintptr_t)~k);
+  evicted[num_evicted++] = k;
+}
+
+static void lru_setup() {
+  cache = LRUCache_allocate(CAPACITY_ENTRIES * ENTRY_COST, &record_evict);
+  ck_assert(cache != NULL);
+  num_evicted = 0;
+}
+static void lru_teardown() {
+  LRUCache_free(cache, NULL);
+}
+
+static bool insert_key(uint32_t key) {
+  return LRUCache_insert(cache, (unsigned char *)&key, sizeof(key),
+      (HTValue)(uintptr_t)~key, CHARGE, NULL);
+}
+static HTValue *find_key(uint32_t key) {
+  return LRUCache_find(cache, (unsigned char *)&key, sizeof(key));
+}
+static HTValue *peek_key(uint32_t key) {
+  return LRUCache_peek(cache, (unsigned char *)&key, sizeof(key));
+}
+
+// Bogus input test cases
+START_TEST(allocate_free) {
+  LRUCache_free(NULL, NULL);
+  LRUCache_free(NULL, &free);
+  ck_assert_int_eq(LRUCache_num_elements(NULL), -1);
+  ck_assert_int_eq(LRUCache_size(NULL), 0);
+  ck_assert_int_eq(LRUCache_capacity(NULL), 0);
+  ck_assert_int_eq(LRUCache_num_elements(cache), 0);
+  ck_assert_int_eq(LRUCache_size(cache), 0);
+  ck_assert_int_eq(LRUCache_capacity(cache), CAPACITY_ENTRIES * ENTRY_COST);
+} END_TEST
+
+START_TEST(null_args) {
+  unsigned char *key = (unsigned char *)"key";
+  ck_assert(!LRUCache_insert(NULL, key, 0, NULL, 1, NULL));
+  ck_assert(!LRUCache_insert(cache, NULL, 0, NULL, 1, NULL));
+  ck_assert_int_eq(LRUCache_num_elements(cache), 0);
+  ck_assert(LRUCache_find(NULL, key, 0) == NULL);
+  ck_assert(LRUCache_find(cache, NULL, 0) == NULL);
+  ck_assert(LRUCache_peek(NULL, key, 0) == NULL);
+  ck_assert(LRUCache_peek(cache, NULL, 0) == NULL);
+  ck_assert(!LRUCache_remove(NULL, key, 0, NULL));
+  ck_assert(!LRUCache_remove(cache, NULL, 0, NULL));
+  ck_assert(!LRUCache_remove(cache, key, 0, NULL));
+} END_TEST
+
+// Entry handling test cases
+START_TEST(insert_find) {
+  unsigned char *key = (unsigned char *)"route";
+  int value = 1;
+  ck_assert(!LRUCache_insert(cache, key, 0, &value, 10, NULL));
+  ck_assert_int_eq(LRUCache_num_elements(cache), 1);
+  ck_assert_int_eq(LRUCache_size(cache), 10 + strlen((char *)key));
+
+  HTValue *found = LRUCache_find(cache, key, 0);
+  ck_assert(found != NULL);
+  ck_assert_ptr_eq(*found, &value);
+  ck_assert_ptr_eq(*LRUCache_peek(cache, key, 0), &value);
+  ck_assert(LRUCache_find(cache, (unsigned char *)"other", 0) == NULL);
+  ck_assert(LRUCache_peek(cache, (unsigned char *)"other", 0) == NULL);
+} END_TEST
+
+START_TEST(insert_overwrite) {
+  unsigned char *key = (unsigned char *)"route";
+  ck_assert(!LRUCache_insert(cache, key, 0, (HTValue)1, 10, NULL));
+  HTValue old_value;
+  ck_assert(LRUCache_insert(cache, key, 0, (HTValue)2, 20, &old_value));
+  ck_assert(old_value == (HTValue)1);
+  ck_assert(*LRUCache_find(cache, key, 0) == (HTValue)2);
+  ck_assert_int_eq(LRUCache_num_elements(cache), 1);
+  ck_assert_int_eq(LRUCache_size(cache), 20 + strlen((char *)key));
+  ck_assert_int_eq(num_evicted, 0);
+} END_TEST
+
+START_TEST(remove) {
+  for (uint32_t key = 0; key < 3; key++) ck_assert(!insert_key(key));
+  uint32_t key = 1;
+  HTValue old_value;
+  ck_assert(LRUCache_remove(cache, (unsigned char *)&key, sizeof(key),
+        &old_value));
+  ck_assert((uintptr_t)old_value == (uintptr_t)~key);
+  ck_assert(find_key(1) == NULL);
+  ck_assert(!LRUCache_remove(cache, (unsigned char *)&key, sizeof(key), NULL));
+  ck_assert_int_eq(LRUCache_num_elements(cache), 2);
+  ck_assert_int_eq(LRUCache_size(cache), 2 * ENTRY_COST);
+  ck_assert_int_eq(num_evicted, 0);
+} END_TEST
+
+// Eviction test cases
+START_TEST(evict_oldest) {
+  for (uint32_t key = 0; key < CAPACITY_ENTRIES; key++) {
+    ck_assert(!insert_key(key));
+  }
+  ck_assert_int_eq(num_evicted, 0);
+  ck_assert_int_eq(LRUCache_size(cache), CAPACITY_ENTRIES * ENTRY_COST);
+
+  for (uint32_t key = CAPACITY_ENTRIES; key < 3 * CAPACITY_ENTRIES; key++) {
+    ck_assert(!insert_key(key));
+    ck_assert_int_eq(num_evicted, key - CAPACITY_ENTRIES + 1);
+    ck_assert_int_eq(evicted[num_evicted - 1], key - CAPACITY_ENTRIES);
+    ck_assert(find_key(key - CAPACITY_ENTRIES) == NULL);
+    ck_assert_int_eq(LRUCache_num_elements(cache), CAPACITY_ENTRIES);
+  }
+} END_TEST
+
+START_TEST(find_refreshes) {
+  for (uint32_t key = 0; key < CAPACITY_ENTRIES; key++) {
+    ck_assert(!insert_key(key));
+  }
+  // 0 is now the most recently used, so 1 goes first
+  ck_assert(find_key(0) != NULL);
+  ck_assert(!insert_key(100));
+  ck_assert_int_eq(num_evicted, 1);
+  ck_assert_int_eq(evicted[0], 1);
+  ck_assert(peek_key(0) != NULL);
+
+  // Peeking doesn't count, so 2 goes next even though it was just peeked at
+  ck_assert(peek_key(2) != NULL);
+  ck_assert(!insert_key(101));
+  ck_assert_int_eq(num_evicted, 2);
+  ck_assert_int_eq(evicted[1], 2);
+
+  // Overwriting an entry does count as using it
+  uint32_t key = 3;
+  ck_assert(LRUCache_insert(cache, (unsigned char *)&key, sizeof(key),
+        (HTValue)(uintptr_t)~key, CHARGE, NULL));
+  ck_assert(!insert_key(102));
+  ck_assert_int_eq(num_evicted, 3);
+  ck_assert_int_eq(evicted[2], 4);
+} END_TEST
+
+START_TEST(evict_by_size) {
+  for (uint32_t key = 0; key < CAPACITY_ENTRIES; key++) {
+    ck_assert(!insert_key(key));
+  }
+  // An entry as big as three others pushes out the three oldest
+  uint32_t key = 100;
+  ck_assert(!LRUCache_insert(cache, (unsigned char *)&key, sizeof(key),
+        (HTValue)(uintptr_t)~key, 3 * ENTRY_COST - sizeof(key), NULL));
+  ck_assert_int_eq(num_evicted, 3);
+  for (int i = 0; i < 3; i++) ck_assert_int_eq(evicted[i], i);
+  ck_assert_int_eq(LRUCache_size(cache), CAPACITY_ENTRIES * ENTRY_COST);
+
+  // Growing an existing entry makes it the most recently used, so others go
+  key = 3;
+  ck_assert(LRUCache_insert(cache, (unsigned char *)&key, sizeof(key),
+        (HTValue)(uintptr_t)~key, 2 * ENTRY_COST - sizeof(key), NULL));
+  ck_assert_int_eq(num_evicted, 4);
+  ck_assert_int_eq(evicted[3], 4);
+  ck_assert(peek_key(3) != NULL);
+  ck_assert(LRUCache_size(cache) <= LRUCache_capacity(cache));
+} END_TEST
+
+START_TEST(evict_too_big) {
+  for (uint32_t key = 0; key < CAPACITY_ENTRIES; key++) {
+    ck_assert(!insert_key(key));
+  }
+  // Too big to fit at all, so only the new entry goes
+  uint32_t key = 100;
+  ck_assert(!LRUCache_insert(cache, (unsigned char *)&key, sizeof(key),
+        (HTValue)(uintptr_t)~key, LRUCache_capacity(cache), NULL));
+  ck_assert_int_eq(num_evicted, 1);
+  ck_assert_int_eq(evicted[0], 100);
+  ck_assert(peek_key(100) == NULL);
+  ck_assert_int_eq(LRUCache_num_elements(cache), CAPACITY_ENTRIES);
+  ck_assert_int_eq(LRUCache_size(cache), CAPACITY_ENTRIES * ENTRY_COST);
+  for (uint32_t k = 0; k < CAPACITY_ENTRIES; k++) {
+    ck_assert(peek_key(k) != NULL);
+  }
+
+  // Overwriting an existing entry with one that's too big replaces it
+  key = 3;
+  HTValue old_value;
+  ck_assert(LRUCache_insert(cache, (unsigned char *)&key, sizeof(key),
+        (HTValue)(uintptr_t)~key, SIZE_MAX, &old_value));
+  ck_assert(old_value == (HTValue)(uintptr_t)~key);
+  ck_assert_int_eq(num_evicted, 2);
+  ck_assert_int_eq(evicted[1], 3);
+  ck_assert(peek_key(3) == NULL);
+  ck_assert_int_eq(LRUCache_num_elements(cache), CAPACITY_ENTRIES - 1);
+  ck_assert_int_eq(LRUCache_size(cache), (CAPACITY_ENTRIES - 1) * ENTRY_COST);
+} END_TEST
+
+START_TEST(matches_model) {
+  // Compare against a simple array kept in recency order, most recent first
+  uint32_t model[CAPACITY_ENTRIES];
+  int model_len = 0;
+  uint64_t rng = 99;
+  for (int i = 0; i < 20000; i++) {
+    rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint32_t key = (rng >> 33) % (2 * CAPACITY_ENTRIES);
+    int pos = -1;
+    for (int j = 0; j < model_len; j++) {
+      if (model[j] == key) pos = j;
+    }
+
+    int expected_evictions = num_evicted;
+    if ((rng >> 20) % 2 == 0) {
+      ck_assert((find_key(key) != NULL) == (pos >= 0));
+      if (pos < 0) continue;
+    } else {
+      ck_assert(insert_key(key) == (pos >= 0));
+      if (pos < 0) {
+        if (model_len == CAPACITY_ENTRIES) {
+          ck_assert_int_eq(evicted[num_evicted - 1], model[model_len - 1]);
+          expected_evictions++;
+          model_len--;
+        }
+        pos = model_len++;
+      }
+    }
+    ck_assert_int_eq(num_evicted, expected_evictions);
+    memmove(&model[1], &model[0], pos * sizeof(model[0]));
+    model[0] = key;
+    if (num_evicted == MAX_KEYS * 64) num_evicted = 0;
+  }
+} END_TEST
+
+START_TEST(free_values) {
+  LRUCache *values = LRUCache_allocate(1000, NULL);
+  ck_assert(values != NULL);
+  for (uint32_t key = 0; key < 10; key++) {
+    int *value = malloc(sizeof(int));
+    ck_assert(value != NULL);
+    ck_assert(!LRUCache_insert(values, (unsigned char *)&key, sizeof(key),
+          value, sizeof(int), NULL));
+  }
+  LRUCache_free(values, &free);
+} END_TEST
+
+Suite *lru_cache_tests() {
+  Suite *s = suite_create("LRUCache");
+
+  TCase *tc_bogus = tcase_create("bogus input");
+  tcase_add_checked_fixture(tc_bogus, &lru_setup, &lru_teardown);
+  tcase_add_test(tc_bogus, allocate_free);
+  tcase_add_test(tc_bogus, null_args);
+  suite_add_tcase(s, tc_bogus);
+
+  TCase *tc_entry = tcase_create("entry handling");
+  tcase_add_checked_fixture(tc_entry, &lru_setup, &lru_teardown);
+  tcase_add_test(tc_entry, insert_find);
+  tcase_add_test(tc_entry, insert_overwrite);
+  tcase_add_test(tc_entry, remove);
+  tcase_add_test(tc_entry, free_values);
+  suite_add_tcase(s, tc_entry);
+
+  TCase *tc_evict = tcase_create("eviction");
+  tcase_add_checked_fixture(tc_evict, &lru_setup, &lru_teardown);
+  tcase_add_test(tc_evict, evict_oldest);
+  tcase_add_test(tc_evict, find_refreshes);
+  tcase_add_test(tc_evict, evict_by_size);
+  tcase_add_test(tc_evict, evict_too_big);
+  tcase_add_test(tc_evict, matches_model);
+  suite_add_tcase(s, tc_evict);
+
+  return s;
+}
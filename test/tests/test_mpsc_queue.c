@@ -0,0 +1,294 @@
+/* Provides tests for `mpsc_queue.c`
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _XOPEN_SOURCE 700
+
+#include "test_mpsc_queue.h"
+
+#include <check.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "alloc_hooks.h"
+#include "mpsc_queue.h"
+
+#define NUM_ITEMS 100
+#define NUM_PRODUCERS 4
+#define NUM_PER_PRODUCER 20000
+
+typedef struct {
+  int producer;
+  int seq;
+  MPSCLink link;
+} Item;
+
+// Helper variables
+static MPSCQueue *queue;
+static Item items[NUM_ITEMS];
+
+// Helper functions
+static Item *item_of(MPSCLink *link) {
+  return MPSC_ENTRY(link, Item, link);
+}
+
+static void common_setup() {
+  queue = MPSCQueue_allocate();
+  ck_assert(queue != NULL);
+  for (int i = 0; i < NUM_ITEMS; i++) {
+    items[i].producer = 0;
+    items[i].seq = i;
+  }
+}
+static void common_teardown() {
+  MPSCQueue_free(queue);
+}
+
+// Bogus input test cases
+static void bogus_input_setup() {
+  common_setup();
+}
+static void bogus_input_teardown() {
+  common_teardown();
+}
+
+START_TEST(free_null) {
+  // Segfaults on failure
+  MPSCQueue_free(NULL);
+} END_TEST
+
+START_TEST(push_null) {
+  ck_assert(!MPSCQueue_push(NULL, &items[0].link));
+  ck_assert(!MPSCQueue_push(queue, NULL));
+} END_TEST
+
+START_TEST(pop_null) {
+  MPSCLink *out = NULL;
+  MPSCLink *links[1];
+  ck_assert(!MPSCQueue_pop(NULL, &out));
+  ck_assert_int_eq(MPSCQueue_pop_many(NULL, links, 1), 0);
+  ck_assert(out == NULL);
+
+  MPSCQueue_push(queue, &items[0].link);
+  ck_assert(!MPSCQueue_pop(queue, NULL));
+  ck_assert_int_eq(MPSCQueue_pop_many(queue, NULL, 1), 0);
+  ck_assert_int_eq(MPSCQueue_pop_many(queue, links, 0), 0);
+  ck_assert(MPSCQueue_pop(queue, &out));
+  ck_assert(out == &items[0].link);
+} END_TEST
+
+START_TEST(pop_empty) {
+  MPSCLink *out = NULL;
+  MPSCLink *links[1];
+  ck_assert(!MPSCQueue_pop(queue, &out));
+  ck_assert_int_eq(MPSCQueue_pop_many(queue, links, 1), 0);
+  ck_assert(out == NULL);
+} END_TEST
+
+// Single threaded test cases
+static void single_thread_setup() {
+  common_setup();
+}
+static void single_thread_teardown() {
+  common_teardown();
+}
+
+START_TEST(fifo) {
+  for (int i = 0; i < NUM_ITEMS; i++) {
+    ck_assert(MPSCQueue_push(queue, &items[i].link));
+  }
+  MPSCLink *out;
+  for (int i = 0; i < NUM_ITEMS; i++) {
+    ck_assert(MPSCQueue_pop(queue, &out));
+    ck_assert_int_eq(item_of(out)->seq, i);
+  }
+  ck_assert(!MPSCQueue_pop(queue, &out));
+} END_TEST
+
+START_TEST(one_at_a_time) {
+  // Empties the queue every time, so the stub is pushed and skipped over and
+  // over again
+  MPSCLink *out;
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < NUM_ITEMS; i++) {
+      ck_assert(MPSCQueue_push(queue, &items[i].link));
+      ck_assert(MPSCQueue_pop(queue, &out));
+      ck_assert(out == &items[i].link);
+      ck_assert(!MPSCQueue_pop(queue, &out));
+    }
+  }
+} END_TEST
+
+START_TEST(pop_many) {
+  for (int i = 0; i < NUM_ITEMS; i++) MPSCQueue_push(queue, &items[i].link);
+
+  MPSCLink *links[NUM_ITEMS];
+  size_t next = 0;
+  for (size_t batch = 1; next < NUM_ITEMS; batch++) {
+    size_t n = MPSCQueue_pop_many(queue, links, batch);
+    size_t expected = NUM_ITEMS - next < batch ? NUM_ITEMS - next : batch;
+    ck_assert_int_eq(n, expected);
+    for (size_t i = 0; i < n; i++) {
+      ck_assert_int_eq(item_of(links[i])->seq, next++);
+    }
+  }
+  ck_assert_int_eq(MPSCQueue_pop_many(queue, links, NUM_ITEMS), 0);
+} END_TEST
+
+START_TEST(interleaved) {
+  // Mixes pushes, pops and batches, so that pop_many starts from the stub,
+  // from a real link, and right after the queue was emptied
+  MPSCLink *links[NUM_ITEMS];
+  MPSCLink *out;
+  int next_in = 0, next_out = 0;
+  while (next_out < NUM_ITEMS) {
+    int num_push = next_in % 7 + 1;
+    for (int i = 0; i < num_push && next_in < NUM_ITEMS; i++) {
+      MPSCQueue_push(queue, &items[next_in++].link);
+    }
+    if (next_in % 2 == 0 && MPSCQueue_pop(queue, &out)) {
+      ck_assert_int_eq(item_of(out)->seq, next_out++);
+    }
+    size_t n = MPSCQueue_pop_many(queue, links, 3);
+    for (size_t i = 0; i < n; i++) {
+      ck_assert_int_eq(item_of(links[i])->seq, next_out++);
+    }
+  }
+  ck_assert_int_eq(next_in, NUM_ITEMS);
+  ck_assert(!MPSCQueue_pop(queue, &out));
+} END_TEST
+
+START_TEST(reuse_links) {
+  MPSCLink *out;
+  MPSCQueue_push(queue, &items[0].link);
+  MPSCQueue_push(queue, &items[1].link);
+  ck_assert(MPSCQueue_pop(queue, &out));
+  ck_assert(MPSCQueue_push(queue, out));
+  ck_assert(MPSCQueue_pop(queue, &out));
+  ck_assert(out == &items[1].link);
+  ck_assert(MPSCQueue_pop(queue, &out));
+  ck_assert(out == &items[0].link);
+  ck_assert(!MPSCQueue_pop(queue, &out));
+} END_TEST
+
+START_TEST(no_allocations) {
+  if (!alloc_hooks_available()) return;
+
+  MPSCLink *links[NUM_ITEMS];
+  MPSCLink *out;
+  alloc_hooks_start();
+  for (int i = 0; i < NUM_ITEMS; i++) MPSCQueue_push(queue, &items[i].link);
+  MPSCQueue_pop(queue, &out);
+  MPSCQueue_pop_many(queue, links, NUM_ITEMS);
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Queue operations made %zu allocations", allocs);
+} END_TEST
+
+// Multithreaded test cases
+static Item *produced;
+
+static void *produce(void *arg) {
+  int producer = (int)(intptr_t)arg;
+  Item *mine = produced + (size_t)producer * NUM_PER_PRODUCER;
+  for (int i = 0; i < NUM_PER_PRODUCER; i++) {
+    mine[i].producer = producer;
+    mine[i].seq = i;
+    MPSCQueue_push(queue, &mine[i].link);
+    if (i % 1000 == 0) sched_yield();
+  }
+  return NULL;
+}
+
+static void threaded_setup() {
+  common_setup();
+  produced = calloc((size_t)NUM_PRODUCERS * NUM_PER_PRODUCER, sizeof(Item));
+  ck_assert(produced != NULL);
+}
+static void threaded_teardown() {
+  free(produced);
+  common_teardown();
+}
+
+START_TEST(many_producers) {
+  pthread_t threads[NUM_PRODUCERS];
+  for (int p = 0; p < NUM_PRODUCERS; p++) {
+    ck_assert(pthread_create(&threads[p], NULL, &produce,
+          (void *)(intptr_t)p) == 0);
+  }
+
+  // Every item must come out exactly once, in the order its producer pushed
+  // it, no matter how the producers interleave
+  int next_seq[NUM_PRODUCERS] = {0};
+  int num_received = 0;
+  MPSCLink *links[64];
+  while (num_received < NUM_PRODUCERS * NUM_PER_PRODUCER) {
+    size_t n = MPSCQueue_pop_many(queue, links, 64);
+    if (n == 0) {
+      sched_yield();
+      continue;
+    }
+    for (size_t i = 0; i < n; i++) {
+      Item *item = item_of(links[i]);
+      ck_assert_int_eq(item->seq, next_seq[item->producer]);
+      next_seq[item->producer]++;
+    }
+    num_received += n;
+  }
+
+  for (int p = 0; p < NUM_PRODUCERS; p++) {
+    pthread_join(threads[p], NULL);
+    ck_assert_int_eq(next_seq[p], NUM_PER_PRODUCER);
+  }
+  MPSCLink *out;
+  ck_assert(!MPSCQueue_pop(queue, &out));
+} END_TEST
+
+Suite *mpsc_queue_tests() {
+  Suite *s = suite_create("MPSCQueue");
+  TCase *tc_bogus = tcase_create("bogus input");
+  tcase_add_checked_fixture(tc_bogus, &bogus_input_setup,
+      &bogus_input_teardown);
+  tcase_add_test(tc_bogus, free_null);
+  tcase_add_test(tc_bogus, push_null);
+  tcase_add_test(tc_bogus, pop_null);
+  tcase_add_test(tc_bogus, pop_empty);
+  suite_add_tcase(s, tc_bogus);
+
+  TCase *tc_single = tcase_create("single thread");
+  tcase_add_checked_fixture(tc_single, &single_thread_setup,
+      &single_thread_teardown);
+  tcase_add_test(tc_single, fifo);
+  tcase_add_test(tc_single, one_at_a_time);
+  tcase_add_test(tc_single, pop_many);
+  tcase_add_test(tc_single, interleaved);
+  tcase_add_test(tc_single, reuse_links);
+  tcase_add_test(tc_single, no_allocations);
+  suite_add_tcase(s, tc_single);
+
+  TCase *tc_threaded = tcase_create("threaded");
+  tcase_add_checked_fixture(tc_threaded, &threaded_setup,
+      &threaded_teardown);
+  tcase_add_test(tc_threaded, many_producers);
+  suite_add_tcase(s, tc_threaded);
+
+  return s;
+}
@@ -0,0 +1,476 @@
+/* Provides tests for `persistent_hash_map.c`
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "test_persistent_hash_map.h"
+
+#include <check.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc_hooks.h"
+#include "persistent_hash_map.h"
+
+// Enough keys that the trie is several levels deep, and that plenty of keys
+// share the first couple of levels' worth of hash bits
+#define NUM_KEYS 20000
+
+// Helper variables
+static PersistentHashMap *map;
+static PersistentHashMap *snapshot;
+
+// Values are allocated counters, so that value_free can keep track of which
+// ones have been freed
+static int values_freed;
+static void count_free(HTValue value) {
+  values_freed++;
+  free(value);
+}
+static HTValue new_value(uint32_t n) {
+  uint32_t *value = malloc(sizeof(uint32_t));
+  ck_assert(value != NULL);
+  *value = n;
+  return value;
+}
+
+static void phm_setup() {
+  values_freed = 0;
+  map = PersistentHashMap_allocate(HT_HASH_SIPHASH, NULL);
+  ck_assert(map != NULL);
+  snapshot = NULL;
+}
+static void phm_teardown() {
+  PersistentHashMap_free(snapshot);
+  PersistentHashMap_free(map);
+}
+
+// Like phm_setup, but with NUM_KEYS counters mapping i -> i, freed with
+// count_free
+static void counters_setup() {
+  values_freed = 0;
+  map = PersistentHashMap_allocate(HT_HASH_WYHASH, &count_free);
+  ck_assert(map != NULL);
+  snapshot = NULL;
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    ck_assert(PersistentHashMap_insert(map, (unsigned char *)&key,
+          sizeof(key), new_value(key)));
+  }
+}
+
+static bool insert_key(PersistentHashMap *m, uint32_t key, uintptr_t value) {
+  return PersistentHashMap_insert(m, (unsigned char *)&key, sizeof(key),
+      (HTValue)value);
+}
+static bool remove_key(PersistentHashMap *m, uint32_t key) {
+  return PersistentHashMap_remove(m, (unsigned char *)&key, sizeof(key));
+}
+static const HTValue *find_key(PersistentHashMap *m, uint32_t key) {
+  return PersistentHashMap_find(m, (unsigned char *)&key, sizeof(key));
+}
+// Returns the counter for `key`, or -1 if it isn't in `m`
+static int64_t find_counter(PersistentHashMap *m, uint32_t key) {
+  const HTValue *value = find_key(m, key);
+  return value != NULL ? (int64_t)*(uint32_t *)*value : -1;
+}
+
+// Bogus input test cases
+START_TEST(allocate_invalid_hash_fn) {
+  ck_assert(PersistentHashMap_allocate((HTHashFn)-1, NULL) == NULL);
+} END_TEST
+
+START_TEST(null_args) {
+  unsigned char *key = (unsigned char *)"key";
+  PersistentHashMap_free(NULL);
+  ck_assert(PersistentHashMap_snapshot(NULL) == NULL);
+  ck_assert_int_eq(PersistentHashMap_num_elements(NULL), -1);
+  ck_assert(!PersistentHashMap_insert(NULL, key, 0, NULL));
+  ck_assert(!PersistentHashMap_insert(map, NULL, 0, NULL));
+  ck_assert(PersistentHashMap_find(NULL, key, 0) == NULL);
+  ck_assert(PersistentHashMap_find(map, NULL, 0) == NULL);
+  ck_assert(!PersistentHashMap_remove(NULL, key, 0));
+  ck_assert(!PersistentHashMap_remove(map, NULL, 0));
+  ck_assert_int_eq(PersistentHashMap_num_elements(map), 0);
+} END_TEST
+
+// Single version test cases
+START_TEST(insert_find) {
+  unsigned char *key = (unsigned char *)"config.port";
+  ck_assert(PersistentHashMap_find(map, key, 0) == NULL);
+  ck_assert(PersistentHashMap_insert(map, key, 0, (HTValue)8080));
+  ck_assert_int_eq(PersistentHashMap_num_elements(map), 1);
+  const HTValue *value = PersistentHashMap_find(map, key, 0);
+  ck_assert(value != NULL && *value == (HTValue)8080);
+  // The NUL terminator isn't part of the key
+  ck_assert(PersistentHashMap_find(map, key, 11) != NULL);
+  ck_assert(PersistentHashMap_find(map, key, 12) == NULL);
+  ck_assert(PersistentHashMap_find(map, key, 6) == NULL);
+
+  // Overwriting doesn't add an element
+  ck_assert(PersistentHashMap_insert(map, key, 11, (HTValue)9090));
+  ck_assert_int_eq(PersistentHashMap_num_elements(map), 1);
+  value = PersistentHashMap_find(map, key, 0);
+  ck_assert(value != NULL && *value == (HTValue)9090);
+} END_TEST
+
+START_TEST(remove) {
+  unsigned char *key = (unsigned char *)"a";
+  ck_assert(!PersistentHashMap_remove(map, key, 0));
+  ck_assert(PersistentHashMap_insert(map, key, 0, NULL));
+  ck_assert(PersistentHashMap_remove(map, key, 0));
+  ck_assert(!PersistentHashMap_remove(map, key, 0));
+  ck_assert(PersistentHashMap_find(map, key, 0) == NULL);
+  ck_assert_int_eq(PersistentHashMap_num_elements(map), 0);
+  // The map is still usable once emptied
+  ck_assert(PersistentHashMap_insert(map, key, 0, (HTValue)1));
+  ck_assert(PersistentHashMap_find(map, key, 0) != NULL);
+} END_TEST
+
+START_TEST(many_keys) {
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    ck_assert(insert_key(map, key, ~key));
+  }
+  ck_assert_int_eq(PersistentHashMap_num_elements(map), NUM_KEYS);
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    const HTValue *value = find_key(map, key);
+    ck_assert_msg(value != NULL, "Key %u missing", key);
+    ck_assert((uintptr_t)*value == (uintptr_t)~key);
+  }
+  ck_assert(find_key(map, NUM_KEYS) == NULL);
+
+  // Removing every other key collapses nodes that are left with one leaf
+  for (uint32_t key = 0; key < NUM_KEYS; key += 2) {
+    ck_assert(remove_key(map, key));
+  }
+  ck_assert_int_eq(PersistentHashMap_num_elements(map), NUM_KEYS / 2);
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    ck_assert((find_key(map, key) != NULL) == (key % 2 == 1));
+  }
+  for (uint32_t key = 1; key < NUM_KEYS; key += 2) {
+    ck_assert(remove_key(map, key));
+  }
+  ck_assert_int_eq(PersistentHashMap_num_elements(map), 0);
+} END_TEST
+
+START_TEST(long_keys) {
+  unsigned char key[200];
+  for (int i = 0; i < 100; i++) {
+    memset(key, 'a' + i % 26, sizeof(key));
+    key[0] = i;
+    ck_assert(PersistentHashMap_insert(map, key, sizeof(key),
+          (HTValue)(uintptr_t)i));
+  }
+  for (int i = 0; i < 100; i++) {
+    memset(key, 'a' + i % 26, sizeof(key));
+    key[0] = i;
+    const HTValue *value = PersistentHashMap_find(map, key, sizeof(key));
+    ck_assert(value != NULL && *value == (HTValue)(uintptr_t)i);
+  }
+} END_TEST
+
+// Snapshot test cases
+START_TEST(snapshot_empty) {
+  snapshot = PersistentHashMap_snapshot(map);
+  ck_assert(snapshot != NULL);
+  ck_assert(insert_key(map, 1, 1));
+  ck_assert_int_eq(PersistentHashMap_num_elements(snapshot), 0);
+  ck_assert(find_key(snapshot, 1) == NULL);
+  ck_assert(insert_key(snapshot, 2, 2));
+  ck_assert(find_key(map, 2) == NULL);
+} END_TEST
+
+START_TEST(snapshot_isolation) {
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    ck_assert(insert_key(map, key, key));
+  }
+  snapshot = PersistentHashMap_snapshot(map);
+  ck_assert(snapshot != NULL);
+
+  // Change the map in every way possible...
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    switch (key % 3) {
+      case 0:
+        ck_assert(insert_key(map, key, key + 1));
+        break;
+      case 1:
+        ck_assert(remove_key(map, key));
+        break;
+    }
+  }
+  for (uint32_t key = NUM_KEYS; key < 2 * NUM_KEYS; key++) {
+    ck_assert(insert_key(map, key, key));
+  }
+
+  // ...without the snapshot seeing any of it
+  ck_assert_int_eq(PersistentHashMap_num_elements(snapshot), NUM_KEYS);
+  for (uint32_t key = 0; key < 2 * NUM_KEYS; key++) {
+    const HTValue *value = find_key(snapshot, key);
+    if (key < NUM_KEYS) {
+      ck_assert_msg(value != NULL, "Key %u missing from snapshot", key);
+      ck_assert((uintptr_t)*value == key);
+    } else {
+      ck_assert(value == NULL);
+    }
+  }
+  for (uint32_t key = 0; key < 2 * NUM_KEYS; key++) {
+    const HTValue *value = find_key(map, key);
+    if (key < NUM_KEYS && key % 3 == 1) {
+      ck_assert(value == NULL);
+    } else {
+      ck_assert(value != NULL);
+      ck_assert((uintptr_t)*value == (key < NUM_KEYS && key % 3 == 0 ?
+            key + 1 : key));
+    }
+  }
+
+  // Changing the snapshot doesn't affect the map either
+  ck_assert(remove_key(snapshot, 0));
+  ck_assert(find_key(map, 0) != NULL);
+  ck_assert(insert_key(snapshot, 2, 42));
+  ck_assert((uintptr_t)*find_key(map, 2) == 2);
+} END_TEST
+
+START_TEST(snapshot_outlives_map) {
+  for (uint32_t key = 0; key < 1000; key++) {
+    ck_assert(insert_key(map, key, key));
+  }
+  snapshot = PersistentHashMap_snapshot(map);
+  ck_assert(snapshot != NULL);
+  PersistentHashMap_free(map);
+  map = NULL;
+  for (uint32_t key = 0; key < 1000; key++) {
+    const HTValue *value = find_key(snapshot, key);
+    ck_assert(value != NULL && (uintptr_t)*value == key);
+  }
+  // With the map gone, the snapshot owns everything and updates in place
+  for (uint32_t key = 0; key < 1000; key++) {
+    ck_assert(insert_key(snapshot, key, key * 2));
+  }
+  ck_assert((uintptr_t)*find_key(snapshot, 999) == 1998);
+} END_TEST
+
+START_TEST(snapshot_chain) {
+  // Each version is a snapshot of the previous one with one more key
+  PersistentHashMap *versions[100];
+  versions[0] = map;
+  map = NULL;
+  for (int i = 1; i < 100; i++) {
+    versions[i] = PersistentHashMap_snapshot(versions[i - 1]);
+    ck_assert(versions[i] != NULL);
+    ck_assert(insert_key(versions[i], i, i));
+  }
+  for (int i = 0; i < 100; i++) {
+    ck_assert_int_eq(PersistentHashMap_num_elements(versions[i]), i);
+    for (int key = 1; key < 100; key++) {
+      ck_assert((find_key(versions[i], key) != NULL) == (key <= i));
+    }
+  }
+  // Freeing versions out of order leaves the others intact
+  for (int i = 0; i < 100; i += 2) PersistentHashMap_free(versions[i]);
+  for (int i = 1; i < 100; i += 2) {
+    for (int key = 1; key < 100; key++) {
+      ck_assert((find_key(versions[i], key) != NULL) == (key <= i));
+    }
+    PersistentHashMap_free(versions[i]);
+  }
+} END_TEST
+
+// value_free test cases
+START_TEST(values_freed_with_map) {
+  PersistentHashMap_free(map);
+  map = NULL;
+  ck_assert_int_eq(values_freed, NUM_KEYS);
+} END_TEST
+
+START_TEST(values_freed_on_update) {
+  // Without a snapshot, overwritten and removed values are freed right away
+  ck_assert(PersistentHashMap_insert(map, (unsigned char *)"k", 0,
+        new_value(0)));
+  ck_assert(PersistentHashMap_insert(map, (unsigned char *)"k", 0,
+        new_value(1)));
+  ck_assert_int_eq(values_freed, 1);
+  ck_assert(PersistentHashMap_remove(map, (unsigned char *)"k", 0));
+  ck_assert_int_eq(values_freed, 2);
+  // Overwriting a value with itself doesn't free it
+  uint32_t key = 7;
+  const HTValue *value = find_key(map, key);
+  ck_assert(PersistentHashMap_insert(map, (unsigned char *)&key, sizeof(key),
+        *value));
+  ck_assert_int_eq(values_freed, 2);
+  ck_assert(find_counter(map, key) == 7);
+} END_TEST
+
+START_TEST(values_freed_with_last_version) {
+  snapshot = PersistentHashMap_snapshot(map);
+  ck_assert(snapshot != NULL);
+  // The snapshot still holds the old values, so nothing is freed yet
+  for (uint32_t key = 0; key < 100; key++) {
+    ck_assert(PersistentHashMap_insert(map, (unsigned char *)&key,
+          sizeof(key), new_value(key + 1)));
+    ck_assert(remove_key(map, key + 100));
+  }
+  ck_assert_int_eq(values_freed, 0);
+  for (uint32_t key = 0; key < 200; key++) {
+    ck_assert(find_counter(snapshot, key) == key);
+  }
+
+  PersistentHashMap_free(snapshot);
+  snapshot = NULL;
+  ck_assert_int_eq(values_freed, 200);
+  for (uint32_t key = 0; key < 100; key++) {
+    ck_assert(find_counter(map, key) == key + 1);
+  }
+  PersistentHashMap_free(map);
+  map = NULL;
+  ck_assert_int_eq(values_freed, NUM_KEYS + 100);
+} END_TEST
+
+// Allocation test cases
+START_TEST(snapshot_allocs) {
+  if (!alloc_hooks_available()) return;
+  alloc_hooks_start();
+  snapshot = PersistentHashMap_snapshot(map);
+  ck_assert(alloc_hooks_stop() == 1);
+  ck_assert(snapshot != NULL);
+
+  // Updating a map whose nodes are shared copies the path to the key, but no
+  // more, so the number of allocations is bounded by the trie's depth
+  uint32_t key = 5;
+  HTValue value = new_value(6);
+  alloc_hooks_start();
+  ck_assert(PersistentHashMap_insert(map, (unsigned char *)&key, sizeof(key),
+        value));
+  size_t allocs = alloc_hooks_stop();
+  ck_assert(allocs >= 2 && allocs <= 8);
+
+  // Once the snapshot's gone, the map is updated in place
+  PersistentHashMap_free(snapshot);
+  snapshot = NULL;
+  value = new_value(7);
+  alloc_hooks_start();
+  ck_assert(PersistentHashMap_insert(map, (unsigned char *)&key, sizeof(key),
+        value));
+  ck_assert(PersistentHashMap_find(map, (unsigned char *)&key, sizeof(key))
+      != NULL);
+  ck_assert(alloc_hooks_stop() == 0);
+  ck_assert(find_counter(map, key) == 7);
+} END_TEST
+
+// Concurrency test cases
+#define NUM_READERS 4
+#define SNAPSHOTS_PER_READER 200
+// Snapshots handed from the writer to the readers, one slot per reader
+static _Atomic(PersistentHashMap *) handoff[NUM_READERS];
+// check's assertions aren't meant to be used off the main thread, so threads
+// count their errors here instead.
+static atomic_int thread_errors;
+
+// Checks and frees SNAPSHOTS_PER_READER snapshots from its handoff slot. Every
+// snapshot maps each key to itself, or to itself plus the version number.
+static void *reader_thread(void *arg) {
+  int reader = (int)(uintptr_t)arg;
+  for (int i = 0; i < SNAPSHOTS_PER_READER; i++) {
+    PersistentHashMap *snap;
+    while ((snap = atomic_exchange(&handoff[reader], NULL)) == NULL) {
+      sched_yield();
+    }
+    for (uint32_t key = 0; key < 1000; key++) {
+      const HTValue *value = find_key(snap, key);
+      if (value == NULL || ((uintptr_t)*value - key) % 1000 != 0) {
+        atomic_fetch_add(&thread_errors, 1);
+      }
+    }
+    PersistentHashMap_free(snap);
+  }
+  return NULL;
+}
+
+START_TEST(snapshots_across_threads) {
+  atomic_store(&thread_errors, 0);
+  for (uint32_t key = 0; key < 1000; key++) {
+    ck_assert(insert_key(map, key, key));
+  }
+  pthread_t readers[NUM_READERS];
+  for (int i = 0; i < NUM_READERS; i++) {
+    atomic_store(&handoff[i], NULL);
+    ck_assert(pthread_create(&readers[i], NULL, &reader_thread,
+          (void *)(uintptr_t)i) == 0);
+  }
+
+  // Keep updating the map while readers check and free snapshots of it, so
+  // that nodes are released by readers while the writer decides whether it
+  // can update them in place
+  for (int version = 1; version <= SNAPSHOTS_PER_READER; version++) {
+    for (int i = 0; i < NUM_READERS; i++) {
+      PersistentHashMap *snap = PersistentHashMap_snapshot(map);
+      ck_assert(snap != NULL);
+      while (atomic_load(&handoff[i]) != NULL) sched_yield();
+      atomic_store(&handoff[i], snap);
+    }
+    for (uint32_t key = version % 10; key < 1000; key += 10) {
+      ck_assert(insert_key(map, key, key + version * 1000));
+    }
+  }
+  for (int i = 0; i < NUM_READERS; i++) pthread_join(readers[i], NULL);
+  ck_assert_int_eq(atomic_load(&thread_errors), 0);
+} END_TEST
+
+Suite *persistent_hash_map_tests() {
+  Suite *s = suite_create("PersistentHashMap");
+
+  TCase *tc_bogus = tcase_create("bogus input");
+  tcase_add_checked_fixture(tc_bogus, &phm_setup, &phm_teardown);
+  tcase_add_test(tc_bogus, allocate_invalid_hash_fn);
+  tcase_add_test(tc_bogus, null_args);
+  suite_add_tcase(s, tc_bogus);
+
+  TCase *tc_entry = tcase_create("entry manipulation");
+  tcase_add_checked_fixture(tc_entry, &phm_setup, &phm_teardown);
+  tcase_add_test(tc_entry, insert_find);
+  tcase_add_test(tc_entry, remove);
+  tcase_add_test(tc_entry, many_keys);
+  tcase_add_test(tc_entry, long_keys);
+  suite_add_tcase(s, tc_entry);
+
+  TCase *tc_snapshot = tcase_create("snapshots");
+  tcase_add_checked_fixture(tc_snapshot, &phm_setup, &phm_teardown);
+  tcase_add_test(tc_snapshot, snapshot_empty);
+  tcase_add_test(tc_snapshot, snapshot_isolation);
+  tcase_add_test(tc_snapshot, snapshot_outlives_map);
+  tcase_add_test(tc_snapshot, snapshot_chain);
+  suite_add_tcase(s, tc_snapshot);
+
+  TCase *tc_values = tcase_create("freeing values");
+  tcase_add_checked_fixture(tc_values, &counters_setup, &phm_teardown);
+  tcase_add_test(tc_values, values_freed_with_map);
+  tcase_add_test(tc_values, values_freed_on_update);
+  tcase_add_test(tc_values, values_freed_with_last_version);
+  tcase_add_test(tc_values, snapshot_allocs);
+  suite_add_tcase(s, tc_values);
+
+  TCase *tc_concurrent = tcase_create("concurrency");
+  tcase_add_checked_fixture(tc_concurrent, &phm_setup, &phm_teardown);
+  tcase_add_test(tc_concurrent, snapshots_across_threads);
+  suite_add_tcase(s, tc_concurrent);
+
+  return s;
+}
@@ -0,0 +1,234 @@
+/* Provides tests for `sharded_hash_table.c`
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "test_sharded_hash_table.h"
+
+#include <check.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "sharded_hash_table.h"
+
+#define NUM_SHARDS 4
+
+// Helper variables
+static ShardedHashTable *sht;
+
+static void sht_setup() {
+  sht = ShardedHashTable_allocate(NUM_SHARDS);
+  ck_assert(sht != NULL);
+}
+static void sht_teardown() {
+  ShardedHashTable_free(sht);
+}
+
+static bool add_key(int shard, uint32_t key, int64_t delta) {
+  return ShardedHashTable_add(sht, shard, (unsigned char *)&key, sizeof(key),
+      delta);
+}
+static int64_t get_key(uint32_t key) {
+  return ShardedHashTable_get(sht, (unsigned char *)&key, sizeof(key));
+}
+static int64_t get_merged_key(uint32_t key) {
+  return ShardedHashTable_get_merged(sht, (unsigned char *)&key, sizeof(key));
+}
+
+// Bogus input test cases
+START_TEST(allocate_invalid) {
+  ck_assert(ShardedHashTable_allocate(0) == NULL);
+  ck_assert(ShardedHashTable_allocate(-1) == NULL);
+} END_TEST
+
+START_TEST(null_args) {
+  unsigned char *key = (unsigned char *)"key";
+  ShardedHashTable_free(NULL);
+  ck_assert_int_eq(ShardedHashTable_num_shards(NULL), -1);
+  ck_assert(!ShardedHashTable_add(NULL, 0, key, 0, 1));
+  ck_assert(!ShardedHashTable_add(sht, 0, NULL, 0, 1));
+  ck_assert(!ShardedHashTable_add(sht, -1, key, 0, 1));
+  ck_assert(!ShardedHashTable_add(sht, NUM_SHARDS, key, 0, 1));
+  ck_assert(ShardedHashTable_get(NULL, key, 0) == 0);
+  ck_assert(ShardedHashTable_get(sht, NULL, 0) == 0);
+  ck_assert(ShardedHashTable_get(sht, key, 0) == 0);
+  ck_assert(ShardedHashTable_get_merged(NULL, key, 0) == 0);
+  ck_assert(ShardedHashTable_get_merged(sht, NULL, 0) == 0);
+  ck_assert(!ShardedHashTable_merge(NULL));
+} END_TEST
+
+// Counter test cases
+START_TEST(num_shards) {
+  ck_assert_int_eq(ShardedHashTable_num_shards(sht), NUM_SHARDS);
+} END_TEST
+
+START_TEST(add_get) {
+  unsigned char *key = (unsigned char *)"client-42";
+  ck_assert(ShardedHashTable_add(sht, 0, key, 0, 5));
+  ck_assert(ShardedHashTable_get(sht, key, 0) == 5);
+  ck_assert(ShardedHashTable_add(sht, 0, key, 0, 2));
+  ck_assert(ShardedHashTable_get(sht, key, 0) == 7);
+  // The NUL terminator isn't part of the key
+  ck_assert(ShardedHashTable_get(sht, key, 9) == 7);
+  ck_assert(ShardedHashTable_get(sht, key, 10) == 0);
+} END_TEST
+
+START_TEST(add_across_shards) {
+  for (int shard = 0; shard < NUM_SHARDS; shard++) {
+    for (uint32_t key = 0; key < 100; key++) {
+      ck_assert(add_key(shard, key, key * (shard + 1)));
+    }
+  }
+  // Each key was added to with 1 + 2 + ... + NUM_SHARDS times itself
+  int64_t multiple = NUM_SHARDS * (NUM_SHARDS + 1) / 2;
+  for (uint32_t key = 0; key < 100; key++) {
+    ck_assert(get_key(key) == key * multiple);
+  }
+  ck_assert(get_key(100) == 0);
+} END_TEST
+
+START_TEST(negative_deltas) {
+  ck_assert(add_key(0, 1, 10));
+  ck_assert(add_key(1, 1, -25));
+  ck_assert(get_key(1) == -15);
+  ck_assert(add_key(2, 2, INT64_MAX));
+  ck_assert(add_key(3, 2, INT64_MIN));
+  ck_assert(get_key(2) == -1);
+} END_TEST
+
+START_TEST(merge) {
+  for (int shard = 0; shard < NUM_SHARDS; shard++) {
+    for (uint32_t key = 0; key < 1000; key++) {
+      ck_assert(add_key(shard, key, 1));
+    }
+  }
+  ck_assert(get_merged_key(0) == 0);
+  ck_assert(ShardedHashTable_merge(sht));
+  for (uint32_t key = 0; key < 1000; key++) {
+    ck_assert(get_merged_key(key) == NUM_SHARDS);
+    ck_assert(get_key(key) == NUM_SHARDS);
+  }
+
+  // Counts after a merge add to the merged ones, but only show up in
+  // get_merged after the next merge
+  ck_assert(add_key(1, 7, 100));
+  ck_assert(get_key(7) == NUM_SHARDS + 100);
+  ck_assert(get_merged_key(7) == NUM_SHARDS);
+  ck_assert(ShardedHashTable_merge(sht));
+  ck_assert(get_merged_key(7) == NUM_SHARDS + 100);
+  ck_assert(get_key(7) == NUM_SHARDS + 100);
+
+  // Merging with nothing new changes nothing
+  ck_assert(ShardedHashTable_merge(sht));
+  ck_assert(get_merged_key(7) == NUM_SHARDS + 100);
+  ck_assert(get_merged_key(8) == NUM_SHARDS);
+} END_TEST
+
+// Concurrency test cases
+#define ADDS_PER_WRITER 200000
+#define NUM_KEYS 64
+static atomic_bool writers_done;
+// check's assertions aren't meant to be used off the main thread, so threads
+// count their errors here instead.
+static atomic_int thread_errors;
+
+// Adds 1 to key (i % NUM_KEYS) for i in [0, ADDS_PER_WRITER), in the shard
+// passed as arg.
+static void *writer_thread(void *arg) {
+  int shard = (int)(uintptr_t)arg;
+  for (uint32_t i = 0; i < ADDS_PER_WRITER; i++) {
+    if (!add_key(shard, i % NUM_KEYS, 1)) {
+      atomic_fetch_add(&thread_errors, 1);
+    }
+  }
+  return NULL;
+}
+
+// Merges and reads until the writers are done, checking that counts never
+// go down.
+static void *merger_thread(void *arg) {
+  (void)arg;
+  int64_t last[NUM_KEYS] = {0};
+  int64_t last_merged[NUM_KEYS] = {0};
+  while (!atomic_load(&writers_done)) {
+    if (!ShardedHashTable_merge(sht)) atomic_fetch_add(&thread_errors, 1);
+    for (uint32_t key = 0; key < NUM_KEYS; key++) {
+      int64_t merged = get_merged_key(key);
+      int64_t total = get_key(key);
+      if (merged < last_merged[key] || total < last[key] || total < merged) {
+        atomic_fetch_add(&thread_errors, 1);
+      }
+      last_merged[key] = merged;
+      last[key] = total;
+    }
+  }
+  return NULL;
+}
+
+START_TEST(writers_and_merger) {
+  atomic_store(&writers_done, false);
+  atomic_store(&thread_errors, 0);
+  pthread_t writers[NUM_SHARDS];
+  pthread_t merger;
+  for (int i = 0; i < NUM_SHARDS; i++) {
+    ck_assert(pthread_create(&writers[i], NULL, &writer_thread,
+          (void *)(uintptr_t)i) == 0);
+  }
+  ck_assert(pthread_create(&merger, NULL, &merger_thread, NULL) == 0);
+  for (int i = 0; i < NUM_SHARDS; i++) pthread_join(writers[i], NULL);
+  atomic_store(&writers_done, true);
+  pthread_join(merger, NULL);
+  ck_assert_int_eq(atomic_load(&thread_errors), 0);
+
+  int64_t expected = (int64_t)NUM_SHARDS * ADDS_PER_WRITER / NUM_KEYS;
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    ck_assert(get_key(key) == expected);
+  }
+  ck_assert(ShardedHashTable_merge(sht));
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    ck_assert(get_merged_key(key) == expected);
+  }
+} END_TEST
+
+Suite *sharded_hash_table_tests() {
+  Suite *s = suite_create("ShardedHashTable");
+
+  TCase *tc_bogus = tcase_create("bogus input");
+  tcase_add_checked_fixture(tc_bogus, &sht_setup, &sht_teardown);
+  tcase_add_test(tc_bogus, allocate_invalid);
+  tcase_add_test(tc_bogus, null_args);
+  suite_add_tcase(s, tc_bogus);
+
+  TCase *tc_counter = tcase_create("counters");
+  tcase_add_checked_fixture(tc_counter, &sht_setup, &sht_teardown);
+  tcase_add_test(tc_counter, num_shards);
+  tcase_add_test(tc_counter, add_get);
+  tcase_add_test(tc_counter, add_across_shards);
+  tcase_add_test(tc_counter, negative_deltas);
+  tcase_add_test(tc_counter, merge);
+  suite_add_tcase(s, tc_counter);
+
+  TCase *tc_concurrent = tcase_create("concurrency");
+  tcase_add_checked_fixture(tc_concurrent, &sht_setup, &sht_teardown);
+  tcase_add_test(tc_concurrent, writers_and_merger);
+  suite_add_tcase(s, tc_concurrent);
+
+  return s;
+}
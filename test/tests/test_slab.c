@@ -0,0 +1,259 @@
+/* Provides tests for `slab.c`
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "test_slab.h"
+
+#include <check.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc_hooks.h"
+#include "slab.h"
+
+// Enough objects to need several chunks, and to overflow the per-thread free
+// lists many times over.
+#define NUM_OBJECTS 10000
+#define OBJ_SIZE 40
+
+// Helper variables
+static Slab *slab;
+static unsigned char *objs[NUM_OBJECTS];
+
+void slab_setup() {
+  slab = Slab_allocate(OBJ_SIZE);
+  ck_assert(slab != NULL);
+}
+void slab_teardown() {
+  Slab_free(slab);
+}
+
+// Allocates NUM_OBJECTS objects into `objs`, filling each one with its index.
+static void alloc_all() {
+  for (int i = 0; i < NUM_OBJECTS; i++) {
+    objs[i] = Slab_alloc_object(slab);
+    ck_assert(objs[i] != NULL);
+    memset(objs[i], i & 0xFF, OBJ_SIZE);
+  }
+}
+
+// Bogus input test cases
+START_TEST(allocate_zero_size) {
+  ck_assert(Slab_allocate(0) == NULL);
+  ck_assert(Slab_allocate(SIZE_MAX) == NULL);
+} END_TEST
+
+START_TEST(free_null) {
+  Slab_free(NULL);
+} END_TEST
+
+START_TEST(object_size_null) {
+  ck_assert(Slab_object_size(NULL) == 0);
+} END_TEST
+
+START_TEST(alloc_object_null) {
+  ck_assert(Slab_alloc_object(NULL) == NULL);
+} END_TEST
+
+START_TEST(free_object_null) {
+  void *obj = Slab_alloc_object(slab);
+  ck_assert(obj != NULL);
+  Slab_free_object(NULL, obj);
+  Slab_free_object(slab, NULL);
+  Slab_free_chain(NULL, obj, obj, 1);
+  Slab_free_chain(slab, NULL, NULL, 1);
+  Slab_free_chain(slab, obj, obj, 0);
+} END_TEST
+
+// Object handling test cases
+START_TEST(object_size) {
+  ck_assert(Slab_object_size(slab) >= OBJ_SIZE);
+  ck_assert(Slab_object_size(slab) % alignof(max_align_t) == 0);
+} END_TEST
+
+START_TEST(objects_distinct) {
+  alloc_all();
+  // Each object still holds what was written to it, so none of them overlap
+  for (int i = 0; i < NUM_OBJECTS; i++) {
+    ck_assert((uintptr_t)objs[i] % alignof(max_align_t) == 0);
+    for (int j = 0; j < OBJ_SIZE; j++) ck_assert(objs[i][j] == (i & 0xFF));
+  }
+} END_TEST
+
+START_TEST(objects_aligned) {
+  Slab *line_slab = Slab_allocate(64);
+  ck_assert(line_slab != NULL);
+  for (int i = 0; i < 1000; i++) {
+    void *obj = Slab_alloc_object(line_slab);
+    ck_assert(obj != NULL);
+    ck_assert((uintptr_t)obj % 64 == 0);
+  }
+  Slab_free(line_slab);
+} END_TEST
+
+START_TEST(objects_reused) {
+  alloc_all();
+  for (int i = 0; i < NUM_OBJECTS; i++) Slab_free_object(slab, objs[i]);
+
+  // Once everything has been freed, allocating the same number of objects
+  // again shouldn't need any more memory.
+  if (alloc_hooks_available()) alloc_hooks_start();
+  alloc_all();
+  if (alloc_hooks_available()) ck_assert(alloc_hooks_stop() == 0);
+} END_TEST
+
+START_TEST(free_chain) {
+  alloc_all();
+  // Link up the first and second halves and free each of them at once
+  for (int i = 0; i < NUM_OBJECTS - 1; i++) {
+    memcpy(objs[i], &objs[i + 1], sizeof(void *));
+  }
+  Slab_free_chain(slab, objs[0], objs[NUM_OBJECTS / 2 - 1], NUM_OBJECTS / 2);
+  Slab_free_chain(slab, objs[NUM_OBJECTS / 2], objs[NUM_OBJECTS - 1],
+      NUM_OBJECTS / 2);
+
+  if (alloc_hooks_available()) alloc_hooks_start();
+  alloc_all();
+  if (alloc_hooks_available()) ck_assert(alloc_hooks_stop() == 0);
+} END_TEST
+
+// Concurrency test cases
+#define NUM_THREADS 4
+
+// Each thread repeatedly allocates a batch of objects, checks that nobody
+// else wrote to them, and frees half of them. The other half is handed to the
+// next thread, which frees them itself, so objects regularly move between
+// threads.
+#define BATCH 100
+
+typedef struct {
+  unsigned char *objs[BATCH / 2];
+  int sender;  // Whatever the objects were filled with
+  pthread_mutex_t lock;
+} Mailbox;
+
+typedef struct {
+  int id;
+  Mailbox *inbox;
+  Mailbox *outbox;
+  bool ok;
+} Worker;
+
+// Frees everything in `box`, checking that it's still what was sent.
+static void empty_mailbox(Mailbox *box, bool *ok) {
+  for (int i = 0; i < BATCH / 2; i++) {
+    if (box->objs[i] == NULL) continue;
+    for (int j = 0; j < OBJ_SIZE; j++) {
+      if (box->objs[i][j] != box->sender) *ok = false;
+    }
+    Slab_free_object(slab, box->objs[i]);
+    box->objs[i] = NULL;
+  }
+}
+
+static void *slab_worker(void *arg) {
+  Worker *w = arg;
+  unsigned char *batch[BATCH];
+  for (int round = 0; round < 200; round++) {
+    for (int i = 0; i < BATCH; i++) {
+      batch[i] = Slab_alloc_object(slab);
+      if (batch[i] == NULL) {
+        w->ok = false;
+        return NULL;
+      }
+      memset(batch[i], w->id, OBJ_SIZE);
+    }
+    for (int i = 0; i < BATCH; i++) {
+      for (int j = 0; j < OBJ_SIZE; j++) {
+        if (batch[i][j] != w->id) w->ok = false;
+      }
+    }
+    for (int i = 0; i < BATCH / 2; i++) Slab_free_object(slab, batch[i]);
+
+    pthread_mutex_lock(&w->inbox->lock);
+    empty_mailbox(w->inbox, &w->ok);
+    pthread_mutex_unlock(&w->inbox->lock);
+
+    // If the next thread hasn't gotten to the last batch yet, take it back
+    pthread_mutex_lock(&w->outbox->lock);
+    empty_mailbox(w->outbox, &w->ok);
+    memcpy(w->outbox->objs, &batch[BATCH / 2], sizeof(w->outbox->objs));
+    pthread_mutex_unlock(&w->outbox->lock);
+  }
+  return NULL;
+}
+
+START_TEST(threads_share_slab) {
+  pthread_t threads[NUM_THREADS];
+  Worker workers[NUM_THREADS];
+  Mailbox mailboxes[NUM_THREADS];
+  for (int i = 0; i < NUM_THREADS; i++) {
+    memset(mailboxes[i].objs, 0, sizeof(mailboxes[i].objs));
+    mailboxes[i].sender = i + 1;
+    pthread_mutex_init(&mailboxes[i].lock, NULL);
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    workers[i].id = i + 1;
+    workers[i].inbox = &mailboxes[(i + NUM_THREADS - 1) % NUM_THREADS];
+    workers[i].outbox = &mailboxes[i];
+    workers[i].ok = true;
+    ck_assert(pthread_create(&threads[i], NULL, &slab_worker,
+          &workers[i]) == 0);
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+    ck_assert(workers[i].ok);
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    pthread_mutex_destroy(&mailboxes[i].lock);
+  }
+} END_TEST
+
+Suite *slab_tests() {
+  Suite *s = suite_create("Slab");
+
+  TCase *tc_bogus = tcase_create("bogus input");
+  tcase_add_checked_fixture(tc_bogus, &slab_setup, &slab_teardown);
+  tcase_add_test(tc_bogus, allocate_zero_size);
+  tcase_add_test(tc_bogus, free_null);
+  tcase_add_test(tc_bogus, object_size_null);
+  tcase_add_test(tc_bogus, alloc_object_null);
+  tcase_add_test(tc_bogus, free_object_null);
+  suite_add_tcase(s, tc_bogus);
+
+  TCase *tc_objects = tcase_create("objects");
+  tcase_add_checked_fixture(tc_objects, &slab_setup, &slab_teardown);
+  tcase_add_test(tc_objects, object_size);
+  tcase_add_test(tc_objects, objects_distinct);
+  tcase_add_test(tc_objects, objects_aligned);
+  tcase_add_test(tc_objects, objects_reused);
+  tcase_add_test(tc_objects, free_chain);
+  suite_add_tcase(s, tc_objects);
+
+  TCase *tc_concurrent = tcase_create("concurrency");
+  tcase_add_checked_fixture(tc_concurrent, &slab_setup, &slab_teardown);
+  tcase_add_test(tc_concurrent, threads_share_slab);
+  suite_add_tcase(s, tc_concurrent);
+
+  return s;
+}
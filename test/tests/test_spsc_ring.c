@@ -0,0 +1,421 @@
+/* Provides tests for `spsc_ring.c`
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _XOPEN_SOURCE 700
+
+#include "test_spsc_ring.h"
+
+#include <check.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "alloc_hooks.h"
+#include "spsc_ring.h"
+
+#define CAPACITY 16
+#define NUM_TRANSFERS 200000
+#define NUM_WAKEUPS 200
+
+// Helper variables
+static SPSCRing *ring;
+static int num_freed;
+
+// Helper functions
+static void count_free(SPSCRingPayload payload) {
+  (void)payload;
+  num_freed++;
+}
+
+static void common_setup() {
+  ring = SPSCRing_allocate(CAPACITY, false);
+  ck_assert(ring != NULL);
+  num_freed = 0;
+}
+static void common_teardown() {
+  SPSCRing_free(ring, NULL);
+}
+
+// Bogus input test cases
+static void bogus_input_setup() {
+  common_setup();
+}
+static void bogus_input_teardown() {
+  common_teardown();
+}
+
+START_TEST(free_null) {
+  // Segfaults on failure
+  SPSCRing_free(NULL, NULL);
+  SPSCRing_free(NULL, &count_free);
+} END_TEST
+
+START_TEST(allocate_bad_capacity) {
+  ck_assert(SPSCRing_allocate(0, false) == NULL);
+  ck_assert(SPSCRing_allocate(SIZE_MAX, false) == NULL);
+  ck_assert(SPSCRing_allocate(SIZE_MAX / 2, false) == NULL);
+} END_TEST
+
+START_TEST(push_null) {
+  SPSCRingPayload payloads[1] = {(void *)1};
+  ck_assert(!SPSCRing_push(NULL, (void *)1));
+  ck_assert_int_eq(SPSCRing_push_many(NULL, payloads, 1), 0);
+  ck_assert_int_eq(SPSCRing_push_many(ring, NULL, 1), 0);
+  ck_assert_int_eq(SPSCRing_push_many(ring, payloads, 0), 0);
+  ck_assert_int_eq(SPSCRing_capacity(NULL), 0);
+} END_TEST
+
+START_TEST(pop_null) {
+  SPSCRingPayload out = NULL;
+  SPSCRingPayload payloads[1];
+  ck_assert(!SPSCRing_pop(NULL, &out));
+  ck_assert_int_eq(SPSCRing_pop_many(NULL, payloads, 1), 0);
+  ck_assert(out == NULL);
+
+  ck_assert(SPSCRing_push(ring, (void *)1));
+  ck_assert(!SPSCRing_pop(ring, NULL));
+  ck_assert_int_eq(SPSCRing_pop_many(ring, NULL, 1), 0);
+  ck_assert_int_eq(SPSCRing_pop_many(ring, payloads, 0), 0);
+  ck_assert(SPSCRing_pop(ring, &out));
+  ck_assert(out == (void *)1);
+} END_TEST
+
+START_TEST(pop_empty) {
+  SPSCRingPayload out = NULL;
+  SPSCRingPayload payloads[1];
+  ck_assert(!SPSCRing_pop(ring, &out));
+  ck_assert_int_eq(SPSCRing_pop_many(ring, payloads, 1), 0);
+  ck_assert(out == NULL);
+} END_TEST
+
+START_TEST(wait_without_wakeup) {
+  ck_assert(!SPSCRing_wait(NULL, 0));
+  // Even when there's something to wait for, since the ring can't be waited on
+  SPSCRing_push(ring, (void *)1);
+  ck_assert(!SPSCRing_wait(ring, 0));
+} END_TEST
+
+// Single threaded test cases
+static void single_thread_setup() {
+  common_setup();
+}
+static void single_thread_teardown() {
+  common_teardown();
+}
+
+START_TEST(capacity) {
+  ck_assert_int_eq(SPSCRing_capacity(ring), CAPACITY);
+  size_t sizes[][2] = {{1, 1}, {2, 2}, {3, 4}, {5, 8}, {1000, 1024}};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    SPSCRing *r = SPSCRing_allocate(sizes[i][0], false);
+    ck_assert(r != NULL);
+    ck_assert_int_eq(SPSCRing_capacity(r), sizes[i][1]);
+    SPSCRing_free(r, NULL);
+  }
+} END_TEST
+
+START_TEST(fifo) {
+  for (uintptr_t i = 1; i <= CAPACITY; i++) {
+    ck_assert(SPSCRing_push(ring, (void *)i));
+  }
+  SPSCRingPayload out;
+  for (uintptr_t i = 1; i <= CAPACITY; i++) {
+    ck_assert(SPSCRing_pop(ring, &out));
+    ck_assert(out == (void *)i);
+  }
+  ck_assert(!SPSCRing_pop(ring, &out));
+} END_TEST
+
+START_TEST(full) {
+  for (uintptr_t i = 1; i <= CAPACITY; i++) {
+    ck_assert(SPSCRing_push(ring, (void *)i));
+  }
+  ck_assert(!SPSCRing_push(ring, (void *)0));
+  SPSCRingPayload payloads[1] = {(void *)0};
+  ck_assert_int_eq(SPSCRing_push_many(ring, payloads, 1), 0);
+
+  // Freeing a slot makes room for exactly one more
+  SPSCRingPayload out;
+  ck_assert(SPSCRing_pop(ring, &out));
+  ck_assert(out == (void *)1);
+  ck_assert(SPSCRing_push(ring, (void *)(CAPACITY + 1)));
+  ck_assert(!SPSCRing_push(ring, (void *)0));
+  for (uintptr_t i = 2; i <= CAPACITY + 1; i++) {
+    ck_assert(SPSCRing_pop(ring, &out));
+    ck_assert(out == (void *)i);
+  }
+} END_TEST
+
+START_TEST(wrap_around) {
+  // Pushing and popping one at a time goes around the ring many times
+  SPSCRingPayload out;
+  for (uintptr_t i = 1; i <= CAPACITY * 10; i++) {
+    ck_assert(SPSCRing_push(ring, (void *)i));
+    if (i > 3) {
+      ck_assert(SPSCRing_pop(ring, &out));
+      ck_assert(out == (void *)(i - 3));
+    }
+  }
+} END_TEST
+
+START_TEST(batches) {
+  // Batches of every size up to the capacity, starting at every offset, so
+  // that some of them are split where the slots wrap around
+  SPSCRingPayload in[CAPACITY], out[CAPACITY];
+  uintptr_t next_in = 1, next_out = 1;
+  for (size_t num = 1; num <= CAPACITY; num++) {
+    for (size_t offset = 0; offset < CAPACITY; offset++) {
+      for (size_t i = 0; i < num; i++) in[i] = (void *)(next_in + i);
+      ck_assert_int_eq(SPSCRing_push_many(ring, in, num), num);
+      next_in += num;
+      ck_assert_int_eq(SPSCRing_pop_many(ring, out, CAPACITY), num);
+      for (size_t i = 0; i < num; i++) {
+        ck_assert(out[i] == (void *)next_out++);
+      }
+      // Moves the starting offset along by one
+      ck_assert(SPSCRing_push(ring, (void *)next_in++));
+      ck_assert(SPSCRing_pop(ring, &out[0]));
+      ck_assert(out[0] == (void *)next_out++);
+    }
+  }
+} END_TEST
+
+START_TEST(partial_batches) {
+  SPSCRingPayload in[CAPACITY + 4], out[CAPACITY + 4];
+  for (uintptr_t i = 0; i < CAPACITY + 4; i++) in[i] = (void *)(i + 1);
+
+  // Only as much as fits is pushed...
+  ck_assert_int_eq(SPSCRing_push_many(ring, in, 5), 5);
+  ck_assert_int_eq(SPSCRing_push_many(ring, in + 5, CAPACITY), CAPACITY - 5);
+  ck_assert_int_eq(SPSCRing_push_many(ring, in + CAPACITY, 4), 0);
+
+  // ...and only as much as there is is popped
+  ck_assert_int_eq(SPSCRing_pop_many(ring, out, 3), 3);
+  ck_assert_int_eq(SPSCRing_pop_many(ring, out + 3, CAPACITY + 4),
+      CAPACITY - 3);
+  for (size_t i = 0; i < CAPACITY; i++) ck_assert(out[i] == in[i]);
+  ck_assert_int_eq(SPSCRing_pop_many(ring, out, CAPACITY), 0);
+} END_TEST
+
+START_TEST(free_payloads) {
+  SPSCRing *r = SPSCRing_allocate(4, false);
+  ck_assert(r != NULL);
+  SPSCRingPayload out;
+  for (uintptr_t i = 1; i <= 3; i++) SPSCRing_push(r, (void *)i);
+  SPSCRing_pop(r, &out);
+  for (uintptr_t i = 4; i <= 5; i++) SPSCRing_push(r, (void *)i);
+  // Holds 2 through 5, wrapped around
+  SPSCRing_free(r, &count_free);
+  ck_assert_int_eq(num_freed, 4);
+} END_TEST
+
+START_TEST(no_allocations) {
+  if (!alloc_hooks_available()) return;
+
+  SPSCRingPayload payloads[CAPACITY] = {0};
+  SPSCRingPayload out;
+  alloc_hooks_start();
+  for (uintptr_t i = 1; i <= CAPACITY / 2; i++) {
+    SPSCRing_push(ring, (void *)i);
+  }
+  SPSCRing_push_many(ring, payloads, CAPACITY / 2);
+  SPSCRing_pop(ring, &out);
+  SPSCRing_pop_many(ring, payloads, CAPACITY);
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Ring operations made %zu allocations", allocs);
+} END_TEST
+
+// Wakeup test cases
+static void wakeup_setup() {
+  ring = SPSCRing_allocate(CAPACITY, true);
+  ck_assert(ring != NULL);
+}
+static void wakeup_teardown() {
+  SPSCRing_free(ring, NULL);
+}
+
+START_TEST(wait_nonempty) {
+  SPSCRing_push(ring, (void *)1);
+  ck_assert(SPSCRing_wait(ring, 0));
+  ck_assert(SPSCRing_wait(ring, -1));
+  SPSCRingPayload out;
+  ck_assert(SPSCRing_pop(ring, &out));
+  ck_assert(!SPSCRing_wait(ring, 0));
+} END_TEST
+
+START_TEST(wait_timeout) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  ck_assert(!SPSCRing_wait(ring, 20));
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  long elapsed_ms = (end.tv_sec - start.tv_sec) * 1000
+    + (end.tv_nsec - start.tv_nsec) / 1000000;
+  ck_assert_msg(elapsed_ms >= 19, "Only waited %ld ms", elapsed_ms);
+
+  // A push made while nobody was waiting doesn't leave the ring unable to
+  // time out later
+  SPSCRing_push(ring, (void *)1);
+  SPSCRingPayload out;
+  SPSCRing_pop(ring, &out);
+  ck_assert(!SPSCRing_wait(ring, 1));
+} END_TEST
+
+// Multithreaded test cases
+static void *produce(void *arg) {
+  size_t batch = (size_t)(uintptr_t)arg;
+  SPSCRingPayload payloads[CAPACITY];
+  uintptr_t next = 1;
+  while (next <= NUM_TRANSFERS) {
+    size_t num = 0;
+    while (num < batch && next + num <= NUM_TRANSFERS) {
+      payloads[num] = (void *)(next + num);
+      num++;
+    }
+    size_t pushed = batch == 1
+      ? (SPSCRing_push(ring, payloads[0]) ? 1 : 0)
+      : SPSCRing_push_many(ring, payloads, num);
+    if (pushed == 0) sched_yield();
+    next += pushed;
+  }
+  return NULL;
+}
+
+// Receives every payload `produce` pushes, checking that they arrive in order.
+// Waits on the ring when it's empty if `wait` is true.
+static void consume(size_t batch, bool wait) {
+  SPSCRingPayload payloads[CAPACITY];
+  uintptr_t next = 1;
+  while (next <= NUM_TRANSFERS) {
+    size_t num = batch == 1
+      ? (SPSCRing_pop(ring, &payloads[0]) ? 1 : 0)
+      : SPSCRing_pop_many(ring, payloads, batch);
+    if (num == 0) {
+      if (wait) {
+        ck_assert(SPSCRing_wait(ring, -1));
+      } else {
+        sched_yield();
+      }
+    }
+    for (size_t i = 0; i < num; i++) {
+      ck_assert(payloads[i] == (void *)next++);
+    }
+  }
+}
+
+static void threaded_setup() {
+  ring = SPSCRing_allocate(CAPACITY, true);
+  ck_assert(ring != NULL);
+}
+static void threaded_teardown() {
+  SPSCRingPayload out;
+  ck_assert(!SPSCRing_pop(ring, &out));
+  SPSCRing_free(ring, NULL);
+}
+
+START_TEST(transfer_one_at_a_time) {
+  pthread_t producer;
+  ck_assert(pthread_create(&producer, NULL, &produce, (void *)1) == 0);
+  consume(1, false);
+  pthread_join(producer, NULL);
+} END_TEST
+
+START_TEST(transfer_batches) {
+  pthread_t producer;
+  ck_assert(pthread_create(&producer, NULL, &produce, (void *)5) == 0);
+  consume(7, false);
+  pthread_join(producer, NULL);
+} END_TEST
+
+START_TEST(transfer_waiting) {
+  pthread_t producer;
+  ck_assert(pthread_create(&producer, NULL, &produce, (void *)3) == 0);
+  consume(CAPACITY, true);
+  pthread_join(producer, NULL);
+} END_TEST
+
+static void *produce_slowly(void *arg) {
+  (void)arg;
+  struct timespec delay = {.tv_sec = 0, .tv_nsec = 100000};
+  for (uintptr_t i = 1; i <= NUM_WAKEUPS; i++) {
+    nanosleep(&delay, NULL);
+    SPSCRing_push(ring, (void *)i);
+  }
+  return NULL;
+}
+
+START_TEST(wakeups) {
+  // The consumer goes to sleep before nearly every push, so each one has to
+  // wake it up. A lost wakeup hangs the test.
+  pthread_t producer;
+  ck_assert(pthread_create(&producer, NULL, &produce_slowly, NULL) == 0);
+  SPSCRingPayload out;
+  for (uintptr_t i = 1; i <= NUM_WAKEUPS; i++) {
+    while (!SPSCRing_pop(ring, &out)) ck_assert(SPSCRing_wait(ring, -1));
+    ck_assert(out == (void *)i);
+  }
+  pthread_join(producer, NULL);
+} END_TEST
+
+Suite *spsc_ring_tests() {
+  Suite *s = suite_create("SPSCRing");
+  TCase *tc_bogus = tcase_create("bogus input");
+  tcase_add_checked_fixture(tc_bogus, &bogus_input_setup,
+      &bogus_input_teardown);
+  tcase_add_test(tc_bogus, free_null);
+  tcase_add_test(tc_bogus, allocate_bad_capacity);
+  tcase_add_test(tc_bogus, push_null);
+  tcase_add_test(tc_bogus, pop_null);
+  tcase_add_test(tc_bogus, pop_empty);
+  tcase_add_test(tc_bogus, wait_without_wakeup);
+  suite_add_tcase(s, tc_bogus);
+
+  TCase *tc_single = tcase_create("single thread");
+  tcase_add_checked_fixture(tc_single, &single_thread_setup,
+      &single_thread_teardown);
+  tcase_add_test(tc_single, capacity);
+  tcase_add_test(tc_single, fifo);
+  tcase_add_test(tc_single, full);
+  tcase_add_test(tc_single, wrap_around);
+  tcase_add_test(tc_single, batches);
+  tcase_add_test(tc_single, partial_batches);
+  tcase_add_test(tc_single, free_payloads);
+  tcase_add_test(tc_single, no_allocations);
+  suite_add_tcase(s, tc_single);
+
+  TCase *tc_wakeup = tcase_create("wakeup");
+  tcase_add_checked_fixture(tc_wakeup, &wakeup_setup, &wakeup_teardown);
+  tcase_add_test(tc_wakeup, wait_nonempty);
+  tcase_add_test(tc_wakeup, wait_timeout);
+  suite_add_tcase(s, tc_wakeup);
+
+  TCase *tc_threaded = tcase_create("threaded");
+  tcase_add_checked_fixture(tc_threaded, &threaded_setup,
+      &threaded_teardown);
+  tcase_add_test(tc_threaded, transfer_one_at_a_time);
+  tcase_add_test(tc_threaded, transfer_batches);
+  tcase_add_test(tc_threaded, transfer_waiting);
+  tcase_add_test(tc_threaded, wakeups);
+  suite_add_tcase(s, tc_threaded);
+
+  return s;
+}
@@ -0,0 +1,317 @@
+/* Provides tests for `ttl_hash_table.c`
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "test_ttl_hash_table.h"
+
+#include <check.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ttl_hash_table.h"
+
+#define START_TIME 1000
+#define NUM_KEYS 5000
+
+// Helper variables
+static TTLHashTable *tt;
+static int num_freed;
+static bool freed[NUM_KEYS];
+
+static void ttl_setup() {
+  tt = TTLHashTable_allocate(START_TIME);
+  ck_assert(tt != NULL);
+  num_freed = 0;
+  memset(freed, 0, sizeof(freed));
+}
+static void ttl_teardown() {
+  TTLHashTable_free(tt, NULL);
+}
+
+// Stands in for a value_free function, recording which values were freed.
+// Values are indices into `freed`.
+static void record_free(HTValue value) {
+  intptr_t i = (intptr_t)value;
+  ck_assert(!freed[i]);
+  freed[i] = true;
+  num_freed++;
+}
+
+static bool insert_key(uint32_t key, uint64_t deadline) {
+  return TTLHashTable_insert(tt, (unsigned char *)&key, sizeof(key),
+      (HTValue)(intptr_t)key, deadline, NULL);
+}
+static HTValue *find_key(uint32_t key) {
+  return TTLHashTable_find(tt, (unsigned char *)&key, sizeof(key), NULL);
+}
+
+// A simple xorshift generator, so that runs are repeatable
+static uint64_t next_rand(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+// Bogus input test cases
+START_TEST(allocate_free) {
+  TTLHashTable_free(NULL, NULL);
+  TTLHashTable_free(NULL, &free);
+  ck_assert_int_eq(TTLHashTable_num_elements(NULL), -1);
+  ck_assert_int_eq(TTLHashTable_num_elements(tt), 0);
+  ck_assert(TTLHashTable_now(NULL) == 0);
+  ck_assert(TTLHashTable_now(tt) == START_TIME);
+} END_TEST
+
+START_TEST(null_args) {
+  unsigned char *key = (unsigned char *)"key";
+  ck_assert(!TTLHashTable_insert(NULL, key, 0, NULL, START_TIME + 1, NULL));
+  ck_assert(!TTLHashTable_insert(tt, NULL, 0, NULL, START_TIME + 1, NULL));
+  ck_assert_int_eq(TTLHashTable_num_elements(tt), 0);
+  ck_assert(TTLHashTable_find(NULL, key, 0, NULL) == NULL);
+  ck_assert(TTLHashTable_find(tt, NULL, 0, NULL) == NULL);
+  ck_assert(!TTLHashTable_set_deadline(NULL, key, 0, START_TIME + 1));
+  ck_assert(!TTLHashTable_set_deadline(tt, NULL, 0, START_TIME + 1));
+  ck_assert(!TTLHashTable_set_deadline(tt, key, 0, START_TIME + 1));
+  ck_assert(!TTLHashTable_remove(NULL, key, 0, NULL));
+  ck_assert(!TTLHashTable_remove(tt, NULL, 0, NULL));
+  ck_assert(!TTLHashTable_remove(tt, key, 0, NULL));
+  ck_assert_int_eq(TTLHashTable_tick(NULL, START_TIME + 1, NULL), -1);
+} END_TEST
+
+// Entry handling test cases
+START_TEST(insert_find) {
+  unsigned char *key = (unsigned char *)"token";
+  int value = 5;
+  ck_assert(!TTLHashTable_insert(tt, key, 0, &value, START_TIME + 10, NULL));
+  ck_assert_int_eq(TTLHashTable_num_elements(tt), 1);
+
+  uint64_t deadline = 0;
+  HTValue *found = TTLHashTable_find(tt, key, 0, &deadline);
+  ck_assert(found != NULL);
+  ck_assert_ptr_eq(*found, &value);
+  ck_assert(deadline == START_TIME + 10);
+  ck_assert(TTLHashTable_find(tt, (unsigned char *)"other", 0, NULL) == NULL);
+
+  // The value can be updated in place
+  int other_value = 6;
+  *found = &other_value;
+  ck_assert_ptr_eq(*TTLHashTable_find(tt, key, 0, NULL), &other_value);
+} END_TEST
+
+START_TEST(insert_overwrite) {
+  unsigned char *key = (unsigned char *)"token";
+  ck_assert(!TTLHashTable_insert(tt, key, 0, (HTValue)1, START_TIME + 10,
+        NULL));
+  HTValue old_value;
+  ck_assert(TTLHashTable_insert(tt, key, 0, (HTValue)2, START_TIME + 20,
+        &old_value));
+  ck_assert(old_value == (HTValue)1);
+  ck_assert_int_eq(TTLHashTable_num_elements(tt), 1);
+
+  // The new deadline replaces the old one
+  ck_assert_int_eq(TTLHashTable_tick(tt, START_TIME + 10, NULL), 0);
+  ck_assert(TTLHashTable_find(tt, key, 0, NULL) != NULL);
+  ck_assert_int_eq(TTLHashTable_tick(tt, START_TIME + 20, NULL), 1);
+  ck_assert(TTLHashTable_find(tt, key, 0, NULL) == NULL);
+} END_TEST
+
+START_TEST(remove) {
+  ck_assert(!insert_key(1, START_TIME + 10));
+  ck_assert(!insert_key(2, START_TIME + 10));
+  uint32_t key = 1;
+  HTValue old_value;
+  ck_assert(TTLHashTable_remove(tt, (unsigned char *)&key, sizeof(key),
+        &old_value));
+  ck_assert(old_value == (HTValue)1);
+  ck_assert(find_key(1) == NULL);
+  ck_assert(!TTLHashTable_remove(tt, (unsigned char *)&key, sizeof(key),
+        NULL));
+
+  // Only the entry that's left expires
+  ck_assert_int_eq(TTLHashTable_tick(tt, START_TIME + 10, &record_free), 1);
+  ck_assert(!freed[1]);
+  ck_assert(freed[2]);
+  ck_assert_int_eq(TTLHashTable_num_elements(tt), 0);
+} END_TEST
+
+// Expiry test cases
+START_TEST(expire_at_deadline) {
+  ck_assert(!insert_key(1, START_TIME + 5));
+  ck_assert_int_eq(TTLHashTable_tick(tt, START_TIME + 4, &record_free), 0);
+  ck_assert(find_key(1) != NULL);
+  ck_assert(TTLHashTable_now(tt) == START_TIME + 4);
+  ck_assert_int_eq(TTLHashTable_tick(tt, START_TIME + 5, &record_free), 1);
+  ck_assert(find_key(1) == NULL);
+  ck_assert(freed[1]);
+  ck_assert_int_eq(TTLHashTable_num_elements(tt), 0);
+} END_TEST
+
+START_TEST(expire_past_deadline) {
+  // Deadlines that have already passed expire at the next tick
+  ck_assert(!insert_key(1, START_TIME));
+  ck_assert(!insert_key(2, 0));
+  uint64_t deadline;
+  uint32_t key = 1;
+  ck_assert(TTLHashTable_find(tt, (unsigned char *)&key, sizeof(key),
+        &deadline) != NULL);
+  ck_assert(deadline == START_TIME + 1);
+  ck_assert_int_eq(TTLHashTable_tick(tt, START_TIME, &record_free), 0);
+  ck_assert_int_eq(TTLHashTable_tick(tt, START_TIME + 1, &record_free), 2);
+} END_TEST
+
+START_TEST(time_goes_forward) {
+  ck_assert(!insert_key(1, START_TIME + 5));
+  ck_assert_int_eq(TTLHashTable_tick(tt, START_TIME - 100, &record_free), 0);
+  ck_assert(TTLHashTable_now(tt) == START_TIME);
+  ck_assert(find_key(1) != NULL);
+} END_TEST
+
+START_TEST(set_deadline) {
+  ck_assert(!insert_key(1, START_TIME + 5));
+  ck_assert(!insert_key(2, START_TIME + 5));
+  uint32_t key = 1;
+  ck_assert(TTLHashTable_set_deadline(tt, (unsigned char *)&key, sizeof(key),
+        START_TIME + 100000));
+  ck_assert_int_eq(TTLHashTable_tick(tt, START_TIME + 5, &record_free), 1);
+  ck_assert(freed[2]);
+  ck_assert(find_key(1) != NULL);
+  ck_assert(*find_key(1) == (HTValue)1);
+
+  // Deadlines can be brought forward too
+  ck_assert(TTLHashTable_set_deadline(tt, (unsigned char *)&key, sizeof(key),
+        START_TIME + 10));
+  ck_assert_int_eq(TTLHashTable_tick(tt, START_TIME + 10, &record_free), 1);
+  ck_assert(freed[1]);
+} END_TEST
+
+START_TEST(expire_all_at_once) {
+  // Deadlines all over the wheel, including some beyond its top level
+  uint64_t rng = 12345;
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    uint64_t ttl = next_rand(&rng) >> (next_rand(&rng) % 64);
+    if (ttl > UINT64_MAX - START_TIME - 1) ttl = UINT64_MAX - START_TIME - 1;
+    ck_assert(!insert_key(key, START_TIME + 1 + ttl));
+  }
+  ck_assert_int_eq(TTLHashTable_tick(tt, UINT64_MAX, &record_free), NUM_KEYS);
+  ck_assert_int_eq(num_freed, NUM_KEYS);
+  ck_assert_int_eq(TTLHashTable_num_elements(tt), 0);
+} END_TEST
+
+// Checks that exactly the entries whose deadline in `deadlines` is after the
+// table's current time are in the table, and that the others have been freed.
+static void check_live(const uint64_t *deadlines, int num_keys) {
+  uint64_t now = TTLHashTable_now(tt);
+  int num_live = 0;
+  for (int key = 0; key < num_keys; key++) {
+    bool live = deadlines[key] > now;
+    ck_assert_msg((find_key(key) != NULL) == live,
+        "key %d with deadline %llu is %s at %llu", key,
+        (unsigned long long)deadlines[key], live ? "missing" : "still there",
+        (unsigned long long)now);
+    ck_assert(freed[key] == !live);
+    num_live += live;
+  }
+  ck_assert_int_eq(TTLHashTable_num_elements(tt), num_live);
+}
+
+START_TEST(expire_in_order) {
+  // Small and huge steps through time should expire exactly the right entries
+  static uint64_t deadlines[NUM_KEYS];
+  uint64_t rng = 67890;
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    uint64_t ttl = 1 + (next_rand(&rng) >> (20 + next_rand(&rng) % 44));
+    deadlines[key] = START_TIME + ttl;
+    ck_assert(!insert_key(key, deadlines[key]));
+  }
+
+  uint64_t now = START_TIME;
+  while (TTLHashTable_num_elements(tt) > 0) {
+    uint64_t step = next_rand(&rng) >> (next_rand(&rng) % 64);
+    if (step == 0 || now > UINT64_MAX - step) step = UINT64_MAX - now;
+    int before = TTLHashTable_num_elements(tt);
+    now += step;
+    int num_expired = TTLHashTable_tick(tt, now, &record_free);
+    ck_assert_int_eq(num_expired, before - TTLHashTable_num_elements(tt));
+    check_live(deadlines, NUM_KEYS);
+  }
+} END_TEST
+
+START_TEST(expire_with_churn) {
+  // Entries get rescheduled and removed while time moves one unit at a time
+  static uint64_t deadlines[NUM_KEYS];
+  uint64_t rng = 424242;
+  for (uint32_t key = 0; key < NUM_KEYS; key++) {
+    deadlines[key] = START_TIME + 1 + next_rand(&rng) % 5000;
+    ck_assert(!insert_key(key, deadlines[key]));
+  }
+
+  for (uint64_t now = START_TIME + 1; now <= START_TIME + 6000; now++) {
+    for (int i = 0; i < 3; i++) {
+      uint32_t key = next_rand(&rng) % NUM_KEYS;
+      if (deadlines[key] <= now - 1) continue;  // Already expired
+      if (next_rand(&rng) % 4 == 0) {
+        ck_assert(TTLHashTable_remove(tt, (unsigned char *)&key, sizeof(key),
+              NULL));
+        // Pretend the removal was an expiry, to keep check_live simple
+        deadlines[key] = now - 1;
+        freed[key] = true;
+        num_freed++;
+      } else {
+        deadlines[key] = now + next_rand(&rng) % 5000;
+        ck_assert(TTLHashTable_set_deadline(tt, (unsigned char *)&key,
+              sizeof(key), deadlines[key]));
+      }
+    }
+    TTLHashTable_tick(tt, now, &record_free);
+    if (now % 500 == 0) check_live(deadlines, NUM_KEYS);
+  }
+} END_TEST
+
+Suite *ttl_hash_table_tests() {
+  Suite *s = suite_create("TTLHashTable");
+
+  TCase *tc_bogus = tcase_create("bogus input");
+  tcase_add_checked_fixture(tc_bogus, &ttl_setup, &ttl_teardown);
+  tcase_add_test(tc_bogus, allocate_free);
+  tcase_add_test(tc_bogus, null_args);
+  suite_add_tcase(s, tc_bogus);
+
+  TCase *tc_entry = tcase_create("entry handling");
+  tcase_add_checked_fixture(tc_entry, &ttl_setup, &ttl_teardown);
+  tcase_add_test(tc_entry, insert_find);
+  tcase_add_test(tc_entry, insert_overwrite);
+  tcase_add_test(tc_entry, remove);
+  suite_add_tcase(s, tc_entry);
+
+  TCase *tc_expire = tcase_create("expiry");
+  tcase_add_checked_fixture(tc_expire, &ttl_setup, &ttl_teardown);
+  tcase_add_test(tc_expire, expire_at_deadline);
+  tcase_add_test(tc_expire, expire_past_deadline);
+  tcase_add_test(tc_expire, time_goes_forward);
+  tcase_add_test(tc_expire, set_deadline);
+  tcase_add_test(tc_expire, expire_all_at_once);
+  tcase_add_test(tc_expire, expire_in_order);
+  tcase_add_test(tc_expire, expire_with_churn);
+  suite_add_tcase(s, tc_expire);
+
+  return s;
+}
@@ -0,0 +1,669 @@
+/* Provides tests for `typed_hash_table.h`
+   Copyright 2021 Mitchell Levy
+
+This file is a part of super-glue
+
+super-glue is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+super-glue is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License
+along with super-glue.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// For strdup
+#define _XOPEN_SOURCE 500
+
+#include "test_typed_hash_table.h"
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc_hooks.h"
+#include "hash_table.h"
+#include "typed_hash_table.h"
+
+// Most of these are ported from test_hash_table.c, using the table types
+// below in place of byte string keys and HTValues.
+
+// NUL terminated string keys, for the entry handling tests
+static uint64_t hash_str(const char *key) {
+  return HashTable_hash_key(HT_HASH_WYHASH, (const unsigned char *)key, 0);
+}
+#define EQ_STR(a, b) (strcmp((a), (b)) == 0)
+DEFINE_HASHTABLE(StrTable, const char *, char *, hash_str, EQ_STR)
+static void free_str(char *value) {
+  free(value);
+}
+
+// Single byte keys, for the iterator tests
+DEFINE_HASHTABLE(ByteTable, uint8_t, intptr_t, TypedHT_hash_u32, TYPED_HT_EQ)
+
+// 32-bit keys, for the resizing and allocation tests
+DEFINE_HASHTABLE(U32Table, uint32_t, uint32_t, TypedHT_hash_u32, TYPED_HT_EQ)
+
+// Struct keys, with a hash function that collides a lot so that long probe
+// sequences and tombstones get exercised
+typedef struct {
+  uint32_t addr;
+  uint16_t port;
+} FlowKey;
+static inline uint64_t hash_flow(FlowKey key) {
+  return TypedHT_hash_u32(key.addr % 8);
+}
+static inline bool eq_flow(FlowKey a, FlowKey b) {
+  return a.addr == b.addr && a.port == b.port;
+}
+DEFINE_HASHTABLE(FlowTable, FlowKey, uint64_t, hash_flow, eq_flow)
+
+// Bogus input handling test cases
+START_TEST(free_null) {
+  // Segfaults on failure
+  StrTable_free(NULL, NULL);
+  U32Table_free(NULL, NULL);
+} END_TEST
+
+START_TEST(num_elements_null) {
+  ck_assert(StrTable_num_elements(NULL) == -1);
+} END_TEST
+
+START_TEST(insert_into_null) {
+  ck_assert(!StrTable_insert(NULL, "abc", NULL, NULL));
+} END_TEST
+
+START_TEST(find_from_null) {
+  ck_assert(StrTable_find(NULL, "abc") == NULL);
+} END_TEST
+
+START_TEST(find_non_existent_entry) {
+  StrTable *t = StrTable_allocate();
+  ck_assert(t != NULL);
+  ck_assert(!StrTable_insert(t, "abc", strdup("def"), NULL));
+
+  ck_assert(StrTable_find(t, "ghi") == NULL);
+  StrTable_free(t, &free_str);
+} END_TEST
+
+START_TEST(remove_from_null) {
+  ck_assert(!StrTable_remove(NULL, "abc", NULL));
+} END_TEST
+
+START_TEST(remove_non_existent_entry) {
+  StrTable *t = StrTable_allocate();
+  ck_assert(t != NULL);
+  ck_assert(!StrTable_remove(t, "abc", NULL));
+  StrTable_free(t, NULL);
+} END_TEST
+
+START_TEST(entry_null) {
+  bool inserted = true;
+  ck_assert(StrTable_entry(NULL, "key", &inserted) == NULL);
+  ck_assert(inserted);
+} END_TEST
+
+START_TEST(iter_null) {
+  ck_assert(StrTableIterator_allocate(NULL) == NULL);
+  // Segfaults on failure
+  StrTableIterator_free(NULL);
+  ck_assert(!StrTableIterator_is_valid(NULL));
+  ck_assert(!StrTableIterator_next(NULL));
+
+  const char *key;
+  char *value;
+  ck_assert(!StrTableIterator_get(NULL, &key, &value));
+  ck_assert(!StrTableIterator_remove(NULL, &key, &value));
+} END_TEST
+
+START_TEST(iter_invalid) {
+  StrTable *t = StrTable_allocate();
+  ck_assert(t != NULL);
+  StrTableIterator *it = StrTableIterator_allocate(t);
+  ck_assert(it != NULL);
+  ck_assert(!StrTableIterator_is_valid(it));
+  ck_assert(!StrTableIterator_next(it));
+
+  const char *key;
+  char *value;
+  ck_assert(!StrTableIterator_get(it, &key, &value));
+  ck_assert(!StrTableIterator_remove(it, &key, &value));
+  StrTableIterator_free(it);
+  StrTable_free(t, NULL);
+} END_TEST
+
+// Entry handling test cases
+// English are keys, French are values
+static StrTable *st;
+static char *one;
+static char *two;
+static char *three;
+static char *un;
+static char *deux;
+static char *trois;
+
+static void entry_setup() {
+  one = strdup("one");
+  two = strdup("two");
+  three = strdup("three");
+  un = strdup("un");
+  deux = strdup("deux");
+  trois = strdup("trois");
+
+  st = StrTable_allocate();
+  ck_assert(st != NULL);
+  ck_assert(!StrTable_insert(st, one, un, NULL));
+  ck_assert(!StrTable_insert(st, two, deux, NULL));
+  ck_assert(!StrTable_insert(st, three, trois, NULL));
+}
+static void entry_teardown() {
+  StrTable_free(st, &free_str);
+  free(one);
+  free(two);
+  free(three);
+}
+
+START_TEST(num_elements_empty) {
+  StrTable *empty = StrTable_allocate();
+  ck_assert(StrTable_num_elements(empty) == 0);
+  StrTable_free(empty, NULL);
+} END_TEST
+
+START_TEST(num_elements) {
+  ck_assert(StrTable_num_elements(st) == 3);
+} END_TEST
+
+START_TEST(insert) {
+  char *old_value = (char *)0xDEADBEEF;
+  const char *value = "value";
+  ck_assert(!StrTable_insert(st, "key", strdup(value), &old_value));
+
+  char **found_value = StrTable_find(st, "key");
+  ck_assert(found_value != NULL);
+  ck_assert(strcmp(*found_value, value) == 0);
+  ck_assert(old_value == (char *)0xDEADBEEF);
+} END_TEST
+
+START_TEST(insert_overwrite) {
+  ck_assert(StrTable_find(st, one) != NULL);
+
+  char *old_value = NULL;
+  char *new_value = strdup("eins");
+  ck_assert(StrTable_insert(st, one, new_value, &old_value));
+  ck_assert(strcmp(old_value, un) == 0);
+  ck_assert(strcmp(*StrTable_find(st, one), new_value) == 0);
+  ck_assert(StrTable_num_elements(st) == 3);
+
+  // Since this won't get freed by StrTable_free anymore
+  free(un);
+} END_TEST
+
+START_TEST(find) {
+  ck_assert(strcmp(*StrTable_find(st, one), un) == 0);
+  ck_assert(strcmp(*StrTable_find(st, two), deux) == 0);
+  ck_assert(strcmp(*StrTable_find(st, three), trois) == 0);
+  // Keys are compared with eqfn, not by address
+  ck_assert(strcmp(*StrTable_find(st, "two"), deux) == 0);
+} END_TEST
+
+START_TEST(remove) {
+  char *old_value = NULL;
+  ck_assert(StrTable_remove(st, one, &old_value));
+  ck_assert(strcmp(old_value, un) == 0);
+  ck_assert(StrTable_find(st, one) == NULL);
+  ck_assert(StrTable_num_elements(st) == 2);
+  free(un);
+} END_TEST
+
+START_TEST(entry_existing) {
+  bool inserted = true;
+  char **value = StrTable_entry(st, two, &inserted);
+  ck_assert(value != NULL);
+  ck_assert(!inserted);
+  ck_assert(*value == deux);
+  ck_assert(value == StrTable_find(st, two));
+  ck_assert(StrTable_num_elements(st) == 3);
+} END_TEST
+
+START_TEST(entry_insert) {
+  const char *key = "four";
+  bool inserted = false;
+  char **value = StrTable_entry(st, key, &inserted);
+  ck_assert(value != NULL);
+  ck_assert(inserted);
+  ck_assert(*value == NULL);
+  ck_assert(StrTable_num_elements(st) == 4);
+
+  // The value can be filled in through the returned pointer
+  *value = strdup("quatre");
+  ck_assert(strcmp(*StrTable_find(st, key), "quatre") == 0);
+
+  value = StrTable_entry(st, key, NULL);
+  ck_assert(value != NULL);
+  ck_assert(strcmp(*value, "quatre") == 0);
+  ck_assert(StrTable_num_elements(st) == 4);
+} END_TEST
+
+START_TEST(entry_update_in_place) {
+  // Count occurrences of each key, the way a caller would with a "find, then
+  // insert if missing" sequence. New entries start out zeroed.
+  static const uint32_t words[] = {7, 3, 7, 1000000, 7, 3};
+  U32Table *counts = U32Table_allocate();
+  ck_assert(counts != NULL);
+  for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+    uint32_t *count = U32Table_entry(counts, words[i], NULL);
+    ck_assert(count != NULL);
+    (*count)++;
+  }
+  ck_assert(U32Table_num_elements(counts) == 3);
+  ck_assert(*U32Table_find(counts, 7) == 3);
+  ck_assert(*U32Table_find(counts, 3) == 2);
+  ck_assert(*U32Table_find(counts, 1000000) == 1);
+  U32Table_free(counts, NULL);
+} END_TEST
+
+START_TEST(struct_keys) {
+  // Every key with the same address % 8 collides
+  FlowTable *ft = FlowTable_allocate();
+  ck_assert(ft != NULL);
+  for (uint32_t addr = 0; addr < 64; addr++) {
+    for (uint16_t port = 0; port < 16; port++) {
+      FlowKey key = {addr, port};
+      ck_assert(!FlowTable_insert(ft, key, addr * 100 + port, NULL));
+    }
+  }
+  ck_assert(FlowTable_num_elements(ft) == 64 * 16);
+  for (uint32_t addr = 0; addr < 64; addr++) {
+    for (uint16_t port = 0; port < 16; port++) {
+      FlowKey key = {addr, port};
+      uint64_t *value = FlowTable_find(ft, key);
+      ck_assert(value != NULL);
+      ck_assert(*value == addr * 100 + port);
+    }
+  }
+  FlowKey missing = {3, 16};
+  ck_assert(FlowTable_find(ft, missing) == NULL);
+  FlowTable_free(ft, NULL);
+} END_TEST
+
+START_TEST(model_check) {
+  // Random inserts and removals over a small key space with a colliding hash,
+  // so that probe sequences run through plenty of tombstones, checked against
+  // a plain array.
+  enum { NUM_ADDRS = 64, NUM_PORTS = 8, NUM_OPS = 100000 };
+  static uint64_t model[NUM_ADDRS][NUM_PORTS];
+  static bool present[NUM_ADDRS][NUM_PORTS];
+  memset(present, 0, sizeof(present));
+  int num_present = 0;
+
+  FlowTable *ft = FlowTable_allocate();
+  ck_assert(ft != NULL);
+  uint64_t rng = 0x5eed;
+  for (uint64_t op = 0; op < NUM_OPS; op++) {
+    rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint32_t addr = (rng >> 33) % NUM_ADDRS;
+    uint16_t port = (rng >> 45) % NUM_PORTS;
+    FlowKey key = {addr, port};
+    uint64_t old_value;
+    if ((rng >> 60) % 3 == 0) {
+      ck_assert(FlowTable_remove(ft, key, &old_value) ==
+          present[addr][port]);
+      if (present[addr][port]) {
+        ck_assert(old_value == model[addr][port]);
+        num_present--;
+      }
+      present[addr][port] = false;
+    } else {
+      ck_assert(FlowTable_insert(ft, key, op, &old_value) ==
+          present[addr][port]);
+      if (present[addr][port]) {
+        ck_assert(old_value == model[addr][port]);
+      } else {
+        num_present++;
+      }
+      present[addr][port] = true;
+      model[addr][port] = op;
+    }
+    ck_assert_int_eq(FlowTable_num_elements(ft), num_present);
+  }
+
+  for (uint32_t addr = 0; addr < NUM_ADDRS; addr++) {
+    for (uint16_t port = 0; port < NUM_PORTS; port++) {
+      FlowKey key = {addr, port};
+      uint64_t *value = FlowTable_find(ft, key);
+      ck_assert((value != NULL) == present[addr][port]);
+      if (value != NULL) ck_assert(*value == model[addr][port]);
+    }
+  }
+  FlowTable_free(ft, NULL);
+} END_TEST
+
+// Iterator test cases
+static const uint8_t max_key = UINT8_MAX;
+static ByteTable *bt;
+static ByteTableIterator *bti;
+static void iter_setup() {
+  bt = ByteTable_allocate();
+  ck_assert(bt != NULL);
+  for (uint8_t key = 0; key < max_key; key++) {
+    ck_assert(!ByteTable_insert(bt, key, ~(intptr_t)key, NULL));
+  }
+  bti = ByteTableIterator_allocate(bt);
+  ck_assert(bti != NULL);
+}
+static void iter_teardown() {
+  ByteTableIterator_free(bti);
+  ByteTable_free(bt, NULL);
+}
+
+START_TEST(iterator_coverage) {
+  uint8_t times_seen[max_key];
+  memset(times_seen, 0, sizeof(times_seen));
+
+  while (ByteTableIterator_is_valid(bti)) {
+    uint8_t key;
+    intptr_t value;
+    ck_assert(ByteTableIterator_get(bti, &key, &value));
+    ck_assert(value == ~(intptr_t)key);
+    times_seen[key]++;
+    ByteTableIterator_next(bti);
+  }
+
+  for (uint8_t key = 0; key < max_key; key++) {
+    ck_assert(times_seen[key] == 1);
+  }
+} END_TEST
+
+START_TEST(iterator_remove) {
+  uint8_t times_seen[max_key];
+  memset(times_seen, 0, sizeof(times_seen));
+
+  while (ByteTableIterator_is_valid(bti)) {
+    uint8_t key;
+    intptr_t value;
+    ck_assert(ByteTableIterator_remove(bti, &key, &value));
+    ck_assert(value == ~(intptr_t)key);
+    times_seen[key]++;
+  }
+
+  ck_assert_int_eq(ByteTable_num_elements(bt), 0);
+  for (uint8_t key = 0; key < max_key; key++) {
+    ck_assert(times_seen[key] == 1);
+    ck_assert(ByteTable_find(bt, key) == NULL);
+  }
+} END_TEST
+
+START_TEST(iterator_remove_some) {
+  uint8_t times_seen[max_key];
+  memset(times_seen, 0, sizeof(times_seen));
+  bool removed[max_key];
+  memset(removed, 0, sizeof(removed));
+  int num_removed = 0;
+
+  for (int i = 0; ByteTableIterator_is_valid(bti); i++) {
+    uint8_t key;
+    ck_assert(ByteTableIterator_get(bti, &key, NULL));
+    times_seen[key]++;
+    if (i % 2 == 0) {
+      intptr_t value;
+      ck_assert(ByteTableIterator_remove(bti, NULL, &value));
+      ck_assert(value == ~(intptr_t)key);
+      removed[key] = true;
+      num_removed++;
+    } else {
+      ByteTableIterator_next(bti);
+    }
+  }
+
+  ck_assert_int_eq(ByteTable_num_elements(bt), max_key - num_removed);
+  for (uint8_t key = 0; key < max_key; key++) {
+    ck_assert(times_seen[key] == 1);
+    intptr_t *value = ByteTable_find(bt, key);
+    if (removed[key]) {
+      ck_assert(value == NULL);
+    } else {
+      ck_assert(value != NULL);
+      ck_assert(*value == ~(intptr_t)key);
+    }
+  }
+} END_TEST
+
+// Resizing test cases
+// Enough keys to force the table through many rounds of growing/shrinking.
+#define num_resize_keys 20000
+static U32Table *ut;
+static U32TableIterator *uti;
+static void resize_setup() {
+  ut = U32Table_allocate();
+  uti = NULL;
+  ck_assert(ut != NULL);
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    ck_assert(!U32Table_insert(ut, key, ~key, NULL));
+  }
+}
+static void resize_teardown() {
+  U32TableIterator_free(uti);
+  U32Table_free(ut, NULL);
+}
+
+START_TEST(resize_grow) {
+  ck_assert(U32Table_num_elements(ut) == num_resize_keys);
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    uint32_t *value = U32Table_find(ut, key);
+    ck_assert_msg(value != NULL, "Key %u missing after growing", key);
+    ck_assert(*value == ~key);
+  }
+} END_TEST
+
+START_TEST(resize_overwrite) {
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    uint32_t old_value;
+    ck_assert(U32Table_insert(ut, key, key, &old_value));
+    ck_assert(old_value == ~key);
+  }
+  ck_assert(U32Table_num_elements(ut) == num_resize_keys);
+} END_TEST
+
+START_TEST(resize_shrink) {
+  // Remove all but every 100th key, which forces the table to shrink
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    if (key % 100 == 0) continue;
+    ck_assert(U32Table_remove(ut, key, NULL));
+  }
+  ck_assert(U32Table_num_elements(ut) == num_resize_keys / 100);
+
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    uint32_t *value = U32Table_find(ut, key);
+    if (key % 100 == 0) {
+      ck_assert_msg(value != NULL, "Key %u missing after shrinking", key);
+      ck_assert(*value == ~key);
+    } else {
+      ck_assert(value == NULL);
+    }
+  }
+} END_TEST
+
+START_TEST(resize_iterate) {
+  for (uint32_t key = num_resize_keys; key < 2 * num_resize_keys; key++) {
+    ck_assert(!U32Table_insert(ut, key, ~key, NULL));
+  }
+
+  uint8_t *times_seen = calloc(2 * num_resize_keys, sizeof(uint8_t));
+  ck_assert(times_seen != NULL);
+  uti = U32TableIterator_allocate(ut);
+  while (U32TableIterator_is_valid(uti)) {
+    uint32_t key;
+    uint32_t value;
+    ck_assert(U32TableIterator_get(uti, &key, &value));
+    ck_assert(value == ~key);
+    // Lookups while iterating must not disturb the iterator
+    ck_assert(U32Table_find(ut, key) != NULL);
+    times_seen[key]++;
+    U32TableIterator_next(uti);
+  }
+
+  for (uint32_t key = 0; key < 2 * num_resize_keys; key++) {
+    ck_assert(times_seen[key] == 1);
+  }
+  free(times_seen);
+} END_TEST
+
+// Allocation test cases
+START_TEST(alloc_hooks_work) {
+  if (!alloc_hooks_available()) return;
+
+  // Growing has to allocate, otherwise the tests below pass vacuously
+  alloc_hooks_start();
+  for (uint32_t key = num_resize_keys; key < 2 * num_resize_keys; key++) {
+    ck_assert(!U32Table_insert(ut, key, ~key, NULL));
+  }
+  ck_assert(alloc_hooks_stop() > 0);
+} END_TEST
+
+START_TEST(find_no_alloc) {
+  if (!alloc_hooks_available()) return;
+
+  alloc_hooks_start();
+  for (uint32_t key = 0; key < 2 * num_resize_keys; key++) {
+    uint32_t *value = U32Table_find(ut, key);
+    ck_assert((value != NULL) == (key < num_resize_keys));
+  }
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Lookups made %zu allocations", allocs);
+} END_TEST
+
+START_TEST(overwrite_no_alloc) {
+  if (!alloc_hooks_available()) return;
+
+  alloc_hooks_start();
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    ck_assert(U32Table_insert(ut, key, key, NULL));
+  }
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Overwrites made %zu allocations", allocs);
+  ck_assert(*U32Table_find(ut, 0) == 0);
+} END_TEST
+
+START_TEST(entry_no_alloc_when_present) {
+  if (!alloc_hooks_available()) return;
+
+  alloc_hooks_start();
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    bool inserted;
+    uint32_t *value = U32Table_entry(ut, key, &inserted);
+    ck_assert(value != NULL && !inserted);
+    *value = key;
+  }
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Entry lookups made %zu allocations", allocs);
+} END_TEST
+
+START_TEST(remove_no_alloc_when_missing) {
+  if (!alloc_hooks_available()) return;
+
+  alloc_hooks_start();
+  for (uint32_t key = num_resize_keys; key < 2 * num_resize_keys; key++) {
+    ck_assert(!U32Table_remove(ut, key, NULL));
+  }
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Failed removals made %zu allocations", allocs);
+} END_TEST
+
+START_TEST(iterate_no_alloc) {
+  if (!alloc_hooks_available()) return;
+
+  uti = U32TableIterator_allocate(ut);
+  ck_assert(uti != NULL);
+  int num_seen = 0;
+  alloc_hooks_start();
+  for (; U32TableIterator_is_valid(uti); U32TableIterator_next(uti)) {
+    ck_assert(U32TableIterator_get(uti, NULL, NULL));
+    num_seen++;
+  }
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Iterating made %zu allocations", allocs);
+  ck_assert_int_eq(num_seen, num_resize_keys);
+} END_TEST
+
+START_TEST(iterator_remove_no_alloc) {
+  if (!alloc_hooks_available()) return;
+
+  uti = U32TableIterator_allocate(ut);
+  ck_assert(uti != NULL);
+  alloc_hooks_start();
+  while (U32TableIterator_is_valid(uti)) {
+    ck_assert(U32TableIterator_remove(uti, NULL, NULL));
+  }
+  size_t allocs = alloc_hooks_stop();
+  ck_assert_msg(allocs == 0, "Removing made %zu allocations", allocs);
+  ck_assert_int_eq(U32Table_num_elements(ut), 0);
+  for (uint32_t key = 0; key < num_resize_keys; key++) {
+    ck_assert(U32Table_find(ut, key) == NULL);
+  }
+} END_TEST
+
+Suite *typed_hash_table_tests() {
+  Suite *s = suite_create("TypedHashTable");
+
+  TCase *tc_bogus = tcase_create("bogus input");
+  tcase_add_test(tc_bogus, free_null);
+  tcase_add_test(tc_bogus, num_elements_null);
+  tcase_add_test(tc_bogus, insert_into_null);
+  tcase_add_test(tc_bogus, find_from_null);
+  tcase_add_test(tc_bogus, find_non_existent_entry);
+  tcase_add_test(tc_bogus, remove_from_null);
+  tcase_add_test(tc_bogus, remove_non_existent_entry);
+  tcase_add_test(tc_bogus, entry_null);
+  tcase_add_test(tc_bogus, iter_null);
+  tcase_add_test(tc_bogus, iter_invalid);
+  suite_add_tcase(s, tc_bogus);
+
+  TCase *tc_entry = tcase_create("entry handling");
+  tcase_add_checked_fixture(tc_entry, &entry_setup, &entry_teardown);
+  tcase_add_test(tc_entry, num_elements_empty);
+  tcase_add_test(tc_entry, num_elements);
+  tcase_add_test(tc_entry, insert);
+  tcase_add_test(tc_entry, insert_overwrite);
+  tcase_add_test(tc_entry, find);
+  tcase_add_test(tc_entry, remove);
+  tcase_add_test(tc_entry, entry_existing);
+  tcase_add_test(tc_entry, entry_insert);
+  tcase_add_test(tc_entry, entry_update_in_place);
+  tcase_add_test(tc_entry, struct_keys);
+  tcase_add_test(tc_entry, model_check);
+  suite_add_tcase(s, tc_entry);
+
+  TCase *tc_iter = tcase_create("iterator");
+  tcase_add_checked_fixture(tc_iter, &iter_setup, &iter_teardown);
+  tcase_add_test(tc_iter, iterator_coverage);
+  tcase_add_test(tc_iter, iterator_remove);
+  tcase_add_test(tc_iter, iterator_remove_some);
+  suite_add_tcase(s, tc_iter);
+
+  TCase *tc_resize = tcase_create("resizing");
+  tcase_add_checked_fixture(tc_resize, &resize_setup, &resize_teardown);
+  tcase_add_test(tc_resize, resize_grow);
+  tcase_add_test(tc_resize, resize_overwrite);
+  tcase_add_test(tc_resize, resize_shrink);
+  tcase_add_test(tc_resize, resize_iterate);
+  suite_add_tcase(s, tc_resize);
+
+  TCase *tc_alloc = tcase_create("allocation");
+  tcase_add_checked_fixture(tc_alloc, &resize_setup, &resize_teardown);
+  tcase_add_test(tc_alloc, alloc_hooks_work);
+  tcase_add_test(tc_alloc, find_no_alloc);
+  tcase_add_test(tc_alloc, overwrite_no_alloc);
+  tcase_add_test(tc_alloc, entry_no_alloc_when_present);
+  tcase_add_test(tc_alloc, remove_no_alloc_when_missing);
+  tcase_add_test(tc_alloc, iterate_no_alloc);
+  tcase_add_test(tc_alloc, iterator_remove_no_alloc);
+  suite_add_tcase(s, tc_alloc);
+
+  return s;
+}